@@ -61,7 +61,9 @@
 ## -----------------------------------------------------------------------------------------------------
 # --------------------------------------- Kernel Options
 #KERNEL_FUNCTION=3              # Choose the kernel function (2=quadratic peak, 3=cubic spline [default], 4=quartic spline, 5=quintic spline, 6=Wendland C2, 7=Wendland C4, 8=2-part quadratic)
+#KERNEL_TABLE=1024              # evaluate the kernel (W and dW, used by all the gas neighbor loops) by linear interpolation in a table of this many intervals (default 1024 = 16 kB, sized to stay in L1) instead of the polynomial. relative error ~1e-6. the (branch-free) polynomials usually vectorize and are faster on current CPUs: test before using
 #KERNEL_CRK_FACES               # Use the consistent reproducing kernel [higher-order tensor corrections to kernel above, compared to our usual matrix formalism] from Frontiere, Raskin, and Owen to define the faces in MFM/MFV methods. can give more accurate closure, potentially improved accuracy in MHD problems. remains experimental for now.
+#DENSITY_HSML_MULTIRADIUS       # each density() pass also sums the neighbor number at several trial kernel lengths (walking out to the largest), so particles which have not converged jump straight to the interpolated Hsml instead of bracketing it over many passes (each with its own tree-walk and MPI exchange)
 ####################################################################################################
 
 
@@ -425,6 +427,23 @@
 #OPENMP=2                       # top-level switch for explicit OpenMP implementation
 #PTHREADS_NUM_THREADS=4         # custom PTHREADs implementation (don't enable with OPENMP)
 #MULTIPLEDOMAINS=16             # Multi-Domain option for the top-tree level (alters load-balancing)
+#MPI_REUSE_EXPORT_PLANS         # repeated neighbor-loop passes (density/ags-hsml iterations, gradient and dynamic-diffusion sweeps) re-use the export list of a previous single-round pass when the search radii still fit inside it, instead of re-building it and re-exchanging counts
+#MPI_SPARSE_COUNT_EXCHANGE      # exchange neighbor-loop export counts with a sparse non-blocking consensus (only messages to tasks we actually export to) instead of an MPI_Alltoall every round. helps at large task counts. requires MPI-3
+#REDUCE_TREEWALK_BRANCHING      # neighbor searches compute all node-opening conditions before a single branch, and test particle distances in batches after the walk (more arithmetic, fewer branches; whether this is faster depends on the machine)
+#VECTOR_AVX                     # AVX2 (or AVX-512, if the compiler targets it) intrinsics for the node checks and batched distance filters of REDUCE_TREEWALK_BRANCHING (which this switches on). compile with -mavx2 or -march=native
+#MPI_COMPACT_EXPORTS            # send neighbor-loop and gravity exports in a compact wire format: 16-bit node-lists (32-bit once there are more than 65534 top-level nodes), positions (density, hydro, gravity) as float offsets from the destination node, and the old acceleration used in the gravity opening criterion with 16 bits. smaller messages, at float precision in the exported positions
+#HYDRO_NGB_LIST_CACHE=256       # store the neighbor lists found in the gradient loop and re-use them in the hydro-force loop instead of walking the tree again (only for elements with no exports; the rest walk as usual). value is the memory budget per task in MB (capped at half of the free memory)
+#HYDRO_NGB_LIST_VERLET=1.2      # keep the cached neighbor lists across timesteps (Verlet lists): built with this skin factor on the kernel lengths, and re-used until the tracked displacements or kernel-length changes could have brought in a new neighbor. mostly helps the smallest timebins. uses HYDRO_NGB_LIST_CACHE for its budget
+#HYDRO_FACE_CACHE=256          # store the face area vector and kernel values of each pair of a cached neighbor list in the gradient loop, and re-use them in the hydro-force loop instead of re-evaluating the kernels and re-building the face (MFM/MFV; identical results). value is the memory budget per task in MB; switches on HYDRO_NGB_LIST_CACHE
+#HYDRO_PAIRWISE_SYMMETRIC       # evaluate each hydro pair of local elements once (from the element with the smaller timestep), applying equal-and-opposite fluxes to both (atomic updates with OpenMP). halves the face-geometry and Riemann-solver work on synchronized steps. not with pthreads, shearing boxes, conduction, viscosity, non-ideal MHD, elastic solids, turbulent diffusion, CRs, or explicit RT
+#HYDRO_RIEMANN_BATCH=32         # solve the Riemann problems of this many faces together (MFM/MFV): the neighbor loop reconstructs the faces of a block first, then a branch-free HLLC estimate for the whole block vectorizes (with -ffast-math or -fno-math-errno), falling back to the full solver face-by-face where it is not valid. not with MHD, general EOS, turbulent diffusion, CRs, or explicit RT
+#DENSITY_FUSED_GRADIENTS        # sum the gradient moments (and slope-limiter extrema) in the density loop, so active elements whose converged pass saw no active neighbor skip the gradient loop (same sums as that loop, up to round-off from their different order; elements with active neighbors go through it as usual). density walks become pair searches. helps deep timestep hierarchies, not synchronized steps. MFM/MFV only, not with MHD, CRs, dynamic diffusion, face corrections, or shearing boxes
+#ACTIVE_LIST_PEANO_ORDER        # keep the list of active particles in storage (Peano-Hilbert) order, so the loops over it walk memory and the tree coherently: sorted when few particles are active, built by an in-order parallel scan of the particle array when many are
+#TIMEBIN_SORTED_STORAGE=5       # store the particles sorted by timebin (then Peano-Hilbert order within each bin), so the active particles of any step sit in one contiguous block of the gas and one of the other particles. forces a domain decomposition (which re-sorts) once more than this percentage of the local particles changed bin. helps deep timestep hierarchies; full steps lose some Peano-Hilbert locality
+#PARTICLE_HOT_SOA               # keep a structure-of-arrays mirror of the particle fields the neighbor-search walks read (positions, mass, type, drift time), so the leaf tests stream through a few dense arrays instead of pulling whole particle structures into cache. costs ~40 bytes/particle; P[] remains authoritative
+#DRIFT_BULK_FRACTION=0.25       # when more than this fraction of all particles is active, drift every particle up-front (threaded) instead of on first touch in the tree-walks (default 0.25). threaded builds drift the on-touch neighbors with per-particle claims rather than a global lock
+#NUMA_FIRST_TOUCH               # first-touch each new part of the mymalloc pool with all threads (static partition, as the parallel loops over the arrays living there), so on multi-socket nodes the pages of P[], SphP[], etc. are spread over the NUMA nodes of the threads that use them. combine with thread pinning (e.g. OMP_PROC_BIND=close) for it to mean anything
+#MYMALLOC_HUGEPAGES=1           # back the mymalloc pool with huge pages: =1 transparent huge pages (madvise), =2 explicit hugetlbfs pages (must be reserved on the nodes; falls back to =1 if unavailable). reduces TLB misses in the tree-walks
 ####################################################################################################
 
 
@@ -433,6 +452,9 @@
 # --------------------------------------- Input/Output options
 ####################################################################################################
 #OUTPUT_ADDITIONAL_RUNINFO      # enables extended simulation output data (can slow down machines significantly in massively-parallel runs)
+#OUTPUT_TIMELINE_TRACE          # every task records the start/end of each CPU_* part of cpu.txt, and of the compute/comm/wait sections of the neighbor loops, and writes them to timeline_trace/trace_<task>.json (Chrome trace format: open in chrome://tracing or ui.perfetto.dev; merge tasks with (echo '['; tail -q -n +2 trace_*.json) > trace.json). set =N to hold N events per task between writes (default 65536). files can get large: use for diagnostic runs
+#OUTPUT_PERF_COUNTERS           # (linux only) read the hardware counters (cycles, instructions, last-level cache misses, branch misses) with perf_event_open at every CPU_* part boundary, and write their running totals per part, summed over tasks, with IPC and misses per 1000 instructions, to perf_counters.txt. needs /proc/sys/kernel/perf_event_paranoid <= 2 on the compute nodes; counters which cannot be opened read as zero
+#OUTPUT_MEMORY_PHASE_LOG        # write memory.txt: for every step (full steps only with IO_REDUCED_MODE), the peak mymalloc use and the largest block allocated in each CPU_* part of cpu.txt, maximum over tasks with the task holding it. use to set MaxMemSize/PartAllocFactor/BufferSize from data
 #OUTPUT_IN_DOUBLEPRECISION      # snapshot files will be written in double precision
 #INPUT_IN_DOUBLEPRECISION       # input files assumed to be in double precision (otherwise float is assumed)
 #OUTPUT_POSITIONS_IN_DOUBLE     # input/output files in single, but positions in double (used in hires, hi-dynamic range sims when positions differ by < float accuracy)
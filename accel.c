@@ -33,14 +33,14 @@
 
 void compute_grav_accelerations(void)
 {
-  CPU_Step[CPU_MISC] += measure_time();
+  CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
   PRINT_STATUS("Start gravity force computation...");
 
 #ifdef PMGRID
   if(All.PM_Ti_endstep == All.Ti_Current)
     {
       long_range_force();
-      CPU_Step[CPU_MESH] += measure_time();
+      CPU_Step[CPU_MESH] += measure_time_phase(CPU_MESH);
     }
 #endif
 
@@ -59,6 +59,9 @@ void compute_hydro_densities_and_forces(void)
   if(All.TotN_gas > 0)
     {
         PRINT_STATUS("Start hydrodynamics computation...");
+#ifdef DENSITY_FUSED_GRADIENTS
+        density_fused_gradients_allocate(); /* gradient sums of the converged density pass, for elements whose neighbors all stay fixed */
+#endif
         density();		/* computes density, and pressure */
 #ifdef AGS_HSML_CALCULATION_IS_ACTIVE
         ags_density();
@@ -84,6 +87,9 @@ void compute_hydro_densities_and_forces(void)
         interpolate_fluxes_opacities_gasgrains();
 #endif
 
+#ifdef HYDRO_NGB_LIST_CACHE
+        ngb_list_cache_init(); /* neighbor lists found in the gradient loop are re-used in the hydro loop (nothing moves in between) */
+#endif
         hydro_gradient_calc(); /* calculates the gradients of hydrodynamical quantities  */
 #if defined(COOLING) && defined(GALSF_FB_FIRE_RT_UVHEATING)
         selfshield_local_incident_uv_flux(); /* needs to be called after gravity tree (where raw flux is calculated) and the local gradient calculation (GradRho) to properly self-shield the particles that had this calculated */
@@ -94,6 +100,12 @@ void compute_hydro_densities_and_forces(void)
         dynamic_diff_calc(); /* This MUST be called immediately following gradient calculations */
 #endif
         hydro_force();		/* adds hydrodynamical accelerations and computes du/dt  */
+#ifdef HYDRO_NGB_LIST_CACHE
+        ngb_list_cache_free();
+#endif
+#ifdef DENSITY_FUSED_GRADIENTS
+        density_fused_gradients_free();
+#endif
         compute_additional_forces_for_all_particles(); /* other accelerations that need to be computed are done here */
         PRINT_STATUS(" ..hydro force computation done.");
 
@@ -127,7 +139,7 @@ void compute_additional_forces_for_all_particles(void)
 #ifdef GALSF
 void compute_stellar_feedback(void)
 {
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 
 #ifdef GALSF_FB_MECHANICAL /* check the mechanical sources of feedback */
     PRINT_STATUS("Start mechanical feedback computation...");
@@ -145,23 +157,23 @@ void compute_stellar_feedback(void)
     mechanical_fb_calc(3); /* additional loop for stellar age tracers */
 #endif
 #endif
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_SNIIHEATING] += measure_time(); /* collect timings and reset clock for next timing */
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_SNIIHEATING] += measure_time_phase(CPU_SNIIHEATING); /* collect timings and reset clock for next timing */
 #endif
 #ifdef GALSF_FB_THERMAL
     thermal_fb_calc(); /* thermal feedback */
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_SNIIHEATING] += measure_time(); /* collect timings and reset clock for next timing */
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_SNIIHEATING] += measure_time_phase(CPU_SNIIHEATING); /* collect timings and reset clock for next timing */
 #endif
     
 #if defined(GALSF_FB_FIRE_RT_HIIHEATING)
     HII_heating_singledomain(); /* local photo-ionization heating */
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_HIIHEATING] += measure_time(); /* collect timings and reset clock for next timing */
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_HIIHEATING] += measure_time_phase(CPU_HIIHEATING); /* collect timings and reset clock for next timing */
 #endif
     
 #ifdef GALSF_FB_FIRE_RT_LOCALRP
     radiation_pressure_winds_consolidated(); /* local radiation pressure */
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_LOCALWIND] += measure_time(); /* collect timings and reset clock for next timing */
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_LOCALWIND] += measure_time_phase(CPU_LOCALWIND); /* collect timings and reset clock for next timing */
 #endif
     
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 }
 #endif // GALSF //
@@ -56,8 +56,14 @@ int *Send_offset, *Send_count, *Recv_count, *Recv_offset, *Sendcount;
 
 int TakeLevel;
 
-int FirstActiveParticle;
-int *NextActiveParticle;
+int NumActiveParticle;
+int *ActiveParticleList;
+#ifdef PARTICLE_HOT_SOA
+struct particle_hot_soa PHot;
+#endif
+#ifdef DRIFT_ON_DEMAND_CLAIMS
+integertime *DriftStamp;	/*!< per-particle drift claims for the tree-walks (see drift_particle_on_demand) */
+#endif
 unsigned char *ProcessedFlag;
 
 int TimeBinCount[TIMEBINS];
@@ -95,6 +101,10 @@ short int special_boundary_condition_xyz_def_reflect[3];
 short int special_boundary_condition_xyz_def_outflow[3];
 #endif
 
+#ifdef KERNEL_TABLE
+double Kernel_Table[KERNEL_TABLE+1][2];
+#endif
+
 #ifdef FIX_PATHSCALE_MPI_STATUS_IGNORE_BUG
 MPI_Status mpistat;
 #endif
@@ -131,11 +141,21 @@ char CPU_SymbolImbalance[CPU_PARTS] = {
     'x', 'y', 'z', 'A', 'I', 'W', 'T', 'V', 'B', 'C', 'D', 'E', 'F', 'G', 'H',  'I', 'J', 'K', 'L', 'Q',
     'R', 'S', 'T', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',  'N', 'O'};//, 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z'};
 char CPU_String[CPU_STRING_LEN + 1];
+const char *CPU_PartName[CPU_PARTS] = { /* labels of the CPU_* parts, in the order of their defines in allvars.h, for the logs which list them one by one */
+    "all", "treewalk1", "treewalk2", "treewait1", "treewait2", "treesend", "treerecv", "treemisc", "treebuild", "treehmaxupdate",
+    "domain", "denscompute", "denswait", "denscomm", "densmisc", "hydcompute", "hydwait", "hydcomm", "hydmisc", "drift",
+    "timeline", "potential", "mesh", "peano", "coolingsfr", "snapshot", "fof", "blackholes", "misc", "dragforce",
+    "sniiheating", "hiiheating", "localwind", "coolsfrimbal", "agsdenscompute", "agsdenswait", "agsdenscomm", "agsdensmisc", "dyndiffmisc", "dyndiffcompute",
+    "dyndiffwait", "dyndiffcomm", "improvdiffmisc", "improvdiffcompute", "improvdiffwait", "improvdiffcomm", "rtnonfluxops", "dummy00", "dummy01", "dummy02",
+    "dummy03", "dummy04", "dummy05", "dummy06", "dummy07", "dummy08", "dummy09", "dummy10"};
 double WallclockTime;		/*!< This holds the last wallclock time measurement for timings measurements */
 int Flag_FullStep;		/*!< Flag used to signal that the current step involves all particles */
 
 
 int TreeReconstructFlag;
+#ifdef TIMEBIN_SORTED_STORAGE
+int TimeBinStorageMoves;
+#endif
 #ifdef WAKEUP
 int NeedToWakeupParticles;      /*!< Flags used to signal that wakeups need to be processed at the beginning of the next timestep */
 int NeedToWakeupParticles_local;
@@ -221,6 +241,12 @@ FILE
 #endif
 #endif
 *FdCPU;        /*!< file handle for cpu.txt log-file. */
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+FILE *FdMemPhase;       /*!< file handle for memory.txt log-file. */
+#endif
+#ifdef OUTPUT_PERF_COUNTERS
+FILE *FdPerfCounters;   /*!< file handle for perf_counters.txt log-file. */
+#endif
 
 #ifdef GALSF
 FILE *FdSfr;			/*!< file handle for sfr.txt log-file. */
@@ -316,6 +342,8 @@ struct data_index *DataIndexTable;	/*!< the particles to be exported are grouped
 
 struct data_nodelist *DataNodeList;
 
+struct export_block_data *ExportBlock;	/*!< per-thread blocks of the export table reserved in the tree-walks */
+
 struct gravdata_in *GravDataIn,	/*!< holds particle data to be exported to other processors */
  *GravDataGet;			/*!< holds particle data imported from other processors */
 
@@ -348,8 +376,13 @@ struct blackhole_temp_particle_data *BlackholeTempInfo; /*! declare this structu
 long Nexport, Nimport;
 int BufferFullFlag;
 int NextParticle;
+int *PrimaryLoopList, PrimaryLoopListLength;
 int NextJ;
 int TimerFlag;
+#ifdef MPI_REUSE_EXPORT_PLANS
+int ExportPlanReplay = 0;
+double ExportPlanSearchFac = 1;
+#endif
 
 struct NODE *Nodes_base,	/*!< points to the actual memory allocated for the nodes */
 *Nodes;			/*!< this is a pointer used to access the nodes which is shifted such that Nodes[All.MaxPart] gives the first allocated node */
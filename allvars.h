@@ -1196,6 +1196,63 @@ static MPI_Datatype MPI_TYPE_TIME = MPI_INT;
 
 #define  NODELISTLENGTH      8
 
+#if defined(MPI_COMPACT_EXPORTS) && defined(DONOTUSENODELIST)
+#undef MPI_COMPACT_EXPORTS /* the compact export format relies on valid node-lists */
+#endif
+#if defined(VECTOR_AVX) && !defined(REDUCE_TREEWALK_BRANCHING)
+#define REDUCE_TREEWALK_BRANCHING /* the SIMD node checks and distance filters live in the reduced-branching neighbor search */
+#endif
+#if defined(HYDRO_PAIRWISE_SYMMETRIC) && (defined(BOX_SHEARING) || defined(PTHREADS_NUM_THREADS) || defined(CONDUCTION) || defined(VISCOSITY) || defined(MHD_NON_IDEAL) || defined(EOS_ELASTIC) || defined(TURB_DIFFUSION) || defined(CHIMES_TURB_DIFF_IONS) || defined(COSMIC_RAYS) || defined(RT_SOLVER_EXPLICIT))
+#undef HYDRO_PAIRWISE_SYMMETRIC /* shearing-box fluxes are not symmetric across the boundaries, pthreads has no atomic updates for the neighbor's share, and these physics modules only accumulate the target's side of each pair */
+#endif
+#if defined(HYDRO_RIEMANN_BATCH) && (defined(HYDRO_SPH) || defined(MAGNETIC) || defined(EOS_GENERAL) || defined(EOS_ELASTIC) || defined(HYDRO_REPLACE_RIEMANN_KT) || defined(TURB_DIFF_METALS) || defined(TURB_DIFFUSION) || defined(COSMIC_RAYS) || defined(RT_SOLVER_EXPLICIT))
+#undef HYDRO_RIEMANN_BATCH /* the batched solver covers the hydro HLLC solver for MFM/MFV, and these modules use face quantities it does not save between its passes */
+#endif
+#if defined(KERNEL_TABLE) && !(CHECK_IF_PREPROCESSOR_HAS_NUMERICAL_VALUE_(KERNEL_TABLE))
+#undef KERNEL_TABLE
+#define KERNEL_TABLE 1024 /* default table size: 16 kB, fits in L1 */
+#endif
+#if defined(DENSITY_FUSED_GRADIENTS) && (defined(HYDRO_SPH) || defined(MAGNETIC) || defined(COSMIC_RAYS) || defined(RT_COMPGRAD_EDDINGTON_TENSOR) || defined(TURB_DIFF_DYNAMIC) || defined(KERNEL_CRK_FACES) || defined(HYDRO_TENSOR_FACE_CORRECTIONS) || defined(HYDRO_VOLUME_CORRECTIONS) || defined(BOX_SHEARING) || defined(ADM) || (defined(HYDRO_MESHLESS_FINITE_VOLUME) && (HYDRO_FIX_MESH_MOTION==6)))
+#undef DENSITY_FUSED_GRADIENTS /* these add terms to the gradient loop (or change the densities between the two loops) which are not summed in density() */
+#endif
+#ifdef DENSITY_FUSED_GRADIENTS /* number of scalar fields whose gradients are summed in density(): density, pressure, velocity, then the optional ones in the order of gradients_fused_quantities() */
+#if defined(TURB_DIFF_METALS) && !defined(TURB_DIFF_METALS_LOWORDER)
+#define DENSITY_FUSED_GRADIENTS_NQ_METALS (NUM_METAL_SPECIES)
+#else
+#define DENSITY_FUSED_GRADIENTS_NQ_METALS (0)
+#endif
+#if defined(DOGRAD_INTERNAL_ENERGY) && defined(DOGRAD_SOUNDSPEED)
+#define DENSITY_FUSED_GRADIENTS_NQ (7 + DENSITY_FUSED_GRADIENTS_NQ_METALS)
+#elif defined(DOGRAD_INTERNAL_ENERGY) || defined(DOGRAD_SOUNDSPEED)
+#define DENSITY_FUSED_GRADIENTS_NQ (6 + DENSITY_FUSED_GRADIENTS_NQ_METALS)
+#else
+#define DENSITY_FUSED_GRADIENTS_NQ (5 + DENSITY_FUSED_GRADIENTS_NQ_METALS)
+#endif
+#endif
+#if defined(HYDRO_NGB_LIST_VERLET) && !defined(HYDRO_NGB_LIST_CACHE)
+#define HYDRO_NGB_LIST_CACHE 256 /* Verlet lists are kept in the neighbor-list cache, default its memory budget */
+#endif
+#if defined(HYDRO_FACE_CACHE) && !defined(HYDRO_NGB_LIST_CACHE)
+#define HYDRO_NGB_LIST_CACHE 256 /* faces are stored per entry of the cached neighbor lists */
+#endif
+#if defined(HYDRO_FACE_CACHE) && !(CHECK_IF_PREPROCESSOR_HAS_NUMERICAL_VALUE_(HYDRO_FACE_CACHE))
+#undef HYDRO_FACE_CACHE
+#define HYDRO_FACE_CACHE 256 /* default memory budget (MB) */
+#endif
+#if defined(HYDRO_NGB_LIST_VERLET) && (defined(REDUCE_TREEWALK_BRANCHING) || (HYDRO_FIX_MESH_MOTION==2) || (HYDRO_FIX_MESH_MOTION==3))
+#undef HYDRO_NGB_LIST_VERLET /* the skin search is not implemented in the reduced-branching filter, and curvilinear mesh motion is not predicted */
+#endif
+#if defined(HYDRO_NGB_LIST_CACHE) && defined(ADM)
+#undef HYDRO_NGB_LIST_CACHE /* the cached walk does not separate the ADM species */
+#undef HYDRO_NGB_LIST_VERLET
+#endif
+#if defined(HYDRO_FACE_CACHE) && (!defined(HYDRO_NGB_LIST_CACHE) || defined(HYDRO_SPH) || defined(HYDRO_REGULAR_GRID) || defined(KERNEL_CRK_FACES) || defined(HYDRO_TENSOR_FACE_CORRECTIONS) || defined(MHD_CONSTRAINED_GRADIENT) || defined(TURB_DIFF_DYNAMIC))
+#undef HYDRO_FACE_CACHE /* faces are only built this way for MFM/MFV, the face corrections need the results of the gradient loop, and these gradient loops do not use the cached lists */
+#endif
+#ifdef MPI_COMPACT_EXPORTS
+#include <stddef.h> /* offsetof, used to describe the layout of the export structures */
+#endif
+
 
 #define EPSILON_FOR_TREERND_SUBNODE_SPLITTING (1.0e-4) /* define some number << 1; particles with less than this separation will trigger randomized sub-node splitting in the tree.
                                                             we set it to a global value here so that other sub-routines will know not to force particle separations below this */
@@ -1241,6 +1298,17 @@ typedef unsigned long long peanokey;
 #define  report_memory_usage(x, y) printf("Memory manager disabled.\n")
 #endif
 
+/* per-thread scratch arena (system/mymalloc.c): opened as one block of the pool around a threaded region, then each thread bump-allocates
+    short-lived scratch from its own slab with myscratch() and drops it again with myscratch_release(myscratch_mark()-style marks).
+    myscratch() returns NULL if no arena is open or the slab is exhausted, so callers keep a fallback */
+#define  myscratch_open(n)         myscratch_open_fullinfo(n, __FUNCTION__, __FILE__, __LINE__)
+#define  myscratch_close()         myscratch_close_fullinfo(__FUNCTION__, __FILE__, __LINE__)
+#if defined(REDUCE_TREEWALK_BRANCHING) && (BOX_SHEARING > 1)
+#define  LOOP_SCRATCH_BYTES_PER_THREAD ((size_t)NumPart * sizeof(int)) /* the shearing-box filter in ngb_filter_variables may see every local particle */
+#else
+#define  LOOP_SCRATCH_BYTES_PER_THREAD ((size_t)65536)
+#endif
+
 #if !defined(EOS_GAMMA)
 #define EOS_GAMMA (5.0/3.0) /*!< adiabatic index of simulated gas */
 #endif
@@ -1606,6 +1674,10 @@ extern short int special_boundary_condition_xyz_def_outflow[3];
 #define BOX_VALUE_FOR_NOTHING_SPECIAL_BOUNDARY_ 20 /* define a dummy value we won't have the user set for reference below */
 #endif
 
+#ifdef KERNEL_TABLE
+extern double Kernel_Table[KERNEL_TABLE+1][2]; /* tabulated (un-normalized) kernel W(u), dW/du at u=i/KERNEL_TABLE, see kernel.h */
+#endif
+
 
 
 /****************************************************************************************************************************/
@@ -1750,14 +1822,28 @@ z=((z)>boxHalf_Z)?((z)-boxSize_Z):(((z)<-boxHalf_Z)?((z)+boxSize_Z):(z)))
 
 #define MACRO_NAME_CONCATENATE(A, B) MACRO_NAME_CONCATENATE_(A, B)
 #define MACRO_NAME_CONCATENATE_(A, B) A##B
+#define MACRO_NAME_STRING(A) MACRO_NAME_STRING_(A)
+#define MACRO_NAME_STRING_(A) #A
+
+#ifdef OUTPUT_TIMELINE_TRACE
+#define TIMELINE_TRACE_COMPUTE 1 /* kinds of the sub-phase events recorded by the neighbor-loop code blocks */
+#define TIMELINE_TRACE_COMM    2
+#define TIMELINE_TRACE_WAIT    3
+#define TIMELINE_TRACE(kind, loop, t0, t1, n) timeline_trace_event(kind, loop, t0, t1, n);
+#else
+#define TIMELINE_TRACE(kind, loop, t0, t1, n)
+#endif
 
 
 /*********************************************************/
 /*  Global variables                                     */
 /*********************************************************/
 
-extern int FirstActiveParticle;
-extern int *NextActiveParticle;
+extern int NumActiveParticle;    /*!< number of local active particles (entries of ActiveParticleList) */
+extern int *ActiveParticleList;  /*!< compact index list of the local active particles, built by make_list_of_active_particles() */
+/*! loop 'i' over the local active particles. the length is fixed when the loop starts, so particles appended to the list
+    inside the loop (spawned/split particles) are not visited by that loop, only by the ones that follow */
+#define FOR_ACTIVE_PARTICLES(i) for(int _k_active = 0, _n_active = NumActiveParticle; _k_active < _n_active && (((i) = ActiveParticleList[_k_active]), 1); _k_active++)
 extern unsigned char *ProcessedFlag;
 extern int TimeBinCount[TIMEBINS];
 extern int TimeBinCountSph[TIMEBINS];
@@ -1815,6 +1901,7 @@ extern double CPU_Step[CPU_PARTS];
 extern char CPU_Symbol[CPU_PARTS];
 extern char CPU_SymbolImbalance[CPU_PARTS];
 extern char CPU_String[CPU_STRING_LEN + 1];
+extern const char *CPU_PartName[CPU_PARTS];
 extern double WallclockTime;    /*!< This holds the last wallclock time measurement for timings measurements */
 extern int Flag_FullStep;	/*!< Flag used to signal that the current step involves all particles */
 extern size_t HighMark_run,  HighMark_domain, HighMark_gravtree, HighMark_pmperiodic,
@@ -1824,6 +1911,9 @@ extern size_t HighMark_run,  HighMark_domain, HighMark_gravtree, HighMark_pmperi
 extern size_t HighMark_turbpower;
 #endif
 extern int TreeReconstructFlag;
+#ifdef TIMEBIN_SORTED_STORAGE
+extern int TimeBinStorageMoves; /*!< particles which changed timebin since the storage was last sorted by timebin */
+#endif
 extern int GlobFlag;
 extern char DumpFlag;
 #ifdef WAKEUP
@@ -1944,6 +2034,12 @@ extern FILE
 #endif
 #endif
  *FdCPU;        /*!< file handle for cpu.txt log-file. */
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+extern FILE *FdMemPhase;    /*!< file handle for memory.txt log-file. */
+#endif
+#ifdef OUTPUT_PERF_COUNTERS
+extern FILE *FdPerfCounters; /*!< file handle for perf_counters.txt log-file. */
+#endif
 #ifdef GALSF
 extern FILE *FdSfr;		/*!< file handle for sfr.txt log-file. */
 #endif
@@ -2867,6 +2963,49 @@ extern ALIGN(32) struct particle_data
  *DomainPartBuf;		/*!< buffer for particle data used in domain decomposition */
 
 
+/* the fields read for every candidate particle in the tree-walks (position, drift time, mass, type). with PARTICLE_HOT_SOA these are
+    mirrored in separate arrays, so a walk touches a few contiguous arrays instead of pulling a (large) P[] record per candidate. P[] stays
+    the authoritative copy: code which changes one of these fields between tree constructions calls P_HOT_SYNC(i) afterwards (the whole
+    mirror is refreshed in force_treebuild, which follows every re-ordering of P[]). walks read through the P_POS etc. accessors */
+#ifdef PARTICLE_HOT_SOA
+extern struct particle_hot_soa
+{
+    MyDouble *Pos[3];               /*!< P[].Pos, one array per coordinate */
+    MyDouble *Mass;                 /*!< P[].Mass */
+    integertime *Ti_current;        /*!< P[].Ti_current */
+    short int *Type;                /*!< P[].Type */
+}
+ PHot;
+#define P_POS(i,k)      (PHot.Pos[k][(i)])
+#define P_MASS(i)       (PHot.Mass[(i)])
+#define P_TI_CURRENT(i) (PHot.Ti_current[(i)])
+#define P_TYPE(i)       (PHot.Type[(i)])
+#define P_HOT_SYNC(i)   do {int _i_hot=(i); PHot.Pos[0][_i_hot]=P[_i_hot].Pos[0]; PHot.Pos[1][_i_hot]=P[_i_hot].Pos[1]; PHot.Pos[2][_i_hot]=P[_i_hot].Pos[2]; PHot.Mass[_i_hot]=P[_i_hot].Mass; PHot.Ti_current[_i_hot]=P[_i_hot].Ti_current; PHot.Type[_i_hot]=P[_i_hot].Type;} while(0)
+#else
+#define P_POS(i,k)      (P[(i)].Pos[k])
+#define P_MASS(i)       (P[(i)].Mass)
+#define P_TI_CURRENT(i) (P[(i)].Ti_current)
+#define P_TYPE(i)       (P[(i)].Type)
+#define P_HOT_SYNC(i)   do {} while(0)
+#endif
+
+/* neighbors found in a tree-walk are drifted to the current time on first touch. in threaded builds each particle carries a drift stamp
+    (the time it was last drifted to and published at, or DRIFT_STAMP_BUSY while a thread is drifting it): the first thread to touch an
+    undrifted particle claims it with a compare-and-swap and drifts it, others wait on that one particle, instead of all threads queuing
+    on a single global lock. stamps are only a cache of P[].Ti_current, re-initialized whenever P[] is re-ordered (drift_stamps_reset) */
+#if defined(_OPENMP) || defined(PTHREADS_NUM_THREADS)
+#define DRIFT_ON_DEMAND_CLAIMS
+#define DRIFT_STAMP_BUSY ((integertime)(-1))
+extern integertime *DriftStamp;
+#define DRIFT_PARTICLE_ON_DEMAND(i,time1) {if(__atomic_load_n(&DriftStamp[(i)], __ATOMIC_ACQUIRE) != (time1)) {drift_particle_on_demand((i),(time1));}}
+#else
+#define DRIFT_PARTICLE_ON_DEMAND(i,time1) {if(P_TI_CURRENT(i) != (time1)) {drift_particle((i),(time1));}}
+#endif
+#ifndef DRIFT_BULK_FRACTION
+#define DRIFT_BULK_FRACTION 0.25 /* if more than this fraction of all particles is active, drift everything up-front in parallel rather than on touch */
+#endif
+
+
 #ifndef GDE_LEAN
 #define GDE_TIMEBEGIN(i) (P[i].a0)
 #define GDE_VMATRIX(i, a, b) (P[i].V_matrix[a][b])
@@ -3337,6 +3476,29 @@ extern struct data_nodelist
 }
 *DataNodeList;
 
+extern struct export_block_data
+{
+  long Next;                    /*!< next free slot of DataIndexTable in the block this thread has reserved */
+  long End;                     /*!< end of the reserved block */
+  char pad[64 - 2 * sizeof(long)];  /*!< one block per cache line, so threads do not write to the same line */
+}
+*ExportBlock;                   /*!< per-thread blocks of the export table, so the tree-walks need not serialize on Nexport for every export */
+
+#ifdef MPI_COMPACT_EXPORTS
+struct compact_export_format    /*!< layout of an export structure, for sending it in the compact wire format (see compact_export_format_init) */
+{
+  size_t size;                  /*!< size of the structure in memory */
+  size_t wire_size;             /*!< size of one packed element */
+  size_t nodelist;              /*!< offset of NodeList[NODELISTLENGTH] */
+  int node_bytes;               /*!< bytes per node offset on the wire: 2, or 4 if there are too many top-level nodes for 16 bits */
+  long pos;                     /*!< offset of the position (sent as float offsets from the first node center), or -1 */
+  int pos_size;                 /*!< size of one position component (float or double) */
+  long approx;                  /*!< offset of a MyFloat which is only used approximately (sent with 16 bits), or -1 */
+  int nseg;                     /*!< number of byte-ranges of the structure sent unchanged */
+  size_t seg_start[4], seg_len[4];
+};
+#endif
+
 extern struct gravdata_in
 {
     MyFloat Pos[3];
@@ -3692,8 +3854,13 @@ enum siofields
 extern long Nexport, Nimport;
 extern int BufferFullFlag;
 extern int NextParticle;
+extern int *PrimaryLoopList, PrimaryLoopListLength; /*!< flattened list of active elements handed out in chunks by the primary loop code block (NextParticle is then a position in it) */
 extern int NextJ;
 extern int TimerFlag;
+#ifdef MPI_REUSE_EXPORT_PLANS
+extern int ExportPlanReplay;        /*!< set while a neighbor loop re-uses a stored export plan: tree-walks then do not record exports */
+extern double ExportPlanSearchFac;  /*!< >1 while a neighbor loop records an export plan with a margin: mode-0 tree-walks open the search radius by this factor */
+#endif
 
 // note, the ALIGN(32) directive will effectively pad the structure size
 // to a multiple of 32 bytes
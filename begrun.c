@@ -85,6 +85,10 @@ void begrun(void)
 
   mymalloc_init();
 
+#ifdef KERNEL_TABLE
+  kernel_table_init();
+#endif
+
 #ifdef DEBUG
   write_pid_file();
   enable_core_dumps_and_fpu_exceptions();
@@ -506,6 +510,20 @@ void begrun(void)
 }
 
 
+#ifdef KERNEL_TABLE
+/*! fills the table of kernel values which kernel_main() interpolates in, instead of evaluating the kernel polynomial for every pair
+ */
+void kernel_table_init(void)
+{
+  int i; double wk, dwk;
+  for(i = 0; i <= KERNEL_TABLE; i++)
+    {
+      kernel_shape((double)i / KERNEL_TABLE, &wk, &dwk, 0);
+      Kernel_Table[i][0] = wk; Kernel_Table[i][1] = dwk;
+    }
+  if(ThisTask == 0) {printf("Kernel table initialized with %d entries (%g kB)\n", KERNEL_TABLE+1, sizeof(Kernel_Table)/1024.);}
+}
+#endif
 
 
 /*! Computes conversion factors between internal code units and the cgs-system
@@ -629,10 +647,22 @@ void open_outputfiles(void)
 #endif // bh-output-more-info if
 #endif // black-holes if
 
+#ifdef OUTPUT_TIMELINE_TRACE
+    timeline_trace_init(); /* every task writes its own trace file */
+#endif
+
     if(ThisTask != 0) {return;}	/* only the root processors writes to the log files listed below */
 
     sprintf(buf, "%s%s", All.OutputDir, "cpu.txt");
     if(!(FdCPU = fopen(buf, mode))) {printf("error in opening file '%s'\n", buf); endrun(1);}
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+    sprintf(buf, "%s%s", All.OutputDir, "memory.txt");
+    if(!(FdMemPhase = fopen(buf, mode))) {printf("error in opening file '%s'\n", buf); endrun(1);}
+#endif
+#ifdef OUTPUT_PERF_COUNTERS
+    sprintf(buf, "%s%s", All.OutputDir, "perf_counters.txt");
+    if(!(FdPerfCounters = fopen(buf, mode))) {printf("error in opening file '%s'\n", buf); endrun(1);}
+#endif
 
 #ifndef IO_REDUCED_MODE
     sprintf(buf, "%s%s", All.OutputDir, "timebin.txt");
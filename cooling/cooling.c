@@ -54,8 +54,8 @@ void cooling_parent_routine(void)
 {
     PRINT_STATUS("Cooling and Chemistry update");
     /* Determine indices of active particles. */
-    int N_active=0, i, j, *active_indices; active_indices = (int *) malloc(N_gas * sizeof(int));
-    for (i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int N_active=0, i, j, *active_indices; active_indices = (int *) mymalloc("active_indices", N_gas * sizeof(int));
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].Type != 0) {continue;}
         if(P[i].Mass <= 0) {continue;}
@@ -90,11 +90,11 @@ void cooling_parent_routine(void)
 #endif
     }
     } /* close parallel block */
-    free(active_indices); /* free memory */
+    myfree(active_indices); /* free memory */
 
 #ifdef CHIMES /* CHIMES records some extra timing information here owing to large possible imbalances */
-  CPU_Step[CPU_COOLINGSFR] += measure_time(); MPI_Barrier(MPI_COMM_WORLD);
-  CPU_Step[CPU_COOLSFRIMBAL] += measure_time(); PRINT_STATUS("CHIMES chemistry and cooling finished");
+  CPU_Step[CPU_COOLINGSFR] += measure_time_phase(CPU_COOLINGSFR); MPI_Barrier(MPI_COMM_WORLD);
+  CPU_Step[CPU_COOLSFRIMBAL] += measure_time_phase(CPU_COOLSFRIMBAL); PRINT_STATUS("CHIMES chemistry and cooling finished");
 #endif
 }
 
@@ -1588,7 +1588,7 @@ double GetLambdaSpecies(long k_index, long index_x0y0, long index_x0y1, long ind
 #ifdef GALSF_FB_FIRE_RT_UVHEATING
 void selfshield_local_incident_uv_flux(void)
 {   /* include local self-shielding with the following */
-    int i; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i; FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].Type==0)
         {
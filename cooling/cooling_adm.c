@@ -1609,7 +1609,7 @@ double GetLambdaSpecies_adm(long k_index, long index_x0y0, long index_x0y1, long
 #ifdef GALSF_FB_FIRE_RT_UVHEATING
 void selfshield_local_incident_uv_flux_adm(void)
 {   /* include local self-shielding with the following */
-    int i; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i; FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].Type==0)
         {
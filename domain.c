@@ -132,7 +132,7 @@ void domain_Decomposition(int UseAllTimeBins, int SaveKeys, int do_particle_merg
 
     UseAllParticles = UseAllTimeBins;
     
-    for(i = 0; i < NumPart; i++) {if(P[i].Ti_current != All.Ti_Current) {drift_particle(i, All.Ti_Current);}}
+    move_particles(All.Ti_Current);
     
     force_treefree();
     domain_free();
@@ -145,7 +145,7 @@ void domain_Decomposition(int UseAllTimeBins, int SaveKeys, int do_particle_merg
     
     //for(i = 0; i < NumPart; i++) {if(P[i].Type > 5 || P[i].Type < 0) {printf("task=%d:  P[i=%d].Type=%d\n", ThisTask, i, P[i].Type); endrun(112411);}} // this is pure de-bugging, doesn't need to be active in normal circumstances //
 
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time(); // sync everything after merge-split and rearrange //
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time_phase(CPU_DRIFT); // sync everything after merge-split and rearrange //
     
     TreeReconstructFlag = 1;	/* ensures that new tree will be constructed */
 #ifdef SINGLE_STAR_SINK_DYNAMICS
@@ -281,7 +281,7 @@ void domain_Decomposition(int UseAllTimeBins, int SaveKeys, int do_particle_merg
   t1 = my_second();
 
   PRINT_STATUS(" ..domain decomposition done. (took %g sec)", timediff(t0, t1));
-  CPU_Step[CPU_DOMAIN] += measure_time();
+  CPU_Step[CPU_DOMAIN] += measure_time_phase(CPU_DOMAIN);
 
   for(i = 0; i < NumPart; i++) {if(P[i].Type > 5 || P[i].Type < 0) {printf("task=%d:  P[i=%d].Type=%d\n", ThisTask, i, P[i].Type); endrun(111111);}}
 
@@ -290,7 +290,7 @@ void domain_Decomposition(int UseAllTimeBins, int SaveKeys, int do_particle_merg
   if(GrNr < 0)			/* we don't do it when SUBFIND is executed for a certain group */
 #endif
     peano_hilbert_order();
-  CPU_Step[CPU_PEANO] += measure_time();
+  CPU_Step[CPU_PEANO] += measure_time_phase(CPU_PEANO);
 #endif
 
   myfree(Key);
@@ -499,7 +499,7 @@ void set_blackhole_new_mass(int i, int n, double dt)
     double dm_alphadisk = ( BlackholeTempInfo[i].mdot_alphadisk - BPP(n).BH_Mdot ) * dt;
     if(dm_alphadisk < -BPP(n).BH_Mass_AlphaDisk) {BPP(n).BH_Mass_AlphaDisk=0;} else {BPP(n).BH_Mass_AlphaDisk += dm_alphadisk;}
     if(BPP(n).BH_Mass_AlphaDisk<0) {BPP(n).BH_Mass_AlphaDisk=0;}
-    if(P[n].Mass<0) {P[n].Mass=0;}
+    if(P[n].Mass<0) {P[n].Mass=0; P_HOT_SYNC(n);}
 #else // #ifdef BH_ALPHADISK_ACCRETION
 #if defined(BH_WIND_CONTINUOUS) || defined(BH_WIND_SPAWN)
     BPP(n).BH_Mass += BPP(n).BH_Mdot * dt / All.BAL_f_accretion; // accrete the winds first, then remove the wind mass in the final loop
@@ -653,7 +653,7 @@ void blackhole_final_operations(void)
 #endif
 
 #ifdef BH_REPOSITION_ON_POTMIN
-    for(n = FirstActiveParticle; n >= 0; n = NextActiveParticle[n])
+    FOR_ACTIVE_PARTICLES(n)
         if(bhsink_isactive(n))
             if(BPP(n).BH_MinPot < 0.5 * BHPOTVALUEINIT)
             {
@@ -675,7 +675,7 @@ void blackhole_final_operations(void)
 #else
                 fac_bh_shift = 1.0; // jump all the way
 #endif
-                for(k = 0; k < 3; k++) {P[n].Pos[k] += (BPP(n).BH_MinPotPos[k]-P[n].Pos[k]) * fac_bh_shift;}
+                for(k = 0; k < 3; k++) {P[n].Pos[k] += (BPP(n).BH_MinPotPos[k]-P[n].Pos[k]) * fac_bh_shift;} P_HOT_SYNC(n);
             }
 #endif
 
@@ -826,6 +826,8 @@ void blackhole_final_operations(void)
         P[n].KernelSum_Around_RT_Source = BlackholeTempInfo[i].BH_angle_weighted_kernel_sum;
 #endif            
 
+        P_HOT_SYNC(n); /* mass (and with BH_FOLLOW_ACCRETED_COM, position) changed above */
+
         /* dump the results to the 'blackhole_details' files */
         mass_disk=0; mdot_disk=0; MgasBulge=0; MstarBulge=0; r0 = PPP[n].Hsml * All.cf_atime;
 #ifdef BH_ALPHADISK_ACCRETION
@@ -474,10 +474,18 @@ int blackhole_swallow_and_kick_evaluate(int target, int mode, int *exportflag, i
                         {
                             #pragma omp atomic
                             P[j].Mass += Mass_j - Mass_j_0; // finite mass update [delta difference added here, allowing for another element to update in the meantime]
+#ifdef PARTICLE_HOT_SOA
+                            #pragma omp atomic
+                            PHot.Mass[j] += Mass_j - Mass_j_0;
+#endif
                         }
                     } else {
                         #pragma omp atomic write
                         P[j].Mass = 0; // make sure the mass is -actually- zero'd here
+#ifdef PARTICLE_HOT_SOA
+                        #pragma omp atomic write
+                        PHot.Mass[j] = 0;
+#endif
                     }
                     
                     for(k=0;k<3;k++) {
@@ -537,7 +545,7 @@ void blackhole_swallow_and_kick_loop(void)
         printf("Accretion done: swallowed %d gas, %d star, %d dm, and %d BH particles\n",
                Ntot_gas_swallowed, Ntot_star_swallowed, Ntot_dm_swallowed, Ntot_BH_swallowed);
     }
-    CPU_Step[CPU_BLACKHOLES] += measure_time(); /* collect timings and reset clock for next timing */
+    CPU_Step[CPU_BLACKHOLES] += measure_time_phase(CPU_BLACKHOLES); /* collect timings and reset clock for next timing */
 }
 #include "../../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
 
@@ -557,7 +565,7 @@ void spawn_bh_wind_feedback(void)
         }
 
     /* don't loop or go forward if there are no gas particles in the domain, or the code will crash */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         long nmax = (int)(0.99*All.MaxPart); if(All.MaxPart-20 < nmax) nmax=All.MaxPart-20;
         if((NumPart+n_particles_split+(int)(2.*(BH_WIND_SPAWN+0.1)) < nmax) && (P[i].Type == 5)) // basic condition: particle is a 'spawner' (sink), and code can handle the event safely without crashing.
@@ -694,7 +702,7 @@ int blackhole_spawn_particle_wind_shell( int i, int dummy_sph_i_to_clone, int nu
         if (P[i].BH_Mass == 0){ //Last batch to be spawned
             n_particles_split = SINGLE_STAR_FB_SNE_N_EJECTA; //we are going to spawn a bunch of low mass particles to take the last bit of mass away
             printf("Spawning last SN ejecta of star %llu with %g mass and %d particles \n",(unsigned long long) P[i].ID,total_mass_in_winds,n_particles_split);
-            P[i].Mass = 0; //set mass to zero so that this sink will get cleaned up (TreeReconstructFlag = 1 should be already set in blackhole.c)
+            P[i].Mass = 0; P_HOT_SYNC(i); //set mass to zero so that this sink will get cleaned up (TreeReconstructFlag = 1 should be already set in blackhole.c)
 #ifdef BH_ALPHADISK_ACCRETION
             P[i].BH_Mass_AlphaDisk = 0; //just to be safe
 #endif
@@ -795,7 +803,7 @@ int blackhole_spawn_particle_wind_shell( int i, int dummy_sph_i_to_clone, int nu
 
         /* now we need to make sure everything is correctly placed in timebins for the tree */
         P[j].TimeBin = bin; // get the timebin, and put this particle into the appropriate timebin
-        NextActiveParticle[j] = FirstActiveParticle; FirstActiveParticle = j; NumForceUpdate++;
+        ActiveParticleList[NumActiveParticle++] = j; NumForceUpdate++;
         TimeBinCount[bin]++; TimeBinCountSph[bin]++; PrevInTimeBin[j] = i0; /* likewise add it to the counters that register how many particles are in each timebin */
 #ifndef BH_DEBUG_SPAWN_JET_TEST
         NextInTimeBin[j] = NextInTimeBin[i0]; if(NextInTimeBin[i0] >= 0) {PrevInTimeBin[NextInTimeBin[i0]] = j;}
@@ -993,6 +1001,7 @@ int blackhole_spawn_particle_wind_shell( int i, int dummy_sph_i_to_clone, int nu
         double dEcr = All.BH_CosmicRay_Injection_Efficiency * P[j].Mass * (All.BAL_f_accretion/(1.-All.BAL_f_accretion)) * C_LIGHT_CODE*C_LIGHT_CODE;
         inject_cosmic_rays(dEcr,All.BAL_v_outflow,5,j,veldir);
 #endif
+        P_HOT_SYNC(j); P_HOT_SYNC(i);
         /* Note: New tree construction can be avoided because of  `force_add_star_to_tree()' */
         force_add_star_to_tree(i0, j);// (buggy) /* we solve this by only calling the merge/split algorithm when we're doing the new domain decomposition */
     }
@@ -27,7 +27,7 @@ void blackhole_start(void)
 
     /* count the num BHs on this task */
     N_active_loc_BHs=0;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(bhsink_isactive(i))
         {
@@ -47,7 +47,7 @@ void blackhole_start(void)
     memset( &BlackholeTempInfo[0], 0, N_active_loc_BHs * sizeof(struct blackhole_temp_particle_data) );
 
     Nbh=0;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(bhsink_isactive(i))
         {
@@ -111,13 +111,13 @@ int disp_density_evaluate(int target, int mode, int *exportflag, int *exportnode
 void disp_density(void)
 {
     /* initialize variables used below, in particlar the structures we need to call throughout the iteration */
-    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC); double t00_truestart = my_second();
     MyFloat *Left, *Right; double desnumngb=64, desnumngbdev=48; long long ntot; 
     int i, npleft, iter=0, redo_particle;
     Left = (MyFloat *) mymalloc("Left", NumPart * sizeof(MyFloat));
     Right = (MyFloat *) mymalloc("Right", NumPart * sizeof(MyFloat));
     /* initialize anything we need to about the active particles before their loop */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {if(disp_density_isactive(i)) {SphP[i].NumNgbDM = 0; Left[i] = Right[i] = 0;}}
+    FOR_ACTIVE_PARTICLES(i) {if(disp_density_isactive(i)) {SphP[i].NumNgbDM = 0; Left[i] = Right[i] = 0;}}
     
     /* allocate buffers to arrange communication */
     #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
@@ -128,7 +128,7 @@ void disp_density(void)
 
         /* do check on whether we have enough neighbors, and iterate for density-hsml solution */
         double tstart = my_second(), tend;
-        for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
+        npleft = 0; FOR_ACTIVE_PARTICLES(i)
         {
             if(disp_density_isactive(i))
             {
@@ -201,7 +201,7 @@ void disp_density(void)
                 }
                 else {P[i].TimeBin = -P[i].TimeBin - 1;}	/* Mark as inactive */
             } //  if(disp_density_isactive(i))
-        } // for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
+        } // npleft = 0; FOR_ACTIVE_PARTICLES(i)
 
         tend = my_second();
         timecomp += timediff(tstart, tend);
@@ -220,13 +220,13 @@ void disp_density(void)
     myfree(Right); myfree(Left);
 
     /* mark as active again */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].TimeBin < 0) {P[i].TimeBin = -P[i].TimeBin - 1;}
     }
     
     /* now that we are DONE iterating to find hsml, we can do the REAL final operations on the results */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(disp_density_isactive(i))
         {
@@ -244,7 +244,7 @@ void disp_density(void)
     }
     
     /* collect some timing information */
-    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
+    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1); phase_interval_close(CPU_AGSDENSCOMPUTE);
     CPU_Step[CPU_AGSDENSCOMPUTE] += timecomp; CPU_Step[CPU_AGSDENSWAIT] += timewait;
     CPU_Step[CPU_AGSDENSCOMM] += timecomm; CPU_Step[CPU_AGSDENSMISC] += timeall - (timecomp + timewait + timecomm);
 }
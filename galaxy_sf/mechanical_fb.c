@@ -52,7 +52,7 @@ void determine_where_SNe_occur(void)
     double mpi_npossible,mpi_nhosttotal,mpi_ntotal,mpi_ptotal,mpi_dtmean,mpi_rmean;
     mpi_npossible=mpi_nhosttotal=mpi_ntotal=mpi_ptotal=mpi_dtmean=mpi_rmean=0;
     // loop over particles //
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         P[i].SNe_ThisTimeStep=0;
 #ifdef GALSF_FB_FIRE_STELLAREVOLUTION
@@ -99,7 +99,7 @@ void determine_where_SNe_occur(void)
 #endif
         if(P[i].SNe_ThisTimeStep>0) {ntotal+=P[i].SNe_ThisTimeStep; nhosttotal++;}
         dtmean += dt;
-    } // for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) //
+    } // FOR_ACTIVE_PARTICLES(i) //
 
     MPI_Reduce(&dtmean, &mpi_dtmean, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
     MPI_Reduce(&rmean, &mpi_rmean, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
@@ -183,7 +183,7 @@ void out2particle_addFB(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loo
 #endif
             for(k=kmin;k<kmax;k++) {ASSIGN_ADD(P[i].Area_weighted_sum[k], out->Area_weighted_sum[k], mode);}
         } else {
-            P[i].Mass -= out->M_coupled; if((P[i].Mass<0)||(isnan(P[i].Mass))) {P[i].Mass=0;}
+            P[i].Mass -= out->M_coupled; if((P[i].Mass<0)||(isnan(P[i].Mass))) {P[i].Mass=0;} P_HOT_SYNC(i);
         }
     }
 }
@@ -456,6 +456,10 @@ int addFB_evaluate(int target, int mode, int *exportflag, int *exportnodecount,
 #ifdef HYDRO_MESHLESS_FINITE_VOLUME
                 #pragma omp atomic
                 SphP[j].MassTrue += Mass_j - Mass_j_0; // finite mass update
+#endif
+#ifdef PARTICLE_HOT_SOA
+                #pragma omp atomic
+                PHot.Mass[j] += Mass_j - Mass_j_0;
 #endif
                 if(rho_j_0 > 0) {
                     #pragma omp atomic
@@ -830,6 +834,10 @@ int addFB_evaluate(int target, int mode, int *exportflag, int *exportnodecount,
 #ifdef HYDRO_MESHLESS_FINITE_VOLUME
                 #pragma omp atomic
                 SphP[j].MassTrue += Mass_j - Mass_j_0; // finite mass update
+#endif
+#ifdef PARTICLE_HOT_SOA
+                #pragma omp atomic
+                PHot.Mass[j] += Mass_j - Mass_j_0;
 #endif
                 if(rho_j_0 > 0) {
                     #pragma omp atomic
@@ -873,7 +881,7 @@ void mechanical_fb_calc(int fb_loop_iteration)
     loop_iteration = fb_loop_iteration; /* sets the appropriate feedback type for the calls below */
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
-    CPU_Step[CPU_SNIIHEATING] += measure_time(); /* collect timings and reset clock for next timing */
+    CPU_Step[CPU_SNIIHEATING] += measure_time_phase(CPU_SNIIHEATING); /* collect timings and reset clock for next timing */
 }
 #include "../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
 
@@ -26,7 +26,7 @@ void radiation_pressure_winds_consolidated(void)
     MyDouble *pos; int N_MAX_KERNEL,N_MIN_KERNEL,MAXITER_FB,NITER,startnode,dummy,numngb_inbox,i,j,k,n;
     double h,wt_sum,delta_v_imparted_rp=0,total_n_wind=0,total_mom_wind=0,total_prob_kick=0,avg_v_kick=0,avg_taufac=0;
 
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if((P[i].Type == 4)||((All.ComovingIntegrationOn==0)&&((P[i].Type == 2)||(P[i].Type==3))))
         {
@@ -174,7 +174,7 @@ void radiation_pressure_winds_consolidated(void)
                 } // // within loop
             } // star age, mass check:: (star_age < 0.1) && (P[i].Mass > 0) && (P[i].DensAroundStar > 0)
         } // particle type check::  if((P[i].Type == 4)....
-    } // main particle loop for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    } // main particle loop FOR_ACTIVE_PARTICLES(i)
     myfree(Ngblist);
 
     double totMPI_n_wind=0,totMPI_mom_wind=0,totMPI_avg_v=0,totMPI_avg_taufac=0,totMPI_prob_kick=0;
@@ -197,7 +197,7 @@ void radiation_pressure_winds_consolidated(void)
     } // if(ThisTask==0)
     if(All.HighestActiveTimeBin == All.HighestOccupiedTimeBin && ThisTask == 0) {fflush(FdMomWinds);}
     PRINT_STATUS(" ..completed local Radiation-Pressure acceleration");
-    CPU_Step[CPU_LOCALWIND] += measure_time(); /* collect timings and reset clock for next timing */
+    CPU_Step[CPU_LOCALWIND] += measure_time_phase(CPU_LOCALWIND); /* collect timings and reset clock for next timing */
 } // end routine :: void radiation_pressure_winds_consolidated(void)
 
 #endif /* closes defined(GALSF_FB_FIRE_RT_LOCALRP)  */
@@ -224,7 +224,7 @@ void HII_heating_singledomain(void)    /* this version of the HII routine only c
     Ngblist = (int *) mymalloc("Ngblist",NumPart * sizeof(int));
     MAX_N_ITERATIONS_HIIFB = 5; NITER_HIIFB = 0;
 
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
 #ifdef BH_HII_HEATING
         if((P[i].Type == 5)||(((P[i].Type == 4)||((All.ComovingIntegrationOn==0)&&((P[i].Type == 2)||(P[i].Type==3))))))
@@ -372,7 +372,7 @@ void HII_heating_singledomain(void)    /* this version of the HII routine only c
                 if(mion_actual>0) {total_m_ionized += mion_actual;}
             } // if(prandom < 2.0*mionizable/P[i].Mass)
         } // if((P[i].Type == 4)||(P[i].Type == 2)||(P[i].Type == 3))
-    } // for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    } // FOR_ACTIVE_PARTICLES(i)
     myfree(Ngblist);
 
     double totMPI_N_ionizing_part=0,totMPI_Ndot_ionizing=0,totMPI_m_ionized=0,totMPI_avg_RHII=0,totMPI_N_ionized=0;
@@ -391,7 +391,7 @@ void HII_heating_singledomain(void)    /* this version of the HII routine only c
         }
         if(All.HighestActiveTimeBin == All.HighestOccupiedTimeBin) {fflush(FdHIIHeating);}
     } // ThisTask == 0
-    CPU_Step[CPU_HIIHEATING] += measure_time();
+    CPU_Step[CPU_HIIHEATING] += measure_time_phase(CPU_HIIHEATING);
 } // void HII_heating_singledomain(void)
 
 
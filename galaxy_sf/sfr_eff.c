@@ -391,7 +391,7 @@ void star_formation_parent_routine(void)
     stars_spawned = stars_converted = 0; sum_sm = sum_mass_stars = 0;
     for(bits = 0; GALSF_GENERATIONS > (1 << bits); bits++);
 
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
       if((P[i].Type == 0)&&(P[i].Mass>0))
       {
@@ -628,8 +628,7 @@ void star_formation_parent_routine(void)
 #ifdef DO_DENSITY_AROUND_STAR_PARTICLES
               P[NumPart + stars_spawned].DensAroundStar = SphP[i].Density;
 #endif
-		      NextActiveParticle[NumPart + stars_spawned] = FirstActiveParticle;
-		      FirstActiveParticle = NumPart + stars_spawned;
+		      ActiveParticleList[NumActiveParticle++] = NumPart + stars_spawned;
 		      NumForceUpdate++;
 
 		      TimeBinCount[P[NumPart + stars_spawned].TimeBin]++;
@@ -651,6 +650,7 @@ void star_formation_parent_routine(void)
 		      sum_mass_stars += P[NumPart + stars_spawned].Mass;
 		      P[NumPart + stars_spawned].StellarAge = All.Time;
 
+		      P_HOT_SYNC(NumPart + stars_spawned);
 		      force_add_star_to_tree(i, NumPart + stars_spawned);
 
 		      stars_spawned++;
@@ -676,7 +676,7 @@ void star_formation_parent_routine(void)
             assign_wind_kick_from_sf_routine(i,sm,dtime,pvtau_return);
         }
 #endif
-
+        P_HOT_SYNC(i); /* type and mass may have changed above */
 	} /* End of If Type = 0 */
     } /* end of main loop over active particles, huzzah! */
 
@@ -724,7 +724,7 @@ void star_formation_parent_routine(void)
             fflush(FdSfr); // can flush it, because only occuring on domain-level steps anyways
         } // thistask==0
     }
-    CPU_Step[CPU_COOLINGSFR] += measure_time();
+    CPU_Step[CPU_COOLINGSFR] += measure_time_phase(CPU_COOLINGSFR);
 } /* end of main sfr_cooling routine!!! */
 
 
@@ -668,7 +668,7 @@ void singlestar_subgrid_protostellar_evolution_update_track(int n, double dm, do
     {
         BPP(n).ProtoStellarRadius_inSolar = R_main_sequence_ignition; BPP(n).ProtoStellarStage = 5; //using same notation for MS as SINGLE_STAR_STARFORGE_PROTOSTELLAR_EVOLUTION == 1
 #ifdef SINGLE_STAR_PROMOTION
-        P[n].Type = 4; P[n].StellarAge = All.Time; P[n].Mass = DMAX(P[n].Mass , BPP(n).BH_Mass + BPP(n).BH_Mass_AlphaDisk); // convert type, mark the new ZAMS age according to the current time, and accrete remaining mass
+        P[n].Type = 4; P[n].StellarAge = All.Time; P[n].Mass = DMAX(P[n].Mass , BPP(n).BH_Mass + BPP(n).BH_Mass_AlphaDisk); P_HOT_SYNC(n); // convert type, mark the new ZAMS age according to the current time, and accrete remaining mass
 #endif
     }
 
@@ -813,7 +813,7 @@ void singlestar_subgrid_protostellar_evolution_update_track(int n, double dm, do
                 P[n].Mass_final = P[n].BH_Mass; //record the final mass the star had
 #ifdef BH_ALPHADISK_ACCRETION
                 BPP(n).BH_Mass_AlphaDisk = 0; //probably does not matter, but let's make sure these don't cause issues
-                P[n].Mass = P[n].BH_Mass;
+                P[n].Mass = P[n].BH_Mass; P_HOT_SYNC(n);
 #endif
                 //Save properties of SN progenitor
                 //This is an unsafe and lazy way of fixing it, but it seems unlikely that two tasks will have SNs at the same time, so probably fne
@@ -28,12 +28,12 @@
 void determine_where_addthermalFB_events_occur(void)
 {
     int i; double check = 0;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].Type != 4) {continue;}
         if(P[i].Mass <= 0) {continue;}
         check += mechanical_fb_calculate_eventrates(i,1); // this should do the calculation and add to number of SNe as needed //
-    } // for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) //
+    } // FOR_ACTIVE_PARTICLES(i) //
 }
 
 struct kernel_addthermalFB {double dp[3], r, wk, dwk, hinv, hinv3, hinv4;};
@@ -78,7 +78,7 @@ struct OUTPUT_STRUCT_NAME
 
 void out2particle_addthermalFB(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loop_iteration)
 {
-    if(P[i].Mass > 0) {P[i].Mass -= out->M_coupled; if((P[i].Mass<0)||(isnan(P[i].Mass))) {P[i].Mass=0;}}
+    if(P[i].Mass > 0) {P[i].Mass -= out->M_coupled; if((P[i].Mass<0)||(isnan(P[i].Mass))) {P[i].Mass=0;} P_HOT_SYNC(i);}
 }
 
 
@@ -196,6 +196,10 @@ int addthermalFB_evaluate(int target, int mode, int *exportflag, int *exportnode
 #ifdef HYDRO_MESHLESS_FINITE_VOLUME
                 #pragma omp atomic
                 SphP[j].MassTrue += Mass_j - Mass_j_0; // finite mass update
+#endif
+#ifdef PARTICLE_HOT_SOA
+                #pragma omp atomic
+                PHot.Mass[j] += Mass_j - Mass_j_0;
 #endif
                 if(rho_j_0 > 0) {
                     #pragma omp atomic
@@ -239,7 +243,7 @@ void thermal_fb_calc(void)
     #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
-    CPU_Step[CPU_SNIIHEATING] += measure_time(); /* collect timings and reset clock for next timing */
+    CPU_Step[CPU_SNIIHEATING] += measure_time_phase(CPU_SNIIHEATING); /* collect timings and reset clock for next timing */
 }
 #include "../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
 
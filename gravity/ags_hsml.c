@@ -71,6 +71,8 @@ int ags_gravity_kernel_shared_BITFLAG(short int particle_type_primary)
 #define INPUTFUNCTION_NAME ags_particle2in_density    /* name of the function which loads the element data needed (for e.g. broadcast to other processors, neighbor search) */
 #define OUTPUTFUNCTION_NAME ags_out2particle_density  /* name of the function which takes the data returned from other processors and combines it back to the original elements */
 #define CONDITIONFUNCTION_FOR_EVALUATION if(ags_density_isactive(i)) /* function for which elements will be 'active' and allowed to undergo operations. can be a function call, e.g. 'density_is_active(i)', or a direct function call like 'if(P[i].Mass>0)' */
+#define EXPORT_PLAN_SEARCH_RADIUS(i) (PPP[i].AGS_Hsml) /* radius determining the exports of element i, so the export list can be re-used between iterations while AGS_Hsml stays inside it */
+#define EXPORT_PLAN_RECORD_MARGIN(pass) ((pass) > 0 ? 1.2 : 1) /* after the first pass, record with a margin so the remaining particles can iterate without new tree-walk exports */
 #include "../system/code_block_xchange_initialize.h" /* pre-define all the ALL_CAPS variables we will use below, so their naming conventions are consistent and they compile together, as well as defining some of the function calls needed */
 
 struct kernel_density 
@@ -254,13 +256,13 @@ int ags_density_evaluate(int target, int mode, int *exportflag, int *exportnodec
 void ags_density(void)
 {
     /* initialize variables used below, in particlar the structures we need to call throughout the iteration */
-    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second(); MyFloat *Left, *Right, *AGS_Prev; double fac, fac_lim, desnumngb, desnumngbdev; long long ntot;
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC); double t00_truestart = my_second(); MyFloat *Left, *Right, *AGS_Prev; double fac, fac_lim, desnumngb, desnumngbdev; long long ntot;
     int i, npleft, iter=0, redo_particle, particle_set_to_minhsml_flag = 0, particle_set_to_maxhsml_flag = 0;
     AGS_Prev = (MyFloat *) mymalloc("AGS_Prev", NumPart * sizeof(MyFloat));
     Left = (MyFloat *) mymalloc("Left", NumPart * sizeof(MyFloat));
     Right = (MyFloat *) mymalloc("Right", NumPart * sizeof(MyFloat));
     /* initialize anything we need to about the active particles before their loop */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {
+    FOR_ACTIVE_PARTICLES(i) {
         if(ags_density_isactive(i)) {
             Left[i] = Right[i] = 0; AGS_Prev[i] = PPP[i].AGS_Hsml; PPP[i].AGS_vsig = 0;
 #ifdef WAKEUP
@@ -277,7 +279,7 @@ void ags_density(void)
 
       /* do check on whether we have enough neighbors, and iterate for density-hsml solution */
         double tstart = my_second(), tend;
-        for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
+        npleft = 0; FOR_ACTIVE_PARTICLES(i)
         {
             if(ags_density_isactive(i))
             {
@@ -507,7 +509,7 @@ void ags_density(void)
                 else
                     P[i].TimeBin = -P[i].TimeBin - 1;	/* Mark as inactive */
             } //  if(ags_density_isactive(i))
-        } // for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
+        } // npleft = 0; FOR_ACTIVE_PARTICLES(i)
         
         tend = my_second();
         timecomp += timediff(tstart, tend);
@@ -526,13 +528,13 @@ void ags_density(void)
     myfree(Right); myfree(Left);
     
     /* mark as active again */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].TimeBin < 0) {P[i].TimeBin = -P[i].TimeBin - 1;}
     }
 
     /* now that we are DONE iterating to find hsml, we can do the REAL final operations on the results */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(ags_density_isactive(i))
         {
@@ -558,7 +560,7 @@ void ags_density(void)
     myfree(AGS_Prev);
     
     /* collect some timing information */
-    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
+    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1); phase_interval_close(CPU_AGSDENSCOMPUTE);
     CPU_Step[CPU_AGSDENSCOMPUTE] += timecomp; CPU_Step[CPU_AGSDENSWAIT] += timewait;
     CPU_Step[CPU_AGSDENSCOMM] += timecomm; CPU_Step[CPU_AGSDENSMISC] += timeall - (timecomp + timewait + timecomm);
 }
@@ -931,25 +933,25 @@ int AGSForce_evaluate(int target, int mode, int *exportflag, int *exportnodecoun
 
 void AGSForce_calc(void)
 {
-    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC); double t00_truestart = my_second();
     PRINT_STATUS(" ..entering AGS-Force calculation [as hydro loop for non-gas elements]\n");
     /* before doing any operations, need to zero the appropriate memory so we can correctly do pair-wise operations */
 #if defined(DM_SIDM)
-    {int i; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {P[i].dtime_sidm = 10.*GET_PARTICLE_TIMESTEP_IN_PHYSICAL(i);}}
+    {int i; FOR_ACTIVE_PARTICLES(i) {P[i].dtime_sidm = 10.*GET_PARTICLE_TIMESTEP_IN_PHYSICAL(i);}}
 #endif
 #ifdef CBE_INTEGRATOR
     /* need to zero values for active particles (which will be re-calculated) before they are added below */
-    //for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {int k1,k2; for(k1=0;k1<CBE_INTEGRATOR_NBASIS;k1++) {for(k2=0;k2<CBE_INTEGRATOR_NMOMENTS;k2++) {P[i].CBE_basis_moments_dt[k1][k2] = 0;}}}
+    //FOR_ACTIVE_PARTICLES(i) {int k1,k2; for(k1=0;k1<CBE_INTEGRATOR_NBASIS;k1++) {for(k2=0;k2<CBE_INTEGRATOR_NMOMENTS;k2++) {P[i].CBE_basis_moments_dt[k1][k2] = 0;}}}
 #endif
     #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
     /* do final operations on results: these are operations that can be done after the complete set of iterations */
 #ifdef CBE_INTEGRATOR
-        for(i=FirstActiveParticle; i>=0; i=NextActiveParticle[i]) {do_postgravity_cbe_calcs(i);} // do any final post-tree-walk calcs from the CBE integrator here //
+        FOR_ACTIVE_PARTICLES(i) {do_postgravity_cbe_calcs(i);} // do any final post-tree-walk calcs from the CBE integrator here //
 #endif
     /* collect timing information */
-    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
+    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1); phase_interval_close(CPU_AGSDENSCOMPUTE);
     CPU_Step[CPU_AGSDENSCOMPUTE] += timecomp; CPU_Step[CPU_AGSDENSWAIT] += timewait;
     CPU_Step[CPU_AGSDENSCOMM] += timecomm; CPU_Step[CPU_AGSDENSMISC] += timeall - (timecomp + timewait + timecomm);
 }
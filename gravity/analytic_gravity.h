@@ -59,9 +59,9 @@ void add_analytic_gravitational_forces()
 void GravAccel_set_zeros_if_needed()
 {
 #if defined(SELFGRAVITY_OFF) || defined(RT_SELFGRAVITY_OFF) /* zero gravaccel [difference is that RT_SELFGRAVITY_OFF... option still computes everything above ]*/
-    int i; for(i=FirstActiveParticle; i>=0; i=NextActiveParticle[i]) {P[i].GravAccel[0]=P[i].GravAccel[1]=P[i].GravAccel[2]=0;}
+    int i; FOR_ACTIVE_PARTICLES(i) {P[i].GravAccel[0]=P[i].GravAccel[1]=P[i].GravAccel[2]=0;}
 #if defined(COMPUTE_TIDAL_TENSOR_IN_GRAVTREE)
-    for(i=FirstActiveParticle; i>=0; i=NextActiveParticle[i]) {P[i].tidal_tensorps[0][0]=P[i].tidal_tensorps[0][1]=P[i].tidal_tensorps[0][2]=P[i].tidal_tensorps[1][0]=P[i].tidal_tensorps[1][1]=P[i].tidal_tensorps[1][2]=P[i].tidal_tensorps[2][0]=P[i].tidal_tensorps[2][1]=P[i].tidal_tensorps[2][2]=0;}
+    FOR_ACTIVE_PARTICLES(i) {P[i].tidal_tensorps[0][0]=P[i].tidal_tensorps[0][1]=P[i].tidal_tensorps[0][2]=P[i].tidal_tensorps[1][0]=P[i].tidal_tensorps[1][1]=P[i].tidal_tensorps[1][2]=P[i].tidal_tensorps[2][0]=P[i].tidal_tensorps[2][1]=P[i].tidal_tensorps[2][2]=0;}
 #endif
 #endif
 }
@@ -72,7 +72,7 @@ void GravAccel_set_zeros_if_needed()
 void GravAccel_RDITestProblem()
 {
 #ifdef GRAIN_RDI_TESTPROBLEM
-    int i; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i; FOR_ACTIVE_PARTICLES(i)
     {   /* add the relevant vertical field for non-anchored particles */
         if(P[i].ID > 0 && (P[i].Type==0 || ((1 << P[i].Type) & (GRAIN_PTYPES))))
         {
@@ -108,7 +108,7 @@ void GravAccel_RDITestProblem()
 void GravAccel_ShearingSheet()
 {
 #ifdef BOX_SHEARING
-    int i; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i; FOR_ACTIVE_PARTICLES(i)
     {
         /* centrifugal force term (depends on distance from box center) */
         P[i].GravAccel[0] += 2.*(P[i].Pos[0]-boxHalf_X) * BOX_SHEARING_Q*BOX_SHEARING_OMEGA_BOX_CENTER*BOX_SHEARING_OMEGA_BOX_CENTER;
@@ -129,7 +129,7 @@ void GravAccel_ShearingSheet()
 /* constant vertical acceleration for Rayleigh-Taylor test problem */
 void GravAccel_RayleighTaylorTest()
 {
-    int i; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i; FOR_ACTIVE_PARTICLES(i)
         {if(P[i].ID != 0) {P[i].GravAccel[1]=-0.5;}} /* now add the constant vertical field */
 }
 
@@ -138,7 +138,7 @@ void GravAccel_RayleighTaylorTest()
 /* static unit Plummer Sphere (assumes G=M=a=1) */
 void GravAccel_StaticPlummerSphere()
 {
-    int i,k; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i,k; FOR_ACTIVE_PARTICLES(i)
     {
         double dp[3]; for(k=0;k<3;k++) {dp[k]=P[i].Pos[k];}
 #ifdef GRAVITY_ANALYTIC_ANCHOR_TO_PARTICLE
@@ -159,7 +159,7 @@ void GravAccel_StaticPlummerSphere()
 void GravAccel_StaticHernquist()
 {
     double HQ_Mtot=100, HQ_a=20; /* total mass and scale-length "a" [both in code units] */
-    int i,k; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i,k; FOR_ACTIVE_PARTICLES(i)
     {
         double dp[3]; for(k=0;k<3;k++) {dp[k]=P[i].Pos[k];}
 #ifdef GRAVITY_ANALYTIC_ANCHOR_TO_PARTICLE
@@ -180,7 +180,7 @@ void GravAccel_StaticHernquist()
 void GravAccel_StaticIsothermalSphere()
 {
     double ISO_Mmax=100, ISO_Rmax=200; /* total mass inside rmax, the maximum radius with mass (outside of which density=0, just set Rmax very large if you want an infinite SIS) */
-    int i,k; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i,k; FOR_ACTIVE_PARTICLES(i)
     {
         double dp[3]; for(k=0;k<3;k++) {dp[k]=P[i].Pos[k];}
 #ifdef GRAVITY_ANALYTIC_ANCHOR_TO_PARTICLE
@@ -219,7 +219,7 @@ void GravAccel_GrowingDiskPotential()
     double r_disk = r_disk_table[i0] + dt * (r_disk_table[i1]-r_disk_table[i0]);
     double z_disk = z_disk_table[i0] + dt * (z_disk_table[i1]-z_disk_table[i0]);
     /* ok now we can assign actual accelerations */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         double dp[3]; for(k=0;k<3;k++) {dp[k]=P[i].Pos[k];}
 #ifdef GRAVITY_ANALYTIC_ANCHOR_TO_PARTICLE
@@ -240,7 +240,7 @@ void GravAccel_GrowingDiskPotential()
 /* Keplerian forces (G=M=1): useful for orbit, MRI, planetary disk problems */
 void GravAccel_KeplerianOrbit()
 {
-    int i,k; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i,k; FOR_ACTIVE_PARTICLES(i)
     {
         double dp[3]; for(k=0;k<3;k++) {dp[k]=P[i].Pos[k];}
 #if defined(GRAVITY_ANALYTIC_ANCHOR_TO_PARTICLE)
@@ -260,7 +260,7 @@ void GravAccel_KeplerianOrbit()
 void GravAccel_KeplerianTestProblem()
 {
     double x00=4.0, y00=4.0; /* 2D center of orbit: the is hard-coded for the relevant test problem */
-    int i; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i; FOR_ACTIVE_PARTICLES(i)
     {
         double r = pow(pow(P[i].Pos[1]-y00,2.)+pow(P[i].Pos[0]-x00,2.),0.5);
         if((r > 0.35)&(r < 2.1))
@@ -293,7 +293,7 @@ void GravAccel_StaticNFW()
 {
     double NFW_M200=100, NFW_C=13; /* NFW mass inside R200 (in code units), and concentration =R200/Rs */
     double R200 = pow(NFW_M200*All.G/(100.*All.Hubble_H0_CodeUnits*All.Hubble_H0_CodeUnits), 1./3.), Rs=R200/NFW_C; /* using R200 = R where mean density = 200x critical density, and Rs=R200/c200 */
-    int i,k; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i,k; FOR_ACTIVE_PARTICLES(i)
     {
         double dp[3]; for(k=0;k<3;k++) {dp[k]=P[i].Pos[k];}
 #ifdef GRAVITY_ANALYTIC_ANCHOR_TO_PARTICLE
@@ -305,7 +305,7 @@ void GravAccel_StaticNFW()
         if(r>0) {
             double mfac = (log(1+x)-x/(1+x)) / (x*x); if(x<=0.04) {mfac=0.5-2.*x/3.+0.75*x*x;} /* expression works well for larger x, small-x leads to potential numerical errors */
             for(k=0;k<3;k++) {P[i].GravAccel[k] += -All.G * mfac * NFW_M200/(cfac*Rs*Rs) * (dp[k]/r);}}
-    } // for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) //
+    } // FOR_ACTIVE_PARTICLES(i) //
 }
 
 
@@ -314,7 +314,7 @@ void GravAccel_StaticNFW()
 void GravAccel_PaczynskyWiita()
 {
     double PACZYNSKY_WIITA_MASS = 1.0; // Mass to use for the Paczynksy-Wiita analytic gravity pseudo-Newtonian potential (in solar masses)
-    int i,k; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i,k; FOR_ACTIVE_PARTICLES(i)
     {
         double dp[3]; for(k=0;k<3;k++) {dp[k]=P[i].Pos[k];}
 #ifdef GRAVITY_ANALYTIC_ANCHOR_TO_PARTICLE
@@ -340,7 +340,7 @@ void apply_excision(void)
     double excision_radius = EXCISION_ETA * pow(EXCISION_INIT_RADIUS*EXCISION_INIT_RADIUS*EXCISION_INIT_RADIUS +
                                                 3.*sqrt(2. * All.G * EXCISION_MASS) * pow(EXCISION_INIT_RADIUS, 3./2.) * All.Time +
                                                 9./2. * All.G * EXCISION_MASS * All.Time*All.Time, 1./3.);
-    int i,k; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    int i,k; FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].Type == 0)
         {
@@ -349,7 +349,7 @@ void apply_excision(void)
             for(k=0;k<3;k++) {dp[k] = -P[i].min_xyz_to_bh[k];}
 #endif
             double r2 = dp[0]*dp[0]+dp[1]*dp[1]+dp[2]*dp[2], r = sqrt(r2);
-            if(r < excision_radius) {P[i].Mass = 0;}
+            if(r < excision_radius) {P[i].Mass = 0; P_HOT_SYNC(i);}
         }
     }
 }
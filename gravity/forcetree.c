@@ -113,6 +113,12 @@ int force_treebuild(int npart, struct unbind_data *mp)
 {
 
     int flag;
+#ifdef PARTICLE_HOT_SOA
+    particle_hot_soa_refresh(); /* P may have been reordered/exchanged since the last build */
+#endif
+#ifdef DRIFT_ON_DEMAND_CLAIMS
+    drift_stamps_reset(); /* likewise for the per-slot drift stamps */
+#endif
     do
     {
         Numnodestree = force_treebuild_single(npart, mp);
@@ -148,6 +154,22 @@ int force_treebuild(int npart, struct unbind_data *mp)
 }
 
 
+#ifdef PARTICLE_HOT_SOA
+/*! Re-copies the fields mirrored in PHot from P for all local particles. Individual writes during the
+ *  timestep keep the mirror current through P_HOT_SYNC; this full pass is needed whenever P is permuted
+ *  or exchanged wholesale (domain decomposition, Peano-Hilbert reordering, particle rearrangement).
+ */
+void particle_hot_soa_refresh(void)
+{
+    int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) schedule(static)
+#endif
+    for(i = 0; i < NumPart; i++) {P_HOT_SYNC(i);}
+}
+#endif
+
+
 
 /*! Constructs the gravitational oct-tree.
  *
@@ -1696,7 +1718,6 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
     MyLongDouble acc_x, acc_y, acc_z;
     // cache some global vars in local vars to help compiler with alias analysis
     int maxPart = All.MaxPart;
-    long bunchSize = All.BunchSize;
     int maxNodes = MaxNodes;
     integertime ti_Current = All.Ti_Current;
     double errTol2 = All.ErrTolTheta * All.ErrTolTheta;
@@ -1957,15 +1978,7 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
             if(no < maxPart)
             {
                 /* the index of the node is the index of the particle */
-                if(P[no].Ti_current != ti_Current)
-                {
-                    LOCK_PARTNODEDRIFT;
-#ifdef _OPENMP
-#pragma omp critical(_partnodedrift_)
-#endif
-                    drift_particle(no, ti_Current);
-                    UNLOCK_PARTNODEDRIFT;
-                }
+                DRIFT_PARTICLE_ON_DEMAND(no, ti_Current);
                 dx = P[no].Pos[0] - pos_x;
                 dy = P[no].Pos[1] - pos_y;
                 dz = P[no].Pos[2] - pos_z;
@@ -2123,26 +2136,8 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 
                         if(exportnodecount[task] == NODELISTLENGTH)
                         {
-                            int exitFlag = 0;
-                            LOCK_NEXPORT;
-#ifdef _OPENMP
-#pragma omp critical(_nexport_)
-#endif
-                            {
-                                if(Nexport >= bunchSize)
-                                {
-                                    /* out of buffer space. Need to discard work for this particle and interrupt */
-                                    BufferFullFlag = 1;
-                                    exitFlag = 1;
-                                }
-                                else
-                                {
-                                    nexp = Nexport;
-                                    Nexport++;
-                                }
-                            }
-                            UNLOCK_NEXPORT;
-                            if(exitFlag) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
+                            nexp = export_block_next_slot(exportflag); /* slot in this thread's block of the export table */
+                            if(nexp < 0) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
 
                             exportnodecount[task] = 0;
                             exportindex[task] = nexp;
@@ -3023,15 +3018,7 @@ int force_treeevaluate_ewald_correction(int target, int mode, int *exportflag, i
             {
                 /* the index of the node is the index of the particle */
                 /* observe the sign */
-                if(P[no].Ti_current != All.Ti_Current)
-                {
-                    LOCK_PARTNODEDRIFT;
-#ifdef _OPENMP
-#pragma omp critical(_partnodedrift_)
-#endif
-                    drift_particle(no, All.Ti_Current);
-                    UNLOCK_PARTNODEDRIFT;
-                }
+                DRIFT_PARTICLE_ON_DEMAND(no, All.Ti_Current);
 
                 dx = P[no].Pos[0] - pos_x;
                 dy = P[no].Pos[1] - pos_y;
@@ -3052,26 +3039,8 @@ int force_treeevaluate_ewald_correction(int target, int mode, int *exportflag, i
 
                         if(exportnodecount[task] == NODELISTLENGTH)
                         {
-                            int exitFlag = 0;
-                            LOCK_NEXPORT;
-#ifdef _OPENMP
-#pragma omp critical(_nexport_)
-#endif
-                            {
-                                if(Nexport >= All.BunchSize)
-                                {
-                                    /* out if buffer space. Need to discard work for this particle and interrupt */
-                                    BufferFullFlag = 1;
-                                    exitFlag = 1;
-                                }
-                                else
-                                {
-                                    nexp = Nexport;
-                                    Nexport++;
-                                }
-                            }
-                            UNLOCK_NEXPORT;
-                            if(exitFlag) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
+                            nexp = export_block_next_slot(exportflag); /* slot in this thread's block of the export table */
+                            if(nexp < 0) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
 
                             exportnodecount[task] = 0;
                             exportindex[task] = nexp;
@@ -3421,7 +3390,7 @@ int force_treeevaluate_potential(int target, int mode, int *nexport, int *nsend_
             {
                 /* the index of the node is the index of the particle */
                 /* observe the sign  */
-                if(P[no].Ti_current != All.Ti_Current) {drift_particle(no, All.Ti_Current);}
+                DRIFT_PARTICLE_ON_DEMAND(no, All.Ti_Current);
                 dx = P[no].Pos[0] - pos_x;
                 dy = P[no].Pos[1] - pos_y;
                 dz = P[no].Pos[2] - pos_z;
@@ -3926,6 +3895,9 @@ void force_treeallocate(int maxnodes, int maxpart)
         endrun(438965237);
     }
     allbytes += bytes;
+#ifdef HYDRO_NGB_LIST_VERLET
+    ngb_list_cache_allocate(); /* neighbor lists kept across timesteps live (and die) with the tree */
+#endif
     if(first_flag == 0)
     {
         first_flag = 1;
@@ -3954,6 +3926,9 @@ void force_treefree(void)
 {
     if(tree_allocated_flag)
     {
+#ifdef HYDRO_NGB_LIST_VERLET
+        ngb_list_cache_deallocate();
+#endif
         myfree(Father);
         myfree(Nextnode);
         myfree(Extnodes_base);
@@ -73,6 +73,9 @@ void   force_setupnonrecursive(int no);
 void   force_treeallocate(int maxnodes, int maxpart);  
 int    force_treebuild(int npart, struct unbind_data *mp);
 int    force_treebuild_single(int npart, struct unbind_data *mp);
+#ifdef PARTICLE_HOT_SOA
+void   particle_hot_soa_refresh(void);
+#endif
 
 int    force_treeevaluate_direct(int target, int mode);
 
@@ -98,6 +101,8 @@ void   ngb_treesearch_notsee(int no);
 
 int ngb_treefind_fof_primary(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode, int mode,
 			    int *nexport, int *nsend_local, int MyFOF_PRIMARY_LINK_TYPES);
+int ngb_treefind_fof_primary_threads(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode, int mode, int *exportflag,
+                                     int *exportnodecount, int *exportindex, int *ngblist, int MyFOF_PRIMARY_LINK_TYPES, int *remote);
 int ngb_clear_buf(MyDouble searchcenter[3], MyFloat hguess, int numngb);
 void ngb_treefind_flagexport(MyDouble searchcenter[3], MyFloat hguess);
 
@@ -105,6 +110,27 @@ void ngb_treefind_flagexport(MyDouble searchcenter[3], MyFloat hguess);
 int ngb_treefind_pairs_threads(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode,
 		       int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist);		       
 
+#ifdef HYDRO_NGB_LIST_CACHE
+int ngb_treefind_pairs_threads_cached(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode,
+               int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist);
+void ngb_list_cache_init(void);
+void ngb_list_cache_free(void);
+#ifdef HYDRO_NGB_LIST_VERLET
+void ngb_list_cache_allocate(void);
+void ngb_list_cache_deallocate(void);
+void ngb_list_cache_invalidate(void);
+#endif
+#ifdef HYDRO_FACE_CACHE
+struct ngb_face_cache_entry /*! one per entry of a cached neighbor list: the pair's face and kernel values, as used in the hydro loop */
+{
+    double Face_Area_Vec[3], Face_Area_Norm;
+    double wk_i, dwk_i, wk_j, dwk_j;
+    int Filled; /*!< 0 if the gradient loop did not reach this pair (the hydro loop then computes it as usual) */
+};
+struct ngb_face_cache_entry *ngb_face_cache_entries(int target, int mode, int numngb, int fill);
+#endif
+#endif
+
 int ngb_treefind_variable_targeted(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode, int mode,
  			  int *nexport, int *nsend_local, int TARGET_BITMASK);
 #ifdef ADM
@@ -22,7 +22,7 @@ void force_update_tree(void)
     PRINT_STATUS("Kick-subroutine will prepare for dynamic update of tree");
     int i, j; GlobFlag++; DomainNumChanged = 0; DomainList = (int *) mymalloc("DomainList", NTopleaves * sizeof(int));
     /* note: the current list of active particles still refers to that synchronized at the previous time. */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         force_kick_node(i, P[i].dp);    /* kick the parent nodes with this momentum difference, also updated maximum velocity, softening and soundspeed, if needed */
         for(j = 0; j < 3; j++) {P[i].dp[j] = 0;}
@@ -371,7 +371,7 @@ void force_update_hmax(void)
   DomainNumChanged = 0;
   DomainList = (int *) mymalloc("DomainList", NTopleaves * sizeof(int));
 
-  for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+  FOR_ACTIVE_PARTICLES(i)
   {
 #if defined(ADAPTIVE_GRAVSOFT_FORALL)
     if(P[i].Mass > 0)
@@ -407,7 +407,7 @@ void force_update_hmax(void)
             no = Nodes[no].u.d.father;
         }
       }
-  } // for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+  } // FOR_ACTIVE_PARTICLES(i)
 
   /* share the hmax-data of the pseudo-particles accross CPUs */
 
@@ -486,5 +486,5 @@ void force_update_hmax(void)
   myfree(counts);
   myfree(DomainList);
 
-  CPU_Step[CPU_TREEHMAXUPDATE] += measure_time();
+  CPU_Step[CPU_TREEHMAXUPDATE] += measure_time_phase(CPU_TREEHMAXUPDATE);
 }
@@ -55,7 +55,7 @@ void gravity_tree(void)
     double t0, t1, timeall = 0, timetree1 = 0, timetree2 = 0, timetree, timewait, timecomm;
     double timecommsumm1 = 0, timecommsumm2 = 0, timewait1 = 0, timewait2 = 0, sum_costtotal, ewaldtot;
     double maxt, sumt, maxt1, sumt1, maxt2, sumt2, sumcommall, sumwaitall, plb, plb_max;
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 
     /* set new softening lengths */
     if(All.ComovingIntegrationOn) {set_softenings();}
@@ -67,17 +67,17 @@ void gravity_tree(void)
     if(TreeReconstructFlag)
     {
         PRINT_STATUS("Tree construction initiated (presently allocated=%g MB)", AllocatedBytes / (1024.0 * 1024.0));
-        CPU_Step[CPU_MISC] += measure_time();
+        CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
         move_particles(All.Ti_Current);
         rearrange_particle_sequence();
-        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time(); /* sync before we do the treebuild */
+        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time_phase(CPU_DRIFT); /* sync before we do the treebuild */
         force_treebuild(NumPart, NULL);
-        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_TREEBUILD] += measure_time(); /* and sync after treebuild as well */
+        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_TREEBUILD] += measure_time_phase(CPU_TREEBUILD); /* and sync after treebuild as well */
         TreeReconstructFlag = 0;
         PRINT_STATUS(" ..Tree construction done.");
     }
 
-    CPU_Step[CPU_TREEMISC] += measure_time(); t0 = my_second();
+    CPU_Step[CPU_TREEMISC] += measure_time_phase(CPU_TREEMISC); t0 = my_second();
 #ifndef SELFGRAVITY_OFF
     /* allocate buffers to arrange communication */
     PRINT_STATUS(" ..Begin tree force. (presently allocated=%g MB)", AllocatedBytes / (1024.0 * 1024.0));
@@ -90,6 +90,12 @@ void gravity_tree(void)
     if(All.HighestActiveTimeBin == All.HighestOccupiedTimeBin) {if(ThisTask == 0) printf(" ..All.BunchSize=%ld\n", All.BunchSize);}
     int k, ewald_max, diff, save_NextParticle, ndone, ndone_flag, place, recvTask; double tstart, tend, ax, ay, az; MPI_Status status;
     Ewaldcount = 0; Costtotal = 0; N_nodesinlist = 0; ewald_max=0;
+    size_t export_wire_size = sizeof(struct gravdata_in); /* bytes per exported element on the wire */
+#ifdef MPI_COMPACT_EXPORTS
+    struct compact_export_format export_wire_format; /* compact exports: reduced node-lists, positions as offsets from the destination node, and OldAcc (only used in the opening criterion) with 16 bits */
+    compact_export_format_init(&export_wire_format, sizeof(struct gravdata_in), offsetof(struct gravdata_in, NodeList), offsetof(struct gravdata_in, Pos), sizeof(GravDataIn->Pos[0]), offsetof(struct gravdata_in, OldAcc));
+    export_wire_size = export_wire_format.wire_size;
+#endif
 #if defined(BOX_PERIODIC) && !defined(GRAVITY_NOT_PERIODIC) && !defined(PMGRID)
     ewald_max = 1; /* the tree-code will need to iterate to perform the periodic boundary condition corrections */
 #endif
@@ -137,7 +143,7 @@ void gravity_tree(void)
     /* begin main communication and tree-walk loop. note the ewald-iter terms here allow for multiple iterations for periodic-tree corrections if needed */
     for(Ewald_iter = 0; Ewald_iter <= ewald_max; Ewald_iter++)
     {
-        NextParticle = FirstActiveParticle;	/* begin with this index */
+        NextParticle = 0;	/* begin with this position in the active list */
         do /* primary point-element loop */
         {
             iter++;
@@ -174,39 +180,18 @@ void gravity_tree(void)
             if(BufferFullFlag) /* we've filled the buffer or reached the end of the list, prepare for communications */
             {
                 int last_nextparticle = NextParticle; NextParticle = save_NextParticle;
-                while(NextParticle >= 0)
+                while(NextParticle < NumActiveParticle)
                 {
                     if(NextParticle == last_nextparticle) {break;}
-                    if(ProcessedFlag[NextParticle] != 1) {break;}
-                    ProcessedFlag[NextParticle] = 2; NextParticle = NextActiveParticle[NextParticle];
+                    if(ProcessedFlag[ActiveParticleList[NextParticle]] != 1) {break;}
+                    ProcessedFlag[ActiveParticleList[NextParticle]] = 2; NextParticle++;
                 }
                 if(NextParticle == save_NextParticle) {endrun(114408);} /* in this case, the buffer is too small to process even a single particle */
-
-                int new_export = 0; /* actually calculate exports [so we can tell other tasks] */
-                for(j = 0, k = 0; j < Nexport; j++)
-                {
-                    if(ProcessedFlag[DataIndexTable[j].Index] != 2)
-                    {
-                        if(k < j + 1) {k = j + 1;}
-                        for(; k < Nexport; k++)
-                            if(ProcessedFlag[DataIndexTable[k].Index] == 2)
-                            {
-                                int old_index = DataIndexTable[j].Index;
-                                DataIndexTable[j] = DataIndexTable[k]; DataNodeList[j] = DataNodeList[k]; DataIndexTable[j].IndexGet = j; new_export++;
-                                DataIndexTable[k].Index = old_index; k++;
-                                break;
-                            }
-                    }
-                    else {new_export++;}
-                }
-                Nexport = new_export; /* counting exports... */
             }
+            Nexport = export_blocks_merge(BufferFullFlag); /* collect the per-thread export blocks (dropping unfinished elements if the buffer filled), grouped by task, and count the exports */
             n_exported += Nexport;
-            for(j = 0; j < NTask; j++) {Send_count[j] = 0;}
-            for(j = 0; j < Nexport; j++) {Send_count[DataIndexTable[j].Task]++;}
-            MYSORT_DATAINDEX(DataIndexTable, Nexport, sizeof(struct data_index), data_index_compare); /* construct export count tables */
             tstart = my_second();
-            MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD); /* broadcast import/export counts */
+            mpi_sparse_alltoall_counts(Send_count, Recv_count); /* broadcast import/export counts */
             tend = my_second(); timewait1 += timediff(tstart, tend);
 
             for(j = 0, Send_offset[0] = 0; j < NTask; j++) {if(j > 0) {Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];}} /* calculate export table offsets */
@@ -260,6 +245,9 @@ void gravity_tree(void)
 #endif
                 memcpy(GravDataIn[j].NodeList,DataNodeList[DataIndexTable[j].IndexGet].NodeList, NODELISTLENGTH * sizeof(int));
             }
+#ifdef MPI_COMPACT_EXPORTS
+            compact_export_pack(&export_wire_format, GravDataIn, Nexport);
+#endif
 
             /* ok now we have to figure out if there is enough memory to handle all the tasks sending us their data, and if not, break it into sub-chunks */
             int N_chunks_for_import, ngrp_initial, ngrp;
@@ -294,13 +282,16 @@ void gravity_tree(void)
                     {
                         if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0) /* get the particles */
                         {
-                            MPI_Sendrecv(&GravDataIn[Send_offset[recvTask]], Send_count[recvTask] * sizeof(struct gravdata_in), MPI_BYTE, recvTask, TAG_GRAV_A,
-                                         &GravDataGet[Nimport], Recv_count[recvTask] * sizeof(struct gravdata_in), MPI_BYTE, recvTask, TAG_GRAV_A,
+                            MPI_Sendrecv((char *) GravDataIn + Send_offset[recvTask] * export_wire_size, Send_count[recvTask] * export_wire_size, MPI_BYTE, recvTask, TAG_GRAV_A,
+                                         (char *) GravDataGet + Nimport * export_wire_size, Recv_count[recvTask] * export_wire_size, MPI_BYTE, recvTask, TAG_GRAV_A,
                                          MPI_COMM_WORLD, &status);
                             Nimport += Recv_count[recvTask];
                         }
                     }
                 }
+#ifdef MPI_COMPACT_EXPORTS
+                compact_export_unpack(&export_wire_format, GravDataGet, Nimport);
+#endif
                 tend = my_second(); timecommsumm1 += timediff(tstart, tend);
                 report_memory_usage(&HighMark_gravtree, "GRAVTREE");
 
@@ -447,7 +438,7 @@ void gravity_tree(void)
             tend = my_second(); timetree1 += timediff(tstart, tend);
             myfree(GravDataOut); myfree(GravDataIn);
 
-            if(NextParticle < 0) {ndone_flag = 1;} else {ndone_flag = 0;} /* figure out if we are done with the particular active set here */
+            if(NextParticle >= NumActiveParticle) {ndone_flag = 1;} else {ndone_flag = 0;} /* figure out if we are done with the particular active set here */
             tstart = my_second();
             MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD); /* call an allreduce to figure out if all tasks are also done here, otherwise we need to iterate */
             tend = my_second(); timewait2 += timediff(tstart, tend);
@@ -475,7 +466,7 @@ void gravity_tree(void)
 #ifndef GRAVITY_HYBRID_OPENING_CRIT  // in collisional systems we don't want to rely on the relative opening criterion alone, because aold can be dominated by a binary companion but we still want accurate contributions from distant nodes. Thus we combine BH and relative criteria. - MYG
     if(header.flag_ic_info == FLAG_SECOND_ORDER_ICS) {if(!(All.Ti_Current == 0 && RestartFlag == 0)) {if(All.TypeOfOpeningCriterion == 1) {All.ErrTolTheta = 0;}}} else {if(All.TypeOfOpeningCriterion == 1) {All.ErrTolTheta = 0;}} /* This will switch to the relative opening criterion for the following force computations */
 #endif
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
 #ifdef HERMITE_INTEGRATION
         if(HermiteOnlyFlag) {if(!eligible_for_hermite(i)) continue;} /* if we are completing an extra loop required for the Hermite integration, all of the below would be double-calculated, so skip it */
@@ -610,7 +601,7 @@ void gravity_tree(void)
 
 
     /* Now the force computation is finished: gather timing and diagnostic information */
-    t1 = WallclockTime = my_second(); timeall = timediff(t0, t1);
+    t1 = WallclockTime = my_second(); timeall = timediff(t0, t1); phase_interval_close(CPU_TREEWALK1);
     timetree = timetree1 + timetree2; timewait = timewait1 + timewait2; timecomm = timecommsumm1 + timecommsumm2;
     MPI_Reduce(&timetree, &sumt, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
     MPI_Reduce(&timetree, &maxt, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
@@ -651,7 +642,7 @@ void gravity_tree(void)
         if(sum_costtotal>0) {PRINT_STATUS(" ..relative error in the total number of tree-gravity interactions = %g", (sum_costtotal - sum_costtotal_new) / sum_costtotal);} /* can be non-zero if THREAD_SAFE_COSTS is not used (and due to round-off errors). */
     }
 #endif
-    CPU_Step[CPU_TREEMISC] += measure_time();
+    CPU_Step[CPU_TREEMISC] += measure_time_phase(CPU_TREEMISC);
 }
 
 
@@ -671,8 +662,8 @@ void *gravity_primary_loop(void *p)
 #pragma omp critical(_nexport_)
 #endif
         {
-        if(BufferFullFlag != 0 || NextParticle < 0) {exitFlag=1;}
-            else {i=NextParticle; ProcessedFlag[i]=0; NextParticle=NextActiveParticle[NextParticle];}
+        if(BufferFullFlag != 0 || NextParticle >= NumActiveParticle) {exitFlag=1;}
+            else {i=ActiveParticleList[NextParticle]; ProcessedFlag[i]=0; NextParticle++;}
         }
         UNLOCK_NEXPORT;
         if(exitFlag) {break;}
@@ -832,6 +823,77 @@ void mysort_dataindex(void *b, size_t n, size_t s, int (*cmp) (const void *, con
 }
 
 
+/*! Returns the next free slot of DataIndexTable for the thread owning 'exportflag' (its block of the thread-local export flags), or -1 (setting
+    BufferFullFlag) if the export buffer is full. Slots are handed out to each thread in blocks, so the global counter Nexport is only touched
+    once per block instead of once per export; the unused tail of each block is discarded in export_blocks_merge() after the primary loop. */
+long export_block_next_slot(int *exportflag)
+{
+    struct export_block_data *blk = &ExportBlock[(exportflag - Exportflag) / NTask];
+    if(blk->Next >= blk->End)
+    {
+        long start, blocksize = All.BunchSize / (4 * maxThreads); /* small enough that the discarded tails cannot eat a significant part of the buffer */
+        if(blocksize > 64) {blocksize = 64;}
+        if(blocksize < 1) {blocksize = 1;}
+        LOCK_NEXPORT;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+        {start = Nexport; Nexport += blocksize;}
+        UNLOCK_NEXPORT;
+        if(start >= All.BunchSize)
+        {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+            BufferFullFlag = 1; /* out of buffer space. the caller needs to discard work for this particle and interrupt */
+            return -1;
+        }
+        blk->Next = start; blk->End = DMIN(start + blocksize, All.BunchSize);
+    }
+    return blk->Next++;
+}
+
+
+/*! Collects the export entries the threads have written into their blocks of DataIndexTable in the last primary loop, and returns the
+    new value of Nexport. Unused block tails are dropped, as are (if the buffer filled, i.e. buffer_full is set) the entries of elements
+    which were not completed in this round (ProcessedFlag != 2). The rest are grouped by task with a stable counting sort, which replaces the
+    general sort of the table; since blocks are handed out in increasing order, the entries of each element keep the order they were created
+    in. DataNodeList is not moved: entries keep pointing to their node lists through IndexGet. Send_count is filled on return. */
+long export_blocks_merge(int buffer_full)
+{
+    long i, n = (Nexport < All.BunchSize) ? Nexport : All.BunchSize, n_new; int j, t;
+    for(t = 0; t < maxThreads; t++) {for(i = ExportBlock[t].Next; i < ExportBlock[t].End; i++) {DataIndexTable[i].Task = -1;} ExportBlock[t].Next = ExportBlock[t].End = 0;}
+    for(j = 0; j < NTask; j++) {Send_count[j] = 0;}
+    for(i = 0; i < n; i++)
+    {
+        if(DataIndexTable[i].Task < 0) {continue;}
+        if(buffer_full && ProcessedFlag[DataIndexTable[i].Index] != 2) {DataIndexTable[i].Task = -1; continue;}
+        Send_count[DataIndexTable[i].Task]++;
+    }
+    for(j = 0, n_new = 0; j < NTask; j++) {Send_offset[j] = n_new; n_new += Send_count[j];}
+    struct data_index *tmp = (struct data_index *) mymalloc("struct data_index *tmp", (n_new + 1) * sizeof(struct data_index));
+    for(i = 0; i < n; i++) {if((j = DataIndexTable[i].Task) >= 0) {tmp[Send_offset[j]++] = DataIndexTable[i];}}
+    memcpy(DataIndexTable, tmp, n_new * sizeof(struct data_index));
+    myfree(tmp);
+    for(j = 0, n_new = 0; j < NTask; j++) {Send_offset[j] = n_new; n_new += Send_count[j];}
+    return n_new;
+}
+
+
+/*! After a round of a loop over PrimaryLoopList which stopped because the export buffer filled: commits (ProcessedFlag=2) every element
+    the threads finished in the round, also those claimed after the first unfinished one, so export_blocks_merge() keeps their exports and
+    the primary loop skips them when the list is resumed (an element whose mode-0 output adds to its fields, or to its neighbors', must
+    never be evaluated twice). NextParticle is moved past the committed elements at the start of the range. Returns the number committed. */
+int primary_loop_commit_finished(int save_nextparticle)
+{
+    int k, last = NextParticle, n = 0;
+    if(last > PrimaryLoopListLength) {last = PrimaryLoopListLength;}
+    for(k = save_nextparticle; k < last; k++) {if(ProcessedFlag[PrimaryLoopList[k]] == 1) {ProcessedFlag[PrimaryLoopList[k]] = 2; n++;}}
+    for(NextParticle = save_nextparticle; NextParticle < last; NextParticle++) {if(ProcessedFlag[PrimaryLoopList[NextParticle]] != 2) {break;}}
+    return n;
+}
+
+
 #if (SINGLE_STAR_TIMESTEPPING > 0)
 void subtract_companion_gravity(int i)
 {
@@ -30,16 +30,16 @@ void compute_potential(void)
     if(All.ComovingIntegrationOn) {set_softenings();}
     
     PRINT_STATUS("Start computation of potential for all particles...");
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
     
     if(TreeReconstructFlag)
     {
         PRINT_STATUS("Tree construction");
-        CPU_Step[CPU_MISC] += measure_time();
+        CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
         rearrange_particle_sequence();
-        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time();
+        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time_phase(CPU_DRIFT);
         force_treebuild(NumPart, NULL);
-        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_TREEBUILD] += measure_time();
+        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_TREEBUILD] += measure_time_phase(CPU_TREEBUILD);
         TreeReconstructFlag = 0;
         PRINT_STATUS(" ..Tree construction done");
     }
@@ -51,7 +51,7 @@ void compute_potential(void)
     DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
     DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
     
-    for(i = 0; i < NumPart; i++) {if(P[i].Ti_current != All.Ti_Current) {drift_particle(i, All.Ti_Current);}}
+    move_particles(All.Ti_Current);
     i = 0; /* begin with this index */
     do
     {
@@ -220,7 +220,7 @@ void compute_potential(void)
 #else
     for(i = 0; i < NumPart; i++) {P[i].Potential = 0;} // self-gravity is off
 #endif
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_POTENTIAL] += measure_time(); // compute timings
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_POTENTIAL] += measure_time_phase(CPU_POTENTIAL); // compute timings
 }
 
 #endif
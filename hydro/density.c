@@ -98,10 +98,93 @@ int density_isactive(int n)
 
 
 
+#ifdef DENSITY_HSML_MULTIRADIUS
+#define DENSITY_HSML_NTRIAL 8 /* number of trial kernel lengths at which the neighbor number is summed in each pass */
+#define DENSITY_HSML_TRIAL_SPAN 1.25 /* trial kernel lengths span Hsml/span to Hsml*span (a factor ~2 in neighbor number either way) */
+static double DensityTrialHsmlFacMin, DensityTrialHsmlFacMax; /* set each pass, identically on all tasks, so imported elements use the same trial lengths */
+static MyFloat *NgbTrial; /* summed (dimensionless) kernel weights at the trial lengths, DENSITY_HSML_NTRIAL per element */
+/*! ratio of the k-th trial kernel length to Hsml: log-spaced between the limits set for this pass */
+static inline double density_trial_hsml_factor(int k) {return DensityTrialHsmlFacMin * pow(DensityTrialHsmlFacMax/DensityTrialHsmlFacMin, (double)k/(DENSITY_HSML_NTRIAL-1));}
+#endif
+
+#ifdef DENSITY_FUSED_GRADIENTS
+/*! the moments for the gradient estimator of hydro_gradient_calc() are summed in the same walk: with the search extended to all pairs (r_ij < MAX(H_i,H_j)),
+    the last (converged) pass of an element sees exactly the neighbors of its gradient loop. the sums only equal what that loop would find if none of those
+    neighbors changes its density or pressure in this call, i.e. none of them is active: this is checked from our side for the pairs we find, and marked from
+    theirs for the active elements which have us inside their own kernel (our walk uses the tree hmax from before their Hsml changed). elements which fail
+    either check are simply done in the gradient loop. */
+struct density_fused_gradients_sums
+{
+    double Grad[DENSITY_FUSED_GRADIENTS_NQ][3];     /*!< sum of -W_i(r_ij) * dx_ij * q_j over the neighbors inside H_i */
+    double Wt[3];                                   /*!< sum of -W_i(r_ij) * dx_ij, so q_i can be subtracted once it is known. q_i*Wt nearly cancels Grad, so both are double even in single-precision builds */
+    MyDouble Max[DENSITY_FUSED_GRADIENTS_NQ];       /*!< extrema of q_j over all pairs, for the slope-limiter */
+    MyDouble Min[DENSITY_FUSED_GRADIENTS_NQ];
+    MyFloat MaxDistance;                            /*!< largest pair separation */
+    int ActiveNgb;                                  /*!< number of pairs whose partner is itself active */
+};
+static struct density_fused_gradients_data
+{
+    struct density_fused_gradients_sums Sums;       /*!< sums of the last pass of this element */
+    MyFloat Hsml;                                   /*!< kernel length they were summed with */
+    char Touched;                                   /*!< set by any active element which has this one inside its kernel */
+} *DensityFusedGrad;
+static int DensityFusedGradActive = 0;
+
+/*! called before density() in the hydro step, freed after the hydro loop (the neighbor-list cache, if used, is allocated and freed inside these) */
+void density_fused_gradients_allocate(void)
+{
+    DensityFusedGrad = (struct density_fused_gradients_data *) mymalloc("DensityFusedGrad", N_gas * sizeof(struct density_fused_gradients_data));
+    DensityFusedGradActive = 1;
+}
+
+void density_fused_gradients_free(void)
+{
+    myfree(DensityFusedGrad); DensityFusedGradActive = 0;
+}
+
+/*! gradient sums (before multiplication with NV_T) and extrema of q_j-q_i over the pairs of element i, from its last density() pass: returns 0 if these are not complete */
+int density_fused_gradients_get(int i, double grad[][3], double *qmax, double *qmin, double *maxdistance)
+{
+    int k, k2; double q_i[DENSITY_FUSED_GRADIENTS_NQ];
+    if(!DensityFusedGradActive || P[i].Type != 0) {return 0;}
+    struct density_fused_gradients_data *d = &DensityFusedGrad[i];
+    if(d->Touched || d->Sums.ActiveNgb > 0 || d->Hsml != PPP[i].Hsml) {return 0;}
+    gradients_fused_quantities(i, q_i);
+    for(k=0;k<DENSITY_FUSED_GRADIENTS_NQ;k++)
+    {
+        for(k2=0;k2<3;k2++) {grad[k][k2] = d->Sums.Grad[k][k2] - q_i[k] * d->Sums.Wt[k2];}
+        qmax[k] = d->Sums.Max[k] - q_i[k]; qmin[k] = d->Sums.Min[k] - q_i[k];
+    }
+    *maxdistance = d->Sums.MaxDistance;
+    return 1;
+}
+
+/*! pair-wise part of the moments (any pair with r_ij < MAX(H_i,H_j), r_ij > 0): returns 1, with the partner's values in q_j, if it enters the sums inside H_i */
+static inline int density_fused_gradients_pair(struct density_fused_gradients_sums *out, int j, double r2, double h2, double *q_j)
+{
+    int k; double h_j = PPP[j].Hsml;
+    if((r2 >= h2) && (r2 >= h_j*h_j)) {return 0;}
+    if(r2 < h2) {DensityFusedGrad[j].Touched = 1;} /* we are active: whatever j sums about us may still change */
+    if((P[j].TimeBin < 0) || TimeBinActive[P[j].TimeBin]) {out->ActiveNgb++; return 0;} /* j's density and pressure are still being computed */
+    if(!GasGrad_isactive(j)) {return 0;}
+    double r = sqrt(r2); if(r > out->MaxDistance) {out->MaxDistance = r;}
+    gradients_fused_quantities(j, q_j);
+    for(k=0;k<DENSITY_FUSED_GRADIENTS_NQ;k++) {if(q_j[k] > out->Max[k]) {out->Max[k] = q_j[k];} if(q_j[k] < out->Min[k]) {out->Min[k] = q_j[k];}}
+    return (r2 < h2);
+}
+#endif
+
 #define CORE_FUNCTION_NAME density_evaluate /* name of the 'core' function doing the actual inter-neighbor operations. this MUST be defined somewhere as "int CORE_FUNCTION_NAME(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)" */
 #define INPUTFUNCTION_NAME hydrokerneldensity_particle2in    /* name of the function which loads the element data needed (for e.g. broadcast to other processors, neighbor search) */
 #define OUTPUTFUNCTION_NAME hydrokerneldensity_out2particle  /* name of the function which takes the data returned from other processors and combines it back to the original elements */
 #define CONDITIONFUNCTION_FOR_EVALUATION if(density_isactive(i)) /* function for which elements will be 'active' and allowed to undergo operations. can be a function call, e.g. 'density_is_active(i)', or a direct function call like 'if(P[i].Mass>0)' */
+#ifdef DENSITY_HSML_MULTIRADIUS
+#define EXPORT_PLAN_SEARCH_RADIUS(i) (PPP[i].Hsml * DensityTrialHsmlFacMax) /* the walk extends out to the largest trial kernel length */
+#else
+#define EXPORT_PLAN_SEARCH_RADIUS(i) (PPP[i].Hsml) /* radius determining the exports of element i, so the export list can be re-used between iterations while Hsml stays inside it */
+#endif
+#define EXPORT_PLAN_RECORD_MARGIN(pass) ((pass) > 0 ? 1.2 : 1) /* after the first pass, record with a margin so the remaining particles can iterate Hsml without new tree-walk exports */
+#define COMPACT_EXPORT_POSITIONS /* the input structure holds the element position as 'Pos', so it can be sent in reduced form with MPI_COMPACT_EXPORTS */
 #include "../system/code_block_xchange_initialize.h" /* pre-define all the ALL_CAPS variables we will use below, so their naming conventions are consistent and they compile together, as well as defining some of the function calls needed */
 
 /*! this structure defines the variables that need to be sent -from- the 'searching' element */
@@ -157,6 +240,9 @@ static struct OUTPUT_STRUCT_NAME
     MyLongDouble DhsmlNgb;
     MyLongDouble Particle_DivVel;
     MyLongDouble NV_T[3][3];
+#ifdef DENSITY_HSML_MULTIRADIUS
+    MyFloat NgbTrial[DENSITY_HSML_NTRIAL];
+#endif
 #if defined(HYDRO_MESHLESS_FINITE_VOLUME) && ((HYDRO_FIX_MESH_MOTION==5)||(HYDRO_FIX_MESH_MOTION==6))
     MyDouble ParticleVel[3];
 #endif
@@ -194,6 +280,9 @@ static struct OUTPUT_STRUCT_NAME
     MyDouble Gas_B[3];
 #endif
 #endif
+#ifdef DENSITY_FUSED_GRADIENTS
+    struct density_fused_gradients_sums FusedGrad;
+#endif
 }
  *DATARESULT_NAME, *DATAOUT_NAME;
 
@@ -204,6 +293,9 @@ void hydrokerneldensity_out2particle(struct OUTPUT_STRUCT_NAME *out, int i, int
     ASSIGN_ADD(PPP[i].NumNgb, out->Ngb, mode);
     ASSIGN_ADD(PPP[i].DhsmlNgbFactor, out->DhsmlNgb, mode);
     ASSIGN_ADD(P[i].Particle_DivVel, out->Particle_DivVel,   mode);
+#ifdef DENSITY_HSML_MULTIRADIUS
+    for(k=0;k<DENSITY_HSML_NTRIAL;k++) {ASSIGN_ADD(NgbTrial[i*DENSITY_HSML_NTRIAL+k], out->NgbTrial[k], mode);}
+#endif
 
     if(P[i].Type == 0)
     {
@@ -237,6 +329,24 @@ void hydrokerneldensity_out2particle(struct OUTPUT_STRUCT_NAME *out, int i, int
                 ASSIGN_ADD(SphP[i].NV_A[k][j], out->NV_A[k][j], mode);
             }
 #endif
+
+#ifdef DENSITY_FUSED_GRADIENTS
+        if(DensityFusedGradActive)
+        {
+            struct density_fused_gradients_sums *d = &DensityFusedGrad[i].Sums;
+            if(mode == 0) {*d = out->FusedGrad; DensityFusedGrad[i].Hsml = PPP[i].Hsml;} else {
+                for(k=0;k<DENSITY_FUSED_GRADIENTS_NQ;k++)
+                {
+                    for(j=0;j<3;j++) {d->Grad[k][j] += out->FusedGrad.Grad[k][j];}
+                    if(out->FusedGrad.Max[k] > d->Max[k]) {d->Max[k] = out->FusedGrad.Max[k];}
+                    if(out->FusedGrad.Min[k] < d->Min[k]) {d->Min[k] = out->FusedGrad.Min[k];}
+                }
+                for(j=0;j<3;j++) {d->Wt[j] += out->FusedGrad.Wt[j];}
+                if(out->FusedGrad.MaxDistance > d->MaxDistance) {d->MaxDistance = out->FusedGrad.MaxDistance;}
+                d->ActiveNgb += out->FusedGrad.ActiveNgb;
+            }
+        }
+#endif
     } // P[i].Type == 0 //
 
 #if defined(GRAIN_FLUID)
@@ -289,19 +399,32 @@ int density_evaluate(int target, int mode, int *exportflag, int *exportnodecount
     struct kernel_density kernel; struct INPUT_STRUCT_NAME local; struct OUTPUT_STRUCT_NAME out; memset(&out, 0, sizeof(struct OUTPUT_STRUCT_NAME));
     if(mode == 0) {hydrokerneldensity_particle2in(&local, target, loop_iteration);} else {local = DATAGET_NAME[target];}
     h2 = local.Hsml * local.Hsml; kernel_hinv(local.Hsml, &kernel.hinv, &kernel.hinv3, &kernel.hinv4);
+#ifdef DENSITY_HSML_MULTIRADIUS
+    int k_trial; double hsml_search = local.Hsml * DensityTrialHsmlFacMax, h2_search = hsml_search * hsml_search, hinv_trial[DENSITY_HSML_NTRIAL];
+    for(k_trial=0;k_trial<DENSITY_HSML_NTRIAL;k_trial++) {hinv_trial[k_trial] = 1. / (local.Hsml * density_trial_hsml_factor(k_trial));}
+#else
+    double hsml_search = local.Hsml;
+#endif
 #if defined(BLACK_HOLES)
     out.BH_TimeBinGasNeighbor = TIMEBINS;
 #ifdef BH_ACCRETE_NEARESTFIRST
     out.BH_dr_to_NearestGasNeighbor = MAX_REAL_NUMBER;
 #endif
+#endif
+#ifdef DENSITY_FUSED_GRADIENTS
+    int k_fg, fused_grad = (local.Type == 0) && DensityFusedGradActive; double q_j[DENSITY_FUSED_GRADIENTS_NQ];
+    for(k_fg=0;k_fg<DENSITY_FUSED_GRADIENTS_NQ;k_fg++) {out.FusedGrad.Max[k_fg] = -MAX_REAL_NUMBER; out.FusedGrad.Min[k_fg] = MAX_REAL_NUMBER;}
 #endif
     if(mode == 0) {startnode = All.MaxPart; /* root node */} else {startnode = DATAGET_NAME[target].NodeList[0]; startnode = Nodes[startnode].u.d.nextnode;    /* open it */}
     while(startnode >= 0) {
         while(startnode >= 0) {
 #ifdef ADM
-	    numngb_inbox = ngb_treefind_variable_threads_adm(local.Pos, local.adm, local.Hsml, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
+	    numngb_inbox = ngb_treefind_variable_threads_adm(local.Pos, local.adm, hsml_search, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
 #else
-            numngb_inbox = ngb_treefind_variable_threads(local.Pos, local.Hsml, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
+#ifdef DENSITY_FUSED_GRADIENTS
+            if(fused_grad) {numngb_inbox = ngb_treefind_pairs_threads(local.Pos, hsml_search, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);} else /* also need the elements which only see us */
+#endif
+            numngb_inbox = ngb_treefind_variable_threads(local.Pos, hsml_search, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
 #endif
             if(numngb_inbox < 0) {return -2;}
             for(n = 0; n < numngb_inbox; n++)
@@ -316,6 +439,16 @@ int density_evaluate(int target, int mode, int *exportflag, int *exportnodecount
                 kernel.dp[2] = local.Pos[2] - P[j].Pos[2];
                 NEAREST_XYZ(kernel.dp[0],kernel.dp[1],kernel.dp[2],1);
                 r2 = kernel.dp[0] * kernel.dp[0] + kernel.dp[1] * kernel.dp[1] + kernel.dp[2] * kernel.dp[2];
+#ifdef DENSITY_HSML_MULTIRADIUS
+                if(r2 < h2_search) /* dimensionless kernel weights at each trial length, so the neighbor number as a function of Hsml is known from this one walk */
+                {
+                    double r_trial = sqrt(r2), wk_trial, dwk_trial;
+                    for(k_trial=0;k_trial<DENSITY_HSML_NTRIAL;k_trial++) {u = r_trial * hinv_trial[k_trial]; if(u < 1) {kernel_main(u, 1, 1, &wk_trial, &dwk_trial, -1); out.NgbTrial[k_trial] += wk_trial;}}
+                }
+#endif
+#ifdef DENSITY_FUSED_GRADIENTS
+                int fused_j = 0; if(fused_grad && (r2 > 0)) {fused_j = density_fused_gradients_pair(&out.FusedGrad, j, r2, h2, q_j);}
+#endif
                 if(r2 < h2) /* this loop is only considering particles inside local.Hsml, i.e. seen-by-main */
                 {
                     kernel.r = sqrt(r2);
@@ -364,6 +497,9 @@ int density_evaluate(int target, int mode, int *exportflag, int *exportnodecount
                             out.NV_T[1][0] += wk * kernel.dp[0];
                             out.NV_T[2][0] += wk * kernel.dp[1];
                             out.NV_T[2][1] += wk * kernel.dp[2];
+#ifdef DENSITY_FUSED_GRADIENTS
+                            if(fused_j) {int k_xyz; for(k_xyz=0;k_xyz<3;k_xyz++) {double wk_xyz = -wk * kernel.dp[k_xyz]; out.FusedGrad.Wt[k_xyz] += wk_xyz; for(k_fg=0;k_fg<DENSITY_FUSED_GRADIENTS_NQ;k_fg++) {out.FusedGrad.Grad[k_fg][k_xyz] += wk_xyz * q_j[k_fg];}}}
+#endif
                         }
                         kernel.dv[0] = local.Vel[0] - SphP[j].VelPred[0];
                         kernel.dv[1] = local.Vel[1] - SphP[j].VelPred[1];
@@ -485,6 +621,40 @@ void density_evaluate_extra_physics_gas(struct INPUT_STRUCT_NAME *local, struct
 
 
 
+#ifdef DENSITY_HSML_MULTIRADIUS
+/*! for an element which needs to be re-done, use the neighbor numbers summed at the trial kernel lengths in the last pass: if two of them bracket the
+    desired number, jump straight to the log-log interpolation between them (returns 1; the next pass is then usually just the confirming one). otherwise
+    move the element to the closest trial length, so the usual bracketing iteration continues from there with the best information we have (returns 0) */
+int density_multiradius_hsml_solve(int i, double desnumngb, double desnumngbdev, MyFloat *Left, MyFloat *Right)
+{
+    int k, k_use; double h[DENSITY_HSML_NTRIAL], ngb[DENSITY_HSML_NTRIAL];
+    for(k=0;k<DENSITY_HSML_NTRIAL;k++)
+    {
+        h[k] = PPP[i].Hsml * density_trial_hsml_factor(k); ngb[k] = NORM_COEFF * NgbTrial[i*DENSITY_HSML_NTRIAL+k];
+        if(ngb[k] < desnumngb - desnumngbdev) {Left[i] = DMAX(Left[i], h[k]);} /* narrow the brackets with every trial length, as if each had been its own pass */
+        if(ngb[k] > desnumngb + desnumngbdev) {if((Right[i] == 0) || (h[k] < Right[i])) {Right[i] = h[k];}}
+    }
+    for(k=0;k<DENSITY_HSML_NTRIAL-1;k++)
+    {
+        if((ngb[k] <= desnumngb) && (ngb[k+1] >= desnumngb) && (ngb[k+1] > ngb[k]))
+        {
+            double x; if(ngb[k] > 0) {x = log(desnumngb/ngb[k]) / log(ngb[k+1]/ngb[k]);} else {x = (desnumngb-ngb[k]) / (ngb[k+1]-ngb[k]);}
+            PPP[i].Hsml = h[k] * exp(x * log(h[k+1]/h[k]));
+            return 1;
+        }
+    }
+    if(ngb[DENSITY_HSML_NTRIAL-1] < desnumngb) {k_use = DENSITY_HSML_NTRIAL-1;} else {k_use = 0;} /* solution lies outside the trial lengths: this is a true outlier */
+    if(h[k_use] != PPP[i].Hsml)
+    {
+        int k_nb = (k_use > 0) ? k_use-1 : 1; /* neighboring trial length, for the local slope d(ln N)/d(ln H) used by the extrapolation */
+        PPP[i].Hsml = h[k_use]; PPP[i].NumNgb = ngb[k_use];
+        if((ngb[k_use] > 0) && (ngb[k_nb] > 0) && (ngb[k_use] != ngb[k_nb])) {PPP[i].DhsmlNgbFactor = NUMDIMS * log(h[k_use]/h[k_nb]) / log(ngb[k_use]/ngb[k_nb]);}
+    }
+    return 0;
+}
+#endif
+
+
 /*! This function computes the local neighbor kernel for each active hydro element, the number of neighbours in the current kernel radius, and the divergence
  * and rotation of the velocity field.  This is used then to compute the effective volume of the element in MFM/MFV/SPH-type methods, which is then used to
  * update volumetric quantities like density and pressure. The routine iterates to attempt to find a target kernel size set adaptively -- see code user guide for details
@@ -492,10 +662,13 @@ void density_evaluate_extra_physics_gas(struct INPUT_STRUCT_NAME *local, struct
 void density(void)
 {
     /* initialize variables used below, in particlar the structures we need to call throughout the iteration */
-    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second(); MyFloat *Left, *Right; double fac, fac_lim, desnumngb, desnumngbdev; long long ntot;
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC); double t00_truestart = my_second(); MyFloat *Left, *Right; double fac, fac_lim, desnumngb, desnumngbdev; long long ntot;
     int i, npleft, iter=0, redo_particle, particle_set_to_minhsml_flag = 0, particle_set_to_maxhsml_flag = 0;
     Left = (MyFloat *) mymalloc("Left", NumPart * sizeof(MyFloat));
     Right = (MyFloat *) mymalloc("Right", NumPart * sizeof(MyFloat));
+#ifdef DENSITY_HSML_MULTIRADIUS
+    NgbTrial = (MyFloat *) mymalloc("NgbTrial", NumPart * DENSITY_HSML_NTRIAL * sizeof(MyFloat));
+#endif
     
 #ifdef DO_DENSITY_AROUND_STAR_PARTICLES /* define a variable for below to know which stellar types qualify here */
     int valid_stellar_types = 2+4+8+16, invalid_stellar_types = 1+32; // allow types 1,2,3,4 here //
@@ -511,7 +684,10 @@ void density(void)
 #endif
     
     /* initialize anything we need to about the active particles before their loop */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {
+    FOR_ACTIVE_PARTICLES(i) {
+#ifdef DENSITY_FUSED_GRADIENTS
+        if(DensityFusedGradActive && P[i].Type == 0) {DensityFusedGrad[i].Touched = 0; DensityFusedGrad[i].Hsml = -1;} /* invalid until a pass records its sums */
+#endif
         if(density_isactive(i)) {
             Left[i] = Right[i] = 0;
 #ifdef BLACK_HOLES
@@ -543,11 +719,15 @@ void density(void)
     /* we will repeat the whole thing for those particles where we didn't find enough neighbours */
     do
     {
+#ifdef DENSITY_HSML_MULTIRADIUS
+        /* the first pass only sums at trial lengths inside Hsml (no larger walk for the majority which converge right away); later passes bracket Hsml on both sides */
+        DensityTrialHsmlFacMin = 1./DENSITY_HSML_TRIAL_SPAN; if(iter > 0) {DensityTrialHsmlFacMax = DENSITY_HSML_TRIAL_SPAN;} else {DensityTrialHsmlFacMax = 1;}
+#endif
         #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
 
         /* do check on whether we have enough neighbors, and iterate for density-hsml solution */
         double tstart = my_second(), tend;
-        for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
+        npleft = 0; FOR_ACTIVE_PARTICLES(i)
         {
             if(density_isactive(i))
             {
@@ -782,7 +962,11 @@ void density(void)
                             continue;
                         }
 
-                    if((particle_set_to_maxhsml_flag==0)&&(particle_set_to_minhsml_flag==0))
+                    if((particle_set_to_maxhsml_flag==0)&&(particle_set_to_minhsml_flag==0)
+#ifdef DENSITY_HSML_MULTIRADIUS
+                       && (density_multiradius_hsml_solve(i, desnumngb, desnumngbdev, Left, Right) == 0) /* only fall through to the iteration below if the trial lengths of this pass did not bracket the solution */
+#endif
+                       )
                     {
                         if(PPP[i].NumNgb < (desnumngb - desnumngbdev)) {Left[i] = DMAX(PPP[i].Hsml, Left[i]);}
                         else
@@ -890,7 +1074,7 @@ void density(void)
                 }
                 else {P[i].TimeBin = -P[i].TimeBin - 1;}	/* Mark as inactive */
             } //  if(density_isactive(i))
-        } // for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
+        } // npleft = 0; FOR_ACTIVE_PARTICLES(i)
 
         tend = my_second();
         timecomp += timediff(tstart, tend);
@@ -906,10 +1090,13 @@ void density(void)
 
     /* iteration is done - de-malloc everything now */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
+#ifdef DENSITY_HSML_MULTIRADIUS
+    myfree(NgbTrial);
+#endif
     myfree(Right); myfree(Left);
 
     /* mark as active again */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].TimeBin < 0) {P[i].TimeBin = -P[i].TimeBin - 1;}
     }
@@ -920,7 +1107,7 @@ void density(void)
      won't save much b/c the real cost is in the neighbor loop for each particle, but it's something )
      -- also, some results (for example, viscosity suppression below) should not be calculated unless
      the quantities are 'stabilized' at their final values -- */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(density_isactive(i))
         {
@@ -1085,11 +1272,11 @@ void density(void)
             if(PPP[i].NumNgb > 0) {PPP[i].NumNgb=pow(PPP[i].NumNgb,1./NUMDIMS);} else {PPP[i].NumNgb=0;}
 
         } // density_isactive(i)
-    } // for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    } // FOR_ACTIVE_PARTICLES(i)
 
 
     /* collect some timing information */
-    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
+    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1); phase_interval_close(CPU_DENSCOMPUTE);
     CPU_Step[CPU_DENSCOMPUTE] += timecomp; CPU_Step[CPU_DENSWAIT] += timewait;
     CPU_Step[CPU_DENSCOMM] += timecomm; CPU_Step[CPU_DENSMISC] += timeall - (timecomp + timewait + timecomm);
 }
@@ -1174,7 +1361,7 @@ int cellcorrections_evaluate(int target, int mode, int *exportflag, int *exportn
 /* final operations for after the updates are computed */
 void cellcorrections_final_operations_and_cleanup(void)
 {
-    int i; for(i=FirstActiveParticle; i>=0; i=NextActiveParticle[i]) { /* check all active elements */
+    int i; FOR_ACTIVE_PARTICLES(i) { /* check all active elements */
         CONDITIONFUNCTION_FOR_EVALUATION /* ensures only the ones which met our criteria above are actually treated here */
         {
             if(SphP[i].Volume_1 > 0) {SphP[i].Density = P[i].Mass / SphP[i].Volume_1;} else {SphP[i].Volume_1 = SphP[i].Volume_0;} // set the updated density. other variables that need volumes will all scale off this, so we can rely on it to inform everything else [if bad value here, revert to the 0th-order volume quadrature]
@@ -1185,13 +1372,13 @@ void cellcorrections_final_operations_and_cleanup(void)
 /* parent routine which calls the work loop above */
 void cellcorrections_calc(void)
 {
-    CPU_Step[CPU_DENSMISC] += measure_time(); double t00_truestart = my_second();
+    CPU_Step[CPU_DENSMISC] += measure_time_phase(CPU_DENSMISC); double t00_truestart = my_second();
     PRINT_STATUS(" ..calculating first-order corrections to cell sizes/faces");
     #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
     cellcorrections_final_operations_and_cleanup(); /* do final operations on results */
-    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
+    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1); phase_interval_close(CPU_DENSCOMPUTE);
     CPU_Step[CPU_DENSCOMPUTE] += timecomp; CPU_Step[CPU_DENSWAIT] += timewait; CPU_Step[CPU_DENSCOMM] += timecomm;
     CPU_Step[CPU_DENSMISC] += timeall - (timecomp + timewait + timecomm); /* collect timings and reset clock for next timing */
 }
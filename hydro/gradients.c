@@ -240,6 +240,9 @@ static struct temporary_data_topass
 #ifdef TURB_DIFF_DYNAMIC
     MyDouble GradVelocity_bar[3][3];
 #endif
+#ifdef DENSITY_FUSED_GRADIENTS
+    char Fused; /* gradient sums and limiter extrema already came out of density(): skip this element in the loop below */
+#endif
 }
 *GasGradDataPasser;
 
@@ -555,6 +558,68 @@ void local_slopelimiter(double *grad, double valmax, double valmin, double alim,
 }
 
 
+#ifdef DENSITY_FUSED_GRADIENTS
+/*! values of the (scalar) fields whose gradients are summed in density(), in a fixed order: this must match the GQuant values loaded above */
+void gradients_fused_quantities(int i, double *q)
+{
+    int k, n = 0;
+    q[n++] = SphP[i].Density;
+    q[n++] = SphP[i].Pressure;
+    for(k=0;k<3;k++) {q[n++] = SphP[i].VelPred[k];}
+#ifdef DOGRAD_INTERNAL_ENERGY
+    q[n++] = SphP[i].InternalEnergyPred;
+#endif
+#ifdef DOGRAD_SOUNDSPEED
+    q[n++] = Get_Gas_effective_soundspeed_i(i);
+#endif
+#if defined(TURB_DIFF_METALS) && !defined(TURB_DIFF_METALS_LOWORDER)
+    for(k=0;k<NUM_METAL_SPECIES;k++) {q[n++] = P[i].Metallicity[k];}
+#endif
+}
+
+/*! load the gradient sums and slope-limiter extrema of element i from density(), if they are complete there (see density.c): returns 1 if so, and the element can skip the loop */
+static int GasGrad_load_fused(int i)
+{
+    int k, k2, n; double grad[DENSITY_FUSED_GRADIENTS_NQ][3], qmax[DENSITY_FUSED_GRADIENTS_NQ], qmin[DENSITY_FUSED_GRADIENTS_NQ], maxdistance;
+    if(!GasGrad_isactive(i) || SHOULD_I_USE_SPH_GRADIENTS(SphP[i].ConditionNumber)) {return 0;} /* the sph-like weights are not summed in density() */
+    if(!density_fused_gradients_get(i, grad, qmax, qmin, &maxdistance)) {return 0;}
+    struct temporary_data_topass *d = &GasGradDataPasser[i];
+    for(k=0;k<3;k++)
+    {
+        n = 0;
+        SphP[i].Gradients.Density[k] = grad[n++][k];
+        SphP[i].Gradients.Pressure[k] = grad[n++][k];
+        for(k2=0;k2<3;k2++) {SphP[i].Gradients.Velocity[k2][k] = grad[n++][k];}
+#ifdef DOGRAD_INTERNAL_ENERGY
+        SphP[i].Gradients.InternalEnergy[k] = grad[n++][k];
+#endif
+#ifdef DOGRAD_SOUNDSPEED
+        SphP[i].Gradients.SoundSpeed[k] = grad[n++][k];
+#endif
+#if defined(TURB_DIFF_METALS) && !defined(TURB_DIFF_METALS_LOWORDER)
+        for(k2=0;k2<NUM_METAL_SPECIES;k2++) {SphP[i].Gradients.Metallicity[k2][k] = grad[n++][k];}
+#endif
+    }
+    for(k=0;k<DENSITY_FUSED_GRADIENTS_NQ;k++) {qmax[k] = DMAX(0, qmax[k]); qmin[k] = DMIN(0, qmin[k]);} /* the loop starts its extrema from zero */
+    n = 0;
+    d->Maxima.Density = qmax[n]; d->Minima.Density = qmin[n++];
+    d->Maxima.Pressure = qmax[n]; d->Minima.Pressure = qmin[n++];
+    for(k=0;k<3;k++) {d->Maxima.Velocity[k] = qmax[n]; d->Minima.Velocity[k] = qmin[n++];}
+#ifdef DOGRAD_INTERNAL_ENERGY
+    d->Maxima.InternalEnergy = qmax[n]; d->Minima.InternalEnergy = qmin[n++];
+#endif
+#ifdef DOGRAD_SOUNDSPEED
+    d->Maxima.SoundSpeed = qmax[n]; d->Minima.SoundSpeed = qmin[n++];
+#endif
+#if defined(TURB_DIFF_METALS) && !defined(TURB_DIFF_METALS_LOWORDER)
+    for(k=0;k<NUM_METAL_SPECIES;k++) {d->Maxima.Metallicity[k] = qmax[n]; d->Minima.Metallicity[k] = qmin[n++];}
+#endif
+    d->MaxDistance = maxdistance; d->Fused = 1;
+    return 1;
+}
+#endif
+
+
 void construct_gradient(double *grad, int i)
 {
     /* check if the matrix is well-conditioned: otherwise we will use the 'standard SPH-like' derivative estimation */
@@ -575,7 +640,7 @@ void construct_gradient(double *grad, int i)
 
 void hydro_gradient_calc(void)
 {
-    CPU_Step[CPU_DENSMISC] += measure_time(); double t0 = my_second();
+    CPU_Step[CPU_DENSMISC] += measure_time_phase(CPU_DENSMISC); double t0 = my_second();
     int i, j, k, k1, ndone, ndone_flag, recvTask, place, save_NextParticle;
     double timeall = 0, timecomp1 = 0, timecomp2 = 0, timecommsumm1 = 0, timecommsumm2 = 0, timewait1 = 0, timewait2 = 0;
     double timecomp, timecomm, timewait, tstart, tend, t1;
@@ -597,9 +662,12 @@ void hydro_gradient_calc(void)
     Ngblist = (int *) mymalloc("Ngblist", NTaskTimesNumPart * sizeof(int));
     DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
     DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
+#ifdef MPI_REUSE_EXPORT_PLANS /* the passes below search the same elements with the same (or, for TURB_DIFF_DYNAMIC, smaller) radii: if the first one fits in a single round, its export list is re-used */
+    int *ExportPlanCount = (int *) mymalloc("ExportPlanCount", 2 * NTask * sizeof(int)); long ExportPlanNexport = 0; int export_plan_valid = 0;
+#endif
 
     /* before doing any operations, need to zero the appropriate memory so we can correctly do pair-wise operations */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
         if(P[i].Type==0)
         {
             int k2;
@@ -655,6 +723,9 @@ void hydro_gradient_calc(void)
                 for(k2=0;k2<N_RT_FREQ_BINS;k2++) {SphP[i].Gradients.Rad_E_gamma_ET[k2][k] = 0;}
 #endif
             }
+#ifdef DENSITY_FUSED_GRADIENTS
+            GasGrad_load_fused(i);
+#endif
         }
 
 
@@ -664,7 +735,7 @@ void hydro_gradient_calc(void)
     for(gradient_iteration = 0; gradient_iteration < NUMBER_OF_GRADIENT_ITERATIONS; gradient_iteration++)
     {
         // need to zero things used in the iteration (anything appearing in out2particle_GasGrad_iter)
-        for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+        FOR_ACTIVE_PARTICLES(i)
             if(P[i].Type==0)
             {
 #ifdef MHD_CONSTRAINED_GRADIENT
@@ -676,11 +747,27 @@ void hydro_gradient_calc(void)
             }
 
         // now we actually begin the main gradient loop //
-        NextParticle = FirstActiveParticle;	/* begin with this index */
+        PrimaryLoopList = (int *) mymalloc("PrimaryLoopList", (NumActiveParticle + 1) * sizeof(int)); /* active list minus the elements already done, so threads can claim chunks of it */
+        k = 0; FOR_ACTIVE_PARTICLES(j)
+        {
+#ifdef DENSITY_FUSED_GRADIENTS
+            if(P[j].Type == 0) {if(GasGradDataPasser[j].Fused) {continue;}}
+#endif
+            PrimaryLoopList[k++] = j;
+        }
+        PrimaryLoopListLength = k;
+        for(k = 0; k < PrimaryLoopListLength; k++) {ProcessedFlag[PrimaryLoopList[k]] = 0;} /* nothing committed yet (see primary_loop_commit_finished) */
+        NextParticle = 0;	/* begin with this position in the list */
+#ifdef MPI_REUSE_EXPORT_PLANS
+        int export_plan_replay = export_plan_valid, export_plan_rounds = 0;
+#endif
         do
         {
             BufferFullFlag = 0; Nexport = 0; save_NextParticle = NextParticle; tstart = my_second();
             for(j = 0; j < NTask; j++) {Send_count[j] = 0; Exportflag[j] = -1;} /* do local particles and prepare export list */
+#ifdef MPI_REUSE_EXPORT_PLANS
+            ExportPlanReplay = export_plan_replay;
+#endif
 #ifdef PTHREADS_NUM_THREADS
             pthread_t mythreads[PTHREADS_NUM_THREADS - 1]; int threadid[PTHREADS_NUM_THREADS - 1]; pthread_attr_t attr;
             pthread_attr_init(&attr); pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
@@ -702,44 +789,30 @@ void hydro_gradient_calc(void)
             for(j = 0; j < PTHREADS_NUM_THREADS - 1; j++) {pthread_join(mythreads[j], NULL);}
 #endif
             tend = my_second(); timecomp1 += timediff(tstart, tend);
+#ifdef MPI_REUSE_EXPORT_PLANS
+            ExportPlanReplay = 0; if(export_plan_replay) {Nexport = ExportPlanNexport;} /* nothing was exported by the walk: the stored (sorted) entries are still in DataIndexTable */
+#endif
 
             if(BufferFullFlag) /* we've filled the buffer or reached the end of the list, prepare for communications */
             {
-                int last_nextparticle = NextParticle; NextParticle = save_NextParticle; /* figure out where we are */
-                while(NextParticle >= 0)
-                {
-                    if(NextParticle == last_nextparticle) {break;}
-                    if(ProcessedFlag[NextParticle] != 1) {break;}
-                    ProcessedFlag[NextParticle] = 2; NextParticle = NextActiveParticle[NextParticle];
-                }
-                if(NextParticle == save_NextParticle) {endrun(113308);} /* in this case, the buffer is too small to process even a single particle */
-
-                int new_export = 0; /* actually calculate exports [so we can tell other tasks] */
-                for(j = 0, k = 0; j < Nexport; j++)
-                {
-                    if(ProcessedFlag[DataIndexTable[j].Index] != 2)
-                    {
-                        if(k < j + 1) {k = j + 1;}
-                        for(; k < Nexport; k++)
-                            if(ProcessedFlag[DataIndexTable[k].Index] == 2)
-                            {
-                                int old_index = DataIndexTable[j].Index;
-                                DataIndexTable[j] = DataIndexTable[k]; DataNodeList[j] = DataNodeList[k]; DataIndexTable[j].IndexGet = j; new_export++;
-                                DataIndexTable[k].Index = old_index; k++;
-                                break;
-                            }
-                    }
-                    else {new_export++;}
-                }
-                Nexport = new_export; /* counting exports... */
+                if(primary_loop_commit_finished(save_NextParticle) == 0) {endrun(113308);} /* in this case, the buffer is too small to process even a single particle */
             }
+#ifdef MPI_REUSE_EXPORT_PLANS
+            if(export_plan_replay) /* identical element set and radii, so the counts are those of the stored plan */
+            {
+                for(j = 0; j < NTask; j++) {Send_count[j] = 0; Recv_count[j] = ExportPlanCount[NTask + j];}
+                for(j = 0; j < Nexport; j++) {Send_count[DataIndexTable[j].Task]++;}
+                n_exported += Nexport;
+            } else {
+#endif
+            Nexport = export_blocks_merge(BufferFullFlag); /* collect the per-thread export blocks (dropping unfinished elements if the buffer filled), grouped by task, and count the exports */
             n_exported += Nexport;
-            for(j = 0; j < NTask; j++) {Send_count[j] = 0;}
-            for(j = 0; j < Nexport; j++) {Send_count[DataIndexTable[j].Task]++;}
-            MYSORT_DATAINDEX(DataIndexTable, Nexport, sizeof(struct data_index), data_index_compare); /* construct export count tables */
             tstart = my_second();
-            MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD); /* broadcast import/export counts */
+            mpi_sparse_alltoall_counts(Send_count, Recv_count); /* broadcast import/export counts */
             tend = my_second(); timewait1 += timediff(tstart, tend);
+#ifdef MPI_REUSE_EXPORT_PLANS
+            }
+#endif
 
             for(j = 0, Send_offset[0] = 0; j < NTask; j++) {if(j > 0) {Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];}} /* calculate export table offsets */
             GasGradDataIn = (struct GasGraddata_in *) mymalloc("GasGradDataIn", Nexport * sizeof(struct GasGraddata_in)); /* allocate memory for exports */
@@ -878,17 +951,22 @@ void hydro_gradient_calc(void)
             if(gradient_iteration==0) {myfree(GasGradDataOut);} else {myfree(GasGradDataOut_iter);} /* free the structures used to receive results, weve used it */
             myfree(GasGradDataIn); /* free the structures used to prepare our initial export data, we're done here! */
 
-            if(NextParticle < 0) {ndone_flag = 1;} else {ndone_flag = 0;} /* figure out if we are done with the particular active set here */
+            if(NextParticle >= PrimaryLoopListLength) {ndone_flag = 1;} else {ndone_flag = 0;} /* figure out if we are done with the particular active set here */
             tstart = my_second();
             MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD); /* call an allreduce to figure out if all tasks are also done here, otherwise we need to iterate */
             tend = my_second(); timewait2 += timediff(tstart, tend);
+#ifdef MPI_REUSE_EXPORT_PLANS
+            if(!export_plan_replay && ++export_plan_rounds == 1 && ndone >= NTask) /* pass completed in a single round on all tasks: store its export list as the plan */
+                {ExportPlanNexport = Nexport; export_plan_valid = 1; for(j = 0; j < NTask; j++) {ExportPlanCount[j] = Send_count[j]; ExportPlanCount[NTask + j] = Recv_count[j];}}
+#endif
         }
         while(ndone < NTask);
+        myfree(PrimaryLoopList);
 
 
         /* here, we insert intermediate operations on the results, from the iterations we have completed */
 #ifdef MHD_CONSTRAINED_GRADIENT
-        for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+        FOR_ACTIVE_PARTICLES(i)
             if(P[i].Type == 0)
             {
                 SphP[i].FlagForConstrainedGradients = 1;
@@ -1019,13 +1097,16 @@ void hydro_gradient_calc(void)
 #endif
     } // closes gradient_iteration
 
+#ifdef MPI_REUSE_EXPORT_PLANS
+    myfree(ExportPlanCount);
+#endif
     myfree(DataNodeList);
     myfree(DataIndexTable);
     myfree(Ngblist);
 
 
     /* do final operations on results: these are operations that can be done after the complete set of iterations */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
         if(P[i].Type == 0)
         {
             /* now we can properly calculate (second-order accurate) gradients of hydrodynamic quantities from this loop */
@@ -1690,7 +1771,7 @@ void hydro_gradient_calc(void)
     myfree(GasGradDataPasser);
 
     /* collect some timing information */
-    t1 = WallclockTime = my_second();
+    t1 = WallclockTime = my_second(); phase_interval_close(CPU_DENSCOMPUTE);
     timeall = timediff(t0, t1);
     timecomp = timecomp1 + timecomp2;
     timewait = timewait1 + timewait2;
@@ -1703,6 +1784,43 @@ void hydro_gradient_calc(void)
 }
 
 
+#ifdef HYDRO_FACE_CACHE
+#if (SLOPE_LIMITER_TOLERANCE==0)
+#define HYDRO_FACE_AREA_LIMITER // as set in hydro_core_meshless.h, so the faces below are the ones the hydro loop would construct //
+#endif
+#if (SLOPE_LIMITER_TOLERANCE != 2) && !((defined(HYDRO_FACE_AREA_LIMITER) || !defined(PROTECT_FROZEN_FIRE)) && (HYDRO_FIX_MESH_MOTION >= 5))
+#if !defined(COOLING) && (SLOPE_LIMITER_TOLERANCE != 0)
+#define GASGRAD_FACE_USES_PARTICLE_SIZE // centered face weights for large volume ratios //
+#endif
+#elif defined(GALSF) || ((defined(HYDRO_FACE_AREA_LIMITER) || !defined(PROTECT_FROZEN_FIRE)) && (HYDRO_FIX_MESH_MOTION >= 5))
+#define GASGRAD_FACE_USES_PARTICLE_SIZE // centered face weights (GALSF) or the geometric face-area limit //
+#endif
+/*! the face of the pair (i,j) and the kernel values, exactly as the hydro loop computes them from i's side (including its single-precision copies of the
+    element-i values), stored in the face cache for hydro_force(). kernel.wk_i and kernel.dwk_i must already be set (with kernel mode 0) */
+static inline void GasGrad_face_cache_store(int i, int j, struct kernel_GasGrad kernel, double r2, double h_j, struct ngb_face_cache_entry *face)
+{
+    int k; struct {MyFloat Hsml; MyLongDouble NV_T[3][3];} local; /* the fields of the hydro-loop element read by the face construction */
+    local.Hsml = PPP[i].Hsml; for(k=0;k<9;k++) {local.NV_T[k/3][k%3] = SphP[i].NV_T[k/3][k%3];}
+    MyFloat mass_i = P[i].Mass, rho_i = SphP[i].Density, cnum_i = SphP[i].ConditionNumber;
+    double V_i = mass_i / rho_i, V_j = P[j].Mass / SphP[j].Density, Face_Area_Vec[3], Face_Area_Norm;
+#ifdef GASGRAD_FACE_USES_PARTICLE_SIZE /* only these branches of compute_finitevol_faces.h read them */
+    double Particle_Size_i, Particle_Size_j; Particle_Size_i = pow(V_i,1./NUMDIMS) * All.cf_atime; Particle_Size_j = Get_Particle_Size(j) * All.cf_atime; /* physical */
+#endif
+    double cnumcrit2 = ((double)CONDITION_NUMBER_DANGER)*((double)CONDITION_NUMBER_DANGER) - cnum_i*cnum_i;
+    if(kernel.r < h_j)
+    {
+        double hinv_j, hinv3_j, hinv4_j; kernel_hinv(h_j, &hinv_j, &hinv3_j, &hinv4_j);
+        kernel_main(kernel.r * hinv_j, hinv3_j, hinv4_j, &kernel.wk_j, &kernel.dwk_j, 0);
+    } else {kernel.wk_j = kernel.dwk_j = 0;}
+
+#include "compute_finitevol_faces.h" /* insert code block for computing Face_Area_Vec, Face_Area_Norm, etc. */
+
+    for(k=0;k<3;k++) {face->Face_Area_Vec[k] = Face_Area_Vec[k];}
+    face->Face_Area_Norm = Face_Area_Norm; face->wk_i = kernel.wk_i; face->dwk_i = kernel.dwk_i; face->wk_j = kernel.wk_j; face->dwk_j = kernel.dwk_j; face->Filled = 1;
+}
+#endif
+
+
 /* this is the main work routine for the gradients calculations */
 /*!   -- this subroutine ONLY should write to shared memory when the local pairwise 'swap_to_j' flag is set. that flag should never be active in OPENMP runs, by the definitions below, for thread safety.
     comparing this to multithreaded code using thread locks or atomic for safety shows the latter provides no performance gain and often a loss, so this is better for safety and speed. if you
@@ -1746,6 +1864,9 @@ int GasGrad_evaluate(int target, int mode, int *exportflag, int *exportnodecount
     V_i = local.Mass / local.GQuant.Density;
 
     int kernel_mode_i = -1; // only need to calculate wk, by default
+#ifdef HYDRO_FACE_CACHE
+    struct ngb_face_cache_entry *face_cache = NULL;
+#endif
     if(sph_gradients_flag_i) kernel_mode_i = 0; // for sph, only need dwk
 #if defined(HYDRO_SPH) || defined(KERNEL_CRK_FACES)
     kernel_mode_i = 0; // for some circumstances, we require both wk and dwk //
@@ -1781,6 +1902,11 @@ int GasGrad_evaluate(int target, int mode, int *exportflag, int *exportnodecount
             {
 #ifdef ADM
 		numngb = ngb_treefind_pairs_threads_adm(local.Pos, local.adm, kernel.h_i, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
+#elif defined(HYDRO_NGB_LIST_CACHE)
+                numngb = ngb_treefind_pairs_threads_cached(local.Pos, kernel.h_i, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
+#ifdef HYDRO_FACE_CACHE
+                if(gradient_iteration == 0 && numngb >= 0) {face_cache = ngb_face_cache_entries(target, mode, numngb, 1); if(face_cache) {kernel_mode_i = 0;}} /* the hydro loop needs dwk as well */
+#endif
 #else
                 numngb = ngb_treefind_pairs_threads(local.Pos, kernel.h_i, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
 #endif
@@ -1872,6 +1998,9 @@ int GasGrad_evaluate(int target, int mode, int *exportflag, int *exportnodecount
                     kernel.dwk_j = kernel.wk_j = 0;
                 }
                 double Particle_Size_j, Particle_Size_i;  Particle_Size_j=Get_Particle_Size(j); Particle_Size_i=pow(local.Mass/local.GQuant.Density, 1./NUMDIMS);
+#ifdef HYDRO_FACE_CACHE
+                if(face_cache) {if((P[j].Mass > 0) && (SphP[j].Density > 0)) {GasGrad_face_cache_store(target, j, kernel, r2, h_j, &face_cache[n]);}}
+#endif
 
 #if defined(MHD_CONSTRAINED_GRADIENT)
                 double V_j = P[j].Mass / SphP[j].Density, Face_Area_Vec[3], Face_Area_Norm, cnumcrit2 = ((double)CONDITION_NUMBER_DANGER)*((double)CONDITION_NUMBER_DANGER) - local.ConditionNumber*local.ConditionNumber;
@@ -17,11 +17,23 @@
 //#endif
     
     double s_star_ij,s_i,s_j,v_frame[3],dummy_pressure,distance_from_i[3],distance_from_j[3],leak_vs_tol=0;
+    double Pressure_i, Pressure_j, n_unit[3], vdotr2_phys=0, press_tot_limiter=0;
+#ifdef HYDRO_RIEMANN_BATCH
+    struct hydro_face_context *face_ctx = &face_block.face[n_face++]; /* face slot of this pair in the current block of neighbors (see hydro_evaluate.h) */
+    if(face_pass == 1)
+    {
+        /* second pass: everything up to the Riemann problem was done and saved in the first pass, just restore it */
+        Face_Area_Norm = face_ctx->Face_Area_Norm; V_j = face_ctx->V_j; face_vel_i = face_ctx->face_vel_i; face_vel_j = face_ctx->face_vel_j; face_area_dot_vel = face_ctx->face_area_dot_vel;
+        dummy_pressure = face_ctx->dummy_pressure; leak_vs_tol = face_ctx->leak_vs_tol; Pressure_i = face_ctx->Pressure_i; Pressure_j = face_ctx->Pressure_j;
+        vdotr2_phys = face_ctx->vdotr2_phys; press_tot_limiter = face_ctx->press_tot_limiter;
+        for(k=0;k<3;k++) {Face_Area_Vec[k] = face_ctx->Face_Area_Vec[k]; n_unit[k] = face_ctx->n_unit[k]; v_frame[k] = face_ctx->v_frame[k];}
+    } else {
+#endif
 #if !(defined(HYDRO_KERNEL_SURFACE_VOLCORR) || defined(EOS_ELASTIC))
     leak_vs_tol = 0.5 * (local.FaceClosureError+SphP[j].FaceClosureError);
 #endif
     dummy_pressure=face_area_dot_vel=face_vel_i=face_vel_j=Face_Area_Norm=0;
-    double Pressure_i = local.Pressure, Pressure_j = SphP[j].Pressure;
+    Pressure_i = local.Pressure; Pressure_j = SphP[j].Pressure;
 #if defined(EOS_TILLOTSON) || defined(EOS_ELASTIC)
     if((Pressure_i<0)||(Pressure_j<0)) /* negative pressures are allowed, but dealt with below by a constant shift and re-shift, which should be invariant for HLLC with the MFM method */
     {
@@ -54,17 +66,18 @@
     /* ------------------------------------------------------------------------------------------------------------------- */
     /* now we're ready to compute the volume integral of the fluxes (or equivalently an 'effective area'/face orientation) */
     /* ------------------------------------------------------------------------------------------------------------------- */
+#ifdef HYDRO_FACE_CACHE
+    if(face_cached) {for(k=0;k<3;k++) {Face_Area_Vec[k] = face_cache[n].Face_Area_Vec[k];} Face_Area_Norm = face_cache[n].Face_Area_Norm;} else {
+#endif
 #include "compute_finitevol_faces.h" /* insert code block for computing Face_Area_Vec, Face_Area_Norm, etc. */
+#ifdef HYDRO_FACE_CACHE
+    }
+#endif
 
-    if(Face_Area_Norm == 0)
+    if(Face_Area_Norm != 0)
     {
-        memset(&Fluxes, 0, sizeof(struct Conserved_var_Riemann));
-#ifdef DIVBCLEANING_DEDNER
-        Riemann_out.phi_normal_mean=Riemann_out.phi_normal_db=0;
-#endif
-    } else {
         if((Face_Area_Norm<=0)||(isnan(Face_Area_Norm))) {PRINT_WARNING("PANIC! Face_Area_Norm=%g Mij=%g/%g wk_ij=%g/%g Vij=%g/%g dx/dy/dz=%g/%g/%g NVT=%g/%g/%g NVT_j=%g/%g/%g \n",Face_Area_Norm,local.Mass,P[j].Mass,kernel.wk_i,kernel.wk_j,V_i,V_j,kernel.dp[0],kernel.dp[1],kernel.dp[2],local.NV_T[0][0],local.NV_T[0][1],local.NV_T[0][2],SphP[j].NV_T[0][0],SphP[j].NV_T[0][1],SphP[j].NV_T[0][2]); fflush(stdout);}
-        double n_unit[3]; for(k=0;k<3;k++) {n_unit[k] = Face_Area_Vec[k] / Face_Area_Norm;} /* define useful unit vector for below */
+        for(k=0;k<3;k++) {n_unit[k] = Face_Area_Vec[k] / Face_Area_Norm;} /* define useful unit vector for below */
 
         /* --------------------------------------------------------------------------------- */
         /* extrapolate the conserved quantities to the interaction face between the particles */
@@ -106,7 +119,7 @@
         
         /* also will need approach velocities to determine maximum upwind pressure */
         double v2_approach = 0;
-        double vdotr2_phys = kernel.vdotr2;
+        vdotr2_phys = kernel.vdotr2;
         if(All.ComovingIntegrationOn) {vdotr2_phys -= All.cf_hubble_a2 * r2;}
         vdotr2_phys *= 1/(kernel.r * All.cf_atime);
         if(vdotr2_phys < 0) {v2_approach = vdotr2_phys*vdotr2_phys;}
@@ -191,7 +204,6 @@
         press_i_tot += 0.5 * kernel.b2_i * fac_magnetic_pressure;
         press_j_tot += 0.5 * kernel.b2_j * fac_magnetic_pressure;
 #endif
-        double press_tot_limiter;
 #ifdef MAGNETIC
         press_tot_limiter = 2.0 * 1.1 * All.cf_a3inv * (press_i_tot + press_j_tot);
 #else 
@@ -207,12 +219,33 @@
 #if defined(EOS_TILLOTSON) || defined(EOS_ELASTIC)
         press_tot_limiter = 1.e10*(press_tot_limiter+1.); // it is unclear how this particular limiter behaves for solid-body EOS's, so for now, disable it in these cases
 #endif
+    } // Face_Area_Norm != 0
+#ifdef HYDRO_RIEMANN_BATCH
+    /* first pass: save the face, queue its Riemann problem for the block, and move on to the next neighbor */
+    face_ctx->Face_Area_Norm = Face_Area_Norm; face_ctx->V_j = V_j; face_ctx->face_vel_i = face_vel_i; face_ctx->face_vel_j = face_vel_j; face_ctx->face_area_dot_vel = face_area_dot_vel;
+    face_ctx->dummy_pressure = dummy_pressure; face_ctx->leak_vs_tol = leak_vs_tol; face_ctx->Pressure_i = Pressure_i; face_ctx->Pressure_j = Pressure_j;
+    face_ctx->vdotr2_phys = vdotr2_phys; face_ctx->press_tot_limiter = press_tot_limiter;
+    for(k=0;k<3;k++) {face_ctx->Face_Area_Vec[k] = Face_Area_Vec[k]; face_ctx->n_unit[k] = n_unit[k]; face_ctx->v_frame[k] = v_frame[k];}
+    face_ctx->i_batch = -1; if(Face_Area_Norm != 0) {face_ctx->i_batch = n_solve; Riemann_batch_set_face(&face_block.batch, n_solve, &Riemann_vec, n_unit, press_tot_limiter); n_solve++;}
+    continue;
+    } // face_pass == 0
+#endif
 
-        
+    if(Face_Area_Norm == 0)
+    {
+        memset(&Fluxes, 0, sizeof(struct Conserved_var_Riemann));
+#ifdef DIVBCLEANING_DEDNER
+        Riemann_out.phi_normal_mean=Riemann_out.phi_normal_db=0;
+#endif
+    } else {
         /* --------------------------------------------------------------------------------- */
         /* Alright! Now we're actually ready to solve the Riemann problem at the particle interface */
         /* --------------------------------------------------------------------------------- */
+#ifdef HYDRO_RIEMANN_BATCH
+        Riemann_batch_get_face(&face_block.batch, face_ctx->i_batch, &Riemann_out); /* already solved, together with the rest of the block */
+#else
         Riemann_solver(Riemann_vec, &Riemann_out, n_unit, press_tot_limiter);
+#endif
         /* before going on, check to make sure we have a valid Riemann solution */
         if((Riemann_out.P_M<0)||(isnan(Riemann_out.P_M))||(Riemann_out.P_M>1.4*press_tot_limiter))
         {
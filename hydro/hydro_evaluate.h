@@ -41,6 +41,9 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
     face_area_dot_vel = 0;
 #endif
     double face_vel_i=0, face_vel_j=0, Face_Area_Norm=0, Face_Area_Vec[3];
+#ifdef HYDRO_RIEMANN_BATCH
+    struct hydro_face_block face_block; int n_block, face_pass, n_face=0, n_solve=0; /* see the neighbor loop below */
+#endif
 
 #ifdef HYDRO_MESHLESS_FINITE_MASS
     double epsilon_entropic_eos_big, epsilon_entropic_eos_small;
@@ -142,12 +145,29 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
             /* --------------------------------------------------------------------------------- */
 #ifdef ADM
 	    numngb = ngb_treefind_pairs_threads_adm(local.Pos, local.adm, kernel.h_i, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
+#elif defined(HYDRO_NGB_LIST_CACHE)
+            numngb = ngb_treefind_pairs_threads_cached(local.Pos, kernel.h_i, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist); /* re-uses the lists found in the gradient loop */
+#ifdef HYDRO_FACE_CACHE
+            struct ngb_face_cache_entry *face_cache = NULL; if(numngb >= 0) {face_cache = ngb_face_cache_entries(target, mode, numngb, 0);} /* and the faces constructed there */
+#endif
 #else
             numngb = ngb_treefind_pairs_threads(local.Pos, kernel.h_i, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
 #endif
             if(numngb < 0) {return -2;}
 
+#ifdef HYDRO_RIEMANN_BATCH
+            /* the neighbor list is processed in blocks of HYDRO_RIEMANN_BATCH: the first pass over a block does the set-up and face reconstruction for each
+                interacting pair and stores the face states (hydro_core_meshless.h), then the Riemann problems of all these faces are solved together, and the
+                second pass repeats the (cheap, deterministic) pair set-up above the core, picks up the stored face and its solution, and assigns the fluxes */
+            for(n_block = 0; n_block < numngb; n_block += HYDRO_RIEMANN_BATCH)
+            for(face_pass = 0; face_pass < 2; face_pass++)
+            {
+            if(face_pass == 1) {Riemann_solver_batch(&face_block.batch, n_solve);}
+            n_face = n_solve = 0;
+            for(n = n_block; n < DMIN(n_block + HYDRO_RIEMANN_BATCH, numngb); n++)
+#else
             for(n = 0; n < numngb; n++)
+#endif
             {
                 j = ngblist[n]; /* since we use the -threaded- version above of ngb-finding, its super-important this is the lower-case ngblist here! */
                 if(P[j].Mass <= 0) {continue;}
@@ -160,15 +180,23 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
                 integertime TimeStep_J; TimeStep_J = GET_PARTICLE_INTEGERTIME(j); dt_hydrostep_j = TimeStep_J * UNIT_INTEGERTIME_IN_PHYSICAL;
                 dt_hydrostep = DMAX(dt_hydrostep_i , dt_hydrostep_j); // this is used for flux-limiting, so we always want to be more conservative and use the larger timestep //
                 int j_is_active_for_fluxes = 0;
-#if 0 //!defined(BOX_SHEARING) && !defined(_OPENMP) // (shearing box means the fluxes at the boundaries are not actually symmetric, so can't do this; OpenMP on some new compilers goes bad here because pointers [e.g. P...] are not thread-safe shared with predictive operations, and vectorization means no gain here with OMP anyways) //
-                if(local.Timestep > TimeStep_J) {continue;} /* compute from particle with smaller timestep */
-                /* use relative positions to break degeneracy */
-                if(local.Timestep == TimeStep_J)
+#ifdef HYDRO_PAIRWISE_SYMMETRIC // (not allowed with shearing boxes, where the fluxes at the boundaries are not actually symmetric: see allvars.h) //
+                /* pairs of local elements are evaluated only once, from the element with the smaller timestep, which then also applies the equal-and-opposite
+                    update to the neighbor (its writes are atomic, see hydro_toplevel.c). imported elements (mode 1) always compute their own side, since the
+                    other side is computed on the rank that exported them. this relies on no element being evaluated twice in mode 0: a walk that fills the
+                    export buffer fails before any pair is applied, and elements finished in a buffer-full round are committed and skipped when the loop
+                    resumes (primary_loop_commit_finished), so the neighbor shares written here are never repeated */
+                if(mode == 0)
                 {
-                    int n0=0; if(local.Pos[n0] == P[j].Pos[n0]) {n0++; if(local.Pos[n0] == P[j].Pos[n0]) n0++;}
-                    if(local.Pos[n0] < P[j].Pos[n0]) {continue;}
+                    if(local.Timestep > TimeStep_J) {continue;} /* compute from particle with smaller timestep */
+                    /* use relative positions to break degeneracy */
+                    if(local.Timestep == TimeStep_J)
+                    {
+                        int n0=0; if(local.Pos[n0] == P[j].Pos[n0]) {n0++; if(local.Pos[n0] == P[j].Pos[n0]) n0++;}
+                        if(local.Pos[n0] < P[j].Pos[n0]) {continue;}
+                    }
+                    if(TimeBinActive[P[j].TimeBin]) {j_is_active_for_fluxes = 1;}
                 }
-                if(TimeBinActive[P[j].TimeBin]) {j_is_active_for_fluxes = 1;}
 #endif
                 kernel.dp[0] = local.Pos[0] - P[j].Pos[0];
                 kernel.dp[1] = local.Pos[1] - P[j].Pos[1];
@@ -249,7 +277,7 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
 #ifdef ENERGY_ENTROPY_SWITCH_IS_ACTIVE
                 double KE = kernel.dv[0]*kernel.dv[0] + kernel.dv[1]*kernel.dv[1] + kernel.dv[2]*kernel.dv[2];
                 if(KE > out.MaxKineticEnergyNgb) {out.MaxKineticEnergyNgb = KE;}
-                if(j_is_active_for_fluxes) {if(KE > SphP[j].MaxKineticEnergyNgb) SphP[j].MaxKineticEnergyNgb = KE;}
+                if(j_is_active_for_fluxes) {PAIRWISE_MAX(SphP[j].MaxKineticEnergyNgb, KE);}
 #endif
 #ifdef TURB_DIFF_METALS
                 double mdot_estimated = 0;
@@ -260,6 +288,10 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
                 
                 /* --------------------------------------------------------------------------------- */
                 /* calculate the kernel functions (centered on both 'i' and 'j') */
+#ifdef HYDRO_FACE_CACHE
+                int face_cached = (face_cache != NULL) && face_cache[n].Filled; /* kernel values and face of this pair were stored in the gradient loop */
+                if(face_cached) {kernel.wk_i = face_cache[n].wk_i; kernel.dwk_i = face_cache[n].dwk_i; kernel.wk_j = face_cache[n].wk_j; kernel.dwk_j = face_cache[n].dwk_j;} else {
+#endif
                 if(kernel.r < kernel.h_i)
                 {
                     u = kernel.r * hinv_i;
@@ -281,6 +313,9 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
                     kernel.dwk_j = 0;
                     kernel.wk_j = 0;
                 }
+#ifdef HYDRO_FACE_CACHE
+                }
+#endif
 
                 /* --------------------------------------------------------------------------------- */
                 /* with the overhead numbers above calculated, we now 'feed into' the "core"
@@ -400,7 +435,7 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
                 double gravwork[3]; gravwork[0]=Fluxes.rho*kernel.dp[0]; gravwork[1]=Fluxes.rho*kernel.dp[1]; gravwork[2]=Fluxes.rho*kernel.dp[2];
                 for(k=0;k<3;k++) {out.GravWorkTerm[k] += gravwork[k];}
 #ifdef METALS   /* if we have mass fluxes, we need to have metal fluxes if we're using them (or any other passive scalars) */
-                if(Fluxes.rho > 0) {out.Dyield[k] += (P[j].Metallicity[k] - local.Metallicity[k]) * dmass_holder;}
+                if(Fluxes.rho > 0) {for(k=0;k<NUM_METAL_SPECIES;k++) {out.Dyield[k] += (P[j].Metallicity[k] - local.Metallicity[k]) * dmass_holder;}}
 #endif
 #endif
                 for(k=0;k<3;k++) {out.Acc[k] += Fluxes.v[k];}
@@ -440,40 +475,40 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
                 if(j_is_active_for_fluxes)
                 {
 #ifdef HYDRO_MESHLESS_FINITE_VOLUME
-                    SphP[j].DtMass -= Fluxes.rho;
-                    for(k=0;k<3;k++) {SphP[j].GravWorkTerm[k] -= gravwork[k];}
+                    PAIRWISE_ATOMIC SphP[j].DtMass -= Fluxes.rho;
+                    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[j].GravWorkTerm[k] -= gravwork[k];}
 #ifdef METALS       /* if we have mass fluxes, we need to have metal fluxes if we're using them (or any other passive scalars) */
-                    if(Fluxes.rho < 0) {SphP[j].Dyield[k] = (P[j].Metallicity[k] - local.Metallicity[k]) * dmass_holder;}
+                    if(Fluxes.rho < 0) {for(k=0;k<NUM_METAL_SPECIES;k++) {PAIRWISE_ATOMIC SphP[j].Dyield[k] += (P[j].Metallicity[k] - local.Metallicity[k]) * dmass_holder;}}
 #endif
 #endif
-                    for(k=0;k<3;k++) {SphP[j].HydroAccel[k] -= Fluxes.v[k];}
-                    SphP[j].DtInternalEnergy -= Fluxes.p;
+                    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[j].HydroAccel[k] -= Fluxes.v[k];}
+                    PAIRWISE_ATOMIC SphP[j].DtInternalEnergy -= Fluxes.p;
 #ifdef MAGNETIC
 #ifndef HYDRO_SPH
-                    for(k=0;k<3;k++) {SphP[j].Face_Area[k] -= Face_Area_Vec[k];}
+                    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[j].Face_Area[k] -= Face_Area_Vec[k];}
 #endif
 #ifndef FREEZE_HYDRO
-                    for(k=0;k<3;k++) {SphP[j].DtB[k]-=Fluxes.B[k];}
-                    SphP[j].divB -= Fluxes.B_normal_corrected;
+                    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[j].DtB[k]-=Fluxes.B[k];}
+                    PAIRWISE_ATOMIC SphP[j].divB -= Fluxes.B_normal_corrected;
 #if defined(DIVBCLEANING_DEDNER) && defined(HYDRO_MESHLESS_FINITE_VOLUME) // mass-based phi-flux
-                    SphP[j].DtPhi -= Fluxes.phi;
+                    PAIRWISE_ATOMIC SphP[j].DtPhi -= Fluxes.phi;
 #endif
 #ifdef HYDRO_SPH
-                    for(k=0;k<3;k++) {SphP[j].DtInternalEnergy-=magfluxv[k]*VelPred_j[k]/All.cf_atime;}
-                    SphP[j].DtInternalEnergy += resistivity_heatflux;
+                    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[j].DtInternalEnergy-=magfluxv[k]*VelPred_j[k]/All.cf_atime;}
+                    PAIRWISE_ATOMIC SphP[j].DtInternalEnergy += resistivity_heatflux;
 #else
                     double wt_face_sum = Face_Area_Norm * (-face_area_dot_vel+face_vel_j);
-                    SphP[j].DtInternalEnergy -= 0.5 * kernel.b2_j*All.cf_a2inv*All.cf_a2inv * wt_face_sum;
+                    PAIRWISE_ATOMIC SphP[j].DtInternalEnergy -= 0.5 * kernel.b2_j*All.cf_a2inv*All.cf_a2inv * wt_face_sum;
 #ifdef DIVBCLEANING_DEDNER
                     for(k=0; k<3; k++)
                     {
-                        SphP[j].DtB_PhiCorr[k] -= Riemann_out.phi_normal_db * Face_Area_Vec[k];
-                        SphP[j].DtB[k] -= Riemann_out.phi_normal_mean * Face_Area_Vec[k];
-                        SphP[j].DtInternalEnergy -= Riemann_out.phi_normal_mean * Face_Area_Vec[k] * BPred_j[k]*All.cf_a2inv;
+                        PAIRWISE_ATOMIC SphP[j].DtB_PhiCorr[k] -= Riemann_out.phi_normal_db * Face_Area_Vec[k];
+                        PAIRWISE_ATOMIC SphP[j].DtB[k] -= Riemann_out.phi_normal_mean * Face_Area_Vec[k];
+                        PAIRWISE_ATOMIC SphP[j].DtInternalEnergy -= Riemann_out.phi_normal_mean * Face_Area_Vec[k] * BPred_j[k]*All.cf_a2inv;
                     }
 #endif
 #ifdef MHD_NON_IDEAL
-                    for(k=0;k<3;k++) {SphP[j].DtInternalEnergy -= BPred_j[k]*All.cf_a2inv*bflux_from_nonideal_effects[k];}
+                    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[j].DtInternalEnergy -= BPred_j[k]*All.cf_a2inv*bflux_from_nonideal_effects[k];}
 #endif
 #endif
 #endif
@@ -485,7 +520,7 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
                 /* don't forget to save the signal velocity for time-stepping! */
                 /* --------------------------------------------------------------------------------- */
                 if(kernel.vsig > out.MaxSignalVel) {out.MaxSignalVel = kernel.vsig;}
-                if(j_is_active_for_fluxes) {if(kernel.vsig > SphP[j].MaxSignalVel) SphP[j].MaxSignalVel = kernel.vsig;}
+                if(j_is_active_for_fluxes) {PAIRWISE_MAX(SphP[j].MaxSignalVel, kernel.vsig);}
 #ifdef WAKEUP
                 if(!(TimeBinActive[P[j].TimeBin]))
                 {
@@ -500,6 +535,9 @@ int hydro_force_evaluate(int target, int mode, int *exportflag, int *exportnodec
 
 
             } // for(n = 0; n < numngb; n++) //
+#ifdef HYDRO_RIEMANN_BATCH
+            } // for(n_block, face_pass) //
+#endif
         } // while(startnode >= 0) //
 #ifndef DONOTUSENODELIST
         if(mode == 1)
@@ -155,6 +155,20 @@ struct kernel_hydra
 #ifndef HYDRO_SPH
 #include "reimann.h"
 #endif
+#ifdef HYDRO_RIEMANN_BATCH
+/* face quantities saved by the first pass over a block of neighbors, so the second pass can apply the batched Riemann solution without re-doing the face set-up */
+struct hydro_face_context
+{
+    double Face_Area_Vec[3], Face_Area_Norm, n_unit[3], v_frame[3], face_vel_i, face_vel_j, face_area_dot_vel;
+    double V_j, dummy_pressure, leak_vs_tol, Pressure_i, Pressure_j, vdotr2_phys, press_tot_limiter;
+    int i_batch; /* index of this face in the Riemann batch (-1 for faces with zero area, which are not solved) */
+};
+struct hydro_face_block
+{
+    struct Riemann_batch batch;
+    struct hydro_face_context face[HYDRO_RIEMANN_BATCH];
+};
+#endif
 
 
 /* ok here we define some important variables for our generic communication
@@ -164,6 +178,7 @@ struct kernel_hydra
 #define INPUTFUNCTION_NAME particle2in_hydra    /* name of the function which loads the element data needed (for e.g. broadcast to other processors, neighbor search) */
 #define OUTPUTFUNCTION_NAME out2particle_hydra  /* name of the function which takes the data returned from other processors and combines it back to the original elements */
 #define CONDITIONFUNCTION_FOR_EVALUATION if((P[i].Type==0)&&(P[i].Mass>0)) /* function for which elements will be 'active' and allowed to undergo operations. can be a function call, e.g. 'density_is_active(i)', or a direct function call like 'if(P[i].Mass>0)' */
+#define COMPACT_EXPORT_POSITIONS /* the input structure holds the element position as 'Pos', so it can be sent in reduced form with MPI_COMPACT_EXPORTS */
 #include "../system/code_block_xchange_initialize.h" /* pre-define all the ALL_CAPS variables we will use below, so their naming conventions are consistent and they compile together, as well as defining some of the function calls needed */
 
 
@@ -576,6 +591,16 @@ static inline void particle2in_hydra(struct INPUT_STRUCT_NAME *in, int i, int lo
 /* --------------------------------------------------------------------------------- */
 /* this subroutine adds the output variables back to the particle values */
 /* --------------------------------------------------------------------------------- */
+#if defined(HYDRO_PAIRWISE_SYMMETRIC) && defined(_OPENMP)
+/* with pair-wise symmetric evaluation, a thread adds the neighbor's share of each flux directly into its SphP fields (in hydro_evaluate.h),
+    while another thread may be doing the same or summing that element's own results below: these updates must be atomic */
+#define PAIRWISE_ATOMIC _Pragma("omp atomic")
+#define PAIRWISE_MAX(x,v) {if((x) < (v)) {_Pragma("omp critical(_hydro_pairwise_max_)") {if((x) < (v)) {x = (v);}}}}
+#else
+#define PAIRWISE_ATOMIC
+#define PAIRWISE_MAX(x,v) {if((x) < (v)) {x = (v);}}
+#endif
+
 static inline void out2particle_hydra(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loop_iteration);
 static inline void out2particle_hydra(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loop_iteration)
 {
@@ -583,23 +608,23 @@ static inline void out2particle_hydra(struct OUTPUT_STRUCT_NAME *out, int i, int
     /* these are zero-d out at beginning of hydro loop so should always be added */
     for(k = 0; k < 3; k++)
     {
-        SphP[i].HydroAccel[k] += out->Acc[k];
+        PAIRWISE_ATOMIC SphP[i].HydroAccel[k] += out->Acc[k];
         //SphP[i].dMomentum[k] += out->dMomentum[k]; //manifest-indiv-timestep-debug//
     }
-    SphP[i].DtInternalEnergy += out->DtInternalEnergy;
+    PAIRWISE_ATOMIC SphP[i].DtInternalEnergy += out->DtInternalEnergy;
     //SphP[i].dInternalEnergy += out->dInternalEnergy; //manifest-indiv-timestep-debug//
 
 #ifdef HYDRO_MESHLESS_FINITE_VOLUME
-    SphP[i].DtMass += out->DtMass;
-    SphP[i].dMass += out->dMass;
-    for(k=0;k<3;k++) {SphP[i].GravWorkTerm[k] += out->GravWorkTerm[k];}
+    PAIRWISE_ATOMIC SphP[i].DtMass += out->DtMass;
+    PAIRWISE_ATOMIC SphP[i].dMass += out->dMass;
+    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[i].GravWorkTerm[k] += out->GravWorkTerm[k];}
 #endif
-    if(SphP[i].MaxSignalVel < out->MaxSignalVel) {SphP[i].MaxSignalVel = out->MaxSignalVel;}
+    PAIRWISE_MAX(SphP[i].MaxSignalVel, out->MaxSignalVel);
 #ifdef ENERGY_ENTROPY_SWITCH_IS_ACTIVE
-    if(SphP[i].MaxKineticEnergyNgb < out->MaxKineticEnergyNgb) {SphP[i].MaxKineticEnergyNgb = out->MaxKineticEnergyNgb;}
+    PAIRWISE_MAX(SphP[i].MaxKineticEnergyNgb, out->MaxKineticEnergyNgb);
 #endif
 #if defined(TURB_DIFF_METALS) || (defined(METALS) && defined(HYDRO_MESHLESS_FINITE_VOLUME))
-    for(k=0;k<NUM_METAL_SPECIES;k++) {SphP[i].Dyield[k] += out->Dyield[k];}
+    for(k=0;k<NUM_METAL_SPECIES;k++) {PAIRWISE_ATOMIC SphP[i].Dyield[k] += out->Dyield[k];}
 #endif
 
 #ifdef CHIMES_TURB_DIFF_IONS
@@ -624,13 +649,13 @@ static inline void out2particle_hydra(struct OUTPUT_STRUCT_NAME *out, int i, int
 
 #if defined(MAGNETIC)
     /* can't just do DtB += out-> DtB, because for SPH methods, the induction equation is solved in the density loop; need to simply add it here */
-    for(k=0;k<3;k++) {SphP[i].DtB[k] += out->DtB[k]; SphP[i].Face_Area[k] += out->Face_Area[k];}
-    SphP[i].divB += out->divB;
+    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[i].DtB[k] += out->DtB[k]; PAIRWISE_ATOMIC SphP[i].Face_Area[k] += out->Face_Area[k];}
+    PAIRWISE_ATOMIC SphP[i].divB += out->divB;
 #if defined(DIVBCLEANING_DEDNER)
 #ifdef HYDRO_MESHLESS_FINITE_VOLUME // mass-based phi-flux
-    SphP[i].DtPhi += out->DtPhi;
+    PAIRWISE_ATOMIC SphP[i].DtPhi += out->DtPhi;
 #endif
-    for(k=0;k<3;k++) {SphP[i].DtB_PhiCorr[k] += out->DtB_PhiCorr[k];}
+    for(k=0;k<3;k++) {PAIRWISE_ATOMIC SphP[i].DtB_PhiCorr[k] += out->DtB_PhiCorr[k];}
 #endif // Dedner //
 #endif // MAGNETIC //
 
@@ -664,7 +689,7 @@ static inline void out2particle_hydra(struct OUTPUT_STRUCT_NAME *out, int i, int
 void hydro_final_operations_and_cleanup(void)
 {
     int i,k;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].Type == 0 && P[i].Mass > 0)
         {
@@ -920,7 +945,7 @@ void hydro_final_operations_and_cleanup(void)
 #ifdef NUCLEAR_NETWORK
     PRINT_STATUS("Doing nuclear network");
     MPI_Barrier(MPI_COMM_WORLD); int nuc_particles=0,nuc_particles_sum=0; double dedt_nuc;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
         if(P[i].Type == 0)
         {   /* evaluate network here, but do it only for high enough temperatures */
             if(SphP[i].Temperature > All.NetworkTempThreshold)
@@ -953,7 +978,7 @@ void hydro_force_initial_operations_preloop(void)
 
     /* need to zero out all numbers that can be set -EITHER- by an active particle in the domain, or by one of the neighbors we will get sent */
     int i, k;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
         if(P[i].Type==0)
         {
             SphP[i].MaxSignalVel = -1.e10;
@@ -1028,14 +1053,14 @@ void hydro_force_initial_operations_preloop(void)
 /* --------------------------------------------------------------------------------- */
 void hydro_force(void)
 {
-    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC); double t00_truestart = my_second();
     hydro_force_initial_operations_preloop(); /* do initial pre-processing operations as needed before main hydro force loop */
     #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
     hydro_final_operations_and_cleanup(); /* do final operations on results */
     /* collect timing information */
-    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
+    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1); phase_interval_close(CPU_HYDCOMPUTE); /* the whole loop (compute, comm, wait) is one accounting interval */
     CPU_Step[CPU_HYDCOMPUTE] += timecomp; CPU_Step[CPU_HYDWAIT] += timewait; CPU_Step[CPU_HYDCOMM] += timecomm;
     CPU_Step[CPU_HYDMISC] += timeall - (timecomp + timewait + timecomm);
 }
@@ -72,6 +72,21 @@ struct Riemann_outputs
 #endif
     struct Conserved_var_Riemann Fluxes;
 };
+#ifdef HYDRO_RIEMANN_BATCH
+/* a block of face states in structure-of-arrays form, for solving the Riemann problems of many faces together (hydro only, see Riemann_solver_batch) */
+struct Riemann_batch
+{
+    MyDouble rho_L[HYDRO_RIEMANN_BATCH], rho_R[HYDRO_RIEMANN_BATCH];
+    MyDouble p_L[HYDRO_RIEMANN_BATCH], p_R[HYDRO_RIEMANN_BATCH];
+    MyDouble v_L[3][HYDRO_RIEMANN_BATCH], v_R[3][HYDRO_RIEMANN_BATCH];
+    MyDouble n_unit[3][HYDRO_RIEMANN_BATCH];
+    MyDouble press_tot_limiter[HYDRO_RIEMANN_BATCH];
+    /* outputs */
+    MyDouble P_M[HYDRO_RIEMANN_BATCH], S_M[HYDRO_RIEMANN_BATCH];
+    MyDouble F_rho[HYDRO_RIEMANN_BATCH], F_p[HYDRO_RIEMANN_BATCH], F_v[3][HYDRO_RIEMANN_BATCH];
+    int use_general_solver[HYDRO_RIEMANN_BATCH];
+};
+#endif
 struct rotation_matrix
 {
     MyDouble n[3];
@@ -86,6 +101,11 @@ struct rotation_matrix
 static inline double actual_slopelimiter(double dQ_1, double dQ_2);
 static inline double get_dQ_from_slopelimiter(double dQ_1, MyFloat grad[3], struct kernel_hydra kernel, double rinv);
 void Riemann_solver(struct Input_vec_Riemann Riemann_vec, struct Riemann_outputs *Riemann_out, double n_unit[3], double press_tot_limiter);
+#ifdef HYDRO_RIEMANN_BATCH
+void Riemann_solver_batch(struct Riemann_batch *batch, int n_faces);
+static inline void Riemann_batch_set_face(struct Riemann_batch *batch, int f, struct Input_vec_Riemann *Riemann_vec, double n_unit[3], double press_tot_limiter);
+static inline void Riemann_batch_get_face(struct Riemann_batch *batch, int f, struct Riemann_outputs *Riemann_out);
+#endif
 double guess_for_pressure(struct Input_vec_Riemann Riemann_vec, struct Riemann_outputs *Riemann_out,
                           double v_line_L, double v_line_R, double cs_L, double cs_R);
 void sample_reimann_standard(double S, struct Input_vec_Riemann Riemann_vec, struct Riemann_outputs *Riemann_out,
@@ -392,6 +412,96 @@ void Riemann_solver(struct Input_vec_Riemann Riemann_vec, struct Riemann_outputs
 
 
 
+#ifdef HYDRO_RIEMANN_BATCH
+/* --------------------------------------------------------------------------------- */
+/* Batched Riemann solver: same answer as calling Riemann_solver() for each face in turn, but the common case -- the first (Gaburov)
+    HLLC estimate of the star state is valid, so neither the Roe/primitive-variable fall-backs nor the exact solver are needed -- is
+    evaluated for all faces of the block in a single branch-free loop the compiler can vectorize. faces where that estimate is not
+    valid (vacuum, non-positive or non-finite pressure, pressure above the limiter, unphysical inputs) are flagged in that loop and
+    then handed to the scalar Riemann_solver() one at a time. (hydro only: no MHD, no general EOS, no KT replacement; see allvars.h) */
+/* --------------------------------------------------------------------------------- */
+static inline void Riemann_batch_set_face(struct Riemann_batch *batch, int f, struct Input_vec_Riemann *Riemann_vec, double n_unit[3], double press_tot_limiter)
+{
+    int k;
+    batch->rho_L[f] = Riemann_vec->L.rho; batch->rho_R[f] = Riemann_vec->R.rho;
+    batch->p_L[f] = Riemann_vec->L.p; batch->p_R[f] = Riemann_vec->R.p;
+    for(k=0;k<3;k++) {batch->v_L[k][f] = Riemann_vec->L.v[k]; batch->v_R[k][f] = Riemann_vec->R.v[k]; batch->n_unit[k][f] = n_unit[k];}
+    batch->press_tot_limiter[f] = press_tot_limiter;
+}
+
+static inline void Riemann_batch_get_face(struct Riemann_batch *batch, int f, struct Riemann_outputs *Riemann_out)
+{
+    int k;
+    Riemann_out->P_M = batch->P_M[f]; Riemann_out->S_M = batch->S_M[f];
+    Riemann_out->Fluxes.rho = batch->F_rho[f]; Riemann_out->Fluxes.p = batch->F_p[f];
+    for(k=0;k<3;k++) {Riemann_out->Fluxes.v[k] = batch->F_v[k][f];}
+}
+
+void Riemann_solver_batch(struct Riemann_batch *batch, int n_faces)
+{
+    int f, k;
+    double fac_v=1, fac_rho=1, fac_p=1; /* convert the inputs to -PHYSICAL- units, as in Riemann_solver */
+    if(All.ComovingIntegrationOn) {fac_v = 1./All.cf_atime; fac_rho = All.cf_a3inv; fac_p = All.cf_a3inv / All.cf_afac1;}
+    
+    for(f=0; f<n_faces; f++)
+    {
+        double rho_L = batch->rho_L[f]*fac_rho, rho_R = batch->rho_R[f]*fac_rho, p_L = batch->p_L[f]*fac_p, p_R = batch->p_R[f]*fac_p;
+        double vL0 = batch->v_L[0][f]*fac_v, vL1 = batch->v_L[1][f]*fac_v, vL2 = batch->v_L[2][f]*fac_v;
+        double vR0 = batch->v_R[0][f]*fac_v, vR1 = batch->v_R[1][f]*fac_v, vR2 = batch->v_R[2][f]*fac_v;
+        double n0 = batch->n_unit[0][f], n1 = batch->n_unit[1][f], n2 = batch->n_unit[2][f];
+        double cs_L = sqrt(GAMMA_G0 * p_L / rho_L), cs_R = sqrt(GAMMA_G0 * p_R / rho_R);
+        double v_line_L = vL0*n0 + vL1*n1 + vL2*n2, v_line_R = vR0*n0 + vR1*n1 + vR2*n2;
+        /* Gaburov: 'simplest' HLLC discretization with weighting scheme (first estimate in get_wavespeeds_and_pressure_star) */
+        double cs_max = DMAX(cs_L,cs_R);
+        double S_L = DMIN(v_line_L,v_line_R) - cs_max, S_R = DMAX(v_line_L,v_line_R) + cs_max;
+        double rho_wt_L = rho_L*(S_L-v_line_L), rho_wt_R = rho_R*(S_R-v_line_R);
+        double S_M = ((p_R-p_L) + rho_wt_L*v_line_L - rho_wt_R*v_line_R) / (rho_wt_L - rho_wt_R);
+        double P_M = (p_L*rho_wt_R - p_R*rho_wt_L + rho_wt_L*rho_wt_R*(v_line_R - v_line_L)) / (rho_wt_R - rho_wt_L);
+        int valid = (rho_L >= 0) & (rho_R >= 0) & ((p_L >= 0) | (p_R >= 0)) & ((v_line_R - v_line_L) <= cs_max) & (P_M > MIN_REAL_NUMBER) & (P_M <= batch->press_tot_limiter[f]);
+        batch->use_general_solver[f] = !valid; batch->P_M[f] = P_M; batch->S_M[f] = S_M;
+#ifdef HYDRO_MESHLESS_FINITE_VOLUME
+        /* HLLC fluxes sampled at the (moving) face, in the same order as HLLC_fluxes with v_line_frame=0: the left state if the face is left of all waves, otherwise
+            the contact wave picks the side and the sign of that side's outer wave decides between star-region and un-shocked state. the S_M==S_L/S_R/0 trap keeps the simple form */
+        double u_L = p_L / (GAMMA_G9 * rho_L), u_R = p_R / (GAMMA_G9 * rho_R);
+        double h_L = p_L/rho_L + u_L + 0.5*(vL0*vL0+vL1*vL1+vL2*vL2), h_R = p_R/rho_R + u_R + 0.5*(vR0*vR0+vR1*vR1+vR2*vR2);
+        int trap = (S_M==S_L) | (S_M==S_R) | (S_M==0), left = (0 < S_L) | (S_M > 0);
+        double rho_X = left ? rho_L : rho_R, p_X = left ? p_L : p_R, h_X = left ? h_L : h_R, v_X = left ? v_line_L : v_line_R, S_X = left ? S_L : S_R;
+        double vX0 = left ? vL0 : vR0, vX1 = left ? vL1 : vR1, vX2 = left ? vL2 : vR2;
+        int unshocked = left ? (0 < S_L) : (S_R < 0);
+        double nfac = rho_X * (S_X-v_X) / (trap ? 1 : (S_X-S_M)); nfac = (nfac < 0) ? 0 : nfac; /* protect against too large expansion estimate */
+        double eK = rho_X * h_X - p_X;
+        double F_rho_star = rho_X * (v_X - S_X) + nfac * S_X;
+        double F_p_star = (rho_X * h_X * v_X - eK * S_X) + S_X * nfac * (eK/rho_X + (S_M-v_X) * (S_M + p_X/(rho_X * (unshocked ? 1 : (S_X-v_X)))));
+        double dv2_star = nfac * S_X * (S_M - v_X) + p_X;
+        double F_rho = unshocked ? rho_X * v_X : F_rho_star, F_p = unshocked ? rho_X * h_X * v_X : F_p_star, dv2 = unshocked ? p_X : dv2_star;
+        batch->F_rho[f] = trap ? 0 : F_rho;
+        batch->F_p[f] = trap ? P_M * S_M : F_p;
+        batch->F_v[0][f] = trap ? P_M * n0 : F_rho * vX0 + dv2 * n0;
+        batch->F_v[1][f] = trap ? P_M * n1 : F_rho * vX1 + dv2 * n1;
+        batch->F_v[2][f] = trap ? P_M * n2 : F_rho * vX2 + dv2 * n2;
+#else
+        batch->F_rho[f] = 0; /* vanishes by definition in this frame */
+        batch->F_p[f] = P_M * S_M; /* becomes extremely simple for MFM in this frame */
+        batch->F_v[0][f] = P_M * n0; batch->F_v[1][f] = P_M * n1; batch->F_v[2][f] = P_M * n2;
+#endif
+    }
+    
+    for(f=0; f<n_faces; f++)
+    {
+        if(!batch->use_general_solver[f]) {continue;}
+        struct Input_vec_Riemann Riemann_vec; struct Riemann_outputs Riemann_out; double n_unit[3];
+        memset(&Riemann_vec, 0, sizeof(struct Input_vec_Riemann)); memset(&Riemann_out, 0, sizeof(struct Riemann_outputs));
+        Riemann_vec.L.rho = batch->rho_L[f]; Riemann_vec.R.rho = batch->rho_R[f]; Riemann_vec.L.p = batch->p_L[f]; Riemann_vec.R.p = batch->p_R[f];
+        for(k=0;k<3;k++) {Riemann_vec.L.v[k] = batch->v_L[k][f]; Riemann_vec.R.v[k] = batch->v_R[k][f]; n_unit[k] = batch->n_unit[k][f];}
+        Riemann_solver(Riemann_vec, &Riemann_out, n_unit, batch->press_tot_limiter[f]);
+        batch->P_M[f] = Riemann_out.P_M; batch->S_M[f] = Riemann_out.S_M; batch->F_rho[f] = Riemann_out.Fluxes.rho; batch->F_p[f] = Riemann_out.Fluxes.p;
+        for(k=0;k<3;k++) {batch->F_v[k][f] = Riemann_out.Fluxes.v[k];}
+    }
+}
+#endif // HYDRO_RIEMANN_BATCH
+
+
+
 /* -------------------------------------------------------------------------------------------------------------- */
 /* the HLLC Riemann solver: try this first - it's approximate, but fast, and accurate for our purposes */
 /*  (wrapper for sub-routines to evaluate hydro reimann problem) */
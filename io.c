@@ -38,7 +38,7 @@ void savepositions(int num)
     char buf[500];
     int n, filenr, gr, ngroups, primaryTask, lastTask;
 
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 
 #ifdef CHIMES_REDUCED_OUTPUT
     if (num % N_chimes_full_output_freq == 0) {Chimes_incl_full_output = 1;} else {Chimes_incl_full_output = 0;}
@@ -132,7 +132,7 @@ void savepositions(int num)
 
         All.Ti_lastoutput = All.Ti_Current;
 
-        CPU_Step[CPU_SNAPSHOT] += measure_time();
+        CPU_Step[CPU_SNAPSHOT] += measure_time_phase(CPU_SNAPSHOT);
 }
 
 #ifdef FOF
@@ -146,7 +146,7 @@ void savepositions(int num)
         if(ThisTask == 0)
             printf("done with group catalogue.\n");
 
-        CPU_Step[CPU_FOF] += measure_time();
+        CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
     }
 #endif
 
@@ -161,7 +161,7 @@ void savepositions(int num)
         if(ThisTask == 0)
             printf("done with power spectra.\n");
 
-        CPU_Step[CPU_MISC] += measure_time();
+        CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
     }
 #endif
 
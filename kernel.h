@@ -180,16 +180,10 @@ static inline void kernel_hinv(double h, double *hinv, double *hinv3, double *hi
   return;
 } 
 
-/* Attention: Here we assume that kernel is only called 
-   with range 0..1 for u as done in hydra or density !! 
-   Call with mode 0 to calculate dwk and wk
-   Call with mode -1 to calculate only wk
-   Call with mode +1 to calculate only dwk */
-
-static inline void kernel_main(double u, double hinv3, double hinv4, double *wk, double *dwk, int mode)
+/* un-normalized kernel shape W(u) and dW/du for 0<=u<1: this is what kernel_main below evaluates (or interpolates, with KERNEL_TABLE). 
+   mode as in kernel_main (nearly all callers pass it as a constant, so once inlined the unused half is compiled out) */
+static inline void kernel_shape(double u, double *wk, double *dwk, int mode)
 {
-    if(u>=1) {*wk=0; *dwk=0; return;} /* currently fully-redundant, but better safety for various subroutines calling this */
-    
 #if (KERNEL_FUNCTION == 1) /* linear ramp */
     if(mode >= 0)
         *dwk = -1;
@@ -206,84 +200,32 @@ static inline void kernel_main(double u, double hinv3, double hinv4, double *wk,
 #endif
     
 
+/* the splines below are written as sums of truncated powers, max(u_k-u,0)^n, rather than piecewise: identical values,
+    but without data-dependent branches, so they compile to a few min/max and multiply-adds and inline cleanly into the neighbor loops */
 #if (KERNEL_FUNCTION == 3) /* cubic spline */
-  if(u < 0.5)
-    {
-      if(mode >= 0) 
-          *dwk = u * (18.0 * u - 12.0);
-      if(mode <= 0) 
-          *wk = (1.0 + 6.0 * (u - 1.0) * u * u);
-    }
-  else
-    {
-      double t1 = (1.0 - u);
-      double t2 = t1 * t1;
-      if(mode >= 0) 
-          *dwk = -6.0 * t2;
-      if(mode <= 0) 
-          *wk = 2.0 * t2 * t1;
-    }
+    double t1 = (1.0 - u), s1 = DMAX(0.5 - u, 0);
+    if(mode >= 0)
+        *dwk = -6.0 * t1*t1 + 24.0 * s1*s1;
+    if(mode <= 0)
+        *wk = 2.0 * t1*t1*t1 - 8.0 * s1*s1*s1;
 #endif /* cubic spline */
 
 #if (KERNEL_FUNCTION == 4) /* quartic spline */
-  double t1 = (1.0 - u);
-  double t2 = t1 * t1;
-  double t4 = t2 * t2;
-
-  if(mode >= 0) 
-      *dwk = -5.0 * t4;
-  if(mode <= 0) 
-      *wk = t4 * t1;
-
-  if (u < 2.0/3.0)
-    {
-      t1 = (2.0/3.0 - u);
-      t2 = t1 * t1;
-      t4 = t2 * t2;
-      if(mode >= 0) 
-          *dwk += 30.0 * t4;
-      if(mode <= 0) 
-          *wk -= 6.0 * t4 * t1;
-    }
-  if (u < 1.0/3.0)
-    {
-      t1 = (1.0/3.0 - u);
-      t2 = t1 * t1;
-      t4 = t2 * t2;
-      if(mode >= 0) 
-          *dwk -= 75.0 * t4;
-      if(mode <= 0) 
-          *wk += 15.0 * t4 * t1;
-    }
+    double t1 = (1.0 - u), s1 = DMAX(2.0/3.0 - u, 0), s2 = DMAX(1.0/3.0 - u, 0);
+    double t4 = t1*t1*t1*t1, s14 = s1*s1*s1*s1, s24 = s2*s2*s2*s2;
+    if(mode >= 0)
+        *dwk = -5.0 * t4 + 30.0 * s14 - 75.0 * s24;
+    if(mode <= 0)
+        *wk = t4 * t1 - 6.0 * s14 * s1 + 15.0 * s24 * s2;
 #endif /* quartic spline */
 
 #if (KERNEL_FUNCTION == 5) /* quintic spline */
-    double t1 = (1.0 - u);
-    double t2 = t1 * t1;
-    
+    double t1 = (1.0 - u), s1 = DMAX(0.6 - u, 0), s2 = DMAX(0.2 - u, 0);
+    double t3 = t1*t1*t1, s13 = s1*s1*s1, s23 = s2*s2*s2;
     if(mode >= 0)
-        *dwk = -4.0 * t2 * t1;
+        *dwk = -4.0 * t3 + 20.0 * s13 - 40.0 * s23;
     if(mode <= 0)
-        *wk = t2 * t2;
-    
-    if (u < 0.6)
-    {
-        t1 = (0.6 - u);
-        t2 = t1 * t1;
-        if(mode >= 0)
-            *dwk += 20.0 * t2 * t1;
-        if(mode <= 0)
-            *wk -= 5.0 * t2 * t2;
-    }
-    if (u < 0.2)
-    {
-        t1 = (0.2 - u);
-        t2 = t1 * t1;
-        if(mode >= 0)
-            *dwk -= 40.0 * t2 * t1;
-        if(mode <= 0)
-            *wk += 10.0 * t2 * t2;
-    }
+        *wk = t3 * t1 - 5.0 * s13 * s1 + 10.0 * s23 * s2;
 #endif /* quintic spline */
     
 
@@ -309,7 +251,7 @@ static inline void kernel_main(double u, double hinv3, double hinv4, double *wk,
     double t5 = t1*t1; t5 *= t5*t1;
 #if (NUMDIMS == 1)
     if(mode >= 0)
-        *dwk = -14.0 * (t5/t1) * u * (1.0 + 4.0*u);
+        *dwk = -14.0 * (t1*t1*t1*t1) * u * (1.0 + 4.0*u); /* (1-u)^4, written out so u=1 (the last table entry) gives 0 rather than 0/0 */
     if(mode <= 0)
         *wk = t5 * (1.0 + 5.0*u + 8.0*u*u);
 #else
@@ -335,7 +277,27 @@ static inline void kernel_main(double u, double hinv3, double hinv4, double *wk,
             *wk = (1-u)*(1-u)/(1-KERNEL_U0);
     }
 #endif
+}
+
+
+/* Attention: Here we assume that kernel is only called 
+   with range 0..1 for u as done in hydra or density !! 
+   Call with mode 0 to calculate dwk and wk
+   Call with mode -1 to calculate only wk
+   Call with mode +1 to calculate only dwk */
+
+static inline void kernel_main(double u, double hinv3, double hinv4, double *wk, double *dwk, int mode)
+{
+    if(u>=1) {*wk=0; *dwk=0; return;} /* currently fully-redundant, but better safety for various subroutines calling this */
     
+#ifdef KERNEL_TABLE
+    /* linear interpolation in the table of W,dW/du filled by kernel_table_init() (pairs stored together, so one lookup touches one cache line) */
+    double x = u * KERNEL_TABLE; int i = (int)x; x -= i;
+    if(mode >= 0) {*dwk = Kernel_Table[i][1] + x * (Kernel_Table[i+1][1] - Kernel_Table[i][1]);}
+    if(mode <= 0) {*wk  = Kernel_Table[i][0] + x * (Kernel_Table[i+1][0] - Kernel_Table[i][0]);}
+#else
+    kernel_shape(u, wk, dwk, mode);
+#endif
     
   if(mode >= 0) {*dwk *= KERNEL_NORM * hinv4;}
   if(mode <= 0) {*wk *= KERNEL_NORM * hinv3;}
@@ -39,7 +39,7 @@ void do_first_halfstep_kick(void)
     {
         if((TimeBinActive[P[i].TimeBin]) || (P[i].Type==0)) /* active OR gas, need to check each timestep to ensure manifest conservation */
 #else
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) /* 'full' kick for active particles */
+    FOR_ACTIVE_PARTICLES(i) /* 'full' kick for active particles */
     {	    
 #endif
         {
@@ -72,7 +72,7 @@ void do_second_halfstep_kick(void)
     {
         if((TimeBinActive[P[i].TimeBin]) || (P[i].Type==0)) /* active OR gas, need to check each timestep to ensure manifest conservation */
 #else
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) /* 'full' kick for active particles */
+    FOR_ACTIVE_PARTICLES(i) /* 'full' kick for active particles */
     {
 #endif
         {
@@ -111,7 +111,7 @@ int eligible_for_hermite(int i)
 void do_hermite_prediction(void)
 {
     int i,j; integertime ti_step, tstart=0, tend=0;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {
+    FOR_ACTIVE_PARTICLES(i) {
 	if(eligible_for_hermite(i)) { /* check if we're actually eligible */	    
 	    if(P[i].Mass > 0) { /* skip massless particles scheduled for deletion */
 		ti_step = GET_PARTICLE_INTEGERTIME(i);
@@ -128,13 +128,14 @@ void do_hermite_prediction(void)
 #endif
 		    P[i].Pos[j] = P[i].OldPos[j] + dt_grav * (P[i].OldVel[j] + dt_grav/2 * (P[i].Hermite_OldAcc[j] + dt_grav/3 * P[i].OldJerk[j])) ;
 		    P[i].Vel[j] = P[i].OldVel[j] + dt_grav * (P[i].Hermite_OldAcc[j] + dt_grav/2 * P[i].OldJerk[j]);
-		}}}} // for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) 
+		}
+		P_HOT_SYNC(i);}}} // FOR_ACTIVE_PARTICLES(i) 
 }
 
 void do_hermite_correction(void) // corrector step
 {
     int i,j; integertime ti_step, tstart=0, tend=0;    
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {	
+    FOR_ACTIVE_PARTICLES(i) {	
 	if(eligible_for_hermite(i)){
                 if(P[i].Mass > 0) {
                     ti_step = GET_PARTICLE_INTEGERTIME(i);
@@ -151,7 +152,8 @@ void do_hermite_correction(void) // corrector step
                             P[i].OldVel[j] += P[i].GravPM[j] * (All.PM_Ti_endstep - All.PM_Ti_begstep)/2 * All.Timebase_interval;
                         }
 #endif
-		    }}}} //     for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+		    }
+                    P_HOT_SYNC(i);}}} //     FOR_ACTIVE_PARTICLES(i)
 }
 #endif // HERMITE_INTEGRATION
 
@@ -383,7 +385,7 @@ void do_the_kick(int i, integertime tstart, integertime tend, integertime tcurre
 
                 for(j=0; j<3; j++) {SphP[i].VelPred[j] = P[i].Vel[j];}//(mass_old*v_old[j] + dp[j]) / mass_new;
 #ifdef HYDRO_MESHLESS_FINITE_VOLUME
-                P[i].Mass = SphP[i].MassTrue; //mass_old + SphP[i].DtMass * dt_hydrokick;
+                P[i].Mass = SphP[i].MassTrue; P_HOT_SYNC(i); //mass_old + SphP[i].DtMass * dt_hydrokick;
 #endif
                 SphP[i].InternalEnergyPred = SphP[i].InternalEnergy; //ent_old + SphP[i].DtInternalEnergy * dt_entr;
 #ifdef HYDRO_EXPLICITLY_INTEGRATE_VOLUME
@@ -591,6 +593,7 @@ void apply_special_boundary_conditions(int i, double mass_for_dp, int mode)
             if(special_boundary_condition_xyz_def_outflow[j] == 0 || special_boundary_condition_xyz_def_outflow[j] == 1) {P[i].Mass=0; if(mode==1) {P[i].dp[0]=P[i].dp[1]=P[i].dp[2]=0;}}
         }
     }
+    P_HOT_SYNC(i);
 #endif
     return;
 }
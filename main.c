@@ -72,6 +72,10 @@ int main(int argc, char **argv)
       output_compile_time_options();
    }
 
+#ifdef OUTPUT_PERF_COUNTERS
+  perf_counters_init(); /* before the thread pool is created, so the counters follow all threads */
+#endif
+
 #ifdef _OPENMP
 #pragma omp parallel
   {
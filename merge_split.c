@@ -278,6 +278,7 @@ void merge_and_split_particles(void)
             // clipping
             P[i].Type = 1; // 'graduate' to high-res DM particle
             P[i].Mass = All.MassOfClippedDMParticles; // set mass to the 'safe' mass of typical high-res particles
+            P_HOT_SYNC(i);
         }
 #endif
         if (Ptmp[i].flag == 1) { // merge this particle
@@ -533,6 +534,7 @@ void split_particle_i(int i, int n_particles_split, int i_nearest)
      but it is important that the periodicity of the box be accounted for in relative positions and that we correct for this before allowing
      any other operations on the particles */
     P[i].Pos[0] += dx; P[j].Pos[0] -= dx; P[i].Pos[1] += dy; P[j].Pos[1] -= dy; P[i].Pos[2] += dz; P[j].Pos[2] -= dz;
+    P_HOT_SYNC(i); P_HOT_SYNC(j);
 
     /* Note: New tree construction can be avoided because of  `force_add_star_to_tree()' */
 #ifdef PARTICLE_MERGE_SPLIT_EVERY_TIMESTEP    
@@ -557,12 +559,12 @@ void merge_particles_ij(int i, int j)
     int k;
     if(P[i].Mass <= 0)
     {
-        P[i].Mass = 0;
+        P[i].Mass = 0; P_HOT_SYNC(i);
         return;
     }
     if(P[j].Mass <= 0)
     {
-        P[j].Mass = 0;
+        P[j].Mass = 0; P_HOT_SYNC(j);
         return;
     }
     double mtot = P[j].Mass + P[i].Mass;
@@ -605,6 +607,7 @@ void merge_particles_ij(int i, int j)
             P[i].dp[k] += P[i].Mass*P[i].Vel[k] - p_old_i[k];
             P[j].dp[k] += P[j].Mass*P[j].Vel[k] - p_old_j[k];
         }
+        P_HOT_SYNC(i); P_HOT_SYNC(j);
         return;
     } // closes merger of non-gas particles, only gas particles will see the blocks below //
 
@@ -811,6 +814,7 @@ void merge_particles_ij(int i, int j)
     }
     /* call the pressure routine to re-calculate pressure (and sound speeds) as needed */
     SphP[j].Pressure = get_pressure(j);
+    P_HOT_SYNC(i); P_HOT_SYNC(j);
     return;
 }
 
@@ -1028,6 +1032,15 @@ void rearrange_particle_sequence(void)
 
     MPI_Allreduce(&flag, &flag_sum, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     if(flag_sum) {reconstruct_timebins();}
+#ifdef PARTICLE_HOT_SOA
+    if(flag_sum) {particle_hot_soa_refresh();} /* entries were swapped/overwritten above */
+#endif
+#ifdef DRIFT_ON_DEMAND_CLAIMS
+    if(flag_sum) {drift_stamps_reset();}
+#endif
+#ifdef HYDRO_NGB_LIST_VERLET
+    if(flag_sum) {ngb_list_cache_invalidate();} /* stored neighbor lists refer to the old particle indices */
+#endif
 }
 
 
@@ -1061,7 +1074,7 @@ void apply_pm_hires_region_clipping_selection(int i)
         if(v_i>3.e4) {for(k=0;k<3;k++) {P[i].Vel[k]*=3.e4/v_i;}} // limit
     }
 #endif
-    if(clip_flag==1) {P[i].Mass=0;} // clip
+    if(clip_flag==1) {P[i].Mass=0; P_HOT_SYNC(i);} // clip
 #endif
     return; // done
 }
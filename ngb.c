@@ -29,9 +29,9 @@
 void ngb_treebuild(void)
 {
     if(ThisTask == 0) {printf("Begin Ngb-tree construction.\n");}
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
     force_treebuild(NumPart, NULL);
-    CPU_Step[CPU_TREEBUILD] += measure_time();
+    CPU_Step[CPU_TREEBUILD] += measure_time_phase(CPU_TREEBUILD);
     if(ThisTask == 0) {printf("Ngb-Tree contruction finished \n");}
 }
 
@@ -65,12 +65,33 @@ extern pthread_mutex_t mutex_nexport, mutex_partnodedrift;
 #else
 #define ALLOC_STACK(n) alloca(n)
 #endif
+/* box lengths handed to the vectorized wrap min(|dx|, L-|dx|) (system/vector.h): on axes that do not wrap, L is effectively infinite and this reduces to |dx| */
+#if defined(BOX_PERIODIC) && !(defined(BOX_REFLECT_X) || defined(BOX_OUTFLOW_X))
+#define NGB_WRAP_LENGTH_X boxSize_X
+#else
+#define NGB_WRAP_LENGTH_X MAX_REAL_NUMBER
+#endif
+#if defined(BOX_PERIODIC) && !(defined(BOX_REFLECT_Y) || defined(BOX_OUTFLOW_Y))
+#define NGB_WRAP_LENGTH_Y boxSize_Y
+#else
+#define NGB_WRAP_LENGTH_Y MAX_REAL_NUMBER
+#endif
+#if defined(BOX_PERIODIC) && !(defined(BOX_REFLECT_Z) || defined(BOX_OUTFLOW_Z))
+#define NGB_WRAP_LENGTH_Z boxSize_Z
+#else
+#define NGB_WRAP_LENGTH_Z MAX_REAL_NUMBER
+#endif
+#define NGB_FILTER_BLOCK 64 /* candidates are gathered into blocks of this size (a multiple of any VECTOR_FILTER_WIDTH) for the batched distance test */
+
 int ngb_filter_variables(long long numngb, int list[], t_vector * center, t_vector * box, t_vector * hbox, MyFloat hsml, int searchbothways_mode) __attribute__ ((noinline));
 
 int ngb_filter_variables(long long numngb, int list[], t_vector * center, t_vector * box, t_vector * hbox, MyFloat hsml, int searchbothways_mode)
 {
-    int numngb_old = numngb, *comp, no;
-    if(!(comp = ALLOC_STACK(numngb_old*sizeof(long long)))) {printf("Failed to allocate additional memory for `comp' (%lu Mbytes), switch off 'REDUCE_TREEWALK_BRANCHING'.\n", numngb_old*sizeof(long long)); endrun(124);}
+    int numngb_old = numngb, no;
+#if (BOX_SHEARING > 1)
+    /* the shearing wrap couples the x and y axes, so this keeps the scalar per-particle test */
+    int *comp; size_t scratch_mark = myscratch_mark();
+    if(!(comp = myscratch(numngb_old*sizeof(int))) && !(comp = ALLOC_STACK(numngb_old*sizeof(long long)))) {printf("Failed to allocate additional memory for `comp' (%lu Mbytes), switch off 'REDUCE_TREEWALK_BRANCHING'.\n", numngb_old*sizeof(long long)); endrun(124);}
     numngb = 0;
     MyDouble dist = hsml;
     for(no = 0; no < numngb_old; no++)
@@ -78,13 +99,34 @@ int ngb_filter_variables(long long numngb, int list[], t_vector * center, t_vect
         int p = list[no];
         MyDouble dx, dy, dz, d2, xtmp; xtmp=0;
         if(searchbothways_mode == 1) {dist = DMAX(PPP[p].Hsml, hsml);}
-        dx = NGB_PERIODIC_BOX_LONG_X(P[p].Pos[0] - center->d[0], P[p].Pos[1] - center->d[1], P[p].Pos[2] - center->d[2],-1);
-        dy = NGB_PERIODIC_BOX_LONG_Y(P[p].Pos[0] - center->d[0], P[p].Pos[1] - center->d[1], P[p].Pos[2] - center->d[2],-1);
-        dz = NGB_PERIODIC_BOX_LONG_Z(P[p].Pos[0] - center->d[0], P[p].Pos[1] - center->d[1], P[p].Pos[2] - center->d[2],-1);
+        dx = NGB_PERIODIC_BOX_LONG_X(P_POS(p,0) - center->d[0], P_POS(p,1) - center->d[1], P_POS(p,2) - center->d[2],-1);
+        dy = NGB_PERIODIC_BOX_LONG_Y(P_POS(p,0) - center->d[0], P_POS(p,1) - center->d[1], P_POS(p,2) - center->d[2],-1);
+        dz = NGB_PERIODIC_BOX_LONG_Z(P_POS(p,0) - center->d[0], P_POS(p,1) - center->d[1], P_POS(p,2) - center->d[2],-1);
         d2 = dx * dx + dy * dy + dz * dz;
         comp[no] = (d2 < dist * dist);
     }
     if(numngb_old > 0) {for(no = 0; no < numngb_old; no++) {if(comp[no]) {list[numngb++] = list[no];}}}
+    myscratch_release(scratch_mark);
+#else
+    /* gather positions and search radii of a block of candidates into contiguous arrays, then test and compact the whole block at once
+        (SIMD with VECTOR_AVX, see system/vector_avx.h). the indices are copied first, so the kept ones can be written back into list[] in place */
+    ALIGN(64) MyDouble dx[NGB_FILTER_BLOCK], dy[NGB_FILTER_BLOCK], dz[NGB_FILTER_BLOCK], r2[NGB_FILTER_BLOCK];
+    ALIGN(64) int idx[NGB_FILTER_BLOCK];
+    MyDouble h2 = (MyDouble)hsml * hsml;
+    int k, nb;
+    numngb = 0;
+    for(no = 0; no < numngb_old; no += NGB_FILTER_BLOCK)
+    {
+        nb = numngb_old - no; if(nb > NGB_FILTER_BLOCK) {nb = NGB_FILTER_BLOCK;}
+        for(k = 0; k < nb; k++)
+        {
+            int p = idx[k] = list[no + k];
+            dx[k] = P_POS(p,0) - center->d[0]; dy[k] = P_POS(p,1) - center->d[1]; dz[k] = P_POS(p,2) - center->d[2];
+            if(searchbothways_mode == 1) {MyDouble dist = DMAX(PPP[p].Hsml, hsml); r2[k] = dist * dist;} else {r2[k] = h2;}
+        }
+        numngb += FILTER_DISTANCE_BLOCK(nb, dx, dy, dz, r2, box, idx, &list[numngb]);
+    }
+#endif
     return (int) numngb;
 }
 #endif // REDUCE_TREEWALK_BRANCHING
@@ -103,8 +145,8 @@ int ngb_treefind_pairs_threads(MyDouble searchcenter[3], MyFloat hsml, int targe
                                int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist)
 {
 #include "system/ngb_codeblock_before_condition.h"
-    if(P[p].Type > 0) continue; // skip particles with non-gas types
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(P_TYPE(p) > 0) continue; // skip particles with non-gas types
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
 #define SEARCHBOTHWAYS 1 // need neighbors that can -mutually- see one another, not just single-directional searching here
 #include "system/ngb_codeblock_after_condition_threaded.h"
 #undef SEARCHBOTHWAYS // must be undefined after code block inserted, or compiler will crash
@@ -118,14 +160,255 @@ int ngb_treefind_pairs_threads_adm(MyDouble searchcenter[3], int adm_type, MyFlo
                                int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist)
 {
 #include "system/ngb_codeblock_before_condition.h"
-    if(P[p].Type > 0) continue; // skip particles with non-gas types
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(P_TYPE(p) > 0) continue; // skip particles with non-gas types
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
     if(P[p].adm != adm_type) continue; // skip particles that aren't the same ADM type
 #define SEARCHBOTHWAYS 1 // need neighbors that can -mutually- see one another, not just single-directional searching here
 #include "system/ngb_codeblock_after_condition_threaded.h"
 #undef SEARCHBOTHWAYS // must be undefined after code block inserted, or compiler will crash
 }
 #endif
+
+#ifdef HYDRO_NGB_LIST_CACHE
+/*! Cache of pair-wise neighbor lists, shared between the gradient and hydro-force loops of a timestep (positions, kernel lengths and tree hmax are
+ *  the same for both, so the walks would return the same lists). Only lists of local elements whose walk never reached a pseudo-particle (i.e. no exports)
+ *  are stored, since a cached list cannot regenerate the exports; everything else (and anything beyond the memory budget) falls back to walking.
+ *
+ *  With HYDRO_NGB_LIST_VERLET the lists are instead built with a skin (search radius and the other side's kernel lengths both enlarged by the skin factor)
+ *  and kept across timesteps, Verlet-style. The storage then lives with the tree (allocated/freed in force_treeallocate/force_treefree, so any domain
+ *  decomposition or re-ordering drops it). Within an 'epoch' we keep reference positions and kernel lengths of all local gas; every step a single
+ *  streaming pass predicts where each element is now (including the drift still pending for lazily-drifted elements) and how its Hsml changed, and these
+ *  are reduced globally. A list built at t_b stays complete as long as
+ *      (skin * Hsml_shrink(t_b) - Hsml_growth(t)) * Hsml_ref > 2 * (max_displacement(t) + max_displacement(t_b)),
+ *  where Hsml_ref is the smallest reference kernel length of the element and its list members (pairs interact through the kernel of either side),
+ *  i.e. no element could have moved (or grown its kernel) far enough to enter the pair-interaction range without being in the list. stale lists are
+ *  re-built individually; when the kernel-length changes eat most of the skin, the buffer fills, or most lists go stale, a new epoch starts (everywhere).
+ */
+static int *NgbCacheList, *NgbCacheStart, *NgbCacheCount, NgbCacheActive=0, NgbCacheFull;
+static long NgbCacheUsed, NgbCacheSize;
+#ifdef HYDRO_NGB_LIST_VERLET
+static struct ngb_verlet_data
+{
+    MyFloat PosRef[3];      /*!< predicted position at the start of the epoch */
+    MyFloat HsmlRef;        /*!< predicted kernel length at the start of the epoch */
+    MyFloat DispBuild;      /*!< global max displacement (since the epoch start) when this element's list was built */
+    MyFloat ShrinkBuild;    /*!< global min Hsml/HsmlRef when this element's list was built */
+    MyFloat HsmlRefList;    /*!< min HsmlRef of this element and the members of its list, when it was built */
+} *NgbVerlet;
+static int NgbVerletAllocated=0, NgbVerletNumPart=0, NgbVerletNgas=0, NgbVerletNewEpoch=1; static long NgbVerletStale;
+static double NgbVerletDisp, NgbVerletGrowth, NgbVerletShrink;
+
+/*! storage for the lists kept across timesteps: called at the end of force_treeallocate, so it is freed (first) in force_treefree */
+void ngb_list_cache_allocate(void)
+{
+    double budget = (double)HYDRO_NGB_LIST_CACHE * 1024. * 1024., bytes_fixed = (double)All.MaxPart * (2.*sizeof(int) + sizeof(struct ngb_verlet_data));
+    if(budget > 0.5*FreeBytes) {budget = 0.5*FreeBytes;} /* never take more than half of what is left, the loops need their buffers */
+    NgbCacheSize = (long) ((budget - bytes_fixed) / sizeof(int)); if(NgbCacheSize < 1) {NgbCacheSize = 1;} if(NgbCacheSize > 2147483647L) {NgbCacheSize = 2147483647L;} /* offsets are stored as int */
+    NgbCacheStart = (int *) mymalloc("NgbCacheStart", All.MaxPart * sizeof(int));
+    NgbCacheCount = (int *) mymalloc("NgbCacheCount", All.MaxPart * sizeof(int));
+    NgbVerlet = (struct ngb_verlet_data *) mymalloc("NgbVerlet", All.MaxPart * sizeof(struct ngb_verlet_data));
+    NgbCacheList = (int *) mymalloc("NgbCacheList", NgbCacheSize * sizeof(int));
+    NgbVerletAllocated = 1; NgbVerletNewEpoch = 1; NgbCacheActive = 0;
+}
+
+void ngb_list_cache_deallocate(void)
+{
+    if(!NgbVerletAllocated) {return;}
+    myfree(NgbCacheList); myfree(NgbVerlet); myfree(NgbCacheCount); myfree(NgbCacheStart);
+    NgbVerletAllocated = 0; NgbCacheActive = 0;
+}
+
+/*! lists are indexed by particle: anything that re-orders or adds elements without re-building the tree must call this */
+void ngb_list_cache_invalidate(void) {NgbVerletNewEpoch = 1;}
+
+/*! where element i is now (or will be once its pending drift is done) and what its kernel length will be: mirrors drift_particle() */
+static inline void ngb_verlet_predict(int i, double pos[3], double *hsml)
+{
+    int k; double dt_drift = 0, divv_fac; *hsml = PPP[i].Hsml; for(k=0;k<3;k++) {pos[k] = P[i].Pos[k];}
+    if(P[i].Ti_current == All.Ti_Current) {return;}
+    if(All.ComovingIntegrationOn) {dt_drift = get_drift_factor(P[i].Ti_current, All.Ti_Current);} else {dt_drift = (All.Ti_Current - P[i].Ti_current) * All.Timebase_interval;}
+#if defined(HYDRO_MESHLESS_FINITE_VOLUME)
+    for(k=0;k<3;k++) {pos[k] += SphP[i].ParticleVel[k] * dt_drift;}
+#else
+    for(k=0;k<3;k++) {pos[k] += P[i].Vel[k] * dt_drift;}
+#endif
+    divv_fac = P[i].Particle_DivVel * dt_drift; if(divv_fac > 0.3) {divv_fac = 0.3;} if(divv_fac < -0.3) {divv_fac = -0.3;}
+    *hsml *= exp(divv_fac / NUMDIMS); if(*hsml < All.MinHsml) {*hsml = All.MinHsml;} if(*hsml > All.MaxHsml) {*hsml = All.MaxHsml;}
+}
+#endif
+
+#ifdef HYDRO_FACE_CACHE
+/*! With HYDRO_FACE_CACHE the gradient loop also stores, for every entry of a cached list, the face (area vector and norm) and the kernel values of
+ *  the pair, computed exactly as the hydro loop would (NV_T, densities and kernel lengths are final by then), so hydro_force() skips both the kernel
+ *  evaluations and the face construction for these pairs. The entries are indexed like the list itself; those beyond the memory budget are not kept,
+ *  and lists which were not (re-)used by the gradient loop in this step are not trusted. */
+static struct ngb_face_cache_entry *NgbFaceCache;
+static char *NgbFaceCacheValid; /*!< per element: its entries were filled by the gradient loop of this step */
+static long NgbFaceCacheSize; static int NgbFaceCacheAllocated=0;
+
+static void ngb_face_cache_init(void)
+{
+    double budget = (double)HYDRO_FACE_CACHE * 1024. * 1024. - (double)NumPart*sizeof(char);
+    if(budget > 0.5*FreeBytes - (double)NumPart*sizeof(char)) {budget = 0.5*FreeBytes - (double)NumPart*sizeof(char);} /* as for the lists themselves */
+    NgbFaceCacheSize = (long) (budget / sizeof(struct ngb_face_cache_entry)); if(NgbFaceCacheSize > NgbCacheSize) {NgbFaceCacheSize = NgbCacheSize;} if(NgbFaceCacheSize < 1) {NgbFaceCacheSize = 1;}
+    NgbFaceCacheValid = (char *) mymalloc("NgbFaceCacheValid", NumPart * sizeof(char));
+    NgbFaceCache = (struct ngb_face_cache_entry *) mymalloc("NgbFaceCache", NgbFaceCacheSize * sizeof(struct ngb_face_cache_entry));
+    memset(NgbFaceCacheValid, 0, NumPart * sizeof(char)); NgbFaceCacheAllocated = 1;
+}
+
+/*! entries for the list of a local element just returned by ngb_treefind_pairs_threads_cached (so they match ngblist[] one by one), or NULL if that list is
+ *  not cached or does not fit in the budget. with fill=1 (gradient loop) they are cleared and claimed for this step, otherwise (hydro loop) only returned if claimed */
+struct ngb_face_cache_entry *ngb_face_cache_entries(int target, int mode, int numngb, int fill)
+{
+    if(!NgbCacheActive || !NgbFaceCacheAllocated || mode != 0 || target < 0 || target >= NumPart || numngb <= 0) {return NULL;}
+#ifdef HYDRO_NGB_LIST_VERLET
+    if(target >= NgbVerletNumPart) {return NULL;}
+#endif
+    if(NgbCacheCount[target] != numngb || (long)NgbCacheStart[target] + numngb > NgbFaceCacheSize) {return NULL;}
+    struct ngb_face_cache_entry *faces = NgbFaceCache + NgbCacheStart[target];
+    if(fill) {int n; for(n=0;n<numngb;n++) {faces[n].Filled = 0;} NgbFaceCacheValid[target] = 1; return faces;}
+    if(NgbFaceCacheValid[target]) {return faces;}
+    return NULL;
+}
+#endif
+
+/*! call after force_update_hmax() and before the first loop which should use the cache; ngb_list_cache_free() after the last one */
+void ngb_list_cache_init(void)
+{
+    int i;
+#ifndef HYDRO_NGB_LIST_VERLET
+    double budget = (double)HYDRO_NGB_LIST_CACHE * 1024. * 1024. - 2.*NumPart*sizeof(int);
+    if(budget > 0.5*FreeBytes - 2.*NumPart*sizeof(int)) {budget = 0.5*FreeBytes - 2.*NumPart*sizeof(int);} /* never take more than half of what is left, the loops need their buffers */
+    NgbCacheSize = (long) (budget / sizeof(int)); if(NgbCacheSize < 1) {NgbCacheSize = 1;} if(NgbCacheSize > 2147483647L) {NgbCacheSize = 2147483647L;} /* offsets are stored as int */
+    NgbCacheStart = (int *) mymalloc("NgbCacheStart", NumPart * sizeof(int));
+    NgbCacheCount = (int *) mymalloc("NgbCacheCount", NumPart * sizeof(int));
+    NgbCacheList = (int *) mymalloc("NgbCacheList", NgbCacheSize * sizeof(int));
+    for(i=0;i<NumPart;i++) {NgbCacheCount[i] = -1;}
+    NgbCacheUsed = 0; NgbCacheFull = 0; NgbCacheActive = 1;
+#ifdef HYDRO_FACE_CACHE
+    ngb_face_cache_init();
+#endif
+#else
+    if(!NgbVerletAllocated) {NgbCacheActive = 0; return;}
+    int k, n_cached = 0; double pos[3], dp[3], hsml, local_max[4] = {0, 1, -1, 0}, global_max[4];
+    for(i=0;i<N_gas;i++) /* one streaming pass: displacement and kernel-length change of every local element since the epoch started */
+    {
+        if(P[i].Type != 0 || i >= NgbVerletNumPart || NgbVerlet[i].HsmlRef <= 0) {continue;}
+        if(NgbCacheCount[i] >= 0) {n_cached++;}
+        ngb_verlet_predict(i, pos, &hsml);
+        for(k=0;k<3;k++) {dp[k] = pos[k] - NgbVerlet[i].PosRef[k];}
+        NEAREST_XYZ(dp[0],dp[1],dp[2],1);
+        double d = sqrt(dp[0]*dp[0] + dp[1]*dp[1] + dp[2]*dp[2]), g = hsml / NgbVerlet[i].HsmlRef;
+        if(d > local_max[0]) {local_max[0] = d;}
+        if(g > local_max[1]) {local_max[1] = g;}
+        if(-g > local_max[2]) {local_max[2] = -g;}
+    }
+    if(NgbVerletNewEpoch || NgbCacheFull || (N_gas != NgbVerletNgas) || (2*NgbVerletStale > n_cached && NgbVerletStale > 0)) {local_max[3] = 1;}
+    MPI_Allreduce(local_max, global_max, 4, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    NgbVerletDisp = global_max[0]; NgbVerletGrowth = global_max[1]; NgbVerletShrink = -global_max[2];
+    if(global_max[3] > 0 || (HYDRO_NGB_LIST_VERLET * NgbVerletShrink - NgbVerletGrowth < 0.5 * (HYDRO_NGB_LIST_VERLET - 1.))) /* start a new epoch: everything is re-referenced to the current (predicted) state */
+    {
+        for(i=0;i<NumPart;i++) {NgbCacheCount[i] = -1;}
+        for(i=0;i<N_gas;i++) {ngb_verlet_predict(i, pos, &hsml); for(k=0;k<3;k++) {NgbVerlet[i].PosRef[k] = pos[k];} NgbVerlet[i].HsmlRef = hsml;}
+        NgbVerletNumPart = NumPart; NgbVerletNgas = N_gas; NgbVerletNewEpoch = 0; NgbCacheUsed = 0; NgbCacheFull = 0;
+        NgbVerletDisp = 0; NgbVerletGrowth = NgbVerletShrink = 1;
+    }
+    NgbVerletStale = 0; NgbCacheActive = 1;
+#ifdef HYDRO_FACE_CACHE
+    ngb_face_cache_init();
+#endif
+#endif
+}
+
+void ngb_list_cache_free(void)
+{
+#ifdef HYDRO_FACE_CACHE
+    if(NgbFaceCacheAllocated) {myfree(NgbFaceCache); myfree(NgbFaceCacheValid); NgbFaceCacheAllocated = 0;}
+#endif
+#ifndef HYDRO_NGB_LIST_VERLET
+    myfree(NgbCacheList); myfree(NgbCacheCount); myfree(NgbCacheStart);
+#endif
+    NgbCacheActive = 0;
+}
+
+/*! walk as ngb_treefind_pairs_threads, but also report whether any pseudo-particle (another task's part of the tree) was reached */
+static int ngb_treefind_pairs_threads_flagremote(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode,
+                               int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int *remote)
+{
+#define NGB_PSEUDOPARTICLE_HOOK {*remote = 1;}
+#ifdef HYDRO_NGB_LIST_VERLET
+#define NGB_SEARCHBOTHWAYS_HFAC (HYDRO_NGB_LIST_VERLET) /* the skin applies to the neighbors' kernel lengths as well */
+    hsml *= HYDRO_NGB_LIST_VERLET;
+#endif
+#include "system/ngb_codeblock_before_condition.h"
+    if(P_TYPE(p) > 0) continue; // skip particles with non-gas types
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
+#define SEARCHBOTHWAYS 1 // need neighbors that can -mutually- see one another, not just single-directional searching here
+#include "system/ngb_codeblock_after_condition_threaded.h"
+#undef SEARCHBOTHWAYS
+#undef NGB_SEARCHBOTHWAYS_HFAC
+#undef NGB_PSEUDOPARTICLE_HOOK
+}
+
+/*! drop-in replacement for ngb_treefind_pairs_threads for loops which can use the cache: returns the stored list for a local element if there is one,
+ *  otherwise walks and stores the result (if it is complete, purely local and fits in the budget) */
+int ngb_treefind_pairs_threads_cached(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode,
+                               int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist)
+{
+    if(!NgbCacheActive || mode != 0 || target < 0 || *startnode != All.MaxPart) {return ngb_treefind_pairs_threads(searchcenter, hsml, target, startnode, mode, exportflag, exportnodecount, exportindex, ngblist);}
+#ifdef HYDRO_NGB_LIST_VERLET
+    if(target >= NgbVerletNumPart || NgbCacheCount[target] == -2) {return ngb_treefind_pairs_threads(searchcenter, hsml, target, startnode, mode, exportflag, exportnodecount, exportindex, ngblist);} /* new since the epoch started, or known to export */
+#endif
+    int numngb = NgbCacheCount[target];
+    if(numngb >= 0)
+    {
+#ifdef HYDRO_NGB_LIST_VERLET
+        if((HYDRO_NGB_LIST_VERLET * NgbVerlet[target].ShrinkBuild - NgbVerletGrowth) * NgbVerlet[target].HsmlRefList > 2. * (NgbVerletDisp + NgbVerlet[target].DispBuild))
+        {
+            int n; integertime ti_Current = All.Ti_Current;
+            memcpy(ngblist, NgbCacheList + NgbCacheStart[target], numngb * sizeof(int)); *startnode = -1;
+            for(n=0;n<numngb;n++) /* the walk would have drifted these */
+            {
+                int p = ngblist[n];
+                DRIFT_PARTICLE_ON_DEMAND(p, ti_Current);
+            }
+            return numngb;
+        }
+#ifdef _OPENMP
+        #pragma omp atomic
+#endif
+        NgbVerletStale++;
+        NgbCacheCount[target] = -1; /* stale: re-build below */
+#else
+        memcpy(ngblist, NgbCacheList + NgbCacheStart[target], numngb * sizeof(int)); *startnode = -1; return numngb;
+#endif
+    }
+    int remote = 0; numngb = ngb_treefind_pairs_threads_flagremote(searchcenter, hsml, target, startnode, mode, exportflag, exportnodecount, exportindex, ngblist, &remote);
+#ifdef HYDRO_NGB_LIST_VERLET
+    if(numngb >= 0 && remote) {NgbCacheCount[target] = -2;} /* don't try again this epoch: the walk with the skin would only add exports */
+#endif
+    if(numngb < 0 || remote || NgbCacheFull) {return numngb;}
+    long start;
+    LOCK_NEXPORT;
+#ifdef _OPENMP
+    #pragma omp atomic capture
+#endif
+    {start = NgbCacheUsed; NgbCacheUsed += numngb;}
+    UNLOCK_NEXPORT;
+    if(start + numngb > NgbCacheSize) {NgbCacheFull = 1; return numngb;} /* over budget: this and all later elements keep walking */
+    memcpy(NgbCacheList + start, ngblist, numngb * sizeof(int)); NgbCacheStart[target] = (int) start; NgbCacheCount[target] = numngb;
+#ifdef HYDRO_NGB_LIST_VERLET
+    NgbVerlet[target].DispBuild = NgbVerletDisp; NgbVerlet[target].ShrinkBuild = NgbVerletShrink;
+    MyFloat hsml_ref_min = NgbVerlet[target].HsmlRef; int n; /* the neighbor side of the pair criterion: a member with a smaller kernel has a smaller margin */
+    for(n=0;n<numngb;n++) {int p = ngblist[n]; if(p < NgbVerletNgas && NgbVerlet[p].HsmlRef < hsml_ref_min) {hsml_ref_min = NgbVerlet[p].HsmlRef;}}
+    NgbVerlet[target].HsmlRefList = hsml_ref_min;
+#endif
+    return numngb;
+}
+#endif
+
+
+
 /*! This function returns neighbours with distance <= hsml and returns them in Ngblist. Actually, particles in a box of half side length hsml are
  *  returned, i.e. the reduction to a sphere still needs to be done in the calling routine.
  */
@@ -133,8 +416,8 @@ int ngb_treefind_variable_threads(MyDouble searchcenter[3], MyFloat hsml, int ta
 				  int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist)
 {
 #include "system/ngb_codeblock_before_condition.h"
-    if(P[p].Type > 0) continue; // skip particles with non-gas types
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(P_TYPE(p) > 0) continue; // skip particles with non-gas types
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
 #define SEARCHBOTHWAYS 0 // only need neighbors inside of search radius, not particles 'looking at' primary
 #include "system/ngb_codeblock_after_condition_threaded.h"
 #undef SEARCHBOTHWAYS
@@ -147,8 +430,8 @@ int ngb_treefind_variable_threads_adm(MyDouble searchcenter[3], int adm_type,  M
                                   int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist)
 {
 #include "system/ngb_codeblock_before_condition.h"
-    if(P[p].Type > 0) continue; // skip particles with non-gas types
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(P_TYPE(p) > 0) continue; // skip particles with non-gas types
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
     if(P[p].adm != adm_type) continue; // skip particles that aren't the same ADM type
 #define SEARCHBOTHWAYS 0 // only need neighbors inside of search radius, not particles 'looking at' primary
 #include "system/ngb_codeblock_after_condition_threaded.h"
@@ -165,8 +448,8 @@ int ngb_treefind_variable_targeted(MyDouble searchcenter[3], MyFloat hsml, int t
 {
     long nexport_save = *nexport; /* this line must be here in the un-threaded versions */
 #include "system/ngb_codeblock_before_condition.h" // call the same variable/initialization block
-    if(!((1 << P[p].Type) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(!((1 << P_TYPE(p)) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
 #define SEARCHBOTHWAYS 0 // only need neighbors inside of search radius, not particles 'looking at' primary
 #include "system/ngb_codeblock_after_condition_unthreaded.h" // call the main loop block as above, but this time the -unthreaded- version
 #undef SEARCHBOTHWAYS
@@ -179,8 +462,8 @@ int ngb_treefind_variable_targeted_adm(int i, MyDouble searchcenter[3], MyFloat
 {
     long nexport_save = *nexport; /* this line must be here in the un-threaded versions */
 #include "system/ngb_codeblock_before_condition.h" // call the same variable/initialization block
-    if(!((1 << P[p].Type) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(!((1 << P_TYPE(p)) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
     if((P[i].Type == 0) || (P[i].Type == 4)) { // if star or gas particle, check that ADM type of neighbor and source are the same
 	if(P[i].adm != P[p].adm) {continue;}
     } else { // if not star or gas particle, ignore ADM particles as neighbors.
@@ -198,8 +481,8 @@ int ngb_treefind_pairs_targeted(MyDouble searchcenter[3], MyFloat hsml, int targ
 {
     long nexport_save = *nexport; /* this line must be here in the un-threaded versions */
 #include "system/ngb_codeblock_before_condition.h" // call the same variable/initialization block
-    if(!((1 << P[p].Type) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(!((1 << P_TYPE(p)) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
 #define SEARCHBOTHWAYS 1 // only need neighbors inside of search radius, not particles 'looking at' primary
 #include "system/ngb_codeblock_after_condition_unthreaded.h" // call the main loop block as above, but this time the -unthreaded- version
 #undef SEARCHBOTHWAYS
@@ -215,8 +498,8 @@ int ngb_treefind_variable_threads_targeted(MyDouble searchcenter[3], MyFloat hsm
                                            int *ngblist, int TARGET_BITMASK)
 {
 #include "system/ngb_codeblock_before_condition.h"
-    if(!((1 << P[p].Type) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(!((1 << P_TYPE(p)) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
 #define SEARCHBOTHWAYS 0 // only need neighbors inside of search radius, not particles 'looking at' primary
 #include "system/ngb_codeblock_after_condition_threaded.h"
 #undef SEARCHBOTHWAYS
@@ -227,8 +510,8 @@ int ngb_treefind_pairs_threads_targeted(MyDouble searchcenter[3], MyFloat hsml,
                                            int *ngblist, int TARGET_BITMASK)
 {
 #include "system/ngb_codeblock_before_condition.h"
-    if(!((1 << P[p].Type) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
-    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+    if(!((1 << P_TYPE(p)) & (TARGET_BITMASK))) continue; // skip anything not of the desired type
+    if(P_MASS(p) <= 0) continue; // skip zero-mass particles
 #define SEARCHBOTHWAYS 1 // only need neighbors inside of search radius, not particles 'looking at' primary
 #include "system/ngb_codeblock_after_condition_threaded.h"
 #undef SEARCHBOTHWAYS
@@ -258,11 +541,9 @@ int ngb_treefind_fof_primary(MyDouble searchcenter[3], MyFloat hsml, int target,
 
 #ifdef REDUCE_TREEWALK_BRANCHING
     t_vector box, hbox, vcenter;
-#ifdef BOX_PERIODIC
-    INIT_VECTOR3(boxSize_X, boxSize_Y, boxSize_Z, &box);
+    INIT_VECTOR3(NGB_WRAP_LENGTH_X, NGB_WRAP_LENGTH_Y, NGB_WRAP_LENGTH_Z, &box);
     INIT_VECTOR3(searchcenter[0], searchcenter[1], searchcenter[2], &vcenter);
     SCALE_VECTOR3(0.5, &box, &hbox);
-#endif
 #endif
     
     nexport_save = *nexport;
@@ -277,7 +558,7 @@ int ngb_treefind_fof_primary(MyDouble searchcenter[3], MyFloat hsml, int target,
             p = no;
             no = Nextnode[no];
             
-            if(!((1 << P[p].Type) & (MyFOF_PRIMARY_LINK_TYPES)))
+            if(!((1 << P_TYPE(p)) & (MyFOF_PRIMARY_LINK_TYPES)))
                 continue;
             
             if(mode == 0)
@@ -285,11 +566,11 @@ int ngb_treefind_fof_primary(MyDouble searchcenter[3], MyFloat hsml, int target,
             
 #ifndef REDUCE_TREEWALK_BRANCHING
             dist = hsml;
-            dx = NGB_PERIODIC_BOX_LONG_X(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+            dx = NGB_PERIODIC_BOX_LONG_X(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
             if(dx > dist) continue;
-            dy = NGB_PERIODIC_BOX_LONG_Y(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+            dy = NGB_PERIODIC_BOX_LONG_Y(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
             if(dy > dist) continue;
-            dz = NGB_PERIODIC_BOX_LONG_Z(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+            dz = NGB_PERIODIC_BOX_LONG_Z(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
             if(dz > dist) continue;
             if(dx * dx + dy * dy + dz * dz > dist * dist) continue;
 #endif
@@ -399,12 +680,12 @@ int ngb_treefind_fof_primary(MyDouble searchcenter[3], MyFloat hsml, int target,
                             {
                                 if(p < maxPart)
                                 {
-                                    if(((1 << P[p].Type) & (MyFOF_PRIMARY_LINK_TYPES)))
+                                    if(((1 << P_TYPE(p)) & (MyFOF_PRIMARY_LINK_TYPES)))
                                     {
 #ifndef REDUCE_TREEWALK_BRANCHING
-                                        dx = NGB_PERIODIC_BOX_LONG_X(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
-                                        dy = NGB_PERIODIC_BOX_LONG_Y(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
-                                        dz = NGB_PERIODIC_BOX_LONG_Z(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+                                        dx = NGB_PERIODIC_BOX_LONG_X(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
+                                        dy = NGB_PERIODIC_BOX_LONG_Y(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
+                                        dz = NGB_PERIODIC_BOX_LONG_Z(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
                                         if(dx * dx + dy * dy + dz * dz > hsml * hsml) break;
 #endif
                                         Ngblist[numngb++] = p;
@@ -440,6 +721,173 @@ int ngb_treefind_fof_primary(MyDouble searchcenter[3], MyFloat hsml, int target,
 }
 
 
+/*
+    threaded version of ngb_treefind_fof_primary above, using the per-thread exportflag/ngblist buffers and the per-thread blocks of the export
+    table (export_block_next_slot), so it can be called from the threaded loop blocks (code_block_xchange_perform_ops.h) or from any other loop
+    run by several threads at once. mode -1 is the purely local search used for the first linking pass: nothing is exported, instead *remote is
+    set if the search reached another task's part of the tree (remote is not used, and can be NULL, otherwise). note the node flags
+    BITFLAG_INSIDE_LINKINGLENGTH are shared between threads: this is safe as long as the links found are merged under a lock, since a node
+    is only flagged by a search which returns (and so links) all of its particles
+ */
+int ngb_treefind_fof_primary_threads(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode, int mode, int *exportflag,
+                                     int *exportnodecount, int *exportindex, int *ngblist, int MyFOF_PRIMARY_LINK_TYPES, int *remote)
+{
+    int numngb, no, p, task;
+    struct NODE *current;
+    MyDouble dx, dy, dz, dist, r2;
+    // cache some global vars locally for improved compiler alias analysis
+    int maxPart = All.MaxPart;
+    int maxNodes = MaxNodes;
+    MyDouble xtmp; xtmp=0;
+
+#ifdef REDUCE_TREEWALK_BRANCHING
+    t_vector box, hbox, vcenter;
+    INIT_VECTOR3(NGB_WRAP_LENGTH_X, NGB_WRAP_LENGTH_Y, NGB_WRAP_LENGTH_Z, &box);
+    INIT_VECTOR3(searchcenter[0], searchcenter[1], searchcenter[2], &vcenter);
+    SCALE_VECTOR3(0.5, &box, &hbox);
+#endif
+
+    numngb = 0;
+    no = *startnode;
+
+    while(no >= 0)
+    {
+        if(no < maxPart)		/* single particle */
+        {
+            p = no;
+            no = Nextnode[no];
+            if(!((1 << P_TYPE(p)) & (MyFOF_PRIMARY_LINK_TYPES))) continue;
+            if(mode == 0) continue;
+#ifndef REDUCE_TREEWALK_BRANCHING
+            dist = hsml;
+            dx = NGB_PERIODIC_BOX_LONG_X(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
+            if(dx > dist) continue;
+            dy = NGB_PERIODIC_BOX_LONG_Y(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
+            if(dy > dist) continue;
+            dz = NGB_PERIODIC_BOX_LONG_Z(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
+            if(dz > dist) continue;
+            if(dx * dx + dy * dy + dz * dz > dist * dist) continue;
+#endif
+            ngblist[numngb++] = p;
+        }
+        else
+        {
+            if(no >= maxPart + maxNodes)	/* pseudo particle */
+            {
+                if(mode == 1) {endrun(123125);}
+                if(mode == -1) {*remote = 1;}
+                if(mode == 0)
+                {
+                    if(exportflag[task = DomainTask[no - (maxPart + maxNodes)]] != target)
+                    {
+                        exportflag[task] = target;
+                        exportnodecount[task] = NODELISTLENGTH;
+                    }
+                    if(exportnodecount[task] == NODELISTLENGTH)
+                    {
+                        long nexp = export_block_next_slot(exportflag); /* slot in this thread's block of the export table */
+                        if(nexp < 0) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
+                        exportnodecount[task] = 0;
+                        exportindex[task] = nexp;
+                        DataIndexTable[nexp].Task = task;
+                        DataIndexTable[nexp].Index = target;
+                        DataIndexTable[nexp].IndexGet = nexp;
+                    }
+#ifndef DONOTUSENODELIST
+                    DataNodeList[exportindex[task]].NodeList[exportnodecount[task]++] = DomainNodeIndex[no - (maxPart + maxNodes)];
+                    if(exportnodecount[task] < NODELISTLENGTH) {DataNodeList[exportindex[task]].NodeList[exportnodecount[task]] = -1;}
+#endif
+                }
+                no = Nextnode[no - maxNodes];
+                continue;
+            }
+
+            current = &Nodes[no];
+            if(mode == 1)
+            {
+                if(current->u.d.bitflags & (1 << BITFLAG_TOPLEVEL))	/* we reached a top-level node again, which means that we are done with the branch */
+                {
+                    *startnode = -1;
+#ifndef REDUCE_TREEWALK_BRANCHING
+                    return numngb;
+#else
+                    return ngb_filter_variables(numngb, ngblist, &vcenter, &box, &hbox, hsml, 0);
+#endif
+                }
+            }
+            if(mode == 0)
+            {
+                if(!(current->u.d.bitflags & (1 << BITFLAG_TOPLEVEL))) {no = current->u.d.sibling; continue;} /* we have a node with only local particles, can skip branch */
+            }
+
+            no = current->u.d.sibling;	/* in case the node can be discarded */
+            dist = hsml + 0.5 * current->len;
+            dx = NGB_PERIODIC_BOX_LONG_X(current->center[0]-searchcenter[0],current->center[1]-searchcenter[1],current->center[2]-searchcenter[2],-1);
+            if(dx > dist) continue;
+            dy = NGB_PERIODIC_BOX_LONG_Y(current->center[0]-searchcenter[0],current->center[1]-searchcenter[1],current->center[2]-searchcenter[2],-1);
+            if(dy > dist) continue;
+            dz = NGB_PERIODIC_BOX_LONG_Z(current->center[0]-searchcenter[0],current->center[1]-searchcenter[1],current->center[2]-searchcenter[2],-1);
+            if(dz > dist) continue;
+            /* now test against the minimal sphere enclosing everything */
+            dist += FACT1 * current->len;
+            if((r2 = (dx * dx + dy * dy + dz * dz)) > dist * dist) continue;
+
+            if((current->u.d.bitflags & ((1 << BITFLAG_TOPLEVEL) + (1 << BITFLAG_DEPENDS_ON_LOCAL_MASS))) == 0)	/* only use fully local nodes */
+            {
+                /* test whether the node is contained within the sphere */
+                dist = hsml - FACT2 * current->len;
+                if(dist > 0)
+                    if(r2 < dist * dist)
+                    {
+                        if(current->u.d.bitflags & (1 << BITFLAG_INSIDE_LINKINGLENGTH))	/* already flagged */
+                        {
+                            /* sufficient to return only one particle inside this cell */
+                            p = current->u.d.nextnode;
+                            while(p >= 0)
+                            {
+                                if(p < maxPart)
+                                {
+                                    if(((1 << P_TYPE(p)) & (MyFOF_PRIMARY_LINK_TYPES)))
+                                    {
+#ifndef REDUCE_TREEWALK_BRANCHING
+                                        dx = NGB_PERIODIC_BOX_LONG_X(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
+                                        dy = NGB_PERIODIC_BOX_LONG_Y(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
+                                        dz = NGB_PERIODIC_BOX_LONG_Z(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
+                                        if(dx * dx + dy * dy + dz * dz > hsml * hsml) break;
+#endif
+                                        ngblist[numngb++] = p;
+                                        break;
+                                    }
+                                    p = Nextnode[p];
+                                }
+                                else if(p >= maxPart + maxNodes) {p = Nextnode[p - maxNodes];}
+                                else {p = Nodes[p].u.d.nextnode;}
+                            }
+                            continue;
+                        }
+                        else
+                        {
+                            /* flag it now: the node is opened below, so this search returns all of its particles */
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                            current->u.d.bitflags |= (1 << BITFLAG_INSIDE_LINKINGLENGTH);
+                        }
+                    }
+            }
+            no = current->u.d.nextnode;	/* ok, we need to open the node */
+        }
+    }
+
+    *startnode = -1;
+#ifndef REDUCE_TREEWALK_BRANCHING
+    return numngb;
+#else
+    return ngb_filter_variables(numngb, ngblist, &vcenter, &box, &hbox, hsml, 0);
+#endif
+}
+
+
 
 
 
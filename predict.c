@@ -76,10 +76,10 @@ void reconstruct_timebins(void)
     
     make_list_of_active_particles();
     
-    for(i = FirstActiveParticle, NumForceUpdate = 0; i >= 0; i = NextActiveParticle[i])
+    NumForceUpdate = 0; FOR_ACTIVE_PARTICLES(i)
     {
         NumForceUpdate++;
-        if(i >= NumPart)
+        if(i < 0 || i >= NumPart)
         {
             printf("Bummer i=%d\n", i);
             terminate("inconsistent list");
@@ -248,15 +248,54 @@ void drift_particle(int i, integertime time1)
     apply_special_boundary_conditions(i,P[i].Mass,0);
 
     P[i].Ti_current = time1;
+    P_HOT_SYNC(i);
+#ifdef DRIFT_ON_DEMAND_CLAIMS
+    __atomic_store_n(&DriftStamp[i], time1, __ATOMIC_RELEASE); /* publish: everything written above is visible to a thread which sees this stamp */
+#endif
 }
 
 
+#ifdef DRIFT_ON_DEMAND_CLAIMS
+/*! drift particle i to time1 on behalf of a (threaded) tree-walk which just found it as a candidate. the first thread to get here
+    claims the particle by swapping its stamp to DRIFT_STAMP_BUSY and drifts it; any other thread touching the same particle meanwhile
+    spins on that stamp alone, until the drifted state is published. different particles are drifted concurrently. */
+void drift_particle_on_demand(int i, integertime time1)
+{
+    while(1)
+    {
+        integertime stamp = __atomic_load_n(&DriftStamp[i], __ATOMIC_ACQUIRE);
+        if(stamp == time1) {return;} /* drifted, and the result published */
+        if(stamp == DRIFT_STAMP_BUSY) {continue;} /* another thread is drifting this particle right now */
+        if(__atomic_compare_exchange_n(&DriftStamp[i], &stamp, DRIFT_STAMP_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            if(P[i].Ti_current != time1) {drift_particle(i, time1);}
+            __atomic_store_n(&DriftStamp[i], time1, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+}
 
+/*! the stamps are indexed by position in P[], so they are re-initialized from P[].Ti_current whenever the particles are re-ordered */
+void drift_stamps_reset(void)
+{
+    int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) schedule(static)
+#endif
+    for(i = 0; i < NumPart; i++) {DriftStamp[i] = P[i].Ti_current;}
+}
+#endif
 
 
+/*! drift all local particles to time1 (bulk version of the on-demand drift above). particles only touch their own data in the drift,
+    so this is a plain parallel loop */
 void move_particles(integertime time1)
 {
-    int i; for(i=0; i<NumPart; i++) {drift_particle(i, time1);}
+    int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) schedule(dynamic,256)
+#endif
+    for(i=0; i<NumPart; i++) {if(P[i].Ti_current != time1) {drift_particle(i, time1);}}
 }
 
 
@@ -363,6 +402,7 @@ void do_box_wrapping(void)
 #endif
             }
         }
+        P_HOT_SYNC(i);
     }
 }
 #endif
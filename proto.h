@@ -163,8 +163,8 @@ void kspace_neutrinos_init(void);
 #ifdef OUTPUT_TWOPOINT_ENABLED
 void twopoint(void);
 void twopoint_save(void);
-int twopoint_ngb_treefind_variable(MyDouble searchcenter[3], MyFloat rsearch, int target, int *startnode, int mode, int *nexport, int *nsend_local);
-int twopoint_count_local(int target, int mode, int *nexport, int *nsend_local);
+int twopoint_ngb_treefind_variable(MyDouble searchcenter[3], MyFloat rsearch, int target, int *startnode, int mode, int *exportflag, int *exportnodecount, int *exportindex, long long *count);
+int twopoint_count_local(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration);
 #endif
 
 void powerspec(int flag, int *typeflag);
@@ -191,6 +191,13 @@ int MPI_Sizelimited_Sendrecv(void *sendbuf, int sendcount, MPI_Datatype sendtype
 			     MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status * status);
 
 int mpi_calculate_offsets(int *send_count, int *send_offset, int *recv_count, int *recv_offset, int send_identical);
+void mpi_sparse_alltoall_counts(int *send_count, int *recv_count);
+void mpi_exchange_counts_with_plan_partners(int *send_count, int *recv_count, int *plan_send_count, int *plan_recv_count);
+#ifdef MPI_COMPACT_EXPORTS
+void compact_export_format_init(struct compact_export_format *f, size_t size, size_t nodelist, long pos, int pos_size, long approx);
+void compact_export_pack(struct compact_export_format *f, void *buf, long n);
+void compact_export_unpack(struct compact_export_format *f, void *buf, long n);
+#endif
 void sort_based_on_field(void *data, int field_offset, int n_items, int item_size, void **data2ptr);
 void mpi_distribute_items_to_tasks(void *data, int task_offset, int *n_items, int *max_n, int item_size);
 
@@ -214,7 +221,7 @@ int conduction_evaluate(int target, int mode, double *in, double *out, double *s
 
 void fof_get_group_center(double *cm, int gr);
 void fof_get_group_velocity(double *cmvel, int gr);
-int fof_find_dmparticles_evaluate(int target, int mode, int *nexport, int *nsend_local);
+int fof_find_dmparticles_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration);
 void fof_compute_group_properties(int gr, int start, int len);
 
 #ifdef TURB_DIFF_DYNAMIC
@@ -228,6 +235,10 @@ int compare_densities_for_sort(const void *a, const void *b);
 int io_compare_P_ID(const void *a, const void *b);
 int io_compare_P_GrNr_SubNr(const void *a, const void *b);
 void drift_particle(int i, integertime time1);
+#ifdef DRIFT_ON_DEMAND_CLAIMS
+void drift_particle_on_demand(int i, integertime time1);
+void drift_stamps_reset(void);
+#endif
 void put_symbol(double t0, double t1, char c);
 void write_cpu_log(void);
 int get_timestep_bin(integertime ti_step);
@@ -254,6 +265,11 @@ void myfree_movable_fullinfo(void *p, const char *func, const char *file, int li
 
 void mymalloc_init(void);
 void dump_memory_table(void);
+void myscratch_open_fullinfo(size_t bytes_per_thread, const char *func, const char *file, int line);
+void myscratch_close_fullinfo(const char *func, const char *file, int line);
+void *myscratch(size_t n);
+size_t myscratch_mark(void);
+void myscratch_release(size_t mark);
 void report_detailed_memory_usage_of_largest_task(size_t *OldHighMarkBytes, const char *label, const char *func, const char *file, int line);
 
 double get_shear_viscosity(int i);
@@ -270,7 +286,7 @@ int compare_length_values(const void *a, const void *b);
 double rho_dot(double z, void *params);
 double bhgrowth(double z1, double z2);
 
-int fof_find_dmparticles_evaluate(int target, int mode, int *nexport, int *nsend_local);
+int fof_find_dmparticles_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration);
 
 double INLINE_FUNC Get_Particle_Size(int i);
 double INLINE_FUNC Get_Gas_density_for_energy_i(int i);
@@ -406,7 +422,7 @@ void fof_compile_catalogue(void);
 void fof_save_groups(int num);
 void fof_save_local_catalogue(int num);
 void fof_find_nearest_dmparticle(void);
-int fof_find_nearest_dmparticle_evaluate(int target, int mode, int *nexport, int *nsend_local);
+int fof_find_nearest_dmparticle_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration);
 
 int fof_compare_key(const void *a, const void *b);
 void fof_link_special(void);
@@ -460,6 +476,9 @@ int data_index_compare(const void *a, const void *b);
 int peano_compare_key(const void *a, const void *b);
 
 void mysort_dataindex(void *b, size_t n, size_t s, int (*cmp) (const void *, const void *));
+long export_block_next_slot(int *exportflag);
+long export_blocks_merge(int buffer_full);
+int primary_loop_commit_finished(int save_nextparticle);
 void mysort_domain(void *b, size_t n, size_t s);
 void mysort_idlist(void *b, size_t n, size_t s, int (*cmp) (const void *, const void *));
 void mysort_pmperiodic(void *b, size_t n, size_t s, int (*cmp) (const void *, const void *));
@@ -738,6 +757,9 @@ void ewald_corr(double dx, double dy, double dz, double *fper);
 void ewald_force(int ii, int jj, int kk, double x[3], double force[3]);
 void ewald_force_ni(int iii, int jjj, int kkk, double x[3], double force[3]);
 void ewald_init(void);
+#ifdef KERNEL_TABLE
+void kernel_table_init(void);
+#endif
 double ewald_psi(double x[3]);
 double ewald_pot_corr(double dx, double dy, double dz);
 int find_ancestor(int i);
@@ -816,6 +838,23 @@ double hydrokick_integ(double a, void *param);
 void init_drift_table(void);
 double get_drift_factor(integertime time0, integertime time1);
 double measure_time(void);
+double measure_time_phase(int part);
+void phase_interval_close(int part);
+void memory_phase_close(int part);
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+void write_memory_phase_log(void);
+#endif
+#ifdef OUTPUT_TIMELINE_TRACE
+void timeline_trace_init(void);
+void timeline_trace_phase(int part);
+void timeline_trace_event(int kind, const char *loop, double t0, double t1, long long n);
+void timeline_trace_flush(int force);
+#endif
+#ifdef OUTPUT_PERF_COUNTERS
+void perf_counters_init(void);
+void perf_counters_phase(int part);
+void write_perf_counters_log(void);
+#endif
 double report_time(void);
 
 /* on some DEC Alphas, the correct prototype for pow() is missing,
@@ -964,6 +1003,12 @@ void hydro_gradient_calc(void);
 int GasGrad_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int gradient_iteration);
 void construct_gradient(double *grad, int i);
 void local_slopelimiter(double *grad, double valmax, double valmin, double alim, double h, double shoot_tol, int pos_preserve, double d_max, double val_cen);
+#ifdef DENSITY_FUSED_GRADIENTS
+void gradients_fused_quantities(int i, double *q);
+void density_fused_gradients_allocate(void);
+void density_fused_gradients_free(void);
+int density_fused_gradients_get(int i, double grad[][3], double *qmax, double *qmin, double *maxdistance);
+#endif
 
 #ifdef TURB_DIFF_DYNAMIC
 void dynamic_diff_vel_calc(void);
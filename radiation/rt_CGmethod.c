@@ -233,7 +233,11 @@ void rt_diffusion_cg_matrix_multiply(double **matrixmult_in, double **matrixmult
     DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
     DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
     
-    NextParticle = FirstActiveParticle;	/* begin with this index */
+    PrimaryLoopListLength = NumActiveParticle; /* copy of the active list, so threads can claim chunks of it */
+    PrimaryLoopList = (int *) mymalloc("PrimaryLoopList", (PrimaryLoopListLength + 1) * sizeof(int));
+    memcpy(PrimaryLoopList, ActiveParticleList, PrimaryLoopListLength * sizeof(int));
+    for(j = 0; j < PrimaryLoopListLength; j++) {ProcessedFlag[PrimaryLoopList[j]] = 0;} /* nothing committed yet (see primary_loop_commit_finished) */
+    NextParticle = 0;	/* begin with this position in the list */
     do
     {
         BufferFullFlag = 0;
@@ -273,49 +277,14 @@ void rt_diffusion_cg_matrix_multiply(double **matrixmult_in, double **matrixmult
 #endif
         if(BufferFullFlag)
         {
-            int last_nextparticle = NextParticle;
-            NextParticle = save_NextParticle;
-            while(NextParticle >= 0)
-            {
-                if(NextParticle == last_nextparticle) break;
-                if(ProcessedFlag[NextParticle] != 1) break;
-                ProcessedFlag[NextParticle] = 2;
-                NextParticle = NextActiveParticle[NextParticle];
-            }
-            if(NextParticle == save_NextParticle)
+            if(primary_loop_commit_finished(save_NextParticle) == 0)
             {
                 /* in this case, the buffer is too small to process even a single particle */
                 endrun(116609);
             }
-            int new_export = 0;
-            for(j = 0, k = 0; j < Nexport; j++)
-            {
-                if(ProcessedFlag[DataIndexTable[j].Index] != 2)
-                {
-                    if(k < j + 1) {k = j + 1;}
-                    for(; k < Nexport; k++)
-                    {
-                        if(ProcessedFlag[DataIndexTable[k].Index] == 2)
-                        {
-                            int old_index = DataIndexTable[j].Index;
-                            DataIndexTable[j] = DataIndexTable[k];
-                            DataNodeList[j] = DataNodeList[k];
-                            DataIndexTable[j].IndexGet = j;
-                            new_export++;
-                            DataIndexTable[k].Index = old_index;
-                            k++;
-                            break;
-                        }
-                    }
-                } else {new_export++;}
-            }
-            Nexport = new_export;
         }
+        Nexport = export_blocks_merge(BufferFullFlag); /* collect the per-thread export blocks (dropping unfinished elements if the buffer filled), grouped by task, and count the exports */
         n_exported += Nexport;
-        
-        for(j = 0; j < NTask; j++) {Send_count[j] = 0;}
-        for(j = 0; j < Nexport; j++) {Send_count[DataIndexTable[j].Task]++;}
-        MYSORT_DATAINDEX(DataIndexTable, Nexport, sizeof(struct data_index), data_index_compare);
         MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD);
         for(j = 0, Nimport = 0, Recv_offset[0] = 0, Send_offset[0] = 0; j < NTask; j++)
         {
@@ -377,7 +346,7 @@ void rt_diffusion_cg_matrix_multiply(double **matrixmult_in, double **matrixmult
         pthread_mutex_destroy(&mutex_nexport);
         pthread_attr_destroy(&attr);
 #endif
-        if(NextParticle < 0) {ndone_flag = 1;} else {ndone_flag = 0;}
+        if(NextParticle >= PrimaryLoopListLength) {ndone_flag = 1;} else {ndone_flag = 0;}
         MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
         /* get the result */
         for(ngrp = 1; ngrp < (1 << PTask); ngrp++)
@@ -411,6 +380,7 @@ void rt_diffusion_cg_matrix_multiply(double **matrixmult_in, double **matrixmult
         myfree(rt_cg_DataGet);
     }
     while(ndone < NTask);
+    myfree(PrimaryLoopList);
     /* free memory */
     myfree(DataNodeList);
     myfree(DataIndexTable);
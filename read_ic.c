@@ -38,7 +38,7 @@ void read_ic(char *fname)
     double u_init_adm, molecular_weight_adm;
 #endif
 
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 
 #ifdef RESCALEVINI
     if(ThisTask == 0 && RestartFlag == 0) {fprintf(stdout, "Rescaling v_ini !\n"); fflush(stdout);}
@@ -185,7 +185,7 @@ void read_ic(char *fname)
     MPI_Barrier(MPI_COMM_WORLD);
     if(ThisTask == 0) {printf("Reading done. Total number of particles :  %d%09d\n\n", (int) (All.TotNumPart / 1000000000), (int) (All.TotNumPart % 1000000000)); fflush(stdout);}
 
-    CPU_Step[CPU_SNAPSHOT] += measure_time();
+    CPU_Step[CPU_SNAPSHOT] += measure_time_phase(CPU_SNAPSHOT);
 }
 
 
@@ -58,6 +58,9 @@ void restart(int modus)
     int partIndex, abunIndex; 
 #endif 
     
+#ifdef OUTPUT_TIMELINE_TRACE
+    if(modus == 0) {timeline_trace_flush(1);} /* runs end (or may be killed) after writing restart files: write out the trace so far */
+#endif
     if(ThisTask == 0 && modus == 0) // writing re-start files: move old files to .bak
     {
         sprintf(buf, "%s/restartfiles", All.OutputDir);
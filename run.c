@@ -29,7 +29,7 @@
  */
 void run(void)
 {
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 
     if(RestartFlag != 1)		/* need to compute forces at initial synchronization time, unless we restarted from restart files */
     {
@@ -253,7 +253,7 @@ void calculate_non_standard_physics(void)
 
 
 #ifdef BLACK_HOLES /***** black hole accretion and feedback *****/
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
     blackhole_accretion();
 #ifdef BH_WIND_SPAWN
     double MaxUnSpanMassBH_global;
@@ -265,7 +265,7 @@ void calculate_non_standard_physics(void)
         MaxUnSpanMassBH=MaxUnSpanMassBH_global=0.;
     }
 #endif
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_BLACKHOLES] += measure_time();
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_BLACKHOLES] += measure_time_phase(CPU_BLACKHOLES);
 #endif
 
 
@@ -275,7 +275,7 @@ void calculate_non_standard_physics(void)
 #endif
 
 #ifdef RADTRANSFER
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 #if defined(RT_SOURCE_INJECTION)
     int flag; flag=1;
 #if !defined(RT_INJECT_PHOTONS_DISCRETELY)
@@ -292,18 +292,18 @@ void calculate_non_standard_physics(void)
     if(Flag_FullStep) {rt_write_chemistry_stats();}
 #endif
 #endif
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_RTNONFLUXOPS] += measure_time();
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_RTNONFLUXOPS] += measure_time_phase(CPU_RTNONFLUXOPS);
 #endif // RADTRANSFER block
 
 #ifdef COOLING	/**** radiative cooling and chemistry  *****/
     cooling_parent_routine(); // top-level cooling and chemistry subroutine //
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_COOLINGSFR] += measure_time(); // finish time calc for SFR+cooling
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_COOLINGSFR] += measure_time_phase(CPU_COOLINGSFR); // finish time calc for SFR+cooling
 #endif
 
 
 #ifdef GALSF /**** star/sink particle formation *****/
     star_formation_parent_routine(); // top-level star formation routine (because this involves common particle conversions, want to keep this at end of this subroutine) //
-    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_COOLINGSFR] += measure_time(); // finish time calc for SFR+cooling
+    MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_COOLINGSFR] += measure_time_phase(CPU_COOLINGSFR); // finish time calc for SFR+cooling
 #endif
 
 }
@@ -389,7 +389,7 @@ void find_next_sync_point_and_drift(void)
         set_cosmo_factors_for_current_time();
 
         move_particles(All.Ti_nextoutput);
-        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time();
+        MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time_phase(CPU_DRIFT);
 
 #ifdef OUTPUT_POTENTIAL
 #if !defined(EVALPOTENTIAL) || (defined(EVALPOTENTIAL) && defined(OUTPUT_RECOMPUTE_POTENTIAL))
@@ -455,33 +455,92 @@ void find_next_sync_point_and_drift(void)
 
   /* move the new set of active/synchronized particles. Note: We do not yet call make_list_of_active_particles(), since we
    * may still need to old list in the dynamic tree update */
-  for(n = 0, prev = -1; n < TIMEBINS; n++)
-    {if(TimeBinActive[n]) {for(i = FirstInTimeBin[n]; i >= 0; i = NextInTimeBin[i]) {drift_particle(i, All.Ti_Current);}}}
+  if(GlobNumForceUpdate > DRIFT_BULK_FRACTION * All.TotNumPart)
+    {
+      move_particles(All.Ti_Current); /* the walks will touch most of the inactive particles as well; cheaper to drift them all now, in parallel, than one at a time on touch */
+    }
+  else
+    {
+      for(n = 0, prev = -1; n < TIMEBINS; n++)
+        {if(TimeBinActive[n]) {for(i = FirstInTimeBin[n]; i >= 0; i = NextInTimeBin[i]) {drift_particle(i, All.Ti_Current);}}}
+    }
 
 }
 
 
-void make_list_of_active_particles(void)
+#ifdef ACTIVE_LIST_PEANO_ORDER
+static int compare_active_particle_index(const void *a, const void *b)
+{
+    if(*(int *) a < *(int *) b) {return -1;}
+    if(*(int *) a > *(int *) b) {return +1;}
+    return 0;
+}
+
+/* build the active list by scanning the particle array in fixed chunks: count the active particles per chunk, take the
+    exclusive prefix sum of the counts as each chunk's write offset, then fill. the list comes out in index order */
+static void make_list_of_active_particles_by_index(void)
 {
-    int i, n, prev;
-    /* make a link list with the particles in the active time bins */
-    FirstActiveParticle = -1;
+#define ACTIVE_LIST_SCAN_CHUNKS 256
+    int c, chunk_offset[ACTIVE_LIST_SCAN_CHUNKS + 1];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(c = 0; c < ACTIVE_LIST_SCAN_CHUNKS; c++)
+    {
+        int i, count = 0, i_end = (int) (((long long) NumPart * (c + 1)) / ACTIVE_LIST_SCAN_CHUNKS);
+        for(i = (int) (((long long) NumPart * c) / ACTIVE_LIST_SCAN_CHUNKS); i < i_end; i++) {if(TimeBinActive[P[i].TimeBin] && P[i].Mass > 0) {count++;}}
+        chunk_offset[c + 1] = count;
+    }
+    for(c = 0, chunk_offset[0] = 0; c < ACTIVE_LIST_SCAN_CHUNKS; c++) {chunk_offset[c + 1] += chunk_offset[c];}
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(c = 0; c < ACTIVE_LIST_SCAN_CHUNKS; c++)
+    {
+        int i, k = chunk_offset[c], i_end = (int) (((long long) NumPart * (c + 1)) / ACTIVE_LIST_SCAN_CHUNKS);
+        for(i = (int) (((long long) NumPart * c) / ACTIVE_LIST_SCAN_CHUNKS); i < i_end; i++) {if(TimeBinActive[P[i].TimeBin] && P[i].Mass > 0) {ActiveParticleList[k++] = i;}}
+    }
+    NumActiveParticle = chunk_offset[ACTIVE_LIST_SCAN_CHUNKS];
+#undef ACTIVE_LIST_SCAN_CHUNKS
+}
+#endif
 
-    for(n = 0, prev = -1; n < TIMEBINS; n++)
+void make_list_of_active_particles(void)
+{
+    /* gather the particles in the active time bins into the compact index list ActiveParticleList. the exclusive prefix sum
+        of the bin occupation gives each active bin its own range of slots, so the bins are walked in parallel; the slots
+        left over by massless particles are then squeezed out, bin by bin */
+    int n, bin_offset[TIMEBINS], bin_kept[TIMEBINS];
+    for(n = 0, NumActiveParticle = 0; n < TIMEBINS; n++) {bin_offset[n] = NumActiveParticle; bin_kept[n] = 0; if(TimeBinActive[n]) {NumActiveParticle += TimeBinCount[n];}}
+#ifdef ACTIVE_LIST_PEANO_ORDER
+    if(NumActiveParticle > NumPart / 8) {make_list_of_active_particles_by_index(); return;} /* a large active fraction is cheaper to scan in order than to sort */
+#endif
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+    for(n = 0; n < TIMEBINS; n++)
     {
-        if(TimeBinActive[n])
+        if(!TimeBinActive[n]) {continue;}
+        int i, k = bin_offset[n], k_end = bin_offset[n] + TimeBinCount[n];
+        for(i = FirstInTimeBin[n]; i >= 0; i = NextInTimeBin[i])
         {
-            for(i = FirstInTimeBin[n]; i >= 0; i = NextInTimeBin[i])
-            {
-                if(P[i].Mass <= 0) {continue;}
-                if(prev == -1) {FirstActiveParticle = i;}
-                if(prev >= 0) {NextActiveParticle[prev] = i;}
-                prev = i;
-            }
+            if(P[i].Mass <= 0) {continue;}
+            if(k >= k_end) {terminate("time bin list is longer than its TimeBinCount");}
+            ActiveParticleList[k++] = i;
         }
+        bin_kept[n] = k - bin_offset[n];
     }
-
-    if(prev >= 0) {NextActiveParticle[prev] = -1;}
+    for(n = 0, NumActiveParticle = 0; n < TIMEBINS; n++)
+    {
+        if(bin_kept[n] <= 0) {continue;}
+        if(bin_offset[n] != NumActiveParticle) {memmove(ActiveParticleList + NumActiveParticle, ActiveParticleList + bin_offset[n], bin_kept[n] * sizeof(int));}
+        NumActiveParticle += bin_kept[n];
+    }
+#ifdef ACTIVE_LIST_PEANO_ORDER
+    /* after a domain decomposition the particles are stored in Peano-Hilbert order (gas and non-gas each), so an ascending
+        index list walks them along the curve: consecutive active particles are then close in memory and in the tree */
+    qsort(ActiveParticleList, NumActiveParticle, sizeof(int), compare_active_particle_index);
+#endif
 }
 
 
@@ -740,12 +799,21 @@ void output_log_messages(void)
 void write_cpu_log(void)
 {
   double max_CPU_Step[CPU_PARTS], avg_CPU_Step[CPU_PARTS], t0, t1, tsum; int i; t0=0; t1=0; tsum=0;
-  CPU_Step[CPU_MISC] += measure_time();
+  CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 
   for(i = 1, CPU_Step[0] = 0; i < CPU_PARTS; i++) {CPU_Step[0] += CPU_Step[i];}
 
   MPI_Reduce(CPU_Step, max_CPU_Step, CPU_PARTS, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
   MPI_Reduce(CPU_Step, avg_CPU_Step, CPU_PARTS, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+  write_memory_phase_log();
+#endif
+#ifdef OUTPUT_TIMELINE_TRACE
+  timeline_trace_flush(0);
+#endif
+#ifdef OUTPUT_PERF_COUNTERS
+  write_perf_counters_log();
+#endif
 
   if(ThisTask == 0)
     {
@@ -171,7 +171,7 @@ void do_dm_fuzzy_drift_kick(int i, double dt, int mode)
         mass_new = psimag_mass_new; /* uses direct [NON-MASS-CONSERVING] integration of psi field */
 #endif
         double psi_corr_fac = sqrt(mass_new / (MIN_REAL_NUMBER + psimag_mass_new));
-        P[i].Mass = mass_new; P[i].AGS_Psi_Re *= psi_corr_fac; P[i].AGS_Psi_Im *= psi_corr_fac;
+        P[i].Mass = mass_new; P[i].AGS_Psi_Re *= psi_corr_fac; P[i].AGS_Psi_Im *= psi_corr_fac; P_HOT_SYNC(i);
 
         P[i].AGS_Density = P[i].Mass * vol_inv;
         P[i].AGS_Psi_Re_Pred = P[i].AGS_Psi_Re;
@@ -469,10 +469,10 @@ int DMGrad_evaluate(int target, int mode, int *exportflag, int *exportnodecount,
 
 void DMGrad_gradient_calc(void)
 {
-    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC); double t00_truestart = my_second();
     PRINT_STATUS(" ..calculating higher-order gradients for DM density field\n");
     /* initialize data, if needed */
-    if(All.Time==All.TimeBegin) {int i; for(i=FirstActiveParticle; i>=0; i=NextActiveParticle[i]) {P[i].AGS_Numerical_QuantumPotential=0;}}
+    if(All.Time==All.TimeBegin) {int i; FOR_ACTIVE_PARTICLES(i) {P[i].AGS_Numerical_QuantumPotential=0;}}
 
     /* allocate memory shared across all loops */
     DMGradDataPasser = (struct temporary_dmgradients_data_topass *) mymalloc("DMGradDataPasser",NumPart * sizeof(struct temporary_dmgradients_data_topass));
@@ -485,7 +485,7 @@ void DMGrad_gradient_calc(void)
 
         /* do post-loop operations on the results */
         int i;
-        for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+        FOR_ACTIVE_PARTICLES(i)
         {
             if(loop_iteration <= 0)
             {
@@ -529,7 +529,7 @@ void DMGrad_gradient_calc(void)
     /* de-allocate memory and collect timing information */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
     myfree(DMGradDataPasser); /* free the temporary structure we created for the MinMax and additional data passing */
-    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
+    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1); phase_interval_close(CPU_AGSDENSCOMPUTE);
     CPU_Step[CPU_AGSDENSCOMPUTE] += timecomp; CPU_Step[CPU_AGSDENSWAIT] += timewait; CPU_Step[CPU_AGSDENSCOMM] += timecomm;
     CPU_Step[CPU_AGSDENSMISC] += timeall - (timecomp + timewait + timecomm);
 }
@@ -33,9 +33,9 @@ void grain_backrx(void);
 /* function to apply the drag on the grains from surrounding gas properties */
 void apply_grain_dragforce(void)
 {
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
     int i, k; PRINT_STATUS("Beginning particulate/grain/PIC force evaluation.");
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) /* loop over active particles */
+    FOR_ACTIVE_PARTICLES(i) /* loop over active particles */
     {
         if(!((1 << P[i].Type) & (GRAIN_PTYPES))) {P[i].Grain_AccelTimeMin = MAX_REAL_NUMBER;} /* for active elements, set this large to re-set below */
 #ifdef BOX_BND_PARTICLES
@@ -221,7 +221,7 @@ void apply_grain_dragforce(void)
     grain_backrx(); /* call parent routine to assign the back-reaction force among neighbors */
 #endif
     PRINT_STATUS(" ..particulate/grain/PIC force evaluation done.");
-    CPU_Step[CPU_DRAGFORCE] += measure_time();
+    CPU_Step[CPU_DRAGFORCE] += measure_time_phase(CPU_DRAGFORCE);
 }
 
 
@@ -344,7 +344,7 @@ void grain_backrx(void)
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
     //grain_backrx_final_operations_and_cleanup(); /* do final operations on results [nothing needed here] */
-    CPU_Step[CPU_DRAGFORCE] += measure_time(); /* collect timings and reset clock for next timing */
+    CPU_Step[CPU_DRAGFORCE] += measure_time_phase(CPU_DRAGFORCE); /* collect timings and reset clock for next timing */
 }
 #include "../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
 
@@ -524,7 +524,7 @@ void interpolate_fluxes_opacities_gasgrains(void)
     #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
-    CPU_Step[CPU_DRAGFORCE] += measure_time(); /* collect timings and reset clock for next timing */
+    CPU_Step[CPU_DRAGFORCE] += measure_time_phase(CPU_DRAGFORCE); /* collect timings and reset clock for next timing */
 }
 #include "../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
 
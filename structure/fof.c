@@ -37,25 +37,6 @@ group_properties *Group;
 
 
 
-static struct fofdata_in
-{
-  MyDouble Pos[3];
-  MyFloat Hsml;
-  MyIDType MinID;
-  MyIDType MinIDTask;
-  int NodeList[NODELISTLENGTH];
-}
- *FoFDataIn, *FoFDataGet;
-
-static struct fofdata_out
-{
-  MyFloat Distance;
-  MyIDType MinID;
-  MyIDType MinIDTask;
-}
- *FoFDataResult, *FoFDataOut;
-
-
 static struct fof_particle_list
 {
   MyIDType MinID;
@@ -104,7 +85,7 @@ void fof_fof(int num)
       printf("\nBegin to compute FoF group catalogues...  (presently allocated=%g MB)\n", AllocatedBytes / (1024.0 * 1024.0));
     }
 
-  CPU_Step[CPU_MISC] += measure_time();
+  CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 
   domain_Decomposition(1, 0, 0);
 
@@ -139,7 +120,7 @@ void fof_fof(int num)
   Next = (MyIDType *) mymalloc("Next", NumPart * sizeof(MyIDType));
   Tail = (MyIDType *) mymalloc("Tail", NumPart * sizeof(MyIDType));
 
-  CPU_Step[CPU_FOF] += measure_time();
+  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 
   if(ThisTask == 0)
     printf("Tree construction.\n");
@@ -305,7 +286,7 @@ void fof_fof(int num)
 #endif
 #endif
 
-  CPU_Step[CPU_FOF] += measure_time();
+  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 
   if(num >= 0)
     {
@@ -323,7 +304,7 @@ void fof_fof(int num)
 
   PRINT_STATUS("Finished computing FoF groups.  (presently allocated=%g MB)", AllocatedBytes / (1024.0 * 1024.0));
 
-  CPU_Step[CPU_FOF] += measure_time();
+  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 
 #ifdef SUBFIND
   domain_Decomposition(1, 0, 0);
@@ -340,42 +321,181 @@ void fof_fof(int num)
 
 
 
+static char *MarkedFlag, *ChangedFlag;
+static long long LinkAcross;
+
+/* the cross-task linking below runs on the threaded loop blocks: each primary-type element on the boundary of the local domain (NonlocalFlag)
+    whose group label changed is sent to the tasks its linking-length sphere overlaps, which lower the MinID of the groups it links to there */
+#define CORE_FUNCTION_NAME fof_find_dmparticles_evaluate /* name of the 'core' function doing the actual inter-neighbor operations. this MUST be defined somewhere as "int CORE_FUNCTION_NAME(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)" */
+#define INPUTFUNCTION_NAME fof_particle2in_links    /* name of the function which loads the element data needed (for e.g. broadcast to other processors, neighbor search) */
+#define OUTPUTFUNCTION_NAME fof_out2particle_links  /* name of the function which takes the data returned from other processors and combines it back to the original elements */
+#define CONDITIONFUNCTION_FOR_EVALUATION if(((1 << P[i].Type) & (MyFOF_PRIMARY_LINK_TYPES)) && NonlocalFlag[i] && ChangedFlag[i]) /* function for which elements will be 'active' and allowed to undergo operations. can be a function call, e.g. 'density_is_active(i)', or a direct function call like 'if(P[i].Mass>0)' */
+#define PRIMARY_LOOP_NUMBER_OF_ELEMENTS NumPart /* loop over all particles, not only the active ones */
+#include "../system/code_block_xchange_initialize.h" /* pre-define all the ALL_CAPS variables we will use below, so their naming conventions are consistent and they compile together, as well as defining some of the function calls needed */
+
+/* this structure defines the variables that need to be sent -from- the 'searching' element */
+static struct INPUT_STRUCT_NAME
+{
+  MyDouble Pos[3];
+  MyIDType MinID;
+  MyIDType MinIDTask;
+  int NodeList[NODELISTLENGTH];
+}
+ *DATAIN_NAME, *DATAGET_NAME;
+
+/* this subroutine assigns the values to the variables that need to be sent -from- the 'searching' element */
+static inline void fof_particle2in_links(struct INPUT_STRUCT_NAME *in, int i, int loop_iteration)
+{
+  int k; for(k = 0; k < 3; k++) {in->Pos[k] = P[i].Pos[k];}
+  in->MinID = MinID[Head[i]];
+  in->MinIDTask = MinIDTask[Head[i]];
+}
+
+/* this structure defines the variables that need to be sent -back to- the 'searching' element */
+static struct OUTPUT_STRUCT_NAME
+{
+  int Links;
+}
+ *DATARESULT_NAME, *DATAOUT_NAME;
+
+/* this subroutine assigns the values to the variables that need to be sent -back to- the 'searching' element */
+static inline void fof_out2particle_links(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loop_iteration)
+{
+  if(mode == 1 && out->Links) {MarkedFlag[i] = 1; LinkAcross += out->Links;} /* need to mark the particle if it induced a link (only imported elements can) */
+}
+
+
+/*! links a local primary-type particle to the local particles within the linking length (the first, purely local pass of fof_find_groups).
+    the searches run in parallel, but the merging of two groups is done under a lock, since it re-labels all members of one of them */
+static int fof_find_dmparticles_link_local(int target, int *ngblist)
+{
+  int j, n, p, s, ss, startnode, numngb_inbox, remote = 0;
+
+  startnode = All.MaxPart;	/* root node */
+  numngb_inbox = ngb_treefind_fof_primary_threads(P[target].Pos, LinkL, target, &startnode, -1, NULL, NULL, NULL, ngblist, MyFOF_PRIMARY_LINK_TYPES, &remote);
+  NonlocalFlag[target] = remote;
+
+  LOCK_NEXPORT;
+#ifdef _OPENMP
+#pragma omp critical(_foflink_)
+#endif
+  {
+  for(n = 0; n < numngb_inbox; n++)
+    {
+      j = ngblist[n];
+      if(Head[target] != Head[j])	/* only if not yet linked */
+	{
+	  if(Len[Head[target]] > Len[Head[j]])	/* p group is longer */
+	    {
+	      p = target;
+	      s = j;
+	    }
+	  else
+	    {
+	      p = j;
+	      s = target;
+	    }
+	  Next[Tail[Head[p]]] = Head[s];
+
+	  Tail[Head[p]] = Tail[Head[s]];
+
+	  Len[Head[p]] += Len[Head[s]];
+
+	  ss = Head[s];
+	  do
+	    Head[ss] = Head[p];
+	  while((ss = Next[ss]) >= 0);
+
+	  if(MinID[Head[s]] < MinID[Head[p]])
+	    {
+	      MinID[Head[p]] = MinID[Head[s]];
+	      MinIDTask[Head[p]] = MinIDTask[Head[s]];
+	    }
+	}
+    }
+  }
+  UNLOCK_NEXPORT;
+  return 0;
+}
+
+
+/*! the cross-task part of the linking: locally (mode 0) this only collects the exports, on the receiving task (mode 1) it lowers the MinID
+    of the local groups the imported particle links to, and returns the number of links made */
+/*!   -- this subroutine writes to shared memory [MinID, MinIDTask of the group heads]: these updates are done under a lock -- */
+int fof_find_dmparticles_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)
+{
+  int j, n, startnode, numngb_inbox, listindex = 0; struct INPUT_STRUCT_NAME local; struct OUTPUT_STRUCT_NAME out; memset(&out, 0, sizeof(struct OUTPUT_STRUCT_NAME)); /* define variables and zero memory and import data for local target*/
+  if(mode == 0) {INPUTFUNCTION_NAME(&local, target, loop_iteration);} else {local = DATAGET_NAME[target];} /* imports the data to the correct place and names */
+  if(mode == 0) {startnode = All.MaxPart; /* root node */} else {startnode = DATAGET_NAME[target].NodeList[0]; startnode = Nodes[startnode].u.d.nextnode;    /* open it */}
+  while(startnode >= 0)
+    {
+      while(startnode >= 0)
+	{
+	  numngb_inbox = ngb_treefind_fof_primary_threads(local.Pos, LinkL, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist, MyFOF_PRIMARY_LINK_TYPES, NULL);
+	  if(numngb_inbox < 0) {return -2;}
+	  for(n = 0; n < numngb_inbox; n++)
+	    {
+	      j = ngblist[n]; /* since we use the -threaded- version above of ngb-finding, its super-important this is the lower-case ngblist here! */
+	      if(MinID[Head[j]] > local.MinID) /* only take the lock if this can lower the group's MinID */
+		{
+		  LOCK_NEXPORT;
+#ifdef _OPENMP
+#pragma omp critical(_foflink_)
+#endif
+		  {
+		  if(MinID[Head[j]] > local.MinID)
+		    {
+		      MinID[Head[j]] = local.MinID;
+		      MinIDTask[Head[j]] = local.MinIDTask;
+		      out.Links++;
+		    }
+		  }
+		  UNLOCK_NEXPORT;
+		}
+	    }
+	}
+      if(mode == 1) {listindex++; if(listindex < NODELISTLENGTH) {startnode = DATAGET_NAME[target].NodeList[listindex]; if(startnode >= 0) {startnode = Nodes[startnode].u.d.nextnode; /* open it */}}} /* continue to open leaves if needed */
+    }
+  if(mode == 0) {OUTPUTFUNCTION_NAME(&out, target, 0, loop_iteration);} else {DATARESULT_NAME[target] = out;} /* collects the result at the right place */
+  return 0;
+}
+
+
 void fof_find_groups(void)
 {
-  int i, j, ndone_flag, link_count, dummy, nprocessed;
-  int ndone, ngrp, recvTask, place, nexport, nimport, link_across;
-  int npart, marked;
-  long long totmarked, totnpart;
-  long long link_across_tot, ntot;
+  int i, npart, marked, nprocessed;
+  long long totmarked, totnpart, link_across_tot, ntot;
   MyIDType *MinIDOld;
-  char *FoFDataOut, *FoFDataResult, *MarkedFlag, *ChangedFlag;
-  double t0, t1;
+  double t0_link, t1_link;
 
   PRINT_STATUS("Start linking particles (presently allocated=%g MB)", AllocatedBytes / (1024.0 * 1024.0));
 
   /* allocate buffers to arrange communication */
-
-  Ngblist = (int *) mymalloc("Ngblist", NumPart * sizeof(int));
-
-    size_t MyBufferSize = All.BufferSize;
-    All.BunchSize = (int) ((MyBufferSize * 1024 * 1024) / (sizeof(struct data_index) + sizeof(struct data_nodelist) +
-					     2 * sizeof(struct fofdata_in)));
-    DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
-    DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
+  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF); /* charge the time so far to the group finder, not the generic loop below */
+  #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
 
   NonlocalFlag = (char *) mymalloc("NonlocalFlag", NumPart * sizeof(char));
+  memset(NonlocalFlag, 0, NumPart * sizeof(char));
   MarkedFlag = (char *) mymalloc("MarkedFlag", NumPart * sizeof(char));
   ChangedFlag = (char *) mymalloc("ChangedFlag", NumPart * sizeof(char));
   MinIDOld = (MyIDType *) mymalloc("MinIDOld", NumPart * sizeof(MyIDType));
 
-  t0 = my_second();
+  t0_link = my_second();
 
   /* first, link only among local particles */
-  for(i = 0, marked = 0, npart = 0; i < NumPart; i++)
+  marked = npart = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:marked,npart)
+#endif
+  for(i = 0; i < NumPart; i++)
     {
       if(((1 << P[i].Type) & (MyFOF_PRIMARY_LINK_TYPES)))
 	{
-	  fof_find_dmparticles_evaluate(i, -1, &dummy, &dummy);
+#ifdef _OPENMP
+	  fof_find_dmparticles_link_local(i, Ngblist + omp_get_thread_num() * NumPart); /* each thread uses its own block of the neighbor list */
+#else
+	  fof_find_dmparticles_link_local(i, Ngblist);
+#endif
 
 	  npart++;
 
@@ -388,10 +508,10 @@ void fof_find_groups(void)
   sumup_large_ints(1, &marked, &totmarked);
   sumup_large_ints(1, &npart, &totnpart);
 
-  t1 = my_second();
+  t1_link = my_second();
 
 
-  PRINT_STATUS("links on local processor done (took %g sec).\nMarked=%d%09d out of the %d%09d primaries which are linked",timediff(t0, t1),(int) (totmarked / 1000000000), (int) (totmarked % 1000000000),(int) (totnpart / 1000000000), (int) (totnpart % 1000000000));
+  PRINT_STATUS("links on local processor done (took %g sec).\nMarked=%d%09d out of the %d%09d primaries which are linked",timediff(t0_link, t1_link),(int) (totmarked / 1000000000), (int) (totmarked % 1000000000),(int) (totnpart / 1000000000), (int) (totnpart % 1000000000));
   PRINT_STATUS("\nlinking across processors (presently allocated=%g MB)",AllocatedBytes / (1024.0 * 1024.0));
     
   for(i = 0; i < NumPart; i++)
@@ -402,159 +522,24 @@ void fof_find_groups(void)
 
   do
     {
-      t0 = my_second();
+      t0_link = my_second();
 
-      for(i = 0; i < NumPart; i++)
+      for(i = 0, nprocessed = 0; i < NumPart; i++)
 	{
 	  ChangedFlag[i] = MarkedFlag[i];
 	  MarkedFlag[i] = 0;
+	  if(((1 << P[i].Type) & (MyFOF_PRIMARY_LINK_TYPES)) && NonlocalFlag[i] && ChangedFlag[i]) {nprocessed++;}
 	}
 
-      i = 0;			/* begin with this index */
-      link_across = 0;
-      nprocessed = 0;
-
-      do
-	{
-	  for(j = 0; j < NTask; j++)
-	    {
-	      Send_count[j] = 0;
-	      Exportflag[j] = -1;
-	    }
-
-	  /* do local particles and prepare export list */
-	  for(nexport = 0; i < NumPart; i++)
-	    {
-	      if(((1 << P[i].Type) & (MyFOF_PRIMARY_LINK_TYPES)))
-		{
-		  if(NonlocalFlag[i] && ChangedFlag[i])
-		    {
-		      if(fof_find_dmparticles_evaluate(i, 0, &nexport, Send_count) < 0)
-			break;
-
-		      nprocessed++;
-		    }
-		}
-	    }
-
-	  MYSORT_DATAINDEX(DataIndexTable, nexport, sizeof(struct data_index), data_index_compare);
-
-	  MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD);
-
-	  for(j = 0, nimport = 0, Recv_offset[0] = 0, Send_offset[0] = 0; j < NTask; j++)
-	    {
-	      nimport += Recv_count[j];
-
-	      if(j > 0)
-		{
-		  Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];
-		  Recv_offset[j] = Recv_offset[j - 1] + Recv_count[j - 1];
-		}
-	    }
-
-	  FoFDataGet = (struct fofdata_in *) mymalloc("FoFDataGet", nimport * sizeof(struct fofdata_in));
-	  FoFDataIn = (struct fofdata_in *) mymalloc("FoFDataIn", nexport * sizeof(struct fofdata_in));
-
-
-	  /* prepare particle data for export */
-	  for(j = 0; j < nexport; j++)
-	    {
-	      place = DataIndexTable[j].Index;
-
-	      FoFDataIn[j].Pos[0] = P[place].Pos[0];
-	      FoFDataIn[j].Pos[1] = P[place].Pos[1];
-	      FoFDataIn[j].Pos[2] = P[place].Pos[2];
-	      FoFDataIn[j].MinID = MinID[Head[place]];
-	      FoFDataIn[j].MinIDTask = MinIDTask[Head[place]];
-
-	      memcpy(FoFDataIn[j].NodeList,
-		     DataNodeList[DataIndexTable[j].IndexGet].NodeList, NODELISTLENGTH * sizeof(int));
-	    }
-
-	  /* exchange particle data */
-	  for(ngrp = 1; ngrp < (1 << PTask); ngrp++)
-	    {
-	      recvTask = ThisTask ^ ngrp;
-
-	      if(recvTask < NTask)
-		{
-		  if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-		    {
-		      /* get the particles */
-		      MPI_Sendrecv(&FoFDataIn[Send_offset[recvTask]],
-				   Send_count[recvTask] * sizeof(struct fofdata_in), MPI_BYTE,
-				   recvTask, TAG_FOF_A,
-				   &FoFDataGet[Recv_offset[recvTask]],
-				   Recv_count[recvTask] * sizeof(struct fofdata_in), MPI_BYTE,
-				   recvTask, TAG_FOF_A, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-		    }
-		}
-	    }
-
-	  myfree(FoFDataIn);
-	  FoFDataResult = (char *) mymalloc("FoFDataResult", nimport * sizeof(char));
-	  FoFDataOut = (char *) mymalloc("FoFDataOut", nexport * sizeof(char));
-
-	  /* now do the particles that were sent to us */
-
-	  for(j = 0; j < nimport; j++)
-	    {
-	      link_count = fof_find_dmparticles_evaluate(j, 1, &dummy, &dummy);
-	      link_across += link_count;
-	      if(link_count)
-		FoFDataResult[j] = 1;
-	      else
-		FoFDataResult[j] = 0;
-	    }
+      LinkAcross = 0;
+      #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
 
-	  /* exchange data */
-	  for(ngrp = 1; ngrp < (1 << PTask); ngrp++)
-	    {
-	      recvTask = ThisTask ^ ngrp;
-
-	      if(recvTask < NTask)
-		{
-		  if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-		    {
-		      /* get the particles */
-		      MPI_Sendrecv(&FoFDataResult[Recv_offset[recvTask]],
-				   Recv_count[recvTask] * sizeof(char),
-				   MPI_BYTE, recvTask, TAG_FOF_B,
-				   &FoFDataOut[Send_offset[recvTask]],
-				   Send_count[recvTask] * sizeof(char),
-				   MPI_BYTE, recvTask, TAG_FOF_B, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-		    }
-		}
-	    }
-
-	  /* need to mark the particle if it induced a link */
-	  for(j = 0; j < nexport; j++)
-	    {
-	      place = DataIndexTable[j].Index;
-	      if(FoFDataOut[j])
-		MarkedFlag[place] = 1;
-	    }
-
-	  myfree(FoFDataOut);
-	  myfree(FoFDataResult);
-	  myfree(FoFDataGet);
-
-	  if(i >= NumPart)
-	    ndone_flag = 1;
-	  else
-	    ndone_flag = 0;
-
-	  MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-	}
-      while(ndone < NTask);
-
-
-      sumup_large_ints(1, &link_across, &link_across_tot);
+      MPI_Allreduce(&LinkAcross, &link_across_tot, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
       sumup_large_ints(1, &nprocessed, &ntot);
 
-      t1 = my_second();
+      t1_link = my_second();
 
-	  PRINT_STATUS("have done %d%09d cross links (processed %d%09d, took %g sec)",(int) (link_across_tot / 1000000000), (int) (link_across_tot % 1000000000),(int) (ntot / 1000000000), (int) (ntot % 1000000000), timediff(t0, t1));
+	  PRINT_STATUS("have done %d%09d cross links (processed %d%09d, took %g sec)",(int) (link_across_tot / 1000000000), (int) (link_across_tot % 1000000000),(int) (ntot / 1000000000), (int) (ntot % 1000000000), timediff(t0_link, t1_link));
 
       /* let's check out which particles have changed their MinID */
       for(i = 0; i < NumPart; i++)
@@ -574,115 +559,11 @@ void fof_find_groups(void)
   myfree(MarkedFlag);
   myfree(NonlocalFlag);
 
-  myfree(DataNodeList);
-  myfree(DataIndexTable);
-  myfree(Ngblist);
+  #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
 
 PRINT_STATUS("Local groups found.");
 }
-
-
-/*!   -- this subroutine is not openmp parallelized at present, so there's not any issue about conflicts over shared memory. if you make it openmp, make sure you protect the writes to shared memory here!!! -- */
-int fof_find_dmparticles_evaluate(int target, int mode, int *nexport, int *nsend_local)
-{
-  int j, n, links, p, s, ss, listindex = 0;
-  int startnode, numngb_inbox;
-  MyDouble *pos;
-
-  links = 0;
-
-  if(mode == 0 || mode == -1)
-    pos = P[target].Pos;
-  else
-    pos = FoFDataGet[target].Pos;
-
-  if(mode == 0 || mode == -1)
-    {
-      startnode = All.MaxPart;	/* root node */
-    }
-  else
-    {
-      startnode = FoFDataGet[target].NodeList[0];
-      startnode = Nodes[startnode].u.d.nextnode;	/* open it */
-    }
-
-  while(startnode >= 0)
-    {
-      while(startnode >= 0)
-	{
-	  if(mode == -1) {*nexport = 0;}
-
-	  numngb_inbox = ngb_treefind_fof_primary(pos, LinkL, target, &startnode, mode, nexport, nsend_local, MyFOF_PRIMARY_LINK_TYPES);
-	  if(numngb_inbox < 0) {return -2;}
-
-	  if(mode == -1) {if(*nexport == 0) {NonlocalFlag[target] = 0;} else {NonlocalFlag[target] = 1;}}
-
-	  for(n = 0; n < numngb_inbox; n++)
-	    {
-	      j = Ngblist[n];
-
-	      if(mode == 0 || mode == -1)
-		{
-		  if(Head[target] != Head[j])	/* only if not yet linked */
-		    {
-
-		      if(mode == 0)
-			endrun(87654);
-
-		      if(Len[Head[target]] > Len[Head[j]])	/* p group is longer */
-			{
-			  p = target;
-			  s = j;
-			}
-		      else
-			{
-			  p = j;
-			  s = target;
-			}
-		      Next[Tail[Head[p]]] = Head[s];
-
-		      Tail[Head[p]] = Tail[Head[s]];
-
-		      Len[Head[p]] += Len[Head[s]];
-
-		      ss = Head[s];
-		      do
-			Head[ss] = Head[p];
-		      while((ss = Next[ss]) >= 0);
-
-		      if(MinID[Head[s]] < MinID[Head[p]])
-			{
-			  MinID[Head[p]] = MinID[Head[s]];
-			  MinIDTask[Head[p]] = MinIDTask[Head[s]];
-			}
-		    }
-		}
-	      else		/* mode is 1 */
-		{
-		  if(MinID[Head[j]] > FoFDataGet[target].MinID)
-		    {
-		      MinID[Head[j]] = FoFDataGet[target].MinID;
-		      MinIDTask[Head[j]] = FoFDataGet[target].MinIDTask;
-		      links++;
-		    }
-		}
-	    }
-	}
-
-      if(mode == 1)
-	{
-	  listindex++;
-	  if(listindex < NODELISTLENGTH)
-	    {
-	      startnode = FoFDataGet[target].NodeList[listindex];
-	      if(startnode >= 0)
-		startnode = Nodes[startnode].u.d.nextnode;	/* open it */
-	    }
-	}
-    }
-
-  return links;
-}
+#include "../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
 
 
 
@@ -1419,10 +1300,90 @@ void fof_save_local_catalogue(int num)
 }
 
 
+#define CORE_FUNCTION_NAME fof_find_nearest_dmparticle_evaluate /* name of the 'core' function doing the actual inter-neighbor operations. this MUST be defined somewhere as "int CORE_FUNCTION_NAME(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)" */
+#define INPUTFUNCTION_NAME fof_particle2in_nearest    /* name of the function which loads the element data needed (for e.g. broadcast to other processors, neighbor search) */
+#define OUTPUTFUNCTION_NAME fof_out2particle_nearest  /* name of the function which takes the data returned from other processors and combines it back to the original elements */
+#define CONDITIONFUNCTION_FOR_EVALUATION if(((1 << P[i].Type) & (MyFOF_SECONDARY_LINK_TYPES)) && (fof_nearest_distance[i] > 1.0e29)) /* function for which elements will be 'active' and allowed to undergo operations. can be a function call, e.g. 'density_is_active(i)', or a direct function call like 'if(P[i].Mass>0)' */
+#define PRIMARY_LOOP_NUMBER_OF_ELEMENTS NumPart /* loop over all particles, not only the active ones */
+#include "../system/code_block_xchange_initialize.h" /* pre-define all the ALL_CAPS variables we will use below, so their naming conventions are consistent and they compile together, as well as defining some of the function calls needed */
+
+/* this structure defines the variables that need to be sent -from- the 'searching' element */
+static struct INPUT_STRUCT_NAME
+{
+  MyDouble Pos[3];
+  MyFloat Hsml;
+  int NodeList[NODELISTLENGTH];
+}
+ *DATAIN_NAME, *DATAGET_NAME;
+
+/* this subroutine assigns the values to the variables that need to be sent -from- the 'searching' element */
+static inline void fof_particle2in_nearest(struct INPUT_STRUCT_NAME *in, int i, int loop_iteration)
+{
+  int k; for(k = 0; k < 3; k++) {in->Pos[k] = P[i].Pos[k];}
+  in->Hsml = fof_nearest_hsml[i];
+}
+
+/* this structure defines the variables that need to be sent -back to- the 'searching' element */
+static struct OUTPUT_STRUCT_NAME
+{
+  MyFloat Distance;
+  MyIDType MinID;
+  MyIDType MinIDTask;
+}
+ *DATARESULT_NAME, *DATAOUT_NAME;
+
+/* this subroutine assigns the values to the variables that need to be sent -back to- the 'searching' element */
+static inline void fof_out2particle_nearest(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loop_iteration)
+{
+  if(out->Distance < fof_nearest_distance[i]) /* keep the nearest of the local and the remote candidates */
+    {
+      fof_nearest_distance[i] = out->Distance;
+      MinID[i] = out->MinID;
+      MinIDTask[i] = out->MinIDTask;
+    }
+}
+
+
+/*! finds the nearest primary-type particle within fof_nearest_hsml of a secondary-type particle, and returns its group label */
+/*!   -- this subroutine contains no writes to shared memory -- */
+int fof_find_nearest_dmparticle_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)
+{
+  int j, n, index = -1, startnode, numngb_inbox, listindex = 0; double r2max = 1.0e30, dx, dy, dz, r2;
+  struct INPUT_STRUCT_NAME local; struct OUTPUT_STRUCT_NAME out; memset(&out, 0, sizeof(struct OUTPUT_STRUCT_NAME)); /* define variables and zero memory and import data for local target*/
+  if(mode == 0) {INPUTFUNCTION_NAME(&local, target, loop_iteration);} else {local = DATAGET_NAME[target];} /* imports the data to the correct place and names */
+  if(mode == 0) {startnode = All.MaxPart; /* root node */} else {startnode = DATAGET_NAME[target].NodeList[0]; startnode = Nodes[startnode].u.d.nextnode;    /* open it */}
+  while(startnode >= 0)
+    {
+      while(startnode >= 0)
+	{
+	  numngb_inbox = ngb_treefind_variable_threads_targeted(local.Pos, local.Hsml, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist, MyFOF_PRIMARY_LINK_TYPES); // MyFOF_PRIMARY_LINK_TYPES defines which types of particles we search for
+	  if(numngb_inbox < 0) {return -2;}
+	  for(n = 0; n < numngb_inbox; n++)
+	    {
+	      j = ngblist[n]; /* since we use the -threaded- version above of ngb-finding, its super-important this is the lower-case ngblist here! */
+	      dx = local.Pos[0] - P[j].Pos[0];
+	      dy = local.Pos[1] - P[j].Pos[1];
+	      dz = local.Pos[2] - P[j].Pos[2];
+	      NEAREST_XYZ(dx,dy,dz,1);
+	      r2 = dx * dx + dy * dy + dz * dz;
+	      if(r2 < r2max && r2 < local.Hsml * local.Hsml)
+		{
+		  index = j;
+		  r2max = r2;
+		}
+	    }
+	}
+      if(mode == 1) {listindex++; if(listindex < NODELISTLENGTH) {startnode = DATAGET_NAME[target].NodeList[listindex]; if(startnode >= 0) {startnode = Nodes[startnode].u.d.nextnode; /* open it */}}} /* continue to open leaves if needed */
+    }
+  if(index >= 0) {out.Distance = sqrt(r2max); out.MinID = MinID[Head[index]]; out.MinIDTask = MinIDTask[Head[index]];} else {out.Distance = 2.0e30;}
+  if(mode == 0) {OUTPUTFUNCTION_NAME(&out, target, 0, loop_iteration);} else {DATARESULT_NAME[target] = out;} /* collects the result at the right place */
+  return 0;
+}
+
+
 void fof_find_nearest_dmparticle(void)
 {
-  int i, j, n, ntot, dummy;
-  int ndone, ndone_flag, ngrp, recvTask, place, nexport, nimport, npleft, iter;
+  int i, n, ntot, npleft, iter;
 
   PRINT_STATUS("Start finding nearest dm-particle (presently allocated=%g MB)",AllocatedBytes / (1024.0 * 1024.0));
   fof_nearest_distance = (float *) mymalloc("fof_nearest_distance", sizeof(float) * NumPart);
@@ -1438,147 +1399,14 @@ void fof_find_nearest_dmparticle(void)
     }
 
   /* allocate buffers to arrange communication */
-
-  Ngblist = (int *) mymalloc("Ngblist", NumPart * sizeof(int));
-
-    size_t MyBufferSize = All.BufferSize;
-    All.BunchSize = (int) ((MyBufferSize * 1024 * 1024) / (sizeof(struct data_index) + sizeof(struct data_nodelist) +
-					     sizeof(struct fofdata_in) + sizeof(struct fofdata_out) +
-					     sizemax(sizeof(struct fofdata_in), sizeof(struct fofdata_out))));
-    DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
-    DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
-
+  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
+  #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
 
   iter = 0;
   /* we will repeat the whole thing for those particles where we didn't find enough neighbours */
   do
     {
-      i = 0;			/* begin with this index */
-
-      do
-	{
-	  for(j = 0; j < NTask; j++)
-	    {
-	      Send_count[j] = 0;
-	      Exportflag[j] = -1;
-	    }
-
-	  /* do local particles and prepare export list */
-	  for(nexport = 0; i < NumPart; i++)
-	    if(((1 << P[i].Type) & (MyFOF_SECONDARY_LINK_TYPES)))
-	      {
-		if(fof_nearest_distance[i] > 1.0e29)
-		  {
-		    if(fof_find_nearest_dmparticle_evaluate(i, 0, &nexport, Send_count) < 0)
-		      break;
-		  }
-	      }
-
-	  MYSORT_DATAINDEX(DataIndexTable, nexport, sizeof(struct data_index), data_index_compare);
-
-	  MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD);
-
-	  for(j = 0, nimport = 0, Recv_offset[0] = 0, Send_offset[0] = 0; j < NTask; j++)
-	    {
-	      nimport += Recv_count[j];
-
-	      if(j > 0)
-		{
-		  Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];
-		  Recv_offset[j] = Recv_offset[j - 1] + Recv_count[j - 1];
-		}
-	    }
-
-	  FoFDataGet = (struct fofdata_in *) mymalloc("FoFDataGet", nimport * sizeof(struct fofdata_in));
-	  FoFDataIn = (struct fofdata_in *) mymalloc("FoFDataIn", nexport * sizeof(struct fofdata_in));
-
-      PRINT_STATUS("still finding nearest... (presently allocated=%g MB)",AllocatedBytes / (1024.0 * 1024.0));
-	  for(j = 0; j < nexport; j++)
-	    {
-	      place = DataIndexTable[j].Index;
-
-	      FoFDataIn[j].Pos[0] = P[place].Pos[0];
-	      FoFDataIn[j].Pos[1] = P[place].Pos[1];
-	      FoFDataIn[j].Pos[2] = P[place].Pos[2];
-	      FoFDataIn[j].Hsml = fof_nearest_hsml[place];
-
-	      memcpy(FoFDataIn[j].NodeList,
-		     DataNodeList[DataIndexTable[j].IndexGet].NodeList, NODELISTLENGTH * sizeof(int));
-	    }
-
-	  /* exchange particle data */
-	  for(ngrp = 1; ngrp < (1 << PTask); ngrp++)
-	    {
-	      recvTask = ThisTask ^ ngrp;
-
-	      if(recvTask < NTask)
-		{
-		  if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-		    {
-		      /* get the particles */
-		      MPI_Sendrecv(&FoFDataIn[Send_offset[recvTask]],
-				   Send_count[recvTask] * sizeof(struct fofdata_in), MPI_BYTE,
-				   recvTask, TAG_FOF_F,
-				   &FoFDataGet[Recv_offset[recvTask]],
-				   Recv_count[recvTask] * sizeof(struct fofdata_in), MPI_BYTE,
-				   recvTask, TAG_FOF_F, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-		    }
-		}
-	    }
-
-	  myfree(FoFDataIn);
-	  FoFDataResult =
-	    (struct fofdata_out *) mymalloc("FoFDataResult", nimport * sizeof(struct fofdata_out));
-	  FoFDataOut = (struct fofdata_out *) mymalloc("FoFDataOut", nexport * sizeof(struct fofdata_out));
-
-	  for(j = 0; j < nimport; j++)
-	    {
-	      fof_find_nearest_dmparticle_evaluate(j, 1, &dummy, &dummy);
-	    }
-
-	  for(ngrp = 1; ngrp < (1 << PTask); ngrp++)
-	    {
-	      recvTask = ThisTask ^ ngrp;
-	      if(recvTask < NTask)
-		{
-		  if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-		    {
-		      /* send the results */
-		      MPI_Sendrecv(&FoFDataResult[Recv_offset[recvTask]],
-				   Recv_count[recvTask] * sizeof(struct fofdata_out),
-				   MPI_BYTE, recvTask, TAG_FOF_G,
-				   &FoFDataOut[Send_offset[recvTask]],
-				   Send_count[recvTask] * sizeof(struct fofdata_out),
-				   MPI_BYTE, recvTask, TAG_FOF_G, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-		    }
-		}
-
-	    }
-
-	  for(j = 0; j < nexport; j++)
-	    {
-	      place = DataIndexTable[j].Index;
-
-	      if(FoFDataOut[j].Distance < fof_nearest_distance[place])
-		{
-		  fof_nearest_distance[place] = FoFDataOut[j].Distance;
-		  MinID[place] = FoFDataOut[j].MinID;
-		  MinIDTask[place] = FoFDataOut[j].MinIDTask;
-		}
-	    }
-
-	  if(i >= NumPart)
-	    ndone_flag = 1;
-	  else
-	    ndone_flag = 0;
-
-	  MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-
-	  myfree(FoFDataOut);
-	  myfree(FoFDataResult);
-	  myfree(FoFDataGet);
-	}
-      while(ndone < NTask);
+      #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
 
       /* do final operations on results */
       for(i = 0, npleft = 0; i < NumPart; i++)
@@ -1618,108 +1446,14 @@ void fof_find_nearest_dmparticle(void)
     }
   while(ntot > 0);
 
-  myfree(DataNodeList);
-  myfree(DataIndexTable);
-  myfree(Ngblist);
+  #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
 
   myfree(fof_nearest_hsml);
   myfree(fof_nearest_distance);
 
   PRINT_STATUS("done finding nearest dm-particle");
 }
-
-
-/*!   -- this subroutine is not openmp parallelized at present, so there's not any issue about conflicts over shared memory. if you make it openmp, make sure you protect the writes to shared memory here!!! -- */
-int fof_find_nearest_dmparticle_evaluate(int target, int mode, int *nexport, int *nsend_local)
-{
-  int j, n, index, listindex = 0;
-  int startnode, numngb_inbox;
-  double h, r2max;
-  double dx, dy, dz, r2;
-  MyDouble *pos;
-
-  if(mode == 0)
-    {
-      pos = P[target].Pos;
-      h = fof_nearest_hsml[target];
-    }
-  else
-    {
-      pos = FoFDataGet[target].Pos;
-      h = FoFDataGet[target].Hsml;
-    }
-
-  index = -1;
-  r2max = 1.0e30;
-
-  if(mode == 0)
-    {
-      startnode = All.MaxPart;	/* root node */
-    }
-  else
-    {
-      startnode = FoFDataGet[target].NodeList[0];
-      startnode = Nodes[startnode].u.d.nextnode;	/* open it */
-    }
-
-  while(startnode >= 0)
-    {
-      while(startnode >= 0)
-	{
-        numngb_inbox = ngb_treefind_variable_targeted(pos, h, target, &startnode, mode, nexport, nsend_local, MyFOF_PRIMARY_LINK_TYPES); // MyFOF_PRIMARY_LINK_TYPES defines which types of particles we search for
-        if(numngb_inbox < 0) {return -2;}
-
-	  for(n = 0; n < numngb_inbox; n++)
-	    {
-            j = Ngblist[n];
-            dx = pos[0] - P[j].Pos[0];
-            dy = pos[1] - P[j].Pos[1];
-            dz = pos[2] - P[j].Pos[2];
-            NEAREST_XYZ(dx,dy,dz,1);
-            r2 = dx * dx + dy * dy + dz * dz;
-            if(r2 < r2max && r2 < h * h)
-		{
-		  index = j;
-		  r2max = r2;
-		}
-	    }
-	}
-
-      if(mode == 1)
-	{
-	  listindex++;
-	  if(listindex < NODELISTLENGTH)
-	    {
-	      startnode = FoFDataGet[target].NodeList[listindex];
-	      if(startnode >= 0)
-		startnode = Nodes[startnode].u.d.nextnode;	/* open it */
-	    }
-	}
-    }
-
-
-  if(mode == 0)
-    {
-      if(index >= 0)
-	{
-	  fof_nearest_distance[target] = sqrt(r2max);
-	  MinID[target] = MinID[Head[index]];
-	  MinIDTask[target] = MinIDTask[Head[index]];
-	}
-    }
-  else
-    {
-      if(index >= 0)
-	{
-	  FoFDataResult[target].Distance = sqrt(r2max);
-	  FoFDataResult[target].MinID = MinID[Head[index]];
-	  FoFDataResult[target].MinIDTask = MinIDTask[Head[index]];
-	}
-      else
-	FoFDataResult[target].Distance = 2.0e30;
-    }
-  return 0;
-}
+#include "../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
 
 
 
@@ -1855,6 +1589,7 @@ void fof_make_black_holes(void)
 #ifdef BH_COUNTPROGS
         BPP(import_indices[n]).BH_CountProgs = 1;
 #endif
+        P_HOT_SYNC(import_indices[n]);
         /* record that we actually made a BH, count numbers for book-keeping in domains */
 #if (BH_SEED_FROM_FOF != 1)
         Stars_converted++;
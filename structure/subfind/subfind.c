@@ -104,7 +104,7 @@ void subfind(int num)
 	      if(ThisTask == 0)
 		printf("Tree construction for species %d (%d).\n", j, countall[j]);
 
-	      CPU_Step[CPU_FOF] += measure_time();
+	      CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 
 	      force_treebuild(count[j], d);
 
@@ -120,7 +120,7 @@ void subfind(int num)
 	      if(ThisTask == 0)
 		printf("Tree construction.\n");
 
-	      CPU_Step[CPU_FOF] += measure_time();
+	      CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 
 	      force_treebuild(NumPart, NULL);
 
@@ -165,7 +165,7 @@ void subfind(int num)
 	  if(ThisTask == 0)
 	    printf("Tree construction for species %d (%d).\n", j, countall[j]);
 
-	  CPU_Step[CPU_FOF] += measure_time();
+	  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 
 	  force_treebuild(count[j], d);
 
@@ -221,7 +221,7 @@ void subfind(int num)
   if(ThisTask == 0)
     printf("Tree construction.\n");
 
-  CPU_Step[CPU_FOF] += measure_time();
+  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 
   force_treebuild(NumPart, NULL);
 
@@ -397,7 +397,7 @@ void subfind(int num)
 
   domain_free_trick();
 
-  CPU_Step[CPU_FOF] += measure_time();
+  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 
 
 #ifdef FOF_DENSITY_SPLIT_TYPES
@@ -463,7 +463,7 @@ void subfind(int num)
 
   myfree(SubGroup);
 
-  CPU_Step[CPU_FOF] += measure_time();
+  CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF);
 }
 
 
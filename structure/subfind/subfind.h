@@ -39,7 +39,7 @@ void subfind_col_save_candidates_task(int totgrouplen, int num);
 void subfind_col_load_candidates(int num);
 
 void subfind(int num);
-int Subfind_DensityOtherProps_evaluate(int target, int mode, int *nexport, int *nsend_local);
+int Subfind_DensityOtherProps_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration);
 int subfind_contamination_treefind(MyDouble *searchcenter, MyFloat hsml, int target, int *startnode,
                                       int mode, int *nexport, int *nsend_local, double *Mass);
 int subfind_contamination_evaluate(int target, int mode, int *nexport, int *nsend_local);
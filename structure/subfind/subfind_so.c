@@ -30,41 +30,66 @@ struct Subfind_DensityOtherPropsEval_data_out *Subfind_DensityOtherPropsEval_Dat
  To add similar computations, follow their template (e.g. the "SUBFIND_ADDIO_..." options). This first subroutine is the core computation of the relevant properties
  in the group. compute them/add them into the "out" structure and the code here and other two scripts below should take care of the rest
 */
-/*!   -- this subroutine is not openmp parallelized at present, so there's not any issue about conflicts over shared memory. if you make it openmp, make sure you protect the writes to shared memory here!!! -- */
-/*! first define a short structure needed to pass in the group info here */
+/*! first define a short structure needed to pass in the group info here (used by the loop for the SO radii below) */
 static struct Subfind_DensityOtherPropsEval_data_in {MyDouble Pos[3]; MyOutputFloat R200; int NodeList[NODELISTLENGTH]; /* all needed for any version */} *Subfind_DensityOtherPropsEval_DataIn, *Subfind_DensityOtherPropsEval_DataGet;
+
+/*! the properties within the SO radii are computed in a loop over the groups on the threaded loop blocks */
+#define CORE_FUNCTION_NAME Subfind_DensityOtherProps_evaluate /* name of the 'core' function doing the actual inter-neighbor operations. this MUST be defined somewhere as "int CORE_FUNCTION_NAME(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)" */
+#define INPUTFUNCTION_NAME Subfind_DensityOtherProps_particle2in    /* name of the function which loads the element data needed (for e.g. broadcast to other processors, neighbor search) */
+#define OUTPUTFUNCTION_NAME Subfind_DensityOtherProps_out2particle  /* name of the function which takes the data returned from other processors and combines it back to the original elements */
+#define CONDITIONFUNCTION_FOR_EVALUATION if(Group[i].Nsubs > 0) /* function for which elements will be 'active' and allowed to undergo operations. can be a function call, e.g. 'density_is_active(i)', or a direct function call like 'if(P[i].Mass>0)' */
+#define PRIMARY_LOOP_NUMBER_OF_ELEMENTS Ngroups /* the elements here are the groups, not particles */
+#include "../../system/code_block_xchange_initialize.h" /* pre-define all the ALL_CAPS variables we will use below, so their naming conventions are consistent and they compile together, as well as defining some of the function calls needed */
+
+static struct INPUT_STRUCT_NAME {MyDouble Pos[3]; MyOutputFloat R200; int NodeList[NODELISTLENGTH];} *DATAIN_NAME, *DATAGET_NAME;
+static inline void Subfind_DensityOtherProps_particle2in(struct INPUT_STRUCT_NAME *in, int i, int loop_iteration) {int k; for(k=0;k<3;k++) {in->Pos[k]=Group[i].Pos[k];} in->R200=R200[i];}
+static struct OUTPUT_STRUCT_NAME {struct Subfind_DensityOtherPropsEval_data_out Props;} *DATARESULT_NAME, *DATAOUT_NAME;
+static inline void Subfind_DensityOtherProps_out2particle(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loop_iteration) {out2particle_Subfind_DensityOtherPropsEval(&out->Props, i, mode);}
+
 /*! now the main routine */
-int Subfind_DensityOtherProps_evaluate(int target, int mode, int *nexport, int *nsend_local)
+/*!   -- this subroutine contains no writes to shared memory -- */
+int Subfind_DensityOtherProps_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)
 {
-    int ngb,n,j,k,startnode,listindex=0; double *subhalo_pos, Hsearch; struct Subfind_DensityOtherPropsEval_data_out out; memset(&out, 0, sizeof(struct Subfind_DensityOtherPropsEval_data_out));
-    if(mode == 0) {subhalo_pos=Group[target].Pos; Hsearch=R200[target];} else {subhalo_pos=Subfind_DensityOtherPropsEval_DataGet[target].Pos; Hsearch=Subfind_DensityOtherPropsEval_DataGet[target].R200;}
-    if(mode == 0) {startnode = All.MaxPart;} else {startnode = Subfind_DensityOtherPropsEval_DataGet[target].NodeList[0]; startnode = Nodes[startnode].u.d.nextnode;}
+    int ngb,n,j,k,startnode,listindex=0; double Hsearch; struct INPUT_STRUCT_NAME local; struct OUTPUT_STRUCT_NAME out_props; memset(&out_props, 0, sizeof(struct OUTPUT_STRUCT_NAME)); struct Subfind_DensityOtherPropsEval_data_out *out = &out_props.Props;
+    if(mode == 0) {INPUTFUNCTION_NAME(&local, target, loop_iteration);} else {local = DATAGET_NAME[target];} /* imports the data to the correct place and names */
+    MyDouble *subhalo_pos = local.Pos; Hsearch = local.R200;
+    if(mode == 0) {startnode = All.MaxPart;} else {startnode = DATAGET_NAME[target].NodeList[0]; startnode = Nodes[startnode].u.d.nextnode;}
     while(startnode >= 0) {while(startnode >= 0) {
-      ngb = ngb_treefind_variable_targeted(subhalo_pos, Hsearch, target, &startnode, mode, nexport, nsend_local, 63);
+      ngb = ngb_treefind_variable_threads_targeted(subhalo_pos, Hsearch, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist, 63);
       if(ngb < 0) {return -2;}
       for(n = 0; n < ngb; n++)
-        { j = Ngblist[n];
+        { j = ngblist[n]; /* since we use the -threaded- version above of ngb-finding, its super-important this is the lower-case ngblist here! */
             double dp[3]; for(k=0;k<3;k++) {dp[k]=P[j].Pos[k]-subhalo_pos[k];} NEAREST_XYZ(dp[0],dp[1],dp[2],-1); double r2=dp[0]*dp[0]+dp[1]*dp[1]+dp[2]*dp[2]; if(r2>Hsearch*Hsearch) continue; /* position offset */
-            out.M200+=P[j].Mass;
+            out->M200+=P[j].Mass;
             
 #ifdef SUBFIND_ADDIO_VELDISP
-            for(k=0;k<3;k++) {double dv=P[j].Vel[k]/All.cf_atime+All.cf_hubble_a*All.cf_atime*dp[k]; out.V200[k]+=P[j].Mass*dv; out.Disp200+=P[j].Mass*dv*dv;}
+            for(k=0;k<3;k++) {double dv=P[j].Vel[k]/All.cf_atime+All.cf_hubble_a*All.cf_atime*dp[k]; out->V200[k]+=P[j].Mass*dv; out->Disp200+=P[j].Mass*dv*dv;}
 #endif
 #ifdef SUBFIND_ADDIO_BARYONS
             if(P[j].Type==0)
             {
                 double temp_keV = 6.14e-16 * (SphP[j].InternalEnergy/UNIT_SPECEGY_IN_CGS); /* temp in keV, for fully-ionized primordial gas */
-                out.gas_mass += P[j].Mass; out.temp += P[j].Mass * temp_keV;
-                out.xlum += 1.52e-20 * (P[j].Mass*UNIT_MASS_IN_CGS) * (SphP[j].Density*All.cf_a3inv*UNIT_DENSITY_IN_CGS) * sqrt(temp_keV); /* converts to 1e44 erg/s assuming thermal brems for fully-ionized primordial composition */
-            } else if (P[j].Type==4) {out.star_mass += P[j].Mass;}
+                out->gas_mass += P[j].Mass; out->temp += P[j].Mass * temp_keV;
+                out->xlum += 1.52e-20 * (P[j].Mass*UNIT_MASS_IN_CGS) * (SphP[j].Density*All.cf_a3inv*UNIT_DENSITY_IN_CGS) * sqrt(temp_keV); /* converts to 1e44 erg/s assuming thermal brems for fully-ionized primordial composition */
+            } else if (P[j].Type==4) {out->star_mass += P[j].Mass;}
 #endif
             
         }
-    } if(mode==1) {listindex++; if(listindex < NODELISTLENGTH) {startnode = Subfind_DensityOtherPropsEval_DataGet[target].NodeList[listindex]; if(startnode >= 0) startnode = Nodes[startnode].u.d.nextnode;}}}
-    if(mode == 0) {out2particle_Subfind_DensityOtherPropsEval(&out, target, 0);} else {Subfind_DensityOtherPropsEval_DataResult[target] = out;} /* collects the result at the right place */
+    } if(mode==1) {listindex++; if(listindex < NODELISTLENGTH) {startnode = DATAGET_NAME[target].NodeList[listindex]; if(startnode >= 0) startnode = Nodes[startnode].u.d.nextnode;}}}
+    if(mode == 0) {OUTPUTFUNCTION_NAME(&out_props, target, 0, loop_iteration);} else {DATARESULT_NAME[target] = out_props;} /* collects the result at the right place */
   return 0;
 }
 
+/*! the loop over the groups (for the present R200 of each) which calls the routine above */
+static void Subfind_DensityOtherProps_Eval(void)
+{
+    CPU_Step[CPU_FOF] += measure_time_phase(CPU_FOF); /* time up to here belongs to subfind (the block below books its own start to CPU_MISC) */
+    #include "../../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
+    #include "../../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
+    #include "../../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
+}
+#include "../../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
+
 /*! add data from other processors back to shared structure after computation. usually ASSIGN_ADD for normal 'set it equal if initial step, then add', but here in case you need to take maxes or mins or other complicated operations */
 static inline void out2particle_Subfind_DensityOtherPropsEval(struct Subfind_DensityOtherPropsEval_data_out *out, int i, int mode)
 {
@@ -107,18 +132,12 @@ void Subfind_DensityOtherProps_Loop(void)
     double t0, t1, t2, t3, rguess, overdensity, Deltas[SUBFIND_ADDIO_NUMOVERDEN], z;
 
     /* allocate buffers to arrange communication */
-    Ngblist = (int *) mymalloc("Ngblist", NumPart * sizeof(int));
     Left = (MyFloat *) mymalloc("Left", sizeof(MyFloat) * Ngroups);
     Right = (MyFloat *) mymalloc("Right", sizeof(MyFloat) * Ngroups);
     R200 = (MyOutputFloat *) mymalloc("R200", sizeof(MyOutputFloat) * Ngroups);
     M200 = (MyOutputFloat *) mymalloc("M200", sizeof(MyOutputFloat) * Ngroups);
     Subfind_DensityOtherPropsEval_GlobalPasser = (struct Subfind_DensityOtherPropsEval_data_out *) mymalloc("Subfind_DensityOtherPropsEval_GlobalPasser",Ngroups * sizeof(struct Subfind_DensityOtherPropsEval_data_out));
     Todo = (char *)mymalloc("Todo", sizeof(char) * Ngroups);
-    size_t MyBufferSize = (size_t)All.BufferSize;
-    All.BunchSize = (int) ((MyBufferSize * 1024 * 1024) / (sizeof(struct data_index) + sizeof(struct data_nodelist) + sizeof(struct Subfind_DensityOtherPropsEval_data_in) + sizeof(struct Subfind_DensityOtherPropsEval_data_out) +
-                     sizemax(sizeof(struct Subfind_DensityOtherPropsEval_data_in), sizeof(struct Subfind_DensityOtherPropsEval_data_out))));
-    DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
-    DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
 
     if(All.ComovingIntegrationOn) {z = 1 / All.Time - 1;} else {z = 0;}
     double rhoback = 3 * All.OmegaMatter * All.Hubble_H0_CodeUnits * All.Hubble_H0_CodeUnits / (8 * M_PI * All.G), zplusone=1.+z;
@@ -142,6 +161,12 @@ void Subfind_DensityOtherProps_Loop(void)
   for(rep = 0; rep < SUBFIND_ADDIO_NUMOVERDEN; rep++)	/* repeat for all three overdensity values */
     {
       t2 = my_second();
+      /* allocate buffers to arrange communication for the SO radius loop */
+      size_t MyBufferSize = (size_t)All.BufferSize;
+      All.BunchSize = (int) ((MyBufferSize * 1024 * 1024) / (sizeof(struct data_index) + sizeof(struct data_nodelist) + sizeof(struct Subfind_DensityOtherPropsEval_data_in) + sizeof(struct Subfind_DensityOtherPropsEval_data_out) +
+                       sizemax(sizeof(struct Subfind_DensityOtherPropsEval_data_in), sizeof(struct Subfind_DensityOtherPropsEval_data_out))));
+      DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
+      DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
       for(i = 0; i < Ngroups; i++)
     {
       if(Group[i].Nsubs > 0)
@@ -317,117 +342,11 @@ void Subfind_DensityOtherProps_Loop(void)
           fflush(stdout);
         }
 
-      t0 = my_second();
-      i = 0;			/* begin with this index */
-      do
-	{
-	  for(j = 0; j < NTask; j++)
-	    {
-	      Send_count[j] = 0;
-	      Exportflag[j] = -1;
-	    }
-
-	  /* do local particles and prepare export list */
-
-	  for(nexport = 0; i < Ngroups; i++)
-	    {
-	      if(Subfind_DensityOtherProps_evaluate(i, 0, &nexport, Send_count) < 0)
-		break;
-	    }
-	  qsort(DataIndexTable, nexport, sizeof(struct data_index), data_index_compare);
-
-	  MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD);
-
-	  for(j = 0, nimport = 0, Recv_offset[0] = 0, Send_offset[0] = 0; j < NTask; j++)
-	    {
-	      nimport += Recv_count[j];
-
-	      if(j > 0)
-		{
-		  Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];
-		  Recv_offset[j] = Recv_offset[j - 1] + Recv_count[j - 1];
-		}
-	    }
-
-	  Subfind_DensityOtherPropsEval_DataGet = (struct Subfind_DensityOtherPropsEval_data_in *) mymalloc("	  Subfind_DensityOtherPropsEval_DataGet", nimport * sizeof(struct Subfind_DensityOtherPropsEval_data_in));
-	  Subfind_DensityOtherPropsEval_DataIn = (struct Subfind_DensityOtherPropsEval_data_in *) mymalloc("	  Subfind_DensityOtherPropsEval_DataIn", nexport * sizeof(struct Subfind_DensityOtherPropsEval_data_in));
-
-	  /* prepare particle data for export */
-	  for(j = 0; j < nexport; j++)
-	    {
-	      place = DataIndexTable[j].Index;
-
-	      Subfind_DensityOtherPropsEval_DataIn[j].Pos[0] = Group[place].Pos[0];
-	      Subfind_DensityOtherPropsEval_DataIn[j].Pos[1] = Group[place].Pos[1];
-	      Subfind_DensityOtherPropsEval_DataIn[j].Pos[2] = Group[place].Pos[2];
-	      Subfind_DensityOtherPropsEval_DataIn[j].R200 = R200[place];
-
-	      memcpy(Subfind_DensityOtherPropsEval_DataIn[j].NodeList,
-		     DataNodeList[DataIndexTable[j].IndexGet].NodeList, NODELISTLENGTH * sizeof(int));
-	    }
-
-	  /* exchange data */
-	  for(ngrp = 1; ngrp < (1 << PTask); ngrp++)
-	    {
-	      recvTask = ThisTask ^ ngrp;
-
-	      if(recvTask < NTask)
-		{
-		  if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-		    {
-		      /* get the data */
-		      MPI_Sendrecv(&Subfind_DensityOtherPropsEval_DataIn[Send_offset[recvTask]],
-				   Send_count[recvTask] * sizeof(struct Subfind_DensityOtherPropsEval_data_in), MPI_BYTE,
-				   recvTask, TAG_DENS_A,
-				   &Subfind_DensityOtherPropsEval_DataGet[Recv_offset[recvTask]],
-				   Recv_count[recvTask] * sizeof(struct Subfind_DensityOtherPropsEval_data_in), MPI_BYTE,
-				   recvTask, TAG_DENS_A, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-		    }
-		}
-	    }
-
-	  myfree(Subfind_DensityOtherPropsEval_DataIn);
-	  Subfind_DensityOtherPropsEval_DataResult = (struct Subfind_DensityOtherPropsEval_data_out *) mymalloc("	  Subfind_DensityOtherPropsEval_DataResult", nimport * sizeof(struct Subfind_DensityOtherPropsEval_data_out));
-	  Subfind_DensityOtherPropsEval_DataOut = (struct Subfind_DensityOtherPropsEval_data_out *) mymalloc("	  Subfind_DensityOtherPropsEval_DataOut", nexport * sizeof(struct Subfind_DensityOtherPropsEval_data_out));
-
-	  /* now do the locations that were sent to us */
-	  for(j = 0; j < nimport; j++)
-	    Subfind_DensityOtherProps_evaluate(j, 1, &dummy, &dummy);
-
-	  if(i >= Ngroups)
-	    ndone_flag = 1;
-	  else
-	    ndone_flag = 0;
-
-	  MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+      myfree(DataNodeList); myfree(DataIndexTable); /* done with the SO radii: the loop below allocates its own buffers */
 
-	  /* get the result */
-	  for(ngrp = 1; ngrp < (1 << PTask); ngrp++)
-	    {
-	      recvTask = ThisTask ^ ngrp;
-	      if(recvTask < NTask)
-		{
-		  if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-		    {
-		      /* send the results */
-		      MPI_Sendrecv(&Subfind_DensityOtherPropsEval_DataResult[Recv_offset[recvTask]], Recv_count[recvTask] * sizeof(struct Subfind_DensityOtherPropsEval_data_out), MPI_BYTE, recvTask, TAG_DENS_B,
-				   &Subfind_DensityOtherPropsEval_DataOut[Send_offset[recvTask]], Send_count[recvTask] * sizeof(struct Subfind_DensityOtherPropsEval_data_out), MPI_BYTE, recvTask, TAG_DENS_B, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-		    }
-		}
-	    }
-
-	  /* add the result to the local particles */
-	  for(j = 0; j < nexport; j++)
-	    {
-	      place = DataIndexTable[j].Index;
-            out2particle_Subfind_DensityOtherPropsEval(Subfind_DensityOtherPropsEval_DataOut, place, 1);
-	    }
-
-	  myfree(Subfind_DensityOtherPropsEval_DataOut);
-	  myfree(Subfind_DensityOtherPropsEval_DataResult);
-	  myfree(Subfind_DensityOtherPropsEval_DataGet);
-	}
-      while(ndone < NTask);
+      t0 = my_second();
+      memset(Subfind_DensityOtherPropsEval_GlobalPasser, 0, Ngroups * sizeof(struct Subfind_DensityOtherPropsEval_data_out));
+      Subfind_DensityOtherProps_Eval();
 
       MPI_Barrier(MPI_COMM_WORLD);
 
@@ -468,16 +387,12 @@ void Subfind_DensityOtherProps_Loop(void)
   t1 = my_second();
   if(ThisTask == 0) {printf("Saving data took %g sec\n", timediff(t0, t1)); fflush(stdout);}
 
-  myfree(DataNodeList);
-  myfree(DataIndexTable);
   myfree(Todo);
   myfree(Subfind_DensityOtherPropsEval_GlobalPasser);
   myfree(M200);
   myfree(R200);
   myfree(Right);
   myfree(Left);
-
-  myfree(Ngblist);
 }
 
 
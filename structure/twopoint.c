@@ -29,19 +29,10 @@
 #endif
 /* above sets fraction of particles selected for sphere placement. Will be scaled with total particle number so that a fixed value should give roughly the same noise level in the meaurement, indpendent of simulation size */
 
-struct twopointdata_in
-{
-  MyDouble Pos[3];
-  MyFloat Rs;
-  int NodeList[NODELISTLENGTH];
-}
- *TwoPointDataIn, *TwoPointDataGet;
-
-
 #define SQUARE_IT(x) ((x)*(x))
 
 
-static long long Count[BINS_TP], Count_bak[BINS_TP];
+static long long Count[BINS_TP];
 static long long CountSpheres[BINS_TP];
 static double Xi[BINS_TP];
 static double Rbin[BINS_TP];
@@ -53,14 +44,54 @@ static double binfac;
 static double PartMass;
 
 static MyFloat *RsList;
+static int *SphereIndex;          /* position of the sphere around particle i in SphereCount, or -1 if it has none */
+static long long *SphereCount;    /* pair counts of each local sphere, BINS_TP per sphere, summed into Count[] after the loop */
+
 
 
+#define CORE_FUNCTION_NAME twopoint_count_local /* name of the 'core' function doing the actual inter-neighbor operations. this MUST be defined somewhere as "int CORE_FUNCTION_NAME(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)" */
+#define INPUTFUNCTION_NAME twopoint_particle2in    /* name of the function which loads the element data needed (for e.g. broadcast to other processors, neighbor search) */
+#define OUTPUTFUNCTION_NAME twopoint_out2particle  /* name of the function which takes the data returned from other processors and combines it back to the original elements */
+#define CONDITIONFUNCTION_FOR_EVALUATION if(RsList[i] > 0) /* function for which elements will be 'active' and allowed to undergo operations. can be a function call, e.g. 'density_is_active(i)', or a direct function call like 'if(P[i].Mass>0)' */
+#define PRIMARY_LOOP_NUMBER_OF_ELEMENTS NumPart /* the sphere centers are drawn from all particles, not only the active ones */
+#include "../system/code_block_xchange_initialize.h" /* pre-define all the ALL_CAPS variables we will use below, so their naming conventions are consistent and they compile together, as well as defining some of the function calls needed */
+
+/* this structure defines the variables that need to be sent -from- the 'searching' element */
+static struct INPUT_STRUCT_NAME
+{
+  MyDouble Pos[3];
+  MyFloat Rs;
+  int NodeList[NODELISTLENGTH];
+}
+ *DATAIN_NAME, *DATAGET_NAME;
+
+/* this subroutine assigns the values to the variables that need to be sent -from- the 'searching' element */
+static inline void twopoint_particle2in(struct INPUT_STRUCT_NAME *in, int i, int loop_iteration)
+{
+  int k; for(k = 0; k < 3; k++) {in->Pos[k] = P[i].Pos[k];}
+  in->Rs = RsList[i];
+}
+
+/* this structure defines the variables that need to be sent -back to- the 'searching' element */
+static struct OUTPUT_STRUCT_NAME
+{
+  long long Count[BINS_TP];
+}
+ *DATARESULT_NAME, *DATAOUT_NAME;
+
+/* this subroutine assigns the values to the variables that need to be sent -back to- the 'searching' element: here the pair counts of the sphere are stored with the sphere (set in mode 0, so a sphere evaluated again is not counted twice) */
+static inline void twopoint_out2particle(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loop_iteration)
+{
+  int k; long long *count = SphereCount + (long long) SphereIndex[i] * BINS_TP;
+  for(k = 0; k < BINS_TP; k++) {ASSIGN_ADD(count[k], out->Count[k], mode);}
+}
+
 
 /*  This function computes the two-point function.
  */
 void twopoint(void)
 {
-    int i, j, k, bin, n, ndone, ndone_flag, dummy, nexport, nimport, place, recvTask, ngrp;
+    int i, j, bin, n, nspheres;
     double p, rs, vol, scaled_frac, tstart, tend, mass, masstot; long long *countbuf; void *state_buffer;
     PRINT_STATUS("begin two-point correlation function..."); tstart = my_second();
     /* set inner and outer radius for the bins that are used for the correlation function estimate */
@@ -69,62 +100,31 @@ void twopoint(void)
     for(i = 0, mass = 0; i < NumPart; i++) {mass += P[i].Mass;}
     MPI_Allreduce(&mass, &masstot, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD); PartMass = masstot / All.TotNumPart;
     for(i = 0; i < BINS_TP; i++) {Count[i] = 0; CountSpheres[i] = 0;}
-    /* allocate buffers to arrange communication */
+    /* select the sphere centers and radii first (serially, since they use the random number generator), then count pairs in the threaded loop */
     RsList = (MyFloat *) mymalloc("RsList", NumPart * sizeof(MyFloat));
-    size_t MyBufferSize = All.BufferSize;
-    All.BunchSize = (int) ((MyBufferSize * 1024 * 1024) / (sizeof(struct data_index) + sizeof(struct data_nodelist) + 2 * sizeof(struct twopointdata_in)));
-    DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
-    DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
+    SphereIndex = (int *) mymalloc("SphereIndex", NumPart * sizeof(int));
     state_buffer = mymalloc("state_buffer", gsl_rng_size(random_generator));
     memcpy(state_buffer, gsl_rng_state(random_generator), gsl_rng_size(random_generator));
     gsl_rng_set(random_generator, P[0].ID + ThisTask);    /* seed things with first particle ID to make sure we are different on each CPU */
-    i = 0;            /* begin with this index */
-    do
+    for(i = 0, nspheres = 0; i < NumPart; i++)
     {
-        for(j = 0; j < NTask; j++) {Send_count[j] = 0; Exportflag[j] = -1;}
-        for(nexport = 0; i < NumPart; i++) /* do local particles and prepare export list */
+        RsList[i] = 0; SphereIndex[i] = -1;
         if(gsl_rng_uniform(random_generator) < scaled_frac)
         {
           p = gsl_rng_uniform(random_generator); rs = pow(pow(R0, ALPHA) + p * (pow(R1, ALPHA) - pow(R0, ALPHA)), 1 / ALPHA);
-          bin = (int) ((log(rs) - logR0) * binfac); rs = exp((bin + 1) / binfac + logR0); RsList[i] = rs;
-          if(twopoint_count_local(i, 0, &nexport, Send_count) < 0) {break;}
+          bin = (int) ((log(rs) - logR0) * binfac); rs = exp((bin + 1) / binfac + logR0); RsList[i] = rs; SphereIndex[i] = nspheres++;
           for(j = 0; j <= bin; j++) {CountSpheres[j]++;}
         }
-        MYSORT_DATAINDEX(DataIndexTable, nexport, sizeof(struct data_index), data_index_compare);
-        MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD);
-        for(j = 0, nimport = 0, Recv_offset[0] = 0, Send_offset[0] = 0; j < NTask; j++)
-        {
-          nimport += Recv_count[j];
-          if(j > 0) {Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1]; Recv_offset[j] = Recv_offset[j - 1] + Recv_count[j - 1];}
-        }
-        TwoPointDataGet = (struct twopointdata_in *) mymalloc("TwoPointDataGet", nimport * sizeof(struct twopointdata_in));
-        TwoPointDataIn = (struct twopointdata_in *) mymalloc("TwoPointDataIn", nexport * sizeof(struct twopointdata_in));
-        for(j = 0; j < nexport; j++)
-        {
-          place = DataIndexTable[j].Index;
-          for(k = 0; k < 3; k++) {TwoPointDataIn[j].Pos[k] = P[place].Pos[k];}
-          TwoPointDataIn[j].Rs = RsList[place];
-          memcpy(TwoPointDataIn[j].NodeList, DataNodeList[DataIndexTable[j].IndexGet].NodeList, NODELISTLENGTH * sizeof(int));
-        }
-        /* exchange particle data */
-        for(ngrp = 1; ngrp < (1 << PTask); ngrp++)
-        {
-          recvTask = ThisTask ^ ngrp;
-          if(recvTask < NTask)
-            if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-            { /* get the particles */
-              MPI_Sendrecv(&TwoPointDataIn[Send_offset[recvTask]], Send_count[recvTask] * sizeof(struct twopointdata_in), MPI_BYTE, recvTask, TAG_HYDRO_A,
-                     &TwoPointDataGet[Recv_offset[recvTask]], Recv_count[recvTask] * sizeof(struct twopointdata_in), MPI_BYTE, recvTask, TAG_HYDRO_A, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            }
-        }
-        myfree(TwoPointDataIn);
-        for(j = 0; j < nimport; j++) {twopoint_count_local(j, 1, &dummy, &dummy);}
-        if(i >= NumPart) {ndone_flag = 1;} else {ndone_flag = 0;}
-        MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-        myfree(TwoPointDataGet);
-    } while(ndone < NTask);
+    }
     memcpy(gsl_rng_state(random_generator), state_buffer, gsl_rng_size(random_generator));
-    myfree(state_buffer); myfree(DataNodeList); myfree(DataIndexTable); myfree(RsList);
+    myfree(state_buffer);
+    SphereCount = (long long *) mymalloc("SphereCount", ((size_t) nspheres * BINS_TP + 1) * sizeof(long long));
+    /* allocate buffers to arrange communication */
+    #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
+    #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
+    #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
+    for(i = 0; i < NumPart; i++) {if(SphereIndex[i] >= 0) {for(j = 0; j < BINS_TP; j++) {Count[j] += SphereCount[(long long) SphereIndex[i] * BINS_TP + j];}}}
+    myfree(SphereCount); myfree(SphereIndex); myfree(RsList);
 
     /* Now compute the actual correlation function */
     countbuf = (long long int *) mymalloc("countbuf", NTask * BINS_TP * sizeof(long long));
@@ -167,61 +167,23 @@ void twopoint_save(void)
 
 /*! This function counts the pairs in a sphere
  */
-/*!   -- this subroutine is not openmp parallelized at present, so there's not any issue about conflicts over shared memory. if you make it openmp, make sure you protect the writes to shared memory here!!! -- */
-int twopoint_count_local(int target, int mode, int *nexport, int *nsend_local)
+/*!   -- this subroutine contains no writes to shared memory (the counts are added to the totals in twopoint_out2particle) -- */
+int twopoint_count_local(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)
 {
-  int startnode, listindex = 0;
-  MyDouble *pos;
-  MyFloat rs;
-
-  if(mode == 0)
-    {
-      pos = P[target].Pos;
-      rs = RsList[target];
-      memcpy(Count_bak, Count, sizeof(long long) * BINS_TP);
-    }
-  else
-    {
-      pos = TwoPointDataGet[target].Pos;
-      rs = TwoPointDataGet[target].Rs;
-    }
-
+  int startnode, listindex = 0; struct INPUT_STRUCT_NAME local; struct OUTPUT_STRUCT_NAME out; memset(&out, 0, sizeof(struct OUTPUT_STRUCT_NAME)); /* define variables and zero memory and import data for local target*/
+  if(mode == 0) {INPUTFUNCTION_NAME(&local, target, loop_iteration);} else {local = DATAGET_NAME[target];} /* imports the data to the correct place and names */
 
   /* Now start the actual tree-walk for this particle */
-
-  if(mode == 0)
-    {
-      startnode = All.MaxPart;	/* root node */
-    }
-  else
-    {
-      startnode = TwoPointDataGet[target].NodeList[0];
-      startnode = Nodes[startnode].u.d.nextnode;	/* open it */
-    }
-
+  if(mode == 0) {startnode = All.MaxPart; /* root node */} else {startnode = DATAGET_NAME[target].NodeList[0]; startnode = Nodes[startnode].u.d.nextnode;    /* open it */}
   while(startnode >= 0)
     {
       while(startnode >= 0)
 	{
-	  if(twopoint_ngb_treefind_variable(pos, rs, target, &startnode, mode, nexport, nsend_local) < 0)
-	    {
-	      /* in this case restore the count-table */
-	      memcpy(Count, Count_bak, sizeof(long long) * BINS_TP); {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
-	    }
-	}
-
-      if(mode == 1)
-	{
-	  listindex++;
-	  if(listindex < NODELISTLENGTH)
-	    {
-	      startnode = TwoPointDataGet[target].NodeList[listindex];
-	      if(startnode >= 0)
-		startnode = Nodes[startnode].u.d.nextnode;	/* open it */
-	    }
+	  if(twopoint_ngb_treefind_variable(local.Pos, local.Rs, target, &startnode, mode, exportflag, exportnodecount, exportindex, out.Count) < 0) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
 	}
+      if(mode == 1) {listindex++; if(listindex < NODELISTLENGTH) {startnode = DATAGET_NAME[target].NodeList[listindex]; if(startnode >= 0) {startnode = Nodes[startnode].u.d.nextnode; /* open it */}}} /* continue to open leaves if needed */
     }
-
+  if(mode == 0) {OUTPUTFUNCTION_NAME(&out, target, 0, loop_iteration);} else {DATARESULT_NAME[target] = out;} /* collects the result at the right place */
   return 0;
 }
 
@@ -233,17 +195,15 @@ int twopoint_count_local(int target, int mode, int *nexport, int *nsend_local)
  *    this is a custom version of "ngb_treefind_variable", hard-coded for a square box (no shearing!) and variable search threshold radii, 
  *    bin-dumping, etc. as a result, updates to the core neighbor search routine will not alter this subroutine
  */
-/*!   -- this subroutine is not openmp parallelized at present, so there's not any issue about conflicts over shared memory. if you make it openmp, make sure you protect the writes to shared memory here!!! -- */
-int twopoint_ngb_treefind_variable(MyDouble searchcenter[3], MyFloat rsearch, int target, int *startnode, int mode, int *nexport, int *nsend_local)
+/*!   -- the pairs are counted into 'count' (the caller's own bins), and exports use the per-thread buffers, so this can run in several threads at once -- */
+int twopoint_ngb_treefind_variable(MyDouble searchcenter[3], MyFloat rsearch, int target, int *startnode, int mode, int *exportflag, int *exportnodecount, int *exportindex, long long *count)
 {
   double r2, r, ri, ro;
-  int no, p, bin, task, bin2, nexport_save;
+  int no, p, bin, task, bin2;
   struct NODE *current;
   MyDouble dx, dy, dz, dist;
   MyDouble xtmp; xtmp=0;
 
-  nexport_save = *nexport;
-
   no = *startnode;
 
   while(no >= 0)
@@ -265,7 +225,7 @@ int twopoint_ngb_treefind_variable(MyDouble searchcenter[3], MyFloat rsearch, in
 		{
 		  bin = (int) ((log(sqrt(r2)) - logR0) * binfac);
 		  if(bin < BINS_TP)
-		    Count[bin]++;
+		    count[bin]++;
 		}
 	    }
 	}
@@ -278,36 +238,28 @@ int twopoint_ngb_treefind_variable(MyDouble searchcenter[3], MyFloat rsearch, in
 
 	      if(target >= 0)	/* if no target is given, export will not occur */
 		{
-		  if(Exportflag[task = DomainTask[no - (All.MaxPart + MaxNodes)]] != target)
+		  if(exportflag[task = DomainTask[no - (All.MaxPart + MaxNodes)]] != target)
 		    {
-		      Exportflag[task] = target;
-		      Exportnodecount[task] = NODELISTLENGTH;
+		      exportflag[task] = target;
+		      exportnodecount[task] = NODELISTLENGTH;
 		    }
 
-		  if(Exportnodecount[task] == NODELISTLENGTH)
+		  if(exportnodecount[task] == NODELISTLENGTH)
 		    {
-		      if(*nexport >= All.BunchSize)
-			{
-			  *nexport = nexport_save;
-			  if(nexport_save == 0) {endrun(13004);}	/* in this case, the buffer is too small to process even a single particle */
-			  for(task = 0; task < NTask; task++) {nsend_local[task] = 0;}
-			  for(no = 0; no < nexport_save; no++) {nsend_local[DataIndexTable[no].Task]++;}
-			  return -1; /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
-			}
-		      Exportnodecount[task] = 0;
-		      Exportindex[task] = *nexport;
-		      DataIndexTable[*nexport].Task = task;
-		      DataIndexTable[*nexport].Index = target;
-		      DataIndexTable[*nexport].IndexGet = *nexport;
-		      *nexport = *nexport + 1;
-		      nsend_local[task]++;
+		      long nexp = export_block_next_slot(exportflag); /* slot in this thread's block of the export table */
+		      if(nexp < 0) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
+		      exportnodecount[task] = 0;
+		      exportindex[task] = nexp;
+		      DataIndexTable[nexp].Task = task;
+		      DataIndexTable[nexp].Index = target;
+		      DataIndexTable[nexp].IndexGet = nexp;
 		    }
 
-		  DataNodeList[Exportindex[task]].NodeList[Exportnodecount[task]++] =
+		  DataNodeList[exportindex[task]].NodeList[exportnodecount[task]++] =
 		    DomainNodeIndex[no - (All.MaxPart + MaxNodes)];
 
-		  if(Exportnodecount[task] < NODELISTLENGTH)
-		    DataNodeList[Exportindex[task]].NodeList[Exportnodecount[task]] = -1;
+		  if(exportnodecount[task] < NODELISTLENGTH)
+		    DataNodeList[exportindex[task]].NodeList[exportnodecount[task]] = -1;
 		}
 
 	      no = Nextnode[no - MaxNodes];
@@ -356,7 +308,7 @@ int twopoint_ngb_treefind_variable(MyDouble searchcenter[3], MyFloat rsearch, in
 			  if((current->u.d.bitflags & (1 << BITFLAG_TOPLEVEL)))
 			    continue;
 			}
-		      Count[bin] += (long long)(current->u.d.mass / PartMass);
+		      count[bin] += (long long)(current->u.d.mass / PartMass);
 		      continue;
 		    }
 		}
@@ -373,4 +325,6 @@ int twopoint_ngb_treefind_variable(MyDouble searchcenter[3], MyFloat rsearch, in
 
 
 
+#include "../system/code_block_xchange_finalize.h" /* de-define the relevant variables and macros to avoid compilation errors and memory leaks */
+
 #endif
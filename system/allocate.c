@@ -33,6 +33,8 @@ void allocate_memory(void)
   Exportflag = (int *) mymalloc("Exportflag", NTaskTimesThreads * sizeof(int));
   Exportindex = (int *) mymalloc("Exportindex", NTaskTimesThreads * sizeof(int));
   Exportnodecount = (int *) mymalloc("Exportnodecount", NTaskTimesThreads * sizeof(int));
+  ExportBlock = (struct export_block_data *) mymalloc("ExportBlock", maxThreads * sizeof(struct export_block_data));
+  memset(ExportBlock, 0, maxThreads * sizeof(struct export_block_data));
 
   Send_count = (int *) mymalloc("Send_count", sizeof(int) * NTask);
   Send_offset = (int *) mymalloc("Send_offset", sizeof(int) * NTask);
@@ -42,9 +44,14 @@ void allocate_memory(void)
   ProcessedFlag = (unsigned char *) mymalloc("ProcessedFlag", bytes = All.MaxPart * sizeof(unsigned char));
   bytes_tot += bytes;
 
-  NextActiveParticle = (int *) mymalloc("NextActiveParticle", bytes = All.MaxPart * sizeof(int));
+  ActiveParticleList = (int *) mymalloc("ActiveParticleList", bytes = All.MaxPart * sizeof(int));
   bytes_tot += bytes;
 
+#ifdef DRIFT_ON_DEMAND_CLAIMS
+  DriftStamp = (integertime *) mymalloc("DriftStamp", bytes = All.MaxPart * sizeof(integertime));
+  bytes_tot += bytes;
+#endif
+
   NextInTimeBin = (int *) mymalloc("NextInTimeBin", bytes = All.MaxPart * sizeof(int));
   bytes_tot += bytes;
 
@@ -60,6 +67,12 @@ void allocate_memory(void)
 	  endrun(1);
 	}
       bytes_tot += bytes;
+#ifdef PARTICLE_HOT_SOA
+      int k; for(k = 0; k < 3; k++) {PHot.Pos[k] = (MyDouble *) mymalloc("PHot.Pos", bytes = All.MaxPart * sizeof(MyDouble)); bytes_tot += bytes;}
+      PHot.Mass = (MyDouble *) mymalloc("PHot.Mass", bytes = All.MaxPart * sizeof(MyDouble)); bytes_tot += bytes;
+      PHot.Ti_current = (integertime *) mymalloc("PHot.Ti_current", bytes = All.MaxPart * sizeof(integertime)); bytes_tot += bytes;
+      PHot.Type = (short int *) mymalloc("PHot.Type", bytes = All.MaxPart * sizeof(short int)); bytes_tot += bytes;
+#endif
 
       if(ThisTask == 0)
 	printf("Allocated %g MByte for particle storage.\n", bytes_tot / (1024.0 * 1024.0));
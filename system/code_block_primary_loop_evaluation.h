@@ -6,12 +6,15 @@
    CONDITION_FOR_EVALUATION inserts the clause that actually determines
         whether or not to pass a particle to the main evaluation routine
    EVALUATION_CALL is the actual call, and needs to be written appropriately
+
+   The elements to loop over are the PrimaryLoopListLength entries of PrimaryLoopList, and NextParticle
+   is the position in that list of the next element not yet handed out to a thread.
  */
 #if !defined(CONDITION_FOR_EVALUATION) || !defined(EVALUATION_CALL)
 printf("Cannot compile the primary sub-loop without both CONDITION_FOR_EVALUATION and EVALUATION_CALL defined. Exiting. \n"); fflush(stdout); exit(995533);
 #endif
 /* variable assignment */
-int i, j, *exportflag, *exportnodecount, *exportindex, *ngblist, thread_id = *(int *) p;
+int i, j, k, chunk, chunk_start, chunk_end, *exportflag, *exportnodecount, *exportindex, *ngblist, thread_id = *(int *) p;
 /* define the pointers needed for each thread to speak back regarding what needs processing */
 ngblist = Ngblist + thread_id * NumPart;
 exportflag = Exportflag + thread_id * NTask;
@@ -19,33 +22,48 @@ exportnodecount = Exportnodecount + thread_id * NTask;
 exportindex = Exportindex + thread_id * NTask;
 /* Note: exportflag is local to each thread */
 for(j = 0; j < NTask; j++) {exportflag[j] = -1;}
-/* now begin the actual loop */
+/* now begin the actual loop. threads claim chunks of the list with an atomic increment of NextParticle, rather than taking a lock for every
+    element. the chunk size shrinks as the list drains (guided self-scheduling), so the tail is handed out element-by-element and threads which
+    finish early keep picking up what remains. every element of a claimed chunk gets ProcessedFlag=0 until it is finished; after a buffer-full
+    round the parent commits every finished element (ProcessedFlag=2, see primary_loop_commit_finished), and those are skipped here when the
+    list is resumed, so no element is evaluated twice. the parent must set ProcessedFlag=0 for the whole list before the first round. */
 while(1)
 {
-    int exitFlag = 0;
+    int buffer_full, position;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    buffer_full = BufferFullFlag;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    position = NextParticle;
+    if(buffer_full != 0 || position >= PrimaryLoopListLength) {break;}
+    chunk = (PrimaryLoopListLength - position) / (4 * maxThreads); if(chunk < 1) {chunk = 1;} if(chunk > 32) {chunk = 32;}
     LOCK_NEXPORT;
 #ifdef _OPENMP
-#pragma omp critical(_nexport_)
+#pragma omp atomic capture
 #endif
+    {chunk_start = NextParticle; NextParticle += chunk;}
+    UNLOCK_NEXPORT;
+    chunk_end = chunk_start + chunk; if(chunk_end > PrimaryLoopListLength) {chunk_end = PrimaryLoopListLength;}
+    for(k = chunk_start; k < chunk_end; k++) {if(ProcessedFlag[PrimaryLoopList[k]] != 2) {ProcessedFlag[PrimaryLoopList[k]] = 0;}}
+    for(k = chunk_start; k < chunk_end; k++)
     {
-        if(BufferFullFlag != 0 || NextParticle < 0)
-        {
-            exitFlag = 1;
-        }
-        else
+        i = PrimaryLoopList[k];
+        if(ProcessedFlag[i] == 2) {continue;} /* committed in an earlier round */
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+        buffer_full = BufferFullFlag;
+        if(buffer_full) {break;} /* another thread filled the export buffer: stop here, the rest of the chunk is re-done in the next round */
+        CONDITION_FOR_EVALUATION
         {
-            i = NextParticle;
-            ProcessedFlag[i] = 0;
-            NextParticle = NextActiveParticle[NextParticle];
+            if(EVALUATION_CALL < 0) {break;} // export buffer has filled up //
         }
+        ProcessedFlag[i] = 1; /* particle successfully finished */
     }
-    UNLOCK_NEXPORT;
-    if(exitFlag) {break;}
-    CONDITION_FOR_EVALUATION
-    {
-        if(EVALUATION_CALL < 0) {break;} // export buffer has filled up //
-    }
-    ProcessedFlag[i] = 1; /* particle successfully finished */
+    if(k < chunk_end) {break;}
 }
 /* loop completed successfully */
 return NULL;
@@ -7,21 +7,25 @@
 #if !defined(EVALUATION_CALL)
 printf("Cannot compile the secondary sub-loop without EVALUATION_CALL defined. Exiting. \n"); fflush(stdout); exit(995534);
 #endif
-int j, dummy, *ngblist, thread_id = *(int *) p;
+int j, dummy, chunk, chunk_start, chunk_end, *ngblist, thread_id = *(int *) p;
 ngblist = Ngblist + thread_id * NumPart;
-while(1)
+while(1) /* claim (shrinking) chunks of the imported elements with an atomic increment, as in the primary loop */
 {
+    int position;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    position = NextJ;
+    if(position >= Nimport) {break;}
+    chunk = (int) ((Nimport - position) / (4 * maxThreads)); if(chunk < 1) {chunk = 1;} if(chunk > 32) {chunk = 32;}
     LOCK_NEXPORT;
 #ifdef _OPENMP
-#pragma omp critical(_nexport_)
+#pragma omp atomic capture
 #endif
-    {
-        j = NextJ;
-        NextJ++;
-    }
+    {chunk_start = NextJ; NextJ += chunk;}
     UNLOCK_NEXPORT;
-    if(j >= Nimport) {break;}
-    EVALUATION_CALL
+    chunk_end = chunk_start + chunk; if(chunk_end > Nimport) {chunk_end = (int) Nimport;}
+    for(j = chunk_start; j < chunk_end; j++) {EVALUATION_CALL}
 }
 /* loop completed successfully */
 return NULL;
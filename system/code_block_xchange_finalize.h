@@ -20,6 +20,19 @@ static inline void *SECONDARY_SUBFUN_NAME(void *p, int loop_iteration)
 }
 
 #undef CONDITIONFUNCTION_FOR_EVALUATION
+#ifdef USE_EXPORT_PLAN
+#undef USE_EXPORT_PLAN
+#undef EXPORT_PLAN_RECORD_MARGIN
+#endif
+#ifdef EXPORT_PLAN_SEARCH_RADIUS
+#undef EXPORT_PLAN_SEARCH_RADIUS
+#endif
+#ifdef COMPACT_EXPORT_POSITIONS
+#undef COMPACT_EXPORT_POSITIONS
+#endif
+#ifdef PRIMARY_LOOP_NUMBER_OF_ELEMENTS
+#undef PRIMARY_LOOP_NUMBER_OF_ELEMENTS
+#endif
 #undef SECONDARY_SUBFUN_NAME
 #undef PRIMARY_SUBFUN_NAME
 #undef OUTPUTFUNCTION_NAME
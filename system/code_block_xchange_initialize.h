@@ -19,6 +19,22 @@ extern pthread_mutex_t mutex_partnodedrift;
 #define UNLOCK_NEXPORT
 #endif
 
+/* loops over elements which are not the active particles (e.g. all particles, or the groups in the structure finders) define PRIMARY_LOOP_NUMBER_OF_ELEMENTS
+    as the number N of elements: the primary loop then runs over the indices 0...N-1 (filtered by CONDITIONFUNCTION_FOR_EVALUATION as usual). since
+    ProcessedFlag is indexed by element, N cannot exceed All.MaxPart. these loops should not define EXPORT_PLAN_SEARCH_RADIUS below */
+
+/* loops which can re-use export plans between repeated calls (e.g. iterations) define EXPORT_PLAN_SEARCH_RADIUS(i), the radius
+    determining the export list of element i, and optionally EXPORT_PLAN_RECORD_MARGIN(pass): see code_block_xchange_perform_ops.h */
+#if defined(MPI_REUSE_EXPORT_PLANS) && defined(EXPORT_PLAN_SEARCH_RADIUS)
+#define USE_EXPORT_PLAN
+#ifndef EXPORT_PLAN_RECORD_MARGIN
+#define EXPORT_PLAN_RECORD_MARGIN(pass) (1)
+#endif
+#endif
+
+/* loops whose input structure holds the element position as 'MyDouble Pos[3]' (or double/float) can define COMPACT_EXPORT_POSITIONS,
+    so that with MPI_COMPACT_EXPORTS it is sent as a float offset from the destination node: see code_block_xchange_perform_ops.h */
+
 /* initialize macro and variable names: these define structures/variables with names following the value of CORE_FUNCTION_NAME with the '_data_in' and other terms appended -- this should be unique within the file defined! */
 #define INPUT_STRUCT_NAME   MACRO_NAME_CONCATENATE(CORE_FUNCTION_NAME, _data_in_)
 #define DATAIN_NAME         MACRO_NAME_CONCATENATE(CORE_FUNCTION_NAME, _DataIn_)
@@ -1,13 +1,54 @@
 /* This is a generic code block designed for simple neighbor loops, so that they don't have to
 be copy-pasted and can be generically optimized in a single place */
 {
-    int j, k, ndone=0, ndone_flag=0, recvTask, place, save_NextParticle; long long n_exported = 0; double tstart, tend, tstart_loop; /* define some variables used only below */
-    NextParticle = FirstActiveParticle;    /* begin the main loop; start with this index */
+    int j, ndone=0, ndone_flag=0, recvTask, place, save_NextParticle; long long n_exported = 0; double tstart, tend, tstart_loop; /* define some variables used only below */
+#ifdef PRIMARY_LOOP_NUMBER_OF_ELEMENTS
+    PrimaryLoopListLength = (PRIMARY_LOOP_NUMBER_OF_ELEMENTS); /* loop over all elements 0...N-1, rather than the active particles */
+    PrimaryLoopList = (int *) mymalloc("PrimaryLoopList", (PrimaryLoopListLength + 1) * sizeof(int));
+    int k; for(k = 0; k < PrimaryLoopListLength; k++) {PrimaryLoopList[k] = k;}
+#else
+    PrimaryLoopListLength = NumActiveParticle; /* copy of the active list, so threads can claim chunks of it */
+    PrimaryLoopList = (int *) mymalloc("PrimaryLoopList", (PrimaryLoopListLength + 1) * sizeof(int));
+    memcpy(PrimaryLoopList, ActiveParticleList, PrimaryLoopListLength * sizeof(int));
+#endif
+    for(j = 0; j < PrimaryLoopListLength; j++) {ProcessedFlag[PrimaryLoopList[j]] = 0;} /* nothing committed yet (see primary_loop_commit_finished) */
+    NextParticle = 0;    /* begin the main loop; start with this position in the list */
     tstart_loop = my_second();
+#ifdef OUTPUT_TIMELINE_TRACE
+    const char *trace_loop_name = MACRO_NAME_STRING(CORE_FUNCTION_NAME); /* label of this loop's compute/comm/wait events in the timeline trace */
+#endif
+    size_t export_wire_size = sizeof(struct INPUT_STRUCT_NAME); /* bytes per exported element on the wire */
+#ifdef MPI_COMPACT_EXPORTS
+    /* send exports in the compact format (packed in place in the export/import buffers): reduced node-lists, and for loops which define
+        COMPACT_EXPORT_POSITIONS (their structure holds the element position as 'Pos'), positions as float offsets from the destination node */
+    struct compact_export_format export_wire_format;
+#ifdef COMPACT_EXPORT_POSITIONS
+    compact_export_format_init(&export_wire_format, sizeof(struct INPUT_STRUCT_NAME), offsetof(struct INPUT_STRUCT_NAME, NodeList), offsetof(struct INPUT_STRUCT_NAME, Pos), sizeof(DATAIN_NAME->Pos[0]), -1);
+#else
+    compact_export_format_init(&export_wire_format, sizeof(struct INPUT_STRUCT_NAME), offsetof(struct INPUT_STRUCT_NAME, NodeList), -1, 0, -1);
+#endif
+    export_wire_size = export_wire_format.wire_size;
+#endif
+#ifdef USE_EXPORT_PLAN
+    /* if a previous call stored an export plan (completed in a single round, so all its exports are still in DataIndexTable/DataNodeList),
+        and the search radius of every active element is still inside the radius it was recorded with, the tree-walks can skip recording
+        exports and we simply re-use the stored list (dropping elements which are no longer active). otherwise, record a new plan. */
+    int export_plan_replay = 0, export_plan_rounds = 0;
+    if(export_plan_valid)
+    {
+        int i, covered = 1;
+        FOR_ACTIVE_PARTICLES(i) {CONDITIONFUNCTION_FOR_EVALUATION {if(!(EXPORT_PLAN_SEARCH_RADIUS(i) <= ExportPlanRadius[i])) {covered = 0; break;}}}
+        MPI_Allreduce(&covered, &export_plan_replay, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    }
+    export_plan_valid = export_plan_replay;
+#endif
     do /* primary point-element loop */
     {
         BufferFullFlag = 0; Nexport = 0; save_NextParticle = NextParticle; tstart = my_second();
         for(j = 0; j < NTask; j++) {Send_count[j] = 0; Exportflag[j] = -1;} /* do local particles and prepare export list */
+#ifdef USE_EXPORT_PLAN
+        ExportPlanReplay = export_plan_replay; ExportPlanSearchFac = (export_plan_replay ? 1 : EXPORT_PLAN_RECORD_MARGIN(export_plan_pass));
+#endif
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
@@ -19,50 +60,44 @@ be copy-pasted and can be generically optimized in a single place */
 #endif
             PRIMARY_SUBFUN_NAME(&mainthreadid, loop_iteration);    /* do local particles and prepare export list */
         }
-        tend = my_second(); timecomp += timediff(tstart, tend);
+        tend = my_second(); timecomp += timediff(tstart, tend); TIMELINE_TRACE(TIMELINE_TRACE_COMPUTE, trace_loop_name, tstart, tend, NextParticle - save_NextParticle)
+#ifdef USE_EXPORT_PLAN
+        ExportPlanReplay = 0; ExportPlanSearchFac = 1;
+        if(export_plan_replay) /* nothing was exported by the walk: take the stored (already sorted) entries, dropping elements no longer active */
+        {
+            int i, k;
+            for(j = 0, k = 0; j < ExportPlanNexport; j++) {i = DataIndexTable[j].Index; CONDITIONFUNCTION_FOR_EVALUATION {DataIndexTable[k++] = DataIndexTable[j]; continue;} ExportPlanRadius[i] = -1;}
+            ExportPlanNexport = Nexport = k;
+        }
+#endif
         if(BufferFullFlag) /* we've filled the buffer or reached the end of the list, prepare for communications */
         {
-            int last_nextparticle = NextParticle; NextParticle = save_NextParticle; /* figure out where we are */
-            while(NextParticle >= 0)
-            {
-                if(NextParticle == last_nextparticle) {break;}
-                if(ProcessedFlag[NextParticle] != 1) {break;}
-                ProcessedFlag[NextParticle] = 2; NextParticle = NextActiveParticle[NextParticle];
-            }
-            if(NextParticle == save_NextParticle)
+            int last_nextparticle = NextParticle; /* figure out where we are */
+            if(primary_loop_commit_finished(save_NextParticle) == 0)
             {
-                PRINT_WARNING("NextParticle == save_NextParticle condition (the buffer appears too small to hold a single particle): NextParticle=%d save_NextParticle=%d last_nextparticle=%d ProcessedFlag[NextParticle]=%d NextActiveParticle[NextParticle]=%d NumPart=%d N_gas=%d NTaskTimesNumPart=%llu maxThreads=%d All.BunchSize=%ld All.BufferSize=%llu Nexport=%ld ndone=%d ndone_flag=%d NTask=%d",NextParticle,save_NextParticle,last_nextparticle,ProcessedFlag[NextParticle],NextActiveParticle[NextParticle],NumPart,N_gas,(unsigned long long)NTaskTimesNumPart,maxThreads,All.BunchSize,(unsigned long long)All.BufferSize,Nexport,ndone,ndone_flag,NTask);
-                if(NextParticle >= 0) {PRINT_WARNING("This is a live particle: NextParticle=%d ID=%llu Mass=%g Type=%d",NextParticle,(unsigned long long)P[NextParticle].ID,P[NextParticle].Mass,P[NextParticle].Type);}
-                printf("Extended Debug: Printing Processed Flag for Entire Active Particle Chain on This Task: \n"); int nj=0; for(j=FirstActiveParticle;j>=0;j=NextActiveParticle[j]) {printf("nj=%d j=%d ProcFlag[j]=%d \n",nj,j,ProcessedFlag[j]); nj++; fflush(stdout);} fflush(stdout);
+                int i_next = PrimaryLoopList[NextParticle];
+                PRINT_WARNING("NextParticle == save_NextParticle condition (the buffer appears too small to hold a single particle): NextParticle=%d save_NextParticle=%d last_nextparticle=%d PrimaryLoopListLength=%d ProcessedFlag[i_next]=%d NumPart=%d N_gas=%d NTaskTimesNumPart=%llu maxThreads=%d All.BunchSize=%ld All.BufferSize=%llu Nexport=%ld ndone=%d ndone_flag=%d NTask=%d",NextParticle,save_NextParticle,last_nextparticle,PrimaryLoopListLength,ProcessedFlag[i_next],NumPart,N_gas,(unsigned long long)NTaskTimesNumPart,maxThreads,All.BunchSize,(unsigned long long)All.BufferSize,Nexport,ndone,ndone_flag,NTask);
+                PRINT_WARNING("This is a live particle: i_next=%d ID=%llu Mass=%g Type=%d",i_next,(unsigned long long)P[i_next].ID,P[i_next].Mass,P[i_next].Type);
+                printf("Extended Debug: Printing Processed Flag for Entire Active Particle List on This Task: \n"); int nj=0; for(nj=0;nj<PrimaryLoopListLength;nj++) {printf("nj=%d j=%d ProcFlag[j]=%d \n",nj,PrimaryLoopList[nj],ProcessedFlag[PrimaryLoopList[nj]]); fflush(stdout);} fflush(stdout);
                 endrun(113312);
             } /* in this case, the buffer is too small to process even a single particle */
-            
-            int new_export = 0; /* actually calculate exports [so we can tell other tasks] */
-            for(j = 0, k = 0; j < Nexport; j++)
-            {
-                if(ProcessedFlag[DataIndexTable[j].Index] != 2)
-                {
-                    if(k < j + 1) {k = j + 1;}
-                    for(; k < Nexport; k++)
-                        if(ProcessedFlag[DataIndexTable[k].Index] == 2)
-                        {
-                            int old_index = DataIndexTable[j].Index;
-                            DataIndexTable[j] = DataIndexTable[k]; DataNodeList[j] = DataNodeList[k]; DataIndexTable[j].IndexGet = j; new_export++;
-                            DataIndexTable[k].Index = old_index; k++;
-                            break;
-                        }
-                }
-                else {new_export++;}
-            }
-            Nexport = new_export; /* counting exports... */
         }
+#ifdef USE_EXPORT_PLAN
+        if(export_plan_replay)
+        {
+            for(j = 0; j < NTask; j++) {Send_count[j] = 0;}
+            for(j = 0; j < Nexport; j++) {Send_count[DataIndexTable[j].Task]++;}
+            n_exported += Nexport; tstart = my_second(); mpi_exchange_counts_with_plan_partners(Send_count, Recv_count, ExportPlanCount, ExportPlanCount + NTask);
+        } else {
+#endif
+        Nexport = export_blocks_merge(BufferFullFlag); /* collect the per-thread export blocks (dropping unfinished elements if the buffer filled), grouped by task, and count the exports */
         n_exported += Nexport;
-        for(j = 0; j < NTask; j++) {Send_count[j] = 0;}
-        for(j = 0; j < Nexport; j++) {Send_count[DataIndexTable[j].Task]++;}
-        MYSORT_DATAINDEX(DataIndexTable, Nexport, sizeof(struct data_index), data_index_compare); /* construct export count tables */
         tstart = my_second();
-        MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD); /* broadcast import/export counts */
-        tend = my_second(); timewait += timediff(tstart, tend);
+        mpi_sparse_alltoall_counts(Send_count, Recv_count); /* broadcast import/export counts */
+#ifdef USE_EXPORT_PLAN
+        }
+#endif
+        tend = my_second(); timewait += timediff(tstart, tend); TIMELINE_TRACE(TIMELINE_TRACE_WAIT, trace_loop_name, tstart, tend, Nexport)
 
         for(j = 0, Send_offset[0] = 0; j < NTask; j++) {if(j > 0) {Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];}} /* calculate export table offsets */
         DATAIN_NAME = (struct INPUT_STRUCT_NAME *) mymalloc("DATAIN_NAME", Nexport * sizeof(struct INPUT_STRUCT_NAME));
@@ -73,6 +108,9 @@ be copy-pasted and can be generically optimized in a single place */
             INPUTFUNCTION_NAME(&DATAIN_NAME[j], place, loop_iteration);
             memcpy(DATAIN_NAME[j].NodeList,DataNodeList[DataIndexTable[j].IndexGet].NodeList, NODELISTLENGTH * sizeof(int));
         }
+#ifdef MPI_COMPACT_EXPORTS
+        compact_export_pack(&export_wire_format, DATAIN_NAME, Nexport);
+#endif
 
         /* ok now we have to figure out if there is enough memory to handle all the tasks sending us their data, and if not, break it into sub-chunks */
         int N_chunks_for_import, ngrp_initial, ngrp;
@@ -108,14 +146,17 @@ be copy-pasted and can be generically optimized in a single place */
                 {
                     if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0) /* get the particles */
                     {
-                        MPI_Sendrecv(&DATAIN_NAME[Send_offset[recvTask]], Send_count[recvTask] * sizeof(struct INPUT_STRUCT_NAME), MPI_BYTE, recvTask, TAG_MPI_GENERIC_COM_BUFFER_A,
-                                     &DATAGET_NAME[Nimport], Recv_count[recvTask] * sizeof(struct INPUT_STRUCT_NAME), MPI_BYTE, recvTask, TAG_MPI_GENERIC_COM_BUFFER_A,
+                        MPI_Sendrecv((char *) DATAIN_NAME + Send_offset[recvTask] * export_wire_size, Send_count[recvTask] * export_wire_size, MPI_BYTE, recvTask, TAG_MPI_GENERIC_COM_BUFFER_A,
+                                     (char *) DATAGET_NAME + Nimport * export_wire_size, Recv_count[recvTask] * export_wire_size, MPI_BYTE, recvTask, TAG_MPI_GENERIC_COM_BUFFER_A,
                                      MPI_COMM_WORLD, MPI_STATUS_IGNORE);
                         Nimport += Recv_count[recvTask];
                     }
                 }
             }
-            tend = my_second(); timecomm += timediff(tstart, tend);
+#ifdef MPI_COMPACT_EXPORTS
+            compact_export_unpack(&export_wire_format, DATAGET_NAME, Nimport);
+#endif
+            tend = my_second(); timecomm += timediff(tstart, tend); TIMELINE_TRACE(TIMELINE_TRACE_COMM, trace_loop_name, tstart, tend, Nimport)
             
             /* now do the particles that were sent to us */
             tstart = my_second(); NextJ = 0;
@@ -130,9 +171,9 @@ be copy-pasted and can be generically optimized in a single place */
 #endif
                 SECONDARY_SUBFUN_NAME(&mainthreadid, loop_iteration);
             }
-            tend = my_second(); timecomp += timediff(tstart, tend); tstart = my_second();
+            tend = my_second(); timecomp += timediff(tstart, tend); TIMELINE_TRACE(TIMELINE_TRACE_COMPUTE, trace_loop_name, tstart, tend, Nimport) tstart = my_second();
             MPI_Barrier(MPI_COMM_WORLD); /* insert MPI Barrier here - will be forced by comms below anyways but this allows for clean timing measurements */
-            tend = my_second(); timewait += timediff(tstart, tend);
+            tend = my_second(); timewait += timediff(tstart, tend); TIMELINE_TRACE(TIMELINE_TRACE_WAIT, trace_loop_name, tstart, tend, 0)
             
             tstart = my_second(); Nimport = 0;
             for(ngrp = ngrp_initial; ngrp < ngrp_initial + N_chunks_for_import; ngrp++) /* send the results for imported elements back to their host tasks */
@@ -149,7 +190,7 @@ be copy-pasted and can be generically optimized in a single place */
                     }
                 }
             }
-            tend = my_second(); timecomm += timediff(tstart, tend);
+            tend = my_second(); timecomm += timediff(tstart, tend); TIMELINE_TRACE(TIMELINE_TRACE_COMM, trace_loop_name, tstart, tend, Nimport)
             myfree(DATARESULT_NAME); myfree(DATAGET_NAME); /* free the structures used to send data back to tasks, its sent */
             
         } /* close the sub-chunking loop: for(ngrp_initial = 1; ngrp_initial < (1 << PTask); ngrp_initial += N_chunks_for_import) */
@@ -161,16 +202,29 @@ be copy-pasted and can be generically optimized in a single place */
             place = DataIndexTable[j].Index;
             OUTPUTFUNCTION_NAME(&DATAOUT_NAME[j], place, 1, loop_iteration);
         }
-        tend = my_second(); timecomp += timediff(tstart, tend);
+        tend = my_second(); timecomp += timediff(tstart, tend); TIMELINE_TRACE(TIMELINE_TRACE_COMPUTE, trace_loop_name, tstart, tend, Nexport)
         myfree(DATAOUT_NAME); myfree(DATAIN_NAME); /* free the structures used to prepare our initial export data, we're done here! */
         
-        if(NextParticle < 0) {ndone_flag = 1;} else {ndone_flag = 0;} /* figure out if we are done with the particular active set here */
+        if(NextParticle >= PrimaryLoopListLength) {ndone_flag = 1;} else {ndone_flag = 0;} /* figure out if we are done with the particular active set here */
         tstart = my_second();
         MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD); /* call an allreduce to figure out if all tasks are also done here, otherwise we need to iterate */
-        tend = my_second(); timewait += timediff(tstart, tend);
+        tend = my_second(); timewait += timediff(tstart, tend); TIMELINE_TRACE(TIMELINE_TRACE_WAIT, trace_loop_name, tstart, tend, 0)
+#ifdef USE_EXPORT_PLAN
+        if(!export_plan_replay && ++export_plan_rounds == 1 && ndone >= NTask) /* all tasks finished in a single round, so DataIndexTable holds the complete export list: store it as the plan */
+        {
+            int i; double fac = EXPORT_PLAN_RECORD_MARGIN(export_plan_pass); ExportPlanNexport = Nexport;
+            for(j = 0; j < NTask; j++) {ExportPlanCount[j] = Send_count[j]; ExportPlanCount[NTask + j] = Recv_count[j];}
+            FOR_ACTIVE_PARTICLES(i) {ExportPlanRadius[i] = -1; CONDITIONFUNCTION_FOR_EVALUATION {ExportPlanRadius[i] = fac * EXPORT_PLAN_SEARCH_RADIUS(i);}}
+            export_plan_valid = 1;
+        }
+#endif
     }
     while(ndone < NTask);
+    myfree(PrimaryLoopList);
     timeall += timediff(tstart_loop, my_second());
+#ifdef USE_EXPORT_PLAN
+    export_plan_pass++;
+#endif
     
 } /* closes clause, so variables don't 'leak' */
 
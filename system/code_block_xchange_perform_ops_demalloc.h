@@ -1,2 +1,6 @@
 /*! just de-allocate buffers from code_block_xchange_perform_ops_malloc in reverse order they were malloc'd */
+myscratch_close();
+#ifdef USE_EXPORT_PLAN
+myfree(ExportPlanCount); myfree(ExportPlanRadius);
+#endif
 myfree(DataNodeList); myfree(DataIndexTable); myfree(Ngblist);
@@ -1,8 +1,14 @@
 /*! allocate buffers to arrange communication */
+CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC); /* close the preceding interval first, so the buffers below are booked to this loop in memory.txt */
 long long NTaskTimesNumPart = maxThreads * NumPart; size_t MyBufferSize = All.BufferSize; int loop_iteration = 0;
 All.BunchSize = (int) ((MyBufferSize * 1024 * 1024) / (sizeof(struct data_index) + sizeof(struct data_nodelist) + sizeof(struct INPUT_STRUCT_NAME) + sizeof(struct OUTPUT_STRUCT_NAME) + sizemax(sizeof(struct INPUT_STRUCT_NAME),sizeof(struct OUTPUT_STRUCT_NAME))));
 Ngblist = (int *) mymalloc("Ngblist", NTaskTimesNumPart * sizeof(int));
 DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
 DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
-double timeall=0, timecomp=0, timecomm=0, timewait=0, t0; CPU_Step[CPU_MISC] += measure_time(); t0 = my_second(); /*! for timing information */
+#ifdef USE_EXPORT_PLAN /* storage for a re-usable export plan: the plan entries themselves stay in DataIndexTable/DataNodeList */
+MyFloat *ExportPlanRadius = (MyFloat *) mymalloc("ExportPlanRadius", NumPart * sizeof(MyFloat));
+int *ExportPlanCount = (int *) mymalloc("ExportPlanCount", 2 * NTask * sizeof(int)); long ExportPlanNexport = 0; int export_plan_valid = 0, export_plan_pass = 0;
+#endif
+myscratch_open(LOOP_SCRATCH_BYTES_PER_THREAD); /* per-thread scratch for the kernels (after the buffers above, so it is released first) */
+double timeall=0, timecomp=0, timecomm=0, timewait=0, t0; t0 = my_second(); /*! for timing information */
 
@@ -9,6 +9,7 @@
  */
 
 #include <mpi.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../allvars.h"
 #include "../proto.h"
@@ -44,6 +45,164 @@ int mpi_calculate_offsets(int *send_count, int *send_offset, int *recv_count, in
 }
 
 
+/** Exchanges the export counts of a neighbor-loop communication round: on return recv_count[j]
+    holds the number of elements task j will send us, given the send_count[] we will send to each task.
+    This is equivalent to MPI_Alltoall(send_count,1,MPI_INT,recv_count,1,MPI_INT,MPI_COMM_WORLD), which is
+    what we do by default. With MPI_SPARSE_COUNT_EXCHANGE set, we instead use the 'non-blocking consensus'
+    (NBX) algorithm of Hoefler et al. 2010: each task only sends synchronous messages to the tasks it
+    actually exports to, receives whatever arrives, and enters a non-blocking barrier once all its own
+    sends have been matched. When the barrier completes, every message has been received. Since each task
+    typically only talks to a handful of neighbor domains, this is O(number of partners) + O(log NTask)
+    instead of O(NTask) per call. Consecutive calls alternate between two tags: a task can run at most one
+    call ahead of another (it cannot complete the barrier without it), so this prevents a message from the
+    next call being mistaken for one in the current call. Requires an MPI-3 library (MPI_Ibarrier). */
+void mpi_sparse_alltoall_counts(int *send_count, int *recv_count)
+{
+#ifndef MPI_SPARSE_COUNT_EXCHANGE
+    MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT, MPI_COMM_WORLD);
+#else
+    static int call_parity = 0; int j, nsend = 0, tag = (call_parity ? TAG_MPI_SPARSE_COUNTS_B : TAG_MPI_SPARSE_COUNTS_A); call_parity = !call_parity;
+    for(j = 0; j < NTask; j++) {recv_count[j] = 0; if(j != ThisTask && send_count[j] > 0) {nsend++;}}
+    recv_count[ThisTask] = send_count[ThisTask];
+    MPI_Request *requests = (MPI_Request *) mymalloc("requests", (nsend+1) * sizeof(MPI_Request)), barrier_request;
+    for(j = 0, nsend = 0; j < NTask; j++) {if(j != ThisTask && send_count[j] > 0) {MPI_Issend(&send_count[j], 1, MPI_INT, j, tag, MPI_COMM_WORLD, &requests[nsend++]);}}
+    int sends_done = 0, barrier_active = 0, all_done = 0;
+    while(!all_done)
+    {
+        int msg_waiting = 0; MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, &msg_waiting, &status);
+        if(msg_waiting) {MPI_Recv(&recv_count[status.MPI_SOURCE], 1, MPI_INT, status.MPI_SOURCE, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);}
+        if(barrier_active) {MPI_Test(&barrier_request, &all_done, MPI_STATUS_IGNORE);}
+            else {MPI_Testall(nsend, requests, &sends_done, MPI_STATUSES_IGNORE); if(sends_done) {MPI_Ibarrier(MPI_COMM_WORLD, &barrier_request); barrier_active = 1;}}
+    }
+    myfree(requests);
+#endif
+}
+
+
+#ifdef MPI_REUSE_EXPORT_PLANS
+/** Exchanges export counts when the set of communication partners is already known from a stored export plan
+    (see code_block_xchange_perform_ops.h): plan_send_count/plan_recv_count are the counts when the plan was
+    recorded, and the current send_count can only be non-zero where plan_send_count is. Only the partners
+    are contacted (point-to-point), no collective is needed. On return the plan counts are updated to the
+    current counts, so the partner sets stay consistent on both sides of each exchange. */
+void mpi_exchange_counts_with_plan_partners(int *send_count, int *recv_count, int *plan_send_count, int *plan_recv_count)
+{
+    int j, nreq = 0;
+    for(j = 0; j < NTask; j++) {if(j != ThisTask) {if(plan_send_count[j] > 0) {nreq++;} if(plan_recv_count[j] > 0) {nreq++;}}}
+    MPI_Request *requests = (MPI_Request *) mymalloc("requests", (nreq+1) * sizeof(MPI_Request));
+    for(j = 0, nreq = 0; j < NTask; j++)
+    {
+        recv_count[j] = 0; if(j == ThisTask) {recv_count[j] = send_count[j]; continue;}
+        if(plan_recv_count[j] > 0) {MPI_Irecv(&recv_count[j], 1, MPI_INT, j, TAG_MPI_EXPORT_PLAN_COUNTS, MPI_COMM_WORLD, &requests[nreq++]);}
+        if(plan_send_count[j] > 0) {MPI_Isend(&send_count[j], 1, MPI_INT, j, TAG_MPI_EXPORT_PLAN_COUNTS, MPI_COMM_WORLD, &requests[nreq++]);}
+            else if(send_count[j] > 0) {terminate("export to a task which is not in the stored export plan");}
+    }
+    MPI_Waitall(nreq, requests, MPI_STATUSES_IGNORE);
+    myfree(requests);
+    for(j = 0; j < NTask; j++) {plan_send_count[j] = send_count[j]; plan_recv_count[j] = recv_count[j];}
+}
+#endif
+
+
+#ifdef MPI_COMPACT_EXPORTS
+/** Sets up the compact wire format used to send an export structure of 'size' bytes, with NodeList[NODELISTLENGTH] at offset
+    'nodelist'. Node indices are sent as offsets from All.MaxPart: exports only point to top-level nodes, which are the first nodes of
+    the tree and are numbered identically on all tasks, so the offsets are below NTopnodes (the same on all tasks) and fit in 16 bits
+    unless the top-level tree is very large (many tasks times MULTIPLEDOMAINS), in which case 32 bits are used. If pos >= 0, the element position at that offset (3 components of
+    pos_size bytes, float or double) is sent as float offsets from the center of the first node in the NodeList, which the receiving
+    task has too. If approx >= 0, the MyFloat at that offset is only used approximately (e.g. in an opening criterion) and is sent
+    with 16 bits (bfloat16: the full float exponent range with ~3 significant digits). Everything else is copied as it is. */
+void compact_export_format_init(struct compact_export_format *f, size_t size, size_t nodelist, long pos, int pos_size, long approx)
+{
+    size_t cut_start[3], cut_end[3], p = 0, end, tmp; int i, j, ncut = 0;
+    f->size = size; f->nodelist = nodelist; f->pos = pos; f->pos_size = pos_size; f->approx = approx;
+    cut_start[ncut] = nodelist; cut_end[ncut++] = nodelist + NODELISTLENGTH * sizeof(int);
+    if(pos >= 0) {cut_start[ncut] = pos; cut_end[ncut++] = pos + 3 * pos_size;}
+    if(approx >= 0) {cut_start[ncut] = approx; cut_end[ncut++] = approx + sizeof(MyFloat);}
+    for(i = 0; i < ncut; i++) {for(j = i + 1; j < ncut; j++) {if(cut_start[j] < cut_start[i]) {tmp = cut_start[i]; cut_start[i] = cut_start[j]; cut_start[j] = tmp; tmp = cut_end[i]; cut_end[i] = cut_end[j]; cut_end[j] = tmp;}}}
+    for(i = 0, f->nseg = 0, f->wire_size = 0; i <= ncut; i++) /* the byte-ranges in between the reduced fields are sent unchanged, in order */
+    {
+        end = (i < ncut) ? cut_start[i] : size;
+        if(end > p) {f->seg_start[f->nseg] = p; f->seg_len[f->nseg] = end - p; f->wire_size += end - p; f->nseg++;}
+        if(i < ncut) {p = cut_end[i];}
+    }
+    f->node_bytes = (NTopnodes < 0xFFFF) ? sizeof(unsigned short) : sizeof(unsigned int); /* 0xFFFF is the list terminator in the 16-bit form */
+    f->wire_size += NODELISTLENGTH * f->node_bytes + ((pos >= 0) ? 3 * sizeof(float) : 0) + ((approx >= 0) ? sizeof(unsigned short) : 0);
+}
+
+
+/** Packs n export structures in 'buf' into the compact wire format set up in compact_export_format_init, in place: element j ends up
+    at j*f->wire_size. The unchanged byte-ranges come first in each packed element, so they only ever move towards lower addresses. */
+void compact_export_pack(struct compact_export_format *f, void *buf, long n)
+{
+    long j; int k; char *in, *w; int nodes[NODELISTLENGTH]; unsigned short u[NODELISTLENGTH], ua = 0; unsigned int u32[NODELISTLENGTH]; float dpos[3]; double x; MyFloat a; float af; unsigned int b;
+    for(j = 0; j < n; j++)
+    {
+        in = (char *) buf + j * f->size; w = (char *) buf + j * f->wire_size;
+        memcpy(nodes, in + f->nodelist, NODELISTLENGTH * sizeof(int)); /* read the reduced fields first, they may be overwritten below */
+        for(k = 0; k < NODELISTLENGTH; k++)
+        {
+            if(nodes[k] < 0) {break;}
+            if(nodes[k] < All.MaxPart || nodes[k] >= All.MaxPart + NTopnodes) {terminate("export points to a node which is not a top-level node");}
+            u[k] = (unsigned short) (nodes[k] - All.MaxPart); u32[k] = (unsigned int) (nodes[k] - All.MaxPart);
+        }
+        for(; k < NODELISTLENGTH; k++) {u[k] = 0xFFFF; u32[k] = 0xFFFFFFFF;} /* list terminator (entries beyond it are never read) */
+        if(f->pos >= 0)
+        {
+            for(k = 0; k < 3; k++)
+            {
+                if(f->pos_size == sizeof(double)) {memcpy(&x, in + f->pos + k * sizeof(double), sizeof(double));} else {memcpy(&af, in + f->pos + k * sizeof(float), sizeof(float)); x = af;}
+                dpos[k] = (float) (x - Nodes[nodes[0]].center[k]);
+            }
+        }
+        if(f->approx >= 0)
+        {
+            memcpy(&a, in + f->approx, sizeof(MyFloat)); af = (float) a; memcpy(&b, &af, sizeof(float));
+            if((b & 0x7F800000) != 0x7F800000) {b += 0x7FFF + ((b >> 16) & 1);} /* round to nearest even, leaving inf/nan alone */
+            ua = (unsigned short) (b >> 16);
+        }
+        for(k = 0; k < f->nseg; k++) {memmove(w, in + f->seg_start[k], f->seg_len[k]); w += f->seg_len[k];}
+        if(f->node_bytes == sizeof(unsigned short)) {memcpy(w, u, NODELISTLENGTH * sizeof(unsigned short));} else {memcpy(w, u32, NODELISTLENGTH * sizeof(unsigned int));}
+        w += NODELISTLENGTH * f->node_bytes;
+        if(f->pos >= 0) {memcpy(w, dpos, 3 * sizeof(float)); w += 3 * sizeof(float);}
+        if(f->approx >= 0) {memcpy(w, &ua, sizeof(unsigned short));}
+    }
+}
+
+
+/** Restores n export structures received in the compact wire format into their full form, in place (the inverse of compact_export_pack,
+    working from the last element backwards). */
+void compact_export_unpack(struct compact_export_format *f, void *buf, long n)
+{
+    long j; int k; char *out, *w, *red; int nodes[NODELISTLENGTH]; unsigned short u[NODELISTLENGTH], ua = 0; unsigned int u32[NODELISTLENGTH]; float dpos[3], af; double x; MyFloat a; unsigned int b;
+    for(j = n - 1; j >= 0; j--)
+    {
+        out = (char *) buf + j * f->size; w = (char *) buf + j * f->wire_size;
+        for(k = 0; k < f->nseg; k++) {w += f->seg_len[k];}
+        red = w; /* read the reduced fields first */
+        if(f->node_bytes == sizeof(unsigned short)) {memcpy(u, red, NODELISTLENGTH * sizeof(unsigned short)); for(k = 0; k < NODELISTLENGTH; k++) {u32[k] = (u[k] == 0xFFFF) ? 0xFFFFFFFF : u[k];}}
+            else {memcpy(u32, red, NODELISTLENGTH * sizeof(unsigned int));}
+        red += NODELISTLENGTH * f->node_bytes;
+        if(f->pos >= 0) {memcpy(dpos, red, 3 * sizeof(float)); red += 3 * sizeof(float);}
+        if(f->approx >= 0) {memcpy(&ua, red, sizeof(unsigned short));}
+        for(k = f->nseg - 1; k >= 0; k--) {w -= f->seg_len[k]; memmove(out + f->seg_start[k], w, f->seg_len[k]);} /* unchanged ranges only move towards higher addresses */
+        for(k = 0; k < NODELISTLENGTH; k++) {nodes[k] = (u32[k] == 0xFFFFFFFF) ? -1 : All.MaxPart + (int) u32[k];}
+        memcpy(out + f->nodelist, nodes, NODELISTLENGTH * sizeof(int));
+        if(f->pos >= 0)
+        {
+            for(k = 0; k < 3; k++)
+            {
+                x = Nodes[nodes[0]].center[k] + (double) dpos[k];
+                if(f->pos_size == sizeof(double)) {memcpy(out + f->pos + k * sizeof(double), &x, sizeof(double));} else {af = (float) x; memcpy(out + f->pos + k * sizeof(float), &af, sizeof(float));}
+            }
+        }
+        if(f->approx >= 0) {b = ((unsigned int) ua) << 16; memcpy(&af, &b, sizeof(float)); a = af; memcpy(out + f->approx, &a, sizeof(MyFloat));}
+    }
+}
+#endif
+
+
 /** Compare function used to sort an array of int pointers into order
     of the pointer targets. */
 int intpointer_compare(const void *a, const void *b)
@@ -7,6 +7,9 @@
 
 #include "../allvars.h"
 #include "../proto.h"
+#ifdef MYMALLOC_HUGEPAGES
+#include <sys/mman.h> /* after allvars.h, which brings in the config flags */
+#endif
 
 /* custom memory allocation routines */
 
@@ -36,6 +39,80 @@ static char *FunctionName;
 static char *FileName;
 static int *LineNumber;
 
+#define SCRATCH_STRIDE 8 /* per-thread counters are spaced by a cache line (8 size_t) so the bumps do not false-share */
+
+static char *ScratchBase;           /* the arena block, or NULL if no arena is open */
+static size_t ScratchSlab;          /* bytes per thread */
+static int ScratchThreads;          /* number of slabs */
+static size_t *ScratchUsed;         /* [thread*SCRATCH_STRIDE]: current bump offset, [thread*SCRATCH_STRIDE+1]: peak in this opening */
+static size_t ScratchHighMarkBytes; /* largest per-thread use over all openings */
+static size_t ScratchHighMarkSlab;  /* slab size at the time it was reached */
+static long long ScratchFailures;   /* requests that did not fit and went to the caller's fallback */
+
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+static size_t PhaseIntervalPeak;              /* AllocatedBytes high-water since the last memory_phase_close() */
+static size_t PhaseIntervalBlockBytes;        /* largest block (re)allocated since then, and its name */
+static char PhaseIntervalBlockName[MAXCHARS];
+static size_t PhasePeakBytes[CPU_PARTS];      /* per CPU_* part: peak AllocatedBytes over the intervals booked to it, */
+static size_t PhaseBlockBytes[CPU_PARTS];     /* and the largest block allocated in them. cleared when written to the log */
+static char PhaseBlockName[CPU_PARTS][MAXCHARS];
+
+static inline void memory_phase_note(unsigned long nr)
+{
+  if(AllocatedBytes > PhaseIntervalPeak) {PhaseIntervalPeak = AllocatedBytes;}
+  if(BlockSize[nr] > PhaseIntervalBlockBytes) {PhaseIntervalBlockBytes = BlockSize[nr]; strncpy(PhaseIntervalBlockName, VarName + nr * MAXCHARS, MAXCHARS - 1);}
+}
+#endif
+
+#ifdef NUMA_FIRST_TOUCH
+static size_t TouchedBytes;         /* the pool below this offset has been first-touched */
+
+/*! the pages of a block are physically placed on the NUMA node of the thread which first writes them. so the first time a block reaches
+    into untouched pool memory, the new part is zeroed by all threads with a static partition of the block -- the same mapping as the
+    'omp parallel for schedule(static)' loops over the arrays which live in it (P[], SphP[], ...) -- instead of by whichever single thread
+    later happens to write it first */
+static void mymalloc_first_touch(size_t offset, size_t n)
+{
+  if(offset + n <= TouchedBytes) {return;}
+  if(offset < TouchedBytes) {n -= TouchedBytes - offset; offset = TouchedBytes;}
+  TouchedBytes = offset + n;
+#ifdef _OPENMP
+  if(omp_in_parallel()) {return;} /* called inside a parallel region: leave the pages to their first writer */
+  int nthreads = maxThreads;
+#pragma omp parallel num_threads(nthreads)
+  {
+    int t = omp_get_thread_num(); size_t chunk = n / nthreads, start = offset + t * chunk, len = (t == nthreads - 1) ? (n - t * chunk) : chunk;
+    memset((char *) Base + start, 0, len);
+  }
+#else
+  memset((char *) Base + offset, 0, n);
+#endif
+}
+#endif
+
+
+#ifdef MYMALLOC_HUGEPAGES
+#define MYMALLOC_HUGEPAGE_SIZE ((size_t)2 * 1024 * 1024)
+/*! back the pool with huge pages, to cut TLB misses in the tree-walks over the large particle/node arrays. MYMALLOC_HUGEPAGES=2 asks
+    for explicit (hugetlbfs) pages, which must have been reserved by the administrator; if that fails, or with MYMALLOC_HUGEPAGES=1, we
+    take an ordinary huge-page-aligned mapping and advise the kernel to use transparent huge pages for it */
+static void *mymalloc_hugepage_pool(size_t *n)
+{
+  void *p = MAP_FAILED;
+  *n = ((*n + MYMALLOC_HUGEPAGE_SIZE - 1) / MYMALLOC_HUGEPAGE_SIZE) * MYMALLOC_HUGEPAGE_SIZE;
+#if (MYMALLOC_HUGEPAGES+0 > 1) && defined(MAP_HUGETLB)
+  p = mmap(NULL, *n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if(p != MAP_FAILED) {return p;}
+  if(ThisTask == 0) {printf("MYMALLOC_HUGEPAGES: explicit huge pages not available, using transparent huge pages for the memory pool\n");}
+#endif
+  if(posix_memalign(&p, MYMALLOC_HUGEPAGE_SIZE, *n) != 0) {return NULL;}
+#ifdef MADV_HUGEPAGE
+  madvise(p, *n, MADV_HUGEPAGE);
+#endif
+  return p;
+}
+#endif
+
 
 void mymalloc_init(void)
 {
@@ -56,7 +133,9 @@ void mymalloc_init(void)
 
   n = All.MaxMemSize * ((size_t) 1024 * 1024);
 
-#ifdef DISABLE_ALIGNED_ALLOC
+#if defined(MYMALLOC_HUGEPAGES)
+  if(!(Base = mymalloc_hugepage_pool(&n)))
+#elif defined(DISABLE_ALIGNED_ALLOC)
   if(!(Base = malloc(n)))
 #else
   if(!(Base = aligned_alloc(MIN_ALIGNMENT, n)))
@@ -71,6 +150,21 @@ void mymalloc_init(void)
   AllocatedBytes = 0;
   Nblocks = 0;
   HighMarkBytes = 0;
+#ifdef NUMA_FIRST_TOUCH
+  TouchedBytes = 0;
+#endif
+
+  ScratchBase = NULL;
+  ScratchUsed = (size_t *) malloc(maxThreads * SCRATCH_STRIDE * sizeof(size_t));
+  ScratchHighMarkBytes = ScratchHighMarkSlab = 0;
+  ScratchFailures = 0;
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+  PhaseIntervalPeak = PhaseIntervalBlockBytes = 0;
+  memset(PhasePeakBytes, 0, CPU_PARTS * sizeof(size_t));
+  memset(PhaseBlockBytes, 0, CPU_PARTS * sizeof(size_t));
+  memset(PhaseBlockName, 0, CPU_PARTS * MAXCHARS);
+  memset(PhaseIntervalBlockName, 0, MAXCHARS);
+#endif
 }
 
 void report_detailed_memory_usage_of_largest_task(size_t * OldHighMarkBytes, const char *label,
@@ -145,9 +239,166 @@ void dump_memory_table(void)
                    FileName + i * MAXCHARS, LineNumber[i]);
         }
         printf("----------------------------------------------------------------------------------------\n");
+        if(ScratchHighMarkBytes > 0 || ScratchFailures > 0)
+        {
+            printf("%4d scratch arena: high-water %10.4f MB per thread (of a %10.4f MB slab), %lld requests fell back\n",
+                   ThisTask, ScratchHighMarkBytes / (1024.0 * 1024.0), ScratchHighMarkSlab / (1024.0 * 1024.0), ScratchFailures);
+            printf("----------------------------------------------------------------------------------------\n");
+        }
     }
 }
 
+
+
+/*! book the memory use since the previous call to CPU part 'part' (called wherever the time of the interval is booked to CPU_Step[part],
+    see phase_interval_close()): the peak of AllocatedBytes within it, and the largest block allocated in it */
+void memory_phase_close(int part)
+{
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+  if(PhaseIntervalPeak > PhasePeakBytes[part]) {PhasePeakBytes[part] = PhaseIntervalPeak;}
+  if(PhaseIntervalBlockBytes > PhaseBlockBytes[part]) {PhaseBlockBytes[part] = PhaseIntervalBlockBytes; memcpy(PhaseBlockName[part], PhaseIntervalBlockName, MAXCHARS);}
+  PhaseIntervalPeak = AllocatedBytes; PhaseIntervalBlockBytes = 0; /* blocks still allocated count towards the next interval's peak, but not as its 'largest block' */
+#endif
+}
+
+
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+/*! reduce the per-part memory peaks across tasks and write them to memory.txt (called from write_cpu_log() at every sync-point, so
+    the record belongs to the same step as the one in cpu.txt). under IO_REDUCED_MODE only full steps are written, and the record
+    holds the maxima over all steps since the previous one */
+void write_memory_phase_log(void)
+{
+#ifdef IO_REDUCED_MODE
+  if(All.HighestActiveTimeBin != All.HighestOccupiedTimeBin) {return;}
+#endif
+  struct {double bytes; int task;} peak_in[CPU_PARTS], peak_out[CPU_PARTS], block_in[CPU_PARTS], block_out[CPU_PARTS];
+  double peak_local[CPU_PARTS], peak_sum[CPU_PARTS]; unsigned char names_in[CPU_PARTS][MAXCHARS], names_out[CPU_PARTS][MAXCHARS]; int i;
+
+  for(i = 1, PhasePeakBytes[CPU_ALL] = 0; i < CPU_PARTS; i++) {if(PhasePeakBytes[i] > PhasePeakBytes[CPU_ALL]) {PhasePeakBytes[CPU_ALL] = PhasePeakBytes[i];}}
+  for(i = 0; i < CPU_PARTS; i++)
+  {
+      peak_in[i].bytes = peak_local[i] = (double) PhasePeakBytes[i]; peak_in[i].task = ThisTask;
+      block_in[i].bytes = (double) PhaseBlockBytes[i]; block_in[i].task = ThisTask;
+  }
+  MPI_Reduce(peak_in, peak_out, CPU_PARTS, MPI_DOUBLE_INT, MPI_MAXLOC, 0, MPI_COMM_WORLD);
+  MPI_Reduce(peak_local, peak_sum, CPU_PARTS, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Allreduce(block_in, block_out, CPU_PARTS, MPI_DOUBLE_INT, MPI_MAXLOC, MPI_COMM_WORLD);
+  memset(names_in, 0, CPU_PARTS * MAXCHARS); /* the name of each part's largest block comes from the task which holds it: all others contribute zeros */
+  for(i = 0; i < CPU_PARTS; i++) {if(block_out[i].task == ThisTask) {memcpy(names_in[i], PhaseBlockName[i], MAXCHARS);}}
+  MPI_Reduce(names_in, names_out, CPU_PARTS * MAXCHARS, MPI_UNSIGNED_CHAR, MPI_MAX, 0, MPI_COMM_WORLD);
+
+  if(ThisTask == 0)
+  {
+      fprintf(FdMemPhase, "Step %lld, Time: %g, CPUs: %d, MaxMemSize: %d MB, HighMark(max over tasks): %g MB\n",
+              (long long) All.NumCurrentTiStep, All.Time, NTask, All.MaxMemSize, peak_out[CPU_ALL].bytes / (1024.0 * 1024.0));
+      fprintf(FdMemPhase, "part                 peak(max)[MB] (task)   peak(avg)[MB]   largest new block [MB] (task)\n");
+      for(i = 1; i < CPU_PARTS; i++)
+      {
+          if(peak_out[i].bytes <= 0) {continue;}
+          names_out[i][MAXCHARS - 1] = 0;
+          fprintf(FdMemPhase, "%-18s %13.2f %7d %15.2f   %-16s %9.2f %7d\n", CPU_PartName[i], peak_out[i].bytes / (1024.0 * 1024.0), peak_out[i].task,
+                  peak_sum[i] / NTask / (1024.0 * 1024.0), block_out[i].bytes > 0 ? (char *) names_out[i] : "-", block_out[i].bytes / (1024.0 * 1024.0), block_out[i].task);
+      }
+      fprintf(FdMemPhase, "\n"); fflush(FdMemPhase);
+  }
+
+  memset(PhasePeakBytes, 0, CPU_PARTS * sizeof(size_t));
+  memset(PhaseBlockBytes, 0, CPU_PARTS * sizeof(size_t));
+  memset(PhaseBlockName, 0, CPU_PARTS * MAXCHARS);
+}
+#endif
+
+
+
+/*! open the per-thread scratch arena: one pool block of maxThreads slabs, each of (at most) bytes_per_thread. the request is capped
+    so that the arena never takes more than 1/8 of what is left in the pool. it obeys the usual LIFO discipline, so it is opened after
+    and closed before the other buffers of the region it serves (anything allocated in between must be freed before it is closed) */
+void myscratch_open_fullinfo(size_t bytes_per_thread, const char *func, const char *file, int line)
+{
+  int t;
+  if(ScratchBase) {printf("Task=%d: scratch arena opened twice at %s()/%s/line %d\n", ThisTask, func, file, line); endrun(818);}
+#ifdef PTHREADS_NUM_THREADS
+  return; /* no thread index available to the callers outside of the loop kernels: leave closed, everything takes the fallback */
+#endif
+  size_t cap = FreeBytes / (8 * (size_t)maxThreads);
+  if(bytes_per_thread > cap) {bytes_per_thread = cap;}
+  bytes_per_thread = (bytes_per_thread / MIN_ALIGNMENT) * MIN_ALIGNMENT;
+  if(bytes_per_thread < MIN_ALIGNMENT) {return;}
+  ScratchSlab = bytes_per_thread; ScratchThreads = maxThreads;
+#ifndef DISABLE_MEMORY_MANAGER
+  ScratchBase = (char *) mymalloc_fullinfo("ScratchArena", ScratchSlab * ScratchThreads, func, file, line);
+#else
+  ScratchBase = (char *) malloc(ScratchSlab * ScratchThreads);
+#endif
+  for(t = 0; t < ScratchThreads; t++) {ScratchUsed[t * SCRATCH_STRIDE] = ScratchUsed[t * SCRATCH_STRIDE + 1] = 0;}
+}
+
+
+void myscratch_close_fullinfo(const char *func, const char *file, int line)
+{
+  int t;
+  if(!ScratchBase) {return;}
+  for(t = 0; t < ScratchThreads; t++)
+    {
+      if(ScratchUsed[t * SCRATCH_STRIDE + 1] > ScratchHighMarkBytes) {ScratchHighMarkBytes = ScratchUsed[t * SCRATCH_STRIDE + 1]; ScratchHighMarkSlab = ScratchSlab;}
+    }
+#ifndef DISABLE_MEMORY_MANAGER
+  myfree_fullinfo(ScratchBase, func, file, line);
+#else
+  free(ScratchBase);
+#endif
+  ScratchBase = NULL;
+}
+
+
+static inline int myscratch_thread(void)
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+
+/*! bump-allocate n bytes of scratch from the calling thread's slab. returns NULL (and counts the miss) if no arena is open or the
+    slab is full: callers must have a fallback (stack, or a smaller/serial path) */
+void *myscratch(size_t n)
+{
+  if(!ScratchBase) {return NULL;}
+  int t = myscratch_thread(); if(t >= ScratchThreads) {return NULL;}
+  size_t *used = &ScratchUsed[t * SCRATCH_STRIDE];
+  if((n % MIN_ALIGNMENT) > 0) {n = (n / MIN_ALIGNMENT + 1) * MIN_ALIGNMENT;}
+  if(used[0] + n > ScratchSlab)
+    {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      ScratchFailures++;
+      return NULL;
+    }
+  void *ptr = ScratchBase + t * ScratchSlab + used[0];
+  used[0] += n; if(used[0] > used[1]) {used[1] = used[0];}
+  return ptr;
+}
+
+
+/*! current position of the calling thread's slab: everything allocated after the mark is dropped by myscratch_release(mark) */
+size_t myscratch_mark(void)
+{
+  if(!ScratchBase) {return 0;}
+  int t = myscratch_thread(); if(t >= ScratchThreads) {return 0;}
+  return ScratchUsed[t * SCRATCH_STRIDE];
+}
+
+
+void myscratch_release(size_t mark)
+{
+  if(!ScratchBase) {return;}
+  int t = myscratch_thread(); if(t >= ScratchThreads) {return;}
+  if(mark <= ScratchUsed[t * SCRATCH_STRIDE]) {ScratchUsed[t * SCRATCH_STRIDE] = mark;}
+}
+
 void *mymalloc_fullinfo(const char *varname, size_t n, const char *func, const char *file, int line)
 {
   if((n % MIN_ALIGNMENT) > 0) {n = (n / MIN_ALIGNMENT + 1) * MIN_ALIGNMENT;}
@@ -169,6 +420,9 @@ void *mymalloc_fullinfo(const char *varname, size_t n, const char *func, const c
       endrun(812);
     }
   Table[Nblocks] = (char*)Base + (TotBytes - FreeBytes);
+#ifdef NUMA_FIRST_TOUCH
+  mymalloc_first_touch(TotBytes - FreeBytes, n);
+#endif
   FreeBytes -= n;
 
   strncpy(VarName + Nblocks * MAXCHARS, varname, MAXCHARS - 1);
@@ -184,6 +438,9 @@ void *mymalloc_fullinfo(const char *varname, size_t n, const char *func, const c
 
   if(AllocatedBytes > HighMarkBytes)
     HighMarkBytes = AllocatedBytes;
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+  memory_phase_note(Nblocks - 1);
+#endif
 
   return Table[Nblocks - 1];
 }
@@ -211,6 +468,9 @@ void *mymalloc_movable_fullinfo(void *ptr, const char *varname, size_t n, const
       endrun(817);
     }
   Table[Nblocks] = (char*)Base + (TotBytes - FreeBytes);
+#ifdef NUMA_FIRST_TOUCH
+  mymalloc_first_touch(TotBytes - FreeBytes, n);
+#endif
   FreeBytes -= n;
 
   strncpy(VarName + Nblocks * MAXCHARS, varname, MAXCHARS - 1);
@@ -227,6 +487,9 @@ void *mymalloc_movable_fullinfo(void *ptr, const char *varname, size_t n, const
 
   if(AllocatedBytes > HighMarkBytes)
     HighMarkBytes = AllocatedBytes;
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+  memory_phase_note(Nblocks - 1);
+#endif
 
   return Table[Nblocks - 1];
 }
@@ -367,6 +630,9 @@ void *myrealloc_fullinfo(void *p, size_t n, const char *func, const char *file,
       endrun(812);
     }
   Table[Nblocks - 1] = (char*)Base + (TotBytes - FreeBytes);
+#ifdef NUMA_FIRST_TOUCH
+  mymalloc_first_touch(TotBytes - FreeBytes, n);
+#endif
   FreeBytes -= n;
 
   AllocatedBytes += n;
@@ -374,6 +640,9 @@ void *myrealloc_fullinfo(void *p, size_t n, const char *func, const char *file,
 
   if(AllocatedBytes > HighMarkBytes)
     HighMarkBytes = AllocatedBytes;
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+  memory_phase_note(Nblocks - 1);
+#endif
 
   return Table[Nblocks - 1];
 }
@@ -437,6 +706,9 @@ void *myrealloc_movable_fullinfo(void *p, size_t n, const char *func, const char
 
   size_t offset = n - BlockSize[nr];
   size_t length = 0;
+#ifdef NUMA_FIRST_TOUCH
+  mymalloc_first_touch(0, TotBytes - FreeBytes + n); /* the blocks moved up below may reach into untouched pages */
+#endif
 
   for(i = nr + 1; i < Nblocks; i++)
     length += BlockSize[i];
@@ -457,6 +729,9 @@ void *myrealloc_movable_fullinfo(void *p, size_t n, const char *func, const char
 
   if(AllocatedBytes > HighMarkBytes)
     HighMarkBytes = AllocatedBytes;
+#ifdef OUTPUT_MEMORY_PHASE_LOG
+  memory_phase_note(nr);
+#endif
 
   return Table[nr];
 }
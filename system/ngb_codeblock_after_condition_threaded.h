@@ -2,27 +2,23 @@
  this defines a code-block to be inserted in the neighbor search routines after the conditions for neighbor-validity are applied
  (valid particle types checked)
  */
-if(P[p].Ti_current != ti_Current)
-{
-    LOCK_PARTNODEDRIFT;
-#ifdef _OPENMP
-#pragma omp critical(_partnodedrift_)
-#endif
-    drift_particle(p, ti_Current);
-    UNLOCK_PARTNODEDRIFT;
-}
+DRIFT_PARTICLE_ON_DEMAND(p, ti_Current);
 
 #ifndef REDUCE_TREEWALK_BRANCHING
 #if (SEARCHBOTHWAYS==1)
+#ifdef NGB_SEARCHBOTHWAYS_HFAC
+dist = DMAX(NGB_SEARCHBOTHWAYS_HFAC * PPP[p].Hsml, hsml); /* caller asked for the other side's kernel lengths to be enlarged as well */
+#else
 dist = DMAX(PPP[p].Hsml, hsml);
+#endif
 #else
 dist = hsml;
 #endif
-dx = NGB_PERIODIC_BOX_LONG_X(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+dx = NGB_PERIODIC_BOX_LONG_X(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
 if(dx > dist) continue;
-dy = NGB_PERIODIC_BOX_LONG_Y(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+dy = NGB_PERIODIC_BOX_LONG_Y(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
 if(dy > dist) continue;
-dz = NGB_PERIODIC_BOX_LONG_Z(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+dz = NGB_PERIODIC_BOX_LONG_Z(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
 if(dz > dist) continue;
 if(dx * dx + dy * dy + dz * dz > dist * dist) continue;
 #endif
@@ -40,8 +36,15 @@ else
         }
 #endif
         if(mode == 1) {endrun(123128);}
+#ifdef NGB_PSEUDOPARTICLE_HOOK
+        NGB_PSEUDOPARTICLE_HOOK /* lets a calling routine note that its search reached another task's part of the tree */
+#endif
         
+#ifdef MPI_REUSE_EXPORT_PLANS
+        if(target >= 0 && !ExportPlanReplay) /* if no target is given, or the loop re-uses a stored export plan, export will not occur */
+#else
         if(target >= 0)	/* if no target is given, export will not occur */
+#endif
         {
             if(exportflag[task = DomainTask[no - (maxPart + maxNodes)]] != target)
             {
@@ -51,26 +54,8 @@ else
             
             if(exportnodecount[task] == NODELISTLENGTH)
             {
-                int exitFlag = 0, nexp;
-                LOCK_NEXPORT;
-#ifdef _OPENMP
-#pragma omp critical(_nexport_)
-#endif
-                {
-                    if(Nexport >= bunchSize)
-                    {
-                        /* out of buffer space. Need to discard work for this particle and interrupt */
-                        BufferFullFlag = 1;
-                        exitFlag = 1;
-                    }
-                    else
-                    {
-                        nexp = Nexport;
-                        Nexport++;
-                    }
-                }
-                UNLOCK_NEXPORT;
-                if(exitFlag) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
+                long nexp = export_block_next_slot(exportflag); /* slot in this thread's block of the export table */
+                if(nexp < 0) {return -1;} /* buffer has filled -- important that only this and other buffer-full conditions return the negative condition for the routine */
                 
                 exportnodecount[task] = 0;
                 exportindex[task] = nexp;
@@ -126,7 +111,11 @@ else
     }
     
 #if (SEARCHBOTHWAYS==1)
+#ifdef NGB_SEARCHBOTHWAYS_HFAC
+    dist = DMAX(NGB_SEARCHBOTHWAYS_HFAC * Extnodes[no].hmax, hsml) + 0.5 * current->len;
+#else
     dist = DMAX(Extnodes[no].hmax, hsml) + 0.5 * current->len;
+#endif
 #else
     dist = hsml + 0.5 * current->len;
 #endif
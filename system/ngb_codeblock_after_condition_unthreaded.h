@@ -1,5 +1,4 @@
-if(P[p].Ti_current != ti_Current)
-drift_particle(p, ti_Current);
+DRIFT_PARTICLE_ON_DEMAND(p, ti_Current);
 
 #ifndef REDUCE_TREEWALK_BRANCHING
 #if (SEARCHBOTHWAYS==1)
@@ -7,11 +6,11 @@ dist = DMAX(PPP[p].Hsml, hsml);
 #else
 dist = hsml;
 #endif
-dx = NGB_PERIODIC_BOX_LONG_X(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+dx = NGB_PERIODIC_BOX_LONG_X(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
 if(dx > dist) continue;
-dy = NGB_PERIODIC_BOX_LONG_Y(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+dy = NGB_PERIODIC_BOX_LONG_Y(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
 if(dy > dist) continue;
-dz = NGB_PERIODIC_BOX_LONG_Z(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - searchcenter[1], P[p].Pos[2] - searchcenter[2],-1);
+dz = NGB_PERIODIC_BOX_LONG_Z(P_POS(p,0) - searchcenter[0], P_POS(p,1) - searchcenter[1], P_POS(p,2) - searchcenter[2],-1);
 if(dz > dist) continue;
 if(dx * dx + dy * dy + dz * dz > dist * dist) continue;
 #endif
@@ -33,7 +32,7 @@ else
             
             if(Exportnodecount[task] == NODELISTLENGTH)
             {
-                if(*nexport >= bunchSize)
+                if(*nexport >= All.BunchSize)
                 {
                     *nexport = nexport_save;
                     if(nexport_save == 0) {endrun(13004);} /* in this case, the buffer is too small to process even a single particle */
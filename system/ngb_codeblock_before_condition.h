@@ -4,20 +4,23 @@
  */
   int numngb, no, p, task;
   struct NODE *current;
+#ifdef MPI_REUSE_EXPORT_PLANS
+  if(mode == 0 && ExportPlanSearchFac > 1) {hsml *= ExportPlanSearchFac;} /* recording an export plan with a margin (see code_block_xchange_perform_ops.h): callers re-check distances against their own radius */
+#endif
   // cache some global vars locally for improved compiler alias analysis
   int maxPart = All.MaxPart;
   int maxNodes = MaxNodes;
-  long bunchSize = All.BunchSize;
   integertime ti_Current = All.Ti_Current;
-  MyDouble dx, dy, dz, dist, xtmp; xtmp=0;
+  MyDouble dist;
+#if !defined(REDUCE_TREEWALK_BRANCHING) || (BOX_SHEARING > 1)
+  MyDouble dx, dy, dz, xtmp; xtmp=0; /* the reduced-branching walk computes node distances in vector form and leaves particle distances to ngb_filter_variables */
+#endif
 
 #ifdef REDUCE_TREEWALK_BRANCHING
   t_vector box, hbox, vcenter;
-#ifdef BOX_PERIODIC
-  INIT_VECTOR3(boxSize_X, boxSize_Y, boxSize_Z, &box);
+  INIT_VECTOR3(NGB_WRAP_LENGTH_X, NGB_WRAP_LENGTH_Y, NGB_WRAP_LENGTH_Z, &box);
   INIT_VECTOR3(searchcenter[0], searchcenter[1], searchcenter[2], &vcenter);
   SCALE_VECTOR3(0.5, &box, &hbox);
-#endif
 #endif
 
   numngb = 0;
@@ -35,12 +35,13 @@
 
 #ifdef REDUCE_TREEWALK_BRANCHING
     // On the Power platform it is more efficient to compute all conditions first and then perform a single branch (on current Intel processors this is equally fast)
+    // the three wrapped box-distances come out of one vector operation (SIMD with VECTOR_AVX), then are tested together with the enclosing sphere
     MyDouble dist2 = dist + FACT1*current->len;
-    dx = NGB_PERIODIC_BOX_LONG_X(current->center[0] - vcenter.d[0], current->center[1] - vcenter.d[1], current->center[2] - vcenter.d[2],-1);
-    dy = NGB_PERIODIC_BOX_LONG_Y(current->center[0] - vcenter.d[0], current->center[1] - vcenter.d[1], current->center[2] - vcenter.d[2],-1);
-    dz = NGB_PERIODIC_BOX_LONG_Z(current->center[0] - vcenter.d[0], current->center[1] - vcenter.d[1], current->center[2] - vcenter.d[2],-1);
-    // now test against the minimal sphere enclosing everything
-    if ((dx > dist) || (dy > dist) || (dz > dist) || (dx * dx + dy * dy + dz * dz > dist2 * dist2)) continue;    // ok, we need to open the node
+    t_vector vnode, vdist;
+    LOAD_VECTOR3(current->center, &vnode);
+    PERIODIC_ABSDIFF_VECTOR3(&vnode, &vcenter, &box, &vnode);
+    SET_VECTOR3(dist, &vdist);
+    if (ANY_COMP_LT_VECTOR3(&vdist, &vnode, 7) | (L2NORM_VECTOR3(&vnode) > dist2 * dist2)) continue;    // ok, we need to open the node
 #else
     // On older Intel and AMD processors it seems better to avoid the computations and branch early
     dx = NGB_PERIODIC_BOX_LONG_X(current->center[0]-searchcenter[0],current->center[1]-searchcenter[1],current->center[2]-searchcenter[2],-1);
@@ -20,11 +20,12 @@ static struct peano_hilbert_data
 {
   peanokey key;
   int index;
+#ifdef TIMEBIN_SORTED_STORAGE
+  int bin;
+#endif
 }
  *mp;
 
-static int *Id;
-
 void peano_hilbert_order(void)
 {
   int i; PRINT_STATUS("Begin Peano-Hilbert order...");
@@ -32,12 +33,14 @@ void peano_hilbert_order(void)
   if(N_gas)
     {
       mp = (struct peano_hilbert_data *) mymalloc("mp", sizeof(struct peano_hilbert_data) * N_gas);
-      Id = (int *) mymalloc("Id", sizeof(int) * N_gas);
 
       for(i = 0; i < N_gas; i++)
 	{
 	  mp[i].index = i;
 	  mp[i].key = Key[i];
+#ifdef TIMEBIN_SORTED_STORAGE
+	  mp[i].bin = P[i].TimeBin;
+#endif
 	}
 
 #ifdef MYSORT
@@ -46,12 +49,8 @@ void peano_hilbert_order(void)
       qsort(mp, N_gas, sizeof(struct peano_hilbert_data), peano_compare_key);
 #endif
 
-      for(i = 0; i < N_gas; i++)
-	Id[mp[i].index] = i;
-
       reorder_gas();
 
-      myfree(Id);
       myfree(mp);
     }
 
@@ -62,13 +61,13 @@ void peano_hilbert_order(void)
 	(struct peano_hilbert_data *) mymalloc("mp", sizeof(struct peano_hilbert_data) * (NumPart - N_gas));
       mp -= (N_gas);
 
-      Id = (int *) mymalloc("Id", sizeof(int) * (NumPart - N_gas));
-      Id -= (N_gas);
-
       for(i = N_gas; i < NumPart; i++)
 	{
 	  mp[i].index = i;
 	  mp[i].key = Key[i];
+#ifdef TIMEBIN_SORTED_STORAGE
+	  mp[i].bin = P[i].TimeBin;
+#endif
 	}
 
 #ifdef MYSORT
@@ -77,114 +76,132 @@ void peano_hilbert_order(void)
       qsort(mp + N_gas, NumPart - N_gas, sizeof(struct peano_hilbert_data), peano_compare_key);
 #endif
 
-      for(i = N_gas; i < NumPart; i++)
-	Id[mp[i].index] = i;
-
       reorder_particles();
 
-      Id += N_gas;
-      myfree(Id);
       mp += N_gas;
       myfree(mp);
     }
 
+#ifdef TIMEBIN_SORTED_STORAGE
+    TimeBinStorageMoves = 0;
+#endif
     PRINT_STATUS(" ..Peano-Hilbert done");
 }
 
 
 int peano_compare_key(const void *a, const void *b)
 {
+#ifdef TIMEBIN_SORTED_STORAGE /* group by timebin first (smallest steps first), so the active set of any step is a contiguous block at the start of the gas and of the non-gas particles */
+  if(((struct peano_hilbert_data *) a)->bin < (((struct peano_hilbert_data *) b)->bin)) {return -1;}
+  if(((struct peano_hilbert_data *) a)->bin > (((struct peano_hilbert_data *) b)->bin)) {return +1;}
+#endif
   if(((struct peano_hilbert_data *) a)->key < (((struct peano_hilbert_data *) b)->key)) {return -1;}
   if(((struct peano_hilbert_data *) a)->key > (((struct peano_hilbert_data *) b)->key)) {return +1;}
   return 0;
 }
 
-void reorder_gas(void)
+
+/*! After the sort, slot k of the range [istart,iend) is to receive the particle currently stored at mp[k].index.
+ *  If there is room for a scratch copy of the largest per-particle structure, the permutation is applied
+ *  out-of-place: each array is gathered into the buffer (contiguous writes, trivially parallel) and copied back.
+ *  Otherwise we fall back to following the cycles of the permutation in place; the cycles are disjoint, so once
+ *  one element ('leader') of each has been identified (a cheap pass over the integer indices only), the cycles
+ *  themselves are moved in parallel. All per-particle arrays (P, and SphP/ChimesGasVars for the gas) are moved
+ *  in the same pass.
+ */
+static void reorder_particle_range(int istart, int iend, int is_gas)
 {
-  int i;
-  struct particle_data Psave, Psource;
-  struct sph_particle_data SphPsave, SphPsource;
-  int idsource, idsave, dest;
-#ifdef CHIMES 
-  struct gasVariables gasVarsSave, gasVarsSource;
-#endif 
-
-  for(i = 0; i < N_gas; i++)
+  int i, n = iend - istart;
+  if(n <= 0) {return;}
+  size_t elsize = sizeof(struct particle_data);
+  if(is_gas)
     {
-      if(Id[i] != i)
-	{
-	  Psource = P[i];
-	  SphPsource = SphP[i];
-#ifdef CHIMES 
-	  gasVarsSource = ChimesGasVars[i];
+      if(sizeof(struct sph_particle_data) > elsize) {elsize = sizeof(struct sph_particle_data);}
+#ifdef CHIMES
+      if(sizeof(struct gasVariables) > elsize) {elsize = sizeof(struct gasVariables);}
 #endif
-	  idsource = Id[i];
-	  dest = Id[i];
-
-	  do
-	    {
-	      Psave = P[dest];
-	      SphPsave = SphP[dest];
-#ifdef CHIMES 
-	      gasVarsSave = ChimesGasVars[dest];
-#endif 
-	      idsave = Id[dest];
-
-	      P[dest] = Psource;
-	      SphP[dest] = SphPsource;
-#ifdef CHIMES 
-	      ChimesGasVars[dest] = gasVarsSource;
-#endif 
-	      Id[dest] = idsource;
-
-	      if(dest == i)
-		break;
-
-	      Psource = Psave;
-	      SphPsource = SphPsave;
-#ifdef CHIMES 
-	      gasVarsSource = gasVarsSave; 
-#endif 
-	      idsource = idsave;
-	      dest = idsource;
-	    }
-	  while(1);
-	}
     }
+
+  if((double)n * elsize + 16384. < (double)FreeBytes)
+    {
+      void *buf = mymalloc("reorder_buf", (size_t)n * elsize);
+      struct particle_data *Pbuf = (struct particle_data *) buf;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) schedule(static)
+#endif
+      for(i = istart; i < iend; i++) {Pbuf[i - istart] = P[mp[i].index];}
+      memcpy(&P[istart], Pbuf, (size_t)n * sizeof(struct particle_data));
+      if(is_gas)
+        {
+          struct sph_particle_data *SphPbuf = (struct sph_particle_data *) buf;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) schedule(static)
+#endif
+          for(i = istart; i < iend; i++) {SphPbuf[i - istart] = SphP[mp[i].index];}
+          memcpy(&SphP[istart], SphPbuf, (size_t)n * sizeof(struct sph_particle_data));
+#ifdef CHIMES
+          struct gasVariables *gasVarsBuf = (struct gasVariables *) buf;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) schedule(static)
+#endif
+          for(i = istart; i < iend; i++) {gasVarsBuf[i - istart] = ChimesGasVars[mp[i].index];}
+          memcpy(&ChimesGasVars[istart], gasVarsBuf, (size_t)n * sizeof(struct gasVariables));
+#endif
+        }
+      myfree(buf);
+      return;
+    }
+
+  /* not enough memory for the scratch copy: identify one leader per non-trivial cycle, then move the cycles in parallel */
+  int nleaders = 0, *leaders = (int *) mymalloc("reorder_leaders", n * sizeof(int));
+  char *done = (char *) mymalloc("reorder_done", n * sizeof(char));
+  memset(done, 0, n * sizeof(char));
+  for(i = istart; i < iend; i++)
+    {
+      if(done[i - istart]) {continue;}
+      done[i - istart] = 1;
+      if(mp[i].index == i) {continue;}
+      leaders[nleaders++] = i;
+      int j; for(j = mp[i].index; j != i; j = mp[j].index) {done[j - istart] = 1;}
+    }
+  int k;
+#ifdef _OPENMP
+#pragma omp parallel for private(k) schedule(dynamic,64)
+#endif
+  for(k = 0; k < nleaders; k++)
+    {
+      int j = leaders[k], src;
+      struct particle_data Psave = P[j];
+      for(src = mp[j].index; src != leaders[k]; j = src, src = mp[j].index) {P[j] = P[src];}
+      P[j] = Psave;
+      if(is_gas)
+        {
+          j = leaders[k];
+          struct sph_particle_data SphPsave = SphP[j];
+          for(src = mp[j].index; src != leaders[k]; j = src, src = mp[j].index) {SphP[j] = SphP[src];}
+          SphP[j] = SphPsave;
+#ifdef CHIMES
+          j = leaders[k];
+          struct gasVariables gasVarsSave = ChimesGasVars[j];
+          for(src = mp[j].index; src != leaders[k]; j = src, src = mp[j].index) {ChimesGasVars[j] = ChimesGasVars[src];}
+          ChimesGasVars[j] = gasVarsSave;
+#endif
+        }
+    }
+  myfree(done);
+  myfree(leaders);
 }
 
 
-void reorder_particles(void)
+void reorder_gas(void)
 {
-  int i;
-  struct particle_data Psave, Psource;
-  int idsource, idsave, dest;
+  reorder_particle_range(0, N_gas, 1);
+}
 
-  for(i = N_gas; i < NumPart; i++)
-    {
-      if(Id[i] != i)
-	{
-	  Psource = P[i];
-	  idsource = Id[i];
-
-	  dest = Id[i];
-
-	  do
-	    {
-	      Psave = P[dest];
-	      idsave = Id[dest];
-	      P[dest] = Psource;
-	      Id[dest] = idsource;
-	      if(dest == i)
-		break;
-
-	      Psource = Psave;
-	      idsource = idsave;
-	      dest = idsource;
-	    }
-	  while(1);
-	}
-    }
+
+void reorder_particles(void)
+{
+  reorder_particle_range(N_gas, NumPart, 0);
 }
 
 
@@ -551,7 +568,11 @@ static void msort_peano_with_tmp(struct peano_hilbert_data *b, size_t n, struct
 
   while(n1 > 0 && n2 > 0)
     {
+#ifdef TIMEBIN_SORTED_STORAGE
+      if(b1->bin < b2->bin || (b1->bin == b2->bin && b1->key <= b2->key))
+#else
       if(b1->key <= b2->key)
+#endif
 	{
 	  --n1;
 	  *tmp++ = *b1++;
@@ -0,0 +1,114 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "../allvars.h"
+#include "../proto.h"
+
+/*
+ *  Optional (OUTPUT_PERF_COUNTERS, Linux only) hardware performance counters per CPU_* part: cycles, instructions, last-level cache
+ *  misses and branch misses are read through perf_event_open() at every boundary where time is booked to CPU_Step[] (see
+ *  phase_interval_close()), and the differences are accumulated for the part the interval is booked to. write_cpu_log() then sums them
+ *  over tasks and writes the running totals to perf_counters.txt, so e.g. the instructions per cycle and cache misses per 1000
+ *  instructions of the tree-walk, hydro or cooling parts can be compared between runs without attaching a profiler.
+ */
+
+#ifdef OUTPUT_PERF_COUNTERS
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define PERF_NCOUNTERS 4
+static const unsigned long long PerfConfig[PERF_NCOUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+static int PerfFd[PERF_NCOUNTERS];              /* -1 where the counter could not be opened */
+static double PerfLast[PERF_NCOUNTERS];         /* counter values at the previous boundary */
+static double PerfStep[CPU_PARTS][PERF_NCOUNTERS]; /* accumulated on this task since the last write_perf_counters_log() */
+static double PerfSum[CPU_PARTS][PERF_NCOUNTERS];  /* running totals over all tasks (on task 0) */
+static int PerfAvailable;                       /* counters open on this task */
+
+
+/* current value of counter k, scaled up for the time it was not counting if the kernel had to multiplex the counters */
+static double perf_counter_value(int k)
+{
+  unsigned long long buf[3]; /* value, time enabled, time running (PERF_FORMAT_TOTAL_TIME_ENABLED|RUNNING) */
+  if(PerfFd[k] < 0) {return 0;}
+  if(read(PerfFd[k], buf, sizeof(buf)) != sizeof(buf)) {return PerfLast[k];}
+  if(buf[2] == 0) {return PerfLast[k];}
+  return (double) buf[0] * ((double) buf[1] / (double) buf[2]);
+}
+
+
+/*! open the counters of this task. this must be done before the OpenMP threads are started: the counters are opened with 'inherit',
+    so they also count all threads created afterwards */
+void perf_counters_init(void)
+{
+  int k, nopen = 0, nopen_min;
+  for(k = 0; k < PERF_NCOUNTERS; k++)
+  {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr); attr.type = PERF_TYPE_HARDWARE; attr.config = PerfConfig[k];
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      attr.inherit = 1; attr.exclude_kernel = 1; attr.exclude_hv = 1; attr.disabled = 1;
+      PerfFd[k] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0); /* this process (and its threads), any cpu */
+      if(PerfFd[k] >= 0) {nopen++;}
+  }
+  MPI_Allreduce(&nopen, &nopen_min, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  if(nopen_min < PERF_NCOUNTERS && ThisTask == 0)
+  {
+      PRINT_WARNING("OUTPUT_PERF_COUNTERS: only %d of the %d hardware counters could be opened on some task (perf_event_paranoid setting, virtualized node, or no PMU?): the missing ones are written as zero", nopen_min, PERF_NCOUNTERS);
+  }
+  for(k = 0; k < PERF_NCOUNTERS; k++) {if(PerfFd[k] >= 0) {ioctl(PerfFd[k], PERF_EVENT_IOC_RESET, 0); ioctl(PerfFd[k], PERF_EVENT_IOC_ENABLE, 0);}}
+  for(k = 0; k < PERF_NCOUNTERS; k++) {PerfLast[k] = perf_counter_value(k);}
+  memset(PerfStep, 0, sizeof(PerfStep)); memset(PerfSum, 0, sizeof(PerfSum));
+  PerfAvailable = (nopen > 0);
+}
+
+
+/*! book the counts since the previous boundary to CPU part 'part' (called from phase_interval_close()) */
+void perf_counters_phase(int part)
+{
+  int k;
+  if(!PerfAvailable) {return;}
+  for(k = 0; k < PERF_NCOUNTERS; k++)
+  {
+      double v = perf_counter_value(k);
+      if(v > PerfLast[k]) {PerfStep[part][k] += v - PerfLast[k];}
+      PerfLast[k] = v;
+  }
+}
+
+
+/*! sum the counts of this step over the tasks, add them to the running totals, and write those (on full steps only with IO_REDUCED_MODE) */
+void write_perf_counters_log(void)
+{
+  double sum[CPU_PARTS][PERF_NCOUNTERS]; int i, k, navail = 0;
+  MPI_Reduce(&PerfStep[0][0], &sum[0][0], CPU_PARTS * PERF_NCOUNTERS, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&PerfAvailable, &navail, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  memset(PerfStep, 0, sizeof(PerfStep));
+  if(ThisTask != 0) {return;}
+
+  for(k = 0; k < PERF_NCOUNTERS; k++) {PerfSum[CPU_ALL][k] = 0;}
+  for(i = 1; i < CPU_PARTS; i++) {for(k = 0; k < PERF_NCOUNTERS; k++) {PerfSum[i][k] += sum[i][k]; PerfSum[CPU_ALL][k] += PerfSum[i][k];}}
+
+#ifdef IO_REDUCED_MODE
+  if(All.HighestActiveTimeBin != All.HighestOccupiedTimeBin) {return;}
+#endif
+  fprintf(FdPerfCounters, "Step %lld, Time: %g, CPUs: %d (counters on %d)\n", (long long) All.NumCurrentTiStep, All.Time, NTask, navail);
+  fprintf(FdPerfCounters, "part                     cycles   instructions      IPC    LLC-miss  LLC-MPKI   branch-miss  BR-MPKI\n");
+  for(i = 0; i < CPU_PARTS; i++)
+  {
+      double *c = PerfSum[i];
+      if(c[0] <= 0) {continue;}
+      fprintf(FdPerfCounters, "%-18s %12.4e   %12.4e  %7.3f  %10.3e  %8.3f  %12.4e  %7.3f\n", CPU_PartName[i], c[0], c[1], c[1] / c[0],
+              c[2], 1000. * c[2] / (MIN_REAL_NUMBER + c[1]), c[3], 1000. * c[3] / (MIN_REAL_NUMBER + c[1]));
+  }
+  fprintf(FdPerfCounters, "\n"); fflush(FdPerfCounters);
+}
+
+#endif
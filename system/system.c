@@ -228,6 +228,23 @@ double measure_time(void)	/* strategy: call this at end of functions to account
   return dt;
 }
 
+double measure_time_phase(int part) /* measure_time() for an interval which is booked to CPU_Step[part]: also closes the interval for the per-part accounting below */
+{
+  phase_interval_close(part);
+  return measure_time();
+}
+
+void phase_interval_close(int part) /* books everything since the previous call to CPU part 'part' in the optional per-part logs (memory high-water, timeline trace, hardware counters) */
+{
+  memory_phase_close(part);
+#ifdef OUTPUT_TIMELINE_TRACE
+  timeline_trace_phase(part);
+#endif
+#ifdef OUTPUT_PERF_COUNTERS
+  perf_counters_phase(part);
+#endif
+}
+
 double report_time(void)       /* strategy: call this to measure sub-times of functions*/
 {
   double t, dt;
@@ -0,0 +1,138 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../allvars.h"
+#include "../proto.h"
+
+/*
+ *  Optional (OUTPUT_TIMELINE_TRACE) per-task timeline of the step: every interval booked to a CPU_* part of cpu.txt, and the compute,
+ *  communication and wait sections of each pass of the neighbor-loop code blocks, are recorded with their start and end times into a
+ *  ring buffer on each task. The ring is written out in the Chrome trace-event (JSON array) format to timeline_trace/trace_<task>.json,
+ *  readable by chrome://tracing or Perfetto (ui.perfetto.dev), or by external converters to OTF2. Each task is a 'process' in the
+ *  trace, with the CPU parts on one thread-row and the loop sections under them on a second, and all tasks share one time axis, so the
+ *  files can be merged into one trace with e.g.:  (echo '['; tail -q -n +2 timeline_trace/trace_*.json) > trace.json
+ */
+
+#ifdef OUTPUT_TIMELINE_TRACE
+
+#if (OUTPUT_TIMELINE_TRACE+0 > 1) /* a bare OUTPUT_TIMELINE_TRACE (defined empty) uses the default */
+#define TIMELINE_TRACE_RING (OUTPUT_TIMELINE_TRACE) /* number of events held by each task between writes */
+#else
+#define TIMELINE_TRACE_RING 65536
+#endif
+
+struct timeline_event
+{
+  double t0, t1;    /* begin and end, in the clock of my_second() */
+  int kind;         /* 0 for a CPU part (then 'part' is set), else TIMELINE_TRACE_COMPUTE/COMM/WAIT of a neighbor loop (then 'loop' is set) */
+  int part;
+  const char *loop; /* points to a string literal, so it need not be copied */
+  long long n;      /* number of elements processed or exchanged in the section */
+};
+
+static struct timeline_event *TraceRing;
+static long long TraceHead, TraceTail, TraceDropped; /* events TraceTail...TraceHead-1 are held (modulo the ring size) */
+static double TraceT0, TraceEpoch;  /* my_second() when the trace was opened, and the corresponding wallclock time [s since 1970] on task 0 */
+static double TracePhaseStart;      /* start of the interval that the next timeline_trace_phase() call closes */
+static long long TraceStep;         /* step number of the events being recorded */
+static FILE *FdTrace;
+
+
+/*! open the trace file of this task (appending on restarts, so the file of a run continued from restart files holds the whole run)
+    and set the common time origin: all tasks leave the barrier at (nearly) the same time, and take task 0's wallclock time there */
+void timeline_trace_init(void)
+{
+  char buf[300], mode[2];
+  if(RestartFlag == 0) {strcpy(mode, "w");} else {strcpy(mode, "a");}
+  if(ThisTask == 0) {sprintf(buf, "%stimeline_trace", All.OutputDir); mkdir(buf, 02755);}
+  MPI_Barrier(MPI_COMM_WORLD);
+  sprintf(buf, "%stimeline_trace/trace_%d.json", All.OutputDir, ThisTask);
+  if(!(FdTrace = fopen(buf, mode))) {printf("error in opening file '%s'\n", buf); endrun(1);}
+  fseek(FdTrace, 0, SEEK_END); if(ftell(FdTrace) == 0) {fprintf(FdTrace, "[\n");} /* the closing bracket is optional in this format, so the file is valid at any point */
+  fprintf(FdTrace, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"task %d\"}},\n", ThisTask, ThisTask);
+  fprintf(FdTrace, "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"sort_index\":%d}},\n", ThisTask, ThisTask);
+  fprintf(FdTrace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"cpu parts\"}},\n", ThisTask);
+  fprintf(FdTrace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"loop sections\"}},\n", ThisTask);
+  fflush(FdTrace);
+
+  TraceRing = (struct timeline_event *) malloc(TIMELINE_TRACE_RING * sizeof(struct timeline_event)); /* outside the mymalloc pool, so it is not counted in the memory logs */
+  if(!TraceRing) {printf("failed to allocate the timeline trace buffer (%d events) on task %d\n", TIMELINE_TRACE_RING, ThisTask); endrun(1);}
+  TraceHead = TraceTail = TraceDropped = 0;
+
+  TraceEpoch = (double) time(NULL);
+  MPI_Bcast(&TraceEpoch, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Barrier(MPI_COMM_WORLD);
+  TraceT0 = TracePhaseStart = my_second();
+  TraceStep = All.NumCurrentTiStep;
+}
+
+
+static inline struct timeline_event *timeline_trace_next(void)
+{
+  struct timeline_event *e = &TraceRing[TraceHead % TIMELINE_TRACE_RING];
+  TraceHead++;
+  if(TraceHead - TraceTail > TIMELINE_TRACE_RING) {TraceTail++; TraceDropped++;} /* full: the oldest event is overwritten */
+  return e;
+}
+
+
+/*! record the interval since the previous call as CPU part 'part' (called from phase_interval_close()) */
+void timeline_trace_phase(int part)
+{
+  if(!TraceRing) {return;} /* calls before the trace is opened are not recorded */
+  double t = my_second();
+  struct timeline_event *e = timeline_trace_next();
+  e->t0 = TracePhaseStart; e->t1 = t; e->kind = 0; e->part = part; e->loop = NULL; e->n = TraceStep;
+  TracePhaseStart = t;
+}
+
+
+/*! record a compute/comm/wait section of a neighbor loop (through the TIMELINE_TRACE macro in the code blocks) */
+void timeline_trace_event(int kind, const char *loop, double t0, double t1, long long n)
+{
+  if(!TraceRing) {return;}
+  struct timeline_event *e = timeline_trace_next();
+  e->t0 = t0; e->t1 = t1; e->kind = kind; e->part = -1; e->loop = loop; e->n = n;
+}
+
+
+/*! write out the events held in the ring. called at every sync-point from write_cpu_log(), where it only writes once the ring is half
+    full, or on full steps (so the I/O happens in few large writes), and with force=1 before restart files are written */
+void timeline_trace_flush(int force)
+{
+  if(!TraceRing) {return;}
+  long long k, held = TraceHead - TraceTail;
+  if(!force && held < TIMELINE_TRACE_RING / 2 && All.HighestActiveTimeBin != All.HighestOccupiedTimeBin) {TraceStep = All.NumCurrentTiStep; return;}
+
+  if(TraceDropped > 0)
+  {
+      double ts = 1.0e6 * (TraceEpoch + TraceRing[TraceTail % TIMELINE_TRACE_RING].t0 - TraceT0);
+      fprintf(FdTrace, "{\"name\":\"%lld events dropped (ring full)\",\"ph\":\"i\",\"s\":\"p\",\"pid\":%d,\"tid\":0,\"ts\":%.3f},\n", TraceDropped, ThisTask, ts);
+      TraceDropped = 0;
+  }
+  for(k = TraceTail; k < TraceHead; k++)
+  {
+      struct timeline_event *e = &TraceRing[k % TIMELINE_TRACE_RING];
+      double ts = 1.0e6 * (TraceEpoch + e->t0 - TraceT0), dur = 1.0e6 * (e->t1 - e->t0); /* microseconds */
+      if(e->kind == 0)
+      {
+          fprintf(FdTrace, "{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"step\":%lld}},\n",
+                  CPU_PartName[e->part], ThisTask, ts, dur, e->n);
+      } else {
+          const char *label = (e->kind == TIMELINE_TRACE_COMPUTE) ? "compute" : ((e->kind == TIMELINE_TRACE_COMM) ? "comm" : "wait");
+          fprintf(FdTrace, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"loop\":\"%s\",\"n\":%lld}},\n",
+                  label, label, ThisTask, ts, dur, e->loop, e->n);
+      }
+  }
+  fflush(FdTrace);
+  TraceTail = TraceHead;
+  TraceStep = All.NumCurrentTiStep;
+}
+
+#endif
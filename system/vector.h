@@ -134,6 +134,27 @@ static inline MyDouble L2NORM_VECTOR3(t_vector * v)
     return v->d[0] * v->d[0] + v->d[1] * v->d[1] + v->d[2] * v->d[2];
 }
 
+// periodic absolute separation of the first 3 components: min(|a-b|, box-|a-b|) (box components set very large on axes that do not wrap)
+static inline void PERIODIC_ABSDIFF_VECTOR3(t_vector * a,t_vector * b,t_vector * box,t_vector * result)
+{
+    int k; for(k=0;k<3;k++) {MyDouble d = fabs(a->d[k] - b->d[k]); result->d[k] = (d < box->d[k] - d) ? d : box->d[k] - d;}
+}
+
+// batched distance filter: keeps the indices idx[] of the candidates whose periodically-wrapped separation (dx,dy,dz) is inside their
+//  squared search radius r2, writing them compacted into out[]; returns how many were kept (see vector_avx.h for the SIMD versions)
+#define VECTOR_FILTER_WIDTH 1
+static inline int FILTER_DISTANCE_BLOCK(int n, MyDouble *dx, MyDouble *dy, MyDouble *dz, MyDouble *r2, t_vector *box, int *idx, int *out)
+{
+    int k, nout = 0;
+    for(k = 0; k < n; k++)
+    {
+        MyDouble x = fabs(dx[k]), y = fabs(dy[k]), z = fabs(dz[k]);
+        x = (x < box->d[0] - x) ? x : box->d[0] - x; y = (y < box->d[1] - y) ? y : box->d[1] - y; z = (z < box->d[2] - z) ? z : box->d[2] - z;
+        out[nout] = idx[k]; nout += (x*x + y*y + z*z < r2[k]);
+    }
+    return nout;
+}
+
 #endif
 
 
@@ -0,0 +1,202 @@
+/*
+ * AVX2 (and, where the compiler targets it, AVX-512) versions of the t_vector operations in vector.h, plus the batched distance filter
+ *   used by the reduced-branching neighbor search (REDUCE_TREEWALK_BRANCHING). Selected with VECTOR_AVX; the code must then be compiled with
+ *   AVX2 enabled (e.g. -mavx2, or -march=native on the target machine). Same interface and semantics as the generic scalar code in vector.h.
+ */
+
+#ifndef _VECTOR_AVX_H_
+#define _VECTOR_AVX_H_
+
+#include <immintrin.h>
+
+#if !defined(__AVX2__)
+#error "VECTOR_AVX requires compiling with AVX2 enabled (e.g. -mavx2 or -march=native)"
+#endif
+
+#ifdef DOUBLEPRECISION
+
+typedef ALIGN(32) union {
+    __m256d v;
+    unsigned long long i[4];
+    double d[4];
+} t_vector;
+
+// read the first 3 components of a vector, 4th component is set to zero
+static inline void LOAD_VECTOR3(MyFloat * src,t_vector * v) {v->v = _mm256_set_pd(0, src[2], src[1], src[0]);}
+
+// read all 4 components of a vector
+static inline void LOAD_VECTOR4(MyFloat * src,t_vector * v) {v->v = _mm256_loadu_pd(src);}
+
+// stores only the first 3 components of a vector (avoid, because it's slow)
+static inline void STORE_VECTOR3(MyFloat * dst,t_vector * v) {dst[0] = v->d[0]; dst[1] = v->d[1]; dst[2] = v->d[2];}
+
+// stores all 4 components of a vector (fast)
+static inline void STORE_VECTOR4(MyFloat * dst,t_vector * v) {_mm256_storeu_pd(dst, v->v);}
+
+// initializes first 3 components of a vector (4th component becomes undefined)
+static inline void SET_VECTOR3(MyFloat a,t_vector * v) {v->v = _mm256_set1_pd(a);}
+
+// initializes all 4 components of a vector with the same scalar value
+static inline void SET_VECTOR4(MyFloat a,t_vector * v) {v->v = _mm256_set1_pd(a);}
+
+// initializes first 3 components of a vector (4th component is set to zero)
+static inline void INIT_VECTOR3(MyFloat a0,MyFloat a1,MyFloat a2,t_vector * v) {v->v = _mm256_set_pd(0, a2, a1, a0);}
+
+// adds the first 3 components of 2 vectors (4th component undefined)
+static inline void ADD_VECTOR3(t_vector * a,t_vector * b,t_vector * result) {result->v = _mm256_add_pd(a->v, b->v);}
+
+// multiplies the first 3 components of 2 vectors (4th component undefined)
+static inline void MUL_VECTOR3(t_vector * a,t_vector * b,t_vector * result) {result->v = _mm256_mul_pd(a->v, b->v);}
+
+// multiplies the first 3 components of 2 vectors (4th component undefined)
+static inline void SCALE_VECTOR3(MyFloat a,t_vector * b,t_vector * v) {v->v = _mm256_mul_pd(_mm256_set1_pd(a), b->v);}
+
+// returns a value >0, if a(i) < b(i) for any i=1..3
+static inline int ANY_COMP_LT_VECTOR3(t_vector * a,t_vector * b,int mask) {return _mm256_movemask_pd(_mm256_cmp_pd(a->v, b->v, _CMP_LT_OQ)) & 7;}
+
+// returns 0, if a(i) < b(i) for any i=1..3
+static inline int ALL_COMP_LT_VECTOR3(t_vector * a,t_vector * b,int mask) {return (_mm256_movemask_pd(_mm256_cmp_pd(a->v, b->v, _CMP_LT_OQ)) & 7) == 7;}
+
+// returns the L2 norm of the first 3 components of a vector
+static inline MyDouble L2NORM_VECTOR3(t_vector * v) {t_vector s; s.v = _mm256_mul_pd(v->v, v->v); return s.d[0] + s.d[1] + s.d[2];}
+
+// periodic absolute separation of the first 3 components: min(|a-b|, box-|a-b|) (box components set very large on axes that do not wrap)
+static inline void PERIODIC_ABSDIFF_VECTOR3(t_vector * a,t_vector * b,t_vector * box,t_vector * result)
+{
+    __m256d d = _mm256_andnot_pd(_mm256_set1_pd(-0.0), _mm256_sub_pd(a->v, b->v));
+    result->v = _mm256_min_pd(d, _mm256_sub_pd(box->v, d));
+}
+
+#else
+
+typedef ALIGN(16) union {
+    __m128 v;
+    unsigned int i[4];
+    float d[4];
+} t_vector;
+
+// read the first 3 components of a vector, 4th component is set to zero
+static inline void LOAD_VECTOR3(MyFloat * src,t_vector * v) {v->v = _mm_set_ps(0, src[2], src[1], src[0]);}
+
+// read all 4 components of a vector
+static inline void LOAD_VECTOR4(MyFloat * src,t_vector * v) {v->v = _mm_loadu_ps(src);}
+
+// stores only the first 3 components of a vector (avoid, because it's slow)
+static inline void STORE_VECTOR3(MyFloat * dst,t_vector * v) {dst[0] = v->d[0]; dst[1] = v->d[1]; dst[2] = v->d[2];}
+
+// stores all 4 components of a vector (fast)
+static inline void STORE_VECTOR4(MyFloat * dst,t_vector * v) {_mm_storeu_ps(dst, v->v);}
+
+// initializes first 3 components of a vector (4th component becomes undefined)
+static inline void SET_VECTOR3(MyFloat a,t_vector * v) {v->v = _mm_set1_ps(a);}
+
+// initializes all 4 components of a vector with the same scalar value
+static inline void SET_VECTOR4(MyFloat a,t_vector * v) {v->v = _mm_set1_ps(a);}
+
+// initializes first 3 components of a vector (4th component is set to zero)
+static inline void INIT_VECTOR3(MyFloat a0,MyFloat a1,MyFloat a2,t_vector * v) {v->v = _mm_set_ps(0, a2, a1, a0);}
+
+// adds the first 3 components of 2 vectors (4th component undefined)
+static inline void ADD_VECTOR3(t_vector * a,t_vector * b,t_vector * result) {result->v = _mm_add_ps(a->v, b->v);}
+
+// multiplies the first 3 components of 2 vectors (4th component undefined)
+static inline void MUL_VECTOR3(t_vector * a,t_vector * b,t_vector * result) {result->v = _mm_mul_ps(a->v, b->v);}
+
+// multiplies the first 3 components of 2 vectors (4th component undefined)
+static inline void SCALE_VECTOR3(MyFloat a,t_vector * b,t_vector * v) {v->v = _mm_mul_ps(_mm_set1_ps(a), b->v);}
+
+// returns a value >0, if a(i) < b(i) for any i=1..3
+static inline int ANY_COMP_LT_VECTOR3(t_vector * a,t_vector * b,int mask) {return _mm_movemask_ps(_mm_cmplt_ps(a->v, b->v)) & 7;}
+
+// returns 0, if a(i) < b(i) for any i=1..3
+static inline int ALL_COMP_LT_VECTOR3(t_vector * a,t_vector * b,int mask) {return (_mm_movemask_ps(_mm_cmplt_ps(a->v, b->v)) & 7) == 7;}
+
+// returns the L2 norm of the first 3 components of a vector
+static inline MyDouble L2NORM_VECTOR3(t_vector * v) {t_vector s; s.v = _mm_mul_ps(v->v, v->v); return s.d[0] + s.d[1] + s.d[2];}
+
+// periodic absolute separation of the first 3 components: min(|a-b|, box-|a-b|) (box components set very large on axes that do not wrap)
+static inline void PERIODIC_ABSDIFF_VECTOR3(t_vector * a,t_vector * b,t_vector * box,t_vector * result)
+{
+    __m128 d = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(a->v, b->v));
+    result->v = _mm_min_ps(d, _mm_sub_ps(box->v, d));
+}
+
+#endif
+
+
+/* batched distance filter: given the separations dx,dy,dz (unwrapped) and squared search radii r2 of n candidates with indices idx[],
+    writes the indices of those inside their radius (after the periodic wrap min(|dx|, box-|dx|) per axis) compacted into out[], and returns
+    how many were kept. the input arrays must be readable up to n rounded up to the SIMD width (lanes beyond n are masked off). out[] may
+    alias the list the candidates were copied from, as long as it starts at or before it. */
+#ifdef DOUBLEPRECISION
+#ifdef __AVX512F__
+#define VECTOR_FILTER_WIDTH 8
+#else
+#define VECTOR_FILTER_WIDTH 4
+#endif
+#else
+#ifdef __AVX512F__
+#define VECTOR_FILTER_WIDTH 16
+#else
+#define VECTOR_FILTER_WIDTH 8
+#endif
+#endif
+
+static inline int FILTER_DISTANCE_BLOCK(int n, MyDouble *dx, MyDouble *dy, MyDouble *dz, MyDouble *r2, t_vector *box, int *idx, int *out)
+{
+    int k, nout = 0;
+#ifdef DOUBLEPRECISION
+#ifdef __AVX512F__
+    __m512d bx = _mm512_set1_pd(box->d[0]), by = _mm512_set1_pd(box->d[1]), bz = _mm512_set1_pd(box->d[2]);
+    for(k = 0; k < n; k += 8)
+    {
+        __m512d x = _mm512_abs_pd(_mm512_loadu_pd(dx+k)), y = _mm512_abs_pd(_mm512_loadu_pd(dy+k)), z = _mm512_abs_pd(_mm512_loadu_pd(dz+k));
+        x = _mm512_min_pd(x, _mm512_sub_pd(bx, x)); y = _mm512_min_pd(y, _mm512_sub_pd(by, y)); z = _mm512_min_pd(z, _mm512_sub_pd(bz, z));
+        __m512d d2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(x, x), _mm512_mul_pd(y, y)), _mm512_mul_pd(z, z));
+        __mmask8 m = _mm512_cmp_pd_mask(d2, _mm512_loadu_pd(r2+k), _CMP_LT_OQ);
+        if(n - k < 8) {m &= (__mmask8)((1u << (n - k)) - 1);}
+        _mm512_mask_compressstoreu_epi32(out + nout, (__mmask16) m, _mm512_castsi256_si512(_mm256_loadu_si256((__m256i *)(idx+k))));
+        nout += __builtin_popcount((unsigned) m);
+    }
+#else
+    __m256d sgn = _mm256_set1_pd(-0.0), bx = _mm256_set1_pd(box->d[0]), by = _mm256_set1_pd(box->d[1]), bz = _mm256_set1_pd(box->d[2]);
+    for(k = 0; k < n; k += 4)
+    {
+        __m256d x = _mm256_andnot_pd(sgn, _mm256_loadu_pd(dx+k)), y = _mm256_andnot_pd(sgn, _mm256_loadu_pd(dy+k)), z = _mm256_andnot_pd(sgn, _mm256_loadu_pd(dz+k));
+        x = _mm256_min_pd(x, _mm256_sub_pd(bx, x)); y = _mm256_min_pd(y, _mm256_sub_pd(by, y)); z = _mm256_min_pd(z, _mm256_sub_pd(bz, z));
+        __m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z));
+        unsigned m = (unsigned) _mm256_movemask_pd(_mm256_cmp_pd(d2, _mm256_loadu_pd(r2+k), _CMP_LT_OQ));
+        if(n - k < 4) {m &= (1u << (n - k)) - 1;}
+        while(m) {out[nout++] = idx[k + __builtin_ctz(m)]; m &= m - 1;}
+    }
+#endif
+#else
+#ifdef __AVX512F__
+    __m512 bx = _mm512_set1_ps(box->d[0]), by = _mm512_set1_ps(box->d[1]), bz = _mm512_set1_ps(box->d[2]);
+    for(k = 0; k < n; k += 16)
+    {
+        __m512 x = _mm512_abs_ps(_mm512_loadu_ps(dx+k)), y = _mm512_abs_ps(_mm512_loadu_ps(dy+k)), z = _mm512_abs_ps(_mm512_loadu_ps(dz+k));
+        x = _mm512_min_ps(x, _mm512_sub_ps(bx, x)); y = _mm512_min_ps(y, _mm512_sub_ps(by, y)); z = _mm512_min_ps(z, _mm512_sub_ps(bz, z));
+        __m512 d2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y)), _mm512_mul_ps(z, z));
+        __mmask16 m = _mm512_cmp_ps_mask(d2, _mm512_loadu_ps(r2+k), _CMP_LT_OQ);
+        if(n - k < 16) {m &= (__mmask16)((1u << (n - k)) - 1);}
+        _mm512_mask_compressstoreu_epi32(out + nout, m, _mm512_loadu_si512((void *)(idx+k)));
+        nout += __builtin_popcount((unsigned) m);
+    }
+#else
+    __m256 sgn = _mm256_set1_ps(-0.0f), bx = _mm256_set1_ps(box->d[0]), by = _mm256_set1_ps(box->d[1]), bz = _mm256_set1_ps(box->d[2]);
+    for(k = 0; k < n; k += 8)
+    {
+        __m256 x = _mm256_andnot_ps(sgn, _mm256_loadu_ps(dx+k)), y = _mm256_andnot_ps(sgn, _mm256_loadu_ps(dy+k)), z = _mm256_andnot_ps(sgn, _mm256_loadu_ps(dz+k));
+        x = _mm256_min_ps(x, _mm256_sub_ps(bx, x)); y = _mm256_min_ps(y, _mm256_sub_ps(by, y)); z = _mm256_min_ps(z, _mm256_sub_ps(bz, z));
+        __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+        unsigned m = (unsigned) _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_loadu_ps(r2+k), _CMP_LT_OQ));
+        if(n - k < 8) {m &= (1u << (n - k)) - 1;}
+        while(m) {out[nout++] = idx[k + __builtin_ctz(m)]; m &= m - 1;}
+    }
+#endif
+#endif
+    return nout;
+}
+
+#endif
@@ -111,4 +111,7 @@
 
 #define TAG_MPI_GENERIC_COM_BUFFER_A 103
 #define TAG_MPI_GENERIC_COM_BUFFER_B 104
+#define TAG_MPI_SPARSE_COUNTS_A      105
+#define TAG_MPI_SPARSE_COUNTS_B      106
+#define TAG_MPI_EXPORT_PLAN_COUNTS   107
 
@@ -28,7 +28,7 @@ static double dt_displacement = 0;
  */
 void find_timesteps(void)
 {
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
 
     int i, bin, binold, prev, next;
     integertime ti_step, ti_step_old, ti_min;
@@ -69,7 +69,7 @@ void find_timesteps(void)
 #endif
 
 #ifdef FORCE_EQUAL_TIMESTEPS
-    for(i = FirstActiveParticle, ti_min = TIMEBASE; i >= 0; i = NextActiveParticle[i])
+    ti_min = TIMEBASE; FOR_ACTIVE_PARTICLES(i)
     {
         ti_step = get_timestep(i, &aphys, 0);
         if(ti_step < ti_min) {ti_min = ti_step;}
@@ -84,7 +84,7 @@ void find_timesteps(void)
 
 
     /* Now assign new timesteps  */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
 #ifdef FORCE_EQUAL_TIMESTEPS
         ti_step = ti_min_glob;
@@ -161,6 +161,9 @@ void find_timesteps(void)
             TimeBinCount[bin]++;
             if(P[i].Type == 0) {TimeBinCountSph[bin]++;}
             P[i].TimeBin = bin;
+#ifdef TIMEBIN_SORTED_STORAGE
+            TimeBinStorageMoves++;
+#endif
         }
 
 #ifndef WAKEUP
@@ -198,7 +201,12 @@ void find_timesteps(void)
     process_wake_ups();
 #endif
 
-    CPU_Step[CPU_TIMELINE] += measure_time();
+#ifdef TIMEBIN_SORTED_STORAGE
+    /* once enough particles have changed bin that the active sets are no longer contiguous in memory, ask for a domain
+        decomposition on this step: it re-sorts the storage by timebin (and rebuilds the tree, which refers to storage positions) */
+    if(TimeBinStorageMoves > 0.01 * TIMEBIN_SORTED_STORAGE * NumPart) {TreeReconstructFlag = 1;}
+#endif
+    CPU_Step[CPU_TIMELINE] += measure_time_phase(CPU_TIMELINE);
 }
 
 
@@ -1238,6 +1246,9 @@ void process_wake_ups(void)
 		TimeBinCount[bin]++;
 		if(P[i].Type == 0) {TimeBinCountSph[bin]++;}
 		P[i].TimeBin = bin;
+#ifdef TIMEBIN_SORTED_STORAGE
+		TimeBinStorageMoves++;
+#endif
         if(TimeBinActive[bin]) {NumForceUpdate++;}
 		n++;
 
@@ -1250,7 +1261,7 @@ void process_wake_ups(void)
 		}
 		P[i].Ti_begstep = All.Ti_Current;
 		P[i].dt_step = GET_INTEGERTIME_FROM_TIMEBIN(bin);
-		if(P[i].Ti_current < All.Ti_Current) {P[i].Ti_current=All.Ti_Current;}
+		if(P[i].Ti_current < All.Ti_Current) {P[i].Ti_current=All.Ti_Current; P_HOT_SYNC(i);}
 	    }
 	}
     }
@@ -198,7 +198,7 @@ static inline void out2particle_DynamicDiff(struct DynamicDiffdata_out *out, int
  */
 void dynamic_diff_calc(void) {
     PRINT_STATUS("Start dynamic diffusion calculations...");
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
     int i, j, k, v, u, ngrp, ndone, ndone_flag, dynamic_iteration;
     double shear_factor, dynamic_denominator, trace = 0, trace_dynamic_fac = 0, hhat2 = 0, leonardTensor[3][3], prefactor = 0;
 #ifdef IO_TURB_DIFF_DYNAMIC_ERROR
@@ -220,16 +220,21 @@ void dynamic_diff_calc(void) {
                                                              sizeof(struct DynamicDiffdata_out) +
                                                              sizemax(sizeof(struct DynamicDiffdata_in),
                                                                      sizeof(struct DynamicDiffdata_out))));
-    CPU_Step[CPU_DYNDIFFMISC] += measure_time();
+    CPU_Step[CPU_DYNDIFFMISC] += measure_time_phase(CPU_DYNDIFFMISC);
     t0 = my_second();
     
     Ngblist = (int *) mymalloc("Ngblist", NTaskTimesNumPart * sizeof(int));
     DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
     DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
+#ifdef MPI_REUSE_EXPORT_PLANS /* every iteration below searches the same elements with the same radii: if the first one fits in a single round, its export list is re-used */
+    int *ExportPlanCount = (int *) mymalloc("ExportPlanCount", 2 * NTask * sizeof(int));
+    long ExportPlanNexport = 0;
+    int export_plan_valid = 0;
+#endif
     PRINT_STATUS(" ..begin initializing smoothed quantities.");
 
     /* Because of smoothing operation, we don't zero these out, they get set to their current value */
-    for (i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {
+    FOR_ACTIVE_PARTICLES(i) {
         if (P[i].Type == 0) {
             memset(&DynamicDiffDataPasser[i], 0, sizeof(struct temporary_data_dyndiff));
 
@@ -259,8 +264,11 @@ void dynamic_diff_calc(void) {
     /* prepare to do the requisite number of sweeps over the particle distribution */
     for (dynamic_iteration = 0; dynamic_iteration < (All.TurbDynamicDiffIterations + 1); dynamic_iteration++) {      
         // now we actually begin the main gradient loop //
-        NextParticle = FirstActiveParticle;	/* begin with this index */
+        NextParticle = 0;	/* begin with this position in the active list */
         PRINT_STATUS(" ..first loop over active particles (iter = %d)", dynamic_iteration);
+#ifdef MPI_REUSE_EXPORT_PLANS
+        int export_plan_replay = export_plan_valid, export_plan_rounds = 0;
+#endif
 
         do {    
             BufferFullFlag = 0;
@@ -271,6 +279,9 @@ void dynamic_diff_calc(void) {
                 Send_count[j] = 0;
                 Exportflag[j] = -1;
             }
+#ifdef MPI_REUSE_EXPORT_PLANS
+            ExportPlanReplay = export_plan_replay;
+#endif
             
             /* do local particles and prepare export list */
             tstart = my_second();
@@ -310,18 +321,22 @@ void dynamic_diff_calc(void) {
             
             tend = my_second();
             timecomp1 += timediff(tstart, tend);
+#ifdef MPI_REUSE_EXPORT_PLANS
+            ExportPlanReplay = 0;
+            if (export_plan_replay) Nexport = ExportPlanNexport; /* nothing was exported by the walk: the stored (sorted) entries are still in DataIndexTable */
+#endif
             
             if (BufferFullFlag) {
                 int last_nextparticle = NextParticle;
                 
                 NextParticle = save_NextParticle;
                 
-                while (NextParticle >= 0) {
+                while (NextParticle < NumActiveParticle) {
                     if (NextParticle == last_nextparticle) break;
-                    if (ProcessedFlag[NextParticle] != 1) break;
+                    if (ProcessedFlag[ActiveParticleList[NextParticle]] != 1) break;
                     
-                    ProcessedFlag[NextParticle] = 2;
-                    NextParticle = NextActiveParticle[NextParticle];
+                    ProcessedFlag[ActiveParticleList[NextParticle]] = 2;
+                    NextParticle++;
                 }
                 
                 if (NextParticle == save_NextParticle) {
@@ -329,48 +344,29 @@ void dynamic_diff_calc(void) {
                     endrun(113308);
                 }
                 
-                int new_export = 0;
-                
-                for (j = 0, k = 0; j < Nexport; j++) {
-                    if (ProcessedFlag[DataIndexTable[j].Index] != 2) {
-                        if (k < j + 1) k = j + 1;
-                        
-                        for (; k < Nexport; k++) {
-                            if (ProcessedFlag[DataIndexTable[k].Index] == 2) {
-                                int old_index = DataIndexTable[j].Index;
-                                
-                                DataIndexTable[j] = DataIndexTable[k];
-                                DataNodeList[j] = DataNodeList[k];
-                                DataIndexTable[j].IndexGet = j;
-                                new_export++;
-                                
-                                DataIndexTable[k].Index = old_index;
-                                k++;
-                                break;
-                            }
-                        }
-                    }
-                    else {
-                        new_export++;
-                    }                
-                }
-
-                Nexport = new_export;       
             }
             
-            n_exported += Nexport;
-            
-            for (j = 0; j < NTask; j++) Send_count[j] = 0;
-            for (j = 0; j < Nexport; j++) Send_count[DataIndexTable[j].Task]++;
+#ifdef MPI_REUSE_EXPORT_PLANS
+            if (export_plan_replay) {
+                for (j = 0; j < NTask; j++) {Send_count[j] = 0; Recv_count[j] = ExportPlanCount[NTask + j];} /* identical element set and radii, so the counts are those of the stored plan */
+                for (j = 0; j < Nexport; j++) Send_count[DataIndexTable[j].Task]++;
+                n_exported += Nexport;
+            } else {
+#endif
+            /* collect the per-thread export blocks (dropping unfinished elements if the buffer filled), grouped by task, and count the exports */
+            Nexport = export_blocks_merge(BufferFullFlag);
             
-            MYSORT_DATAINDEX(DataIndexTable, Nexport, sizeof(struct data_index), data_index_compare);
+            n_exported += Nexport;
             
             tstart = my_second();
             
-            MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD);
+            mpi_sparse_alltoall_counts(Send_count, Recv_count);
             
             tend = my_second();
             timewait1 += timediff(tstart, tend);
+#ifdef MPI_REUSE_EXPORT_PLANS
+            }
+#endif
             
             for (j = 0, Nimport = 0, Recv_offset[0] = 0, Send_offset[0] = 0; j < NTask; j++) {
                 Nimport += Recv_count[j];
@@ -454,7 +450,7 @@ void dynamic_diff_calc(void) {
             tend = my_second();
             timecomp2 += timediff(tstart, tend);
             
-            if (NextParticle < 0) {
+            if (NextParticle >= NumActiveParticle) {
                 ndone_flag = 1;
             }
             else {
@@ -465,6 +461,13 @@ void dynamic_diff_calc(void) {
             MPI_Allreduce(&ndone_flag, &ndone, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
             tend = my_second();
             timewait2 += timediff(tstart, tend);
+#ifdef MPI_REUSE_EXPORT_PLANS
+            if (!export_plan_replay && ++export_plan_rounds == 1 && ndone >= NTask) { /* iteration completed in a single round on all tasks: store its export list as the plan */
+                ExportPlanNexport = Nexport;
+                export_plan_valid = 1;
+                for (j = 0; j < NTask; j++) {ExportPlanCount[j] = Send_count[j]; ExportPlanCount[NTask + j] = Recv_count[j];}
+            }
+#endif
             
             /* get the result */
             tstart = my_second();
@@ -525,7 +528,7 @@ void dynamic_diff_calc(void) {
         /* The first two iterations were solely to calculate the hat quantities */ 
         { 
             /* Now that we have finished preliminaries, need to do the coefficient calculation */
-            for (i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {
+            FOR_ACTIVE_PARTICLES(i) {
                 if (P[i].Type == 0) {
 #ifdef GALSF_SUBGRID_WINDS
                     if (SphP[i].DelayTime > 0) continue; /* Leave C_s alone for wind particles */
@@ -723,13 +726,16 @@ void dynamic_diff_calc(void) {
         timewait3 += timediff(tstart, tend); 
     } // closes dynamic_iteration
     
+#ifdef MPI_REUSE_EXPORT_PLANS
+    myfree(ExportPlanCount);
+#endif
     myfree(DataNodeList);
     myfree(DataIndexTable);
     myfree(Ngblist);
     myfree(DynamicDiffDataPasser);
  
     /* collect some timing information */
-    t1 = WallclockTime = my_second();
+    t1 = WallclockTime = my_second(); phase_interval_close(CPU_DYNDIFFCOMPUTE);
     timeall = timediff(t0, t1);
     timecomp = timecomp1 + timecomp2;
     timewait = timewait1 + timewait2 + timewait3;
@@ -958,13 +964,13 @@ void *DynamicDiff_evaluate_primary(void *p, int dynamic_iteration) {
 #pragma omp critical(_nexport_)
 #endif
         {
-            if (BufferFullFlag != 0 || NextParticle < 0) {
+            if (BufferFullFlag != 0 || NextParticle >= NumActiveParticle) {
                 exitFlag = 1;
             }
             else {
-                i = NextParticle;
+                i = ActiveParticleList[NextParticle];
                 ProcessedFlag[i] = 0;
-                NextParticle = NextActiveParticle[NextParticle];
+                NextParticle++;
             }
         }
 
@@ -86,7 +86,7 @@ void dynamic_diff_vel_calc_initial_operations_preloop(void)
 {
     /* Because of the smoothing operation, need to set bar quantity to current SPH value first */
     int i;
-    for (i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {
+    FOR_ACTIVE_PARTICLES(i) {
         if (P[i].Type == 0) {
             SphP[i].Norm_hat = 0;
             SphP[i].h_turb = Get_Particle_Size(i); // All.cf_atime unnecessary, will multiply later
@@ -204,14 +204,14 @@ int DiffFilter_evaluate(int target, int mode, int *exportflag, int *exportnodeco
  * primary routine being called for this calculation
  */
 void dynamic_diff_vel_calc(void) {
-    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC); double t00_truestart = my_second();
     PRINT_STATUS("Start velocity smoothing computation...");
     dynamic_diff_vel_calc_initial_operations_preloop(); /* any initial operations */
     #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
     PRINT_STATUS(" ..velocity smoothing done.");
-    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
+    double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1); phase_interval_close(CPU_IMPROVDIFFCOMPUTE);
     CPU_Step[CPU_IMPROVDIFFCOMPUTE] += timecomp; CPU_Step[CPU_IMPROVDIFFWAIT] += timewait; CPU_Step[CPU_IMPROVDIFFCOMM] += timecomm;
     CPU_Step[CPU_IMPROVDIFFMISC] += timeall - (timecomp + timewait + timecomm);
 }
@@ -337,7 +337,7 @@ void add_turb_accel()
 {
     set_turb_ampl();
     int i, j, m; double acc[3], fac_sol = 2.*solenoidal_frac_total_weight_renormalization();
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         if(P[i].Type == 0)
         {
@@ -375,9 +375,9 @@ void add_turb_accel()
 /* routine to integrate the turbulent driving forces, specifically the 'TurbAccel' variables that need to be drifted and kicked: note that we actually do drifting and kicking in the normal routines, this is just to integrate the dissipation rates etc used for our tracking */
 void do_turb_driving_step_first_half(void)
 {
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
     int i, j; integertime ti_step, tstart, tend; double dvel[3], dt_gravkick;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         ti_step = GET_PARTICLE_INTEGERTIME(i); tstart = P[i].Ti_begstep; tend = P[i].Ti_begstep + ti_step / 2;	/* beginning / midpoint of step */
         if(All.ComovingIntegrationOn) {dt_gravkick = get_gravkick_factor(tstart, tend);} else {dt_gravkick = (tend - tstart) * All.Timebase_interval;}
@@ -389,16 +389,16 @@ void do_turb_driving_step_first_half(void)
             SphP[i].EgyDrive += ekin1 - ekin0;
         }
     }
-    CPU_Step[CPU_DRIFT] += measure_time();
+    CPU_Step[CPU_DRIFT] += measure_time_phase(CPU_DRIFT);
 }
 
 
 /* routine to integrate the turbulent driving forces, specifically the 'TurbAccel' variables that need to be drifted and kicked: note that we actually do drifting and kicking in the normal routines, this is just to integrate the dissipation rates etc used for our tracking */
 void do_turb_driving_step_second_half(void)
 {
-    CPU_Step[CPU_MISC] += measure_time();
+    CPU_Step[CPU_MISC] += measure_time_phase(CPU_MISC);
     int i, j; integertime ti_step, tstart, tend; double dvel[3], dt_gravkick;
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    FOR_ACTIVE_PARTICLES(i)
     {
         ti_step = GET_PARTICLE_INTEGERTIME(i); tstart = P[i].Ti_begstep + ti_step / 2; tend = P[i].Ti_begstep + ti_step;	/* midpoint/end of step */
         if(All.ComovingIntegrationOn) {dt_gravkick = get_gravkick_factor(tstart, tend);} else {dt_gravkick = (tend - tstart) * All.Timebase_interval;}
@@ -410,7 +410,7 @@ void do_turb_driving_step_second_half(void)
             SphP[i].EgyDrive += ekin1 - ekin0;
         }
     }
-    CPU_Step[CPU_DRIFT] += measure_time();
+    CPU_Step[CPU_DRIFT] += measure_time_phase(CPU_DRIFT);
 }
 
 